@@ -0,0 +1,103 @@
+'use strict';
+
+// Measures token buffer allocations on the canned response path, once with
+// the native buffer pool disabled (every token is a heap allocation) and once
+// with it enabled. The canned path echoes the server response, so tokenSize
+// controls the size of the buffers allocated.
+//
+// Usage: node --expose-gc bench/alloc_bench.js [iterations] [concurrency] [tokenSize]
+//
+// With --expose-gc a collection is forced every gcInterval operations, so
+// buffers go back to the pool at a steady rate instead of whenever V8
+// decides to collect.
+
+const SspiClientApi = require('../src_js/index.js').SspiClientApi;
+const HandshakeBench = require('./handshake_bench.js');
+
+const gcInterval = 256;
+
+function cannedEchoOp(spn, serverResponse) {
+  let count = 0;
+  return (cb) => {
+    if (global.gc && ++count % gcInterval === 0) {
+      global.gc();
+    }
+
+    const sspiClient = new SspiClientApi.SspiClient(spn);
+    sspiClient.utEnableCannedResponse();
+    sspiClient.getNextBlob(serverResponse, 0, serverResponse.length, () => cb(null));
+  };
+}
+
+function runMode(name, enablePool, options, cb) {
+  SspiClientApi.utSetBufferPoolEnabled(enablePool);
+  if (global.gc) {
+    global.gc();
+  }
+
+  SspiClientApi.utResetBufferPoolStats();
+  const rssBefore = process.memoryUsage().rss;
+  const serverResponse = Buffer.alloc(options.tokenSize, 0x5A);
+
+  HandshakeBench.runConcurrent(name, options.iterations, options.concurrency,
+    cannedEchoOp(options.spn, serverResponse), (err, result) => {
+      const stats = SspiClientApi.getBufferPoolStats();
+      const poolHits = stats.threadCacheHits + stats.globalHits;
+
+      result.tokenSize = options.tokenSize;
+      result.heapAllocations = stats.heapAllocations;
+      result.poolHitRate = stats.allocations ? Math.round(poolHits * 1000 / stats.allocations) / 1000 : 0;
+      result.bytesRetained = stats.bytesRetained;
+      result.rssGrowthKb = Math.round((process.memoryUsage().rss - rssBefore) / 1024);
+      cb(err, result);
+    });
+}
+
+// Signature of cb is:
+//  cb(err, results)
+function runBenchmark(options, cb) {
+  options = {
+    iterations: options.iterations || 10000,
+    concurrency: options.concurrency || 16,
+    tokenSize: options.tokenSize || 48256,
+    spn: options.spn || 'MSSQLSvc/localhost:1433'
+  };
+
+  SspiClientApi.ensureInitialization((errorCode, errorString) => {
+    if (errorCode !== 0) {
+      cb(new Error(errorString));
+      return;
+    }
+
+    runMode('canned-heap', false, options, (err, heapResult) => {
+      if (err) {
+        cb(err);
+        return;
+      }
+
+      runMode('canned-pooled', true, options, (err, pooledResult) => {
+        cb(err, [heapResult, pooledResult]);
+      });
+    });
+  });
+}
+
+module.exports.runBenchmark = runBenchmark;
+
+if (require.main === module) {
+  const options = {
+    iterations: parseInt(process.argv[2] || '10000', 10),
+    concurrency: parseInt(process.argv[3] || '16', 10),
+    tokenSize: parseInt(process.argv[4] || '48256', 10)
+  };
+
+  runBenchmark(options, (err, results) => {
+    if (err) {
+      console.log('Benchmark failed: ', err.message);
+      process.exitCode = 1;
+      return;
+    }
+
+    results.forEach((result) => console.log(JSON.stringify(result)));
+  });
+}
@@ -0,0 +1,152 @@
+'use strict';
+
+// Compares filling a connection pool with one getNextBlob call per client
+// against a single getNextBlobBatch call, first legs only. Uses the canned
+// path, plus real first legs when the provider is mock.
+//
+// Usage: node bench/batch_bench.js [poolSize] [rounds]
+
+const SspiClientApi = require('../src_js/index.js').SspiClientApi;
+
+const spn = 'MSSQLSvc/localhost:1433';
+
+function makeClients(count, canned) {
+  const clients = [];
+  for (let i = 0; i < count; i++) {
+    const sspiClient = new SspiClientApi.SspiClient(spn);
+    if (canned) {
+      sspiClient.utEnableCannedResponse();
+    }
+
+    clients.push(sspiClient);
+  }
+
+  return clients;
+}
+
+function fillIndividually(clients, cb) {
+  let pending = clients.length;
+  let failed = null;
+  clients.forEach((client) => {
+    client.getNextBlob(null, 0, 0, (clientResponse, isDone, errorCode, errorString) => {
+      if (clientResponse === null) {
+        failed = failed || new Error(errorString);
+      }
+
+      if (--pending === 0) {
+        cb(failed);
+      }
+    });
+  });
+}
+
+function fillBatched(clients, cb) {
+  SspiClientApi.getNextBlobBatch(clients.map((client) => ({ client: client })), (results) => {
+    const failedResult = results.find((result) => result.clientResponse === null);
+    cb(failedResult ? new Error(failedResult.errorString) : null);
+  });
+}
+
+// Signature of cb is:
+//  cb(err, result)
+function runFills(name, fill, canned, options, cb) {
+  let round = 0;
+  let elapsedMs = 0;
+
+  const next = () => {
+    if (round === options.rounds) {
+      cb(null, {
+        name: name,
+        poolSize: options.poolSize,
+        rounds: options.rounds,
+        msPerFill: Math.round(elapsedMs / options.rounds * 1000) / 1000,
+        firstLegsPerSec: Math.round(options.poolSize * options.rounds * 1000 / elapsedMs)
+      });
+      return;
+    }
+
+    // Clients are created outside the timed section, as a pool would
+    // before connecting.
+    const clients = makeClients(options.poolSize, canned);
+    const begin = process.hrtime();
+    fill(clients, (err) => {
+      if (err) {
+        cb(err);
+        return;
+      }
+
+      const diff = process.hrtime(begin);
+      elapsedMs += diff[0] * 1e3 + diff[1] / 1e6;
+      round++;
+      next();
+    });
+  };
+
+  next();
+}
+
+// Signature of cb is:
+//  cb(err, results)
+function runBenchmark(options, cb) {
+  options = {
+    poolSize: options.poolSize || 500,
+    rounds: options.rounds || 20
+  };
+
+  const modes = [
+    { name: 'canned-individual', fill: fillIndividually, canned: true },
+    { name: 'canned-batch', fill: fillBatched, canned: true }
+  ];
+
+  if (SspiClientApi.getProviderName() === 'mock') {
+    modes.push({ name: 'mock-individual', fill: fillIndividually, canned: false });
+    modes.push({ name: 'mock-batch', fill: fillBatched, canned: false });
+  }
+
+  SspiClientApi.ensureInitialization((errorCode, errorString) => {
+    if (errorCode !== 0) {
+      cb(new Error(errorString));
+      return;
+    }
+
+    const results = [];
+    const runMode = (index) => {
+      if (index === modes.length) {
+        cb(null, results);
+        return;
+      }
+
+      const mode = modes[index];
+      runFills(mode.name, mode.fill, mode.canned, options, (err, result) => {
+        if (err) {
+          cb(err);
+          return;
+        }
+
+        results.push(result);
+        runMode(index + 1);
+      });
+    };
+
+    runMode(0);
+  });
+}
+
+module.exports.runBenchmark = runBenchmark;
+
+if (require.main === module) {
+  const options = {
+    poolSize: parseInt(process.argv[2] || '500', 10),
+    rounds: parseInt(process.argv[3] || '20', 10)
+  };
+
+  runBenchmark(options, (err, results) => {
+    if (err) {
+      console.log('Benchmark failed: ', err.message);
+      process.exitCode = 1;
+      return;
+    }
+
+    results.forEach((result) => console.log(JSON.stringify(result)));
+  });
+}
@@ -0,0 +1,120 @@
+'use strict';
+
+// Reconnect storm: full loopback handshakes with a new SspiClient for each,
+// against clients reset and reused through the client pool. Needs the mock
+// provider, set SSPI_CLIENT_PROVIDER=mock. Run with --expose-gc to include
+// the JavaScript heap growth per handshake.
+//
+// Usage: node --expose-gc bench/client_pool_bench.js [handshakes] [concurrency]
+
+const SspiClientApi = require('../src_js/index.js').SspiClientApi;
+const Loopback = require('../test/utils/loopback.js');
+
+const spn = 'MSSQLSvc/localhost:1433';
+const securityPackage = 'kerberos';
+
+function newClient() {
+  return new SspiClientApi.SspiClient(spn, securityPackage);
+}
+
+function pooledClient() {
+  return SspiClientApi.acquireClient(spn, securityPackage);
+}
+
+// Signature of cb is:
+//  cb(err, result)
+function runStorm(name, getClient, releaseClient, options, cb) {
+  if (global.gc) {
+    global.gc();
+  }
+
+  const heapBefore = process.memoryUsage().heapUsed;
+  const begin = process.hrtime();
+  let started = 0;
+  let completed = 0;
+  let failed = null;
+
+  const startOne = () => {
+    started++;
+    Loopback.runClientHandshake(getClient(), securityPackage, (err, result) => {
+      failed = failed || err;
+      if (!err) {
+        releaseClient(result.sspiClient);
+      }
+
+      if (++completed === options.handshakes) {
+        const diff = process.hrtime(begin);
+        const elapsedMs = diff[0] * 1e3 + diff[1] / 1e6;
+        if (failed) {
+          cb(failed);
+          return;
+        }
+
+        cb(null, {
+          name: name,
+          handshakes: options.handshakes,
+          concurrency: options.concurrency,
+          handshakesPerSec: Math.round(options.handshakes * 1000 / elapsedMs),
+          heapBytesPerHandshake: Math.round((process.memoryUsage().heapUsed - heapBefore) / options.handshakes),
+          clientPool: SspiClientApi.getClientPoolStats()
+        });
+      } else if (started < options.handshakes) {
+        startOne();
+      }
+    });
+  };
+
+  for (let i = 0; i < options.concurrency && i < options.handshakes; i++) {
+    startOne();
+  }
+}
+
+// Signature of cb is:
+//  cb(err, results)
+function runBenchmark(options, cb) {
+  options = {
+    handshakes: options.handshakes || 20000,
+    concurrency: options.concurrency || 64
+  };
+
+  if (SspiClientApi.getProviderName() !== 'mock') {
+    cb(new Error('Needs the mock provider, set SSPI_CLIENT_PROVIDER=mock.'));
+    return;
+  }
+
+  SspiClientApi.configureClientPool({ maxPerSpn: options.concurrency });
+  runStorm('new-client', newClient, () => {}, options, (err, newResult) => {
+    if (err) {
+      cb(err);
+      return;
+    }
+
+    runStorm('pooled-client', pooledClient, SspiClientApi.releaseClient, options, (err, pooledResult) => {
+      if (err) {
+        cb(err);
+        return;
+      }
+
+      cb(null, [ newResult, pooledResult ]);
+    });
+  });
+}
+
+module.exports.runBenchmark = runBenchmark;
+
+if (require.main === module) {
+  const options = {
+    handshakes: parseInt(process.argv[2] || '20000', 10),
+    concurrency: parseInt(process.argv[3] || '64', 10)
+  };
+
+  runBenchmark(options, (err, results) => {
+    if (err) {
+      console.log('Benchmark failed: ', err.message);
+      process.exitCode = 1;
+      return;
+    }
+
+    results.forEach((result) => console.log(JSON.stringify(result)));
+  });
+}
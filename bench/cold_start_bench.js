@@ -0,0 +1,96 @@
+'use strict';
+
+// Measures the event loop while count getNextBlob calls wait on
+// initialization at cold start, the way a connection pool opening many
+// connections at once does. Must run in a fresh process, initialization only
+// happens once.
+//
+// Usage: node bench/cold_start_bench.js [count]
+//
+// Event loop utilization needs Node.js 12.19 or later, loopTurns is reported
+// everywhere.
+
+const SspiClientApi = require('../src_js/index.js').SspiClientApi;
+
+let performance = null;
+try {
+  performance = require('perf_hooks').performance;
+} catch (err) {
+  // Older Node.js, elapsed time and loopTurns only.
+}
+
+// Signature of cb is:
+//  cb(err, result)
+function runBenchmark(options, cb) {
+  const count = options.count || 1000;
+  const spn = 'MSSQLSvc/localhost:1433';
+  const hasElu = performance && typeof (performance.eventLoopUtilization) === 'function';
+
+  // Counts event loop turns with a check phase handle of its own, one per
+  // turn regardless of how many callbacks run in it.
+  let loopTurns = 0;
+  let counting = true;
+  const countTurn = () => {
+    loopTurns++;
+    if (counting) {
+      setImmediate(countTurn);
+    }
+  };
+
+  setImmediate(countTurn);
+
+  const eluBefore = hasElu ? performance.eventLoopUtilization() : null;
+  const begin = process.hrtime();
+  let pending = count;
+  let failed = null;
+
+  for (let i = 0; i < count; i++) {
+    const sspiClient = new SspiClientApi.SspiClient(spn);
+    sspiClient.utEnableCannedResponse();
+    sspiClient.getNextBlob(null, 0, 0, (clientResponse, isDone, errorCode, errorString) => {
+      // The canned response reports an error, anything but a failed
+      // initialization is fine here.
+      if (clientResponse === null) {
+        failed = failed || new Error(errorString);
+      }
+
+      if (--pending > 0) {
+        return;
+      }
+
+      counting = false;
+      const elapsed = process.hrtime(begin);
+      const result = {
+        name: 'cold-start',
+        count: count,
+        elapsedMs: Math.round((elapsed[0] * 1e3 + elapsed[1] / 1e6) * 1000) / 1000,
+        loopTurns: loopTurns
+      };
+
+      if (hasElu) {
+        result.eventLoopUtilization =
+          Math.round(performance.eventLoopUtilization(eluBefore).utilization * 1000) / 1000;
+      }
+
+      cb(failed, result);
+    });
+  }
+}
+
+module.exports.runBenchmark = runBenchmark;
+
+if (require.main === module) {
+  const options = {
+    count: parseInt(process.argv[2] || '1000', 10)
+  };
+
+  runBenchmark(options, (err, result) => {
+    if (err) {
+      console.log('Benchmark failed: ', err.message);
+      process.exitCode = 1;
+      return;
+    }
+
+    console.log(JSON.stringify(result));
+  });
+}
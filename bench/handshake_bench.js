@@ -0,0 +1,148 @@
+'use strict';
+
+// Measures complete client/server handshakes over the in-process loopback
+// (SspiClient against SspiServer) and, for comparison, the canned response
+// path which runs only the native plumbing with no provider calls.
+//
+// Usage: node bench/handshake_bench.js [iterations] [concurrency] [securityPackage] [spn]
+//
+// Use SSPI_CLIENT_PROVIDER to pick the provider, 'mock' on any platform or
+// 'gssapi' with the KDC from test/integration/krb5kdc.
+
+const SspiClientApi = require('../src_js/index.js').SspiClientApi;
+const Loopback = require('../test/utils/loopback.js');
+
+function percentile(sortedValues, p) {
+  if (sortedValues.length === 0) {
+    return 0;
+  }
+
+  const index = Math.min(sortedValues.length - 1, Math.floor(sortedValues.length * p));
+  return sortedValues[index];
+}
+
+function summarize(name, latenciesMs, elapsedMs) {
+  latenciesMs.sort((a, b) => a - b);
+  return {
+    name: name,
+    count: latenciesMs.length,
+    opsPerSec: Math.round(latenciesMs.length * 1000 / elapsedMs),
+    p50Ms: percentile(latenciesMs, 0.5),
+    p99Ms: percentile(latenciesMs, 0.99),
+    p999Ms: percentile(latenciesMs, 0.999),
+    maxMs: latenciesMs[latenciesMs.length - 1]
+  };
+}
+
+// Adds per operation token traffic, native buffer allocations and memory to
+// result.
+function addBlobStats(result, blobStatsBefore, poolStatsBefore) {
+  const blobStats = SspiClientApi.getBlobStats();
+  const poolStats = SspiClientApi.getBufferPoolStats();
+  const perOp = (value) => result.count ? Math.round(value / result.count) : 0;
+  const perOpFraction = (value) => result.count ? Math.round(value * 100 / result.count) / 100 : 0;
+
+  result.inBytesPerOp = perOp(blobStats.inBytes - blobStatsBefore.inBytes);
+  result.outBytesPerOp = perOp(blobStats.outBytes - blobStatsBefore.outBytes);
+  result.bytesCopiedPerOp = perOp(blobStats.bytesCopied - blobStatsBefore.bytesCopied);
+  result.bufferAllocationsPerOp = perOpFraction(poolStats.allocations - poolStatsBefore.allocations);
+  result.heapAllocationsPerOp = perOpFraction(poolStats.heapAllocations - poolStatsBefore.heapAllocations);
+  result.bufferBytesInUse = poolStats.bytesInUse;
+  result.externalKb = Math.round(process.memoryUsage().external / 1024);
+  return result;
+}
+
+// Runs op() iterations times with at most concurrency in flight.
+//
+// Signature of op is:
+//  op(cb) where cb(err)
+function runConcurrent(name, iterations, concurrency, op, cb) {
+  const blobStatsBefore = SspiClientApi.getBlobStats();
+  const poolStatsBefore = SspiClientApi.getBufferPoolStats();
+  const latenciesMs = [];
+  let started = 0;
+  let completed = 0;
+  let failed = null;
+  const begin = process.hrtime();
+
+  const startOne = () => {
+    started++;
+    const opBegin = process.hrtime();
+    op((err) => {
+      const diff = process.hrtime(opBegin);
+      latenciesMs.push(diff[0] * 1e3 + diff[1] / 1e6);
+      failed = failed || err;
+      completed++;
+
+      if (started < iterations) {
+        startOne();
+      } else if (completed === iterations) {
+        const total = process.hrtime(begin);
+        cb(failed, addBlobStats(summarize(name, latenciesMs, total[0] * 1e3 + total[1] / 1e6), blobStatsBefore, poolStatsBefore));
+      }
+    });
+  };
+
+  for (let i = 0; i < Math.min(concurrency, iterations); i++) {
+    startOne();
+  }
+}
+
+function handshakeOp(spn, securityPackage) {
+  return (cb) => Loopback.runHandshake(spn, securityPackage, (err) => cb(err));
+}
+
+function cannedOp(spn) {
+  return (cb) => {
+    const sspiClient = new SspiClientApi.SspiClient(spn);
+    sspiClient.utEnableCannedResponse();
+    sspiClient.getNextBlob(null, 0, 0, () => cb(null));
+  };
+}
+
+// Signature of cb is:
+//  cb(err, results)
+function runBenchmark(options, cb) {
+  const iterations = options.iterations || 1000;
+  const concurrency = options.concurrency || 16;
+  const spn = options.spn || 'MSSQLSvc/localhost:1433';
+
+  SspiClientApi.ensureInitialization((errorCode, errorString) => {
+    if (errorCode !== 0) {
+      cb(new Error(errorString));
+      return;
+    }
+
+    runConcurrent('canned', iterations, concurrency, cannedOp(spn), (err, cannedResult) => {
+      const handshakeName = SspiClientApi.getProviderName() + '-handshake-'
+        + (options.securityPackage || SspiClientApi.getDefaultSspiPackageName().toLowerCase());
+      runConcurrent(handshakeName, iterations, concurrency, handshakeOp(spn, options.securityPackage),
+        (err, handshakeResult) => {
+          cb(err, [cannedResult, handshakeResult]);
+        });
+    });
+  });
+}
+
+module.exports.runConcurrent = runConcurrent;
+module.exports.runBenchmark = runBenchmark;
+module.exports.summarize = summarize;
+
+if (require.main === module) {
+  const options = {
+    iterations: parseInt(process.argv[2] || '1000', 10),
+    concurrency: parseInt(process.argv[3] || '16', 10),
+    securityPackage: process.argv[4],
+    spn: process.argv[5]
+  };
+
+  runBenchmark(options, (err, results) => {
+    if (err) {
+      console.log('Benchmark failed: ', err.message);
+      process.exitCode = 1;
+      return;
+    }
+
+    results.forEach((result) => console.log(JSON.stringify(result)));
+  });
+}
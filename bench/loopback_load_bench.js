@@ -0,0 +1,320 @@
+'use strict';
+
+// Load generator driving many concurrent SspiClient handshakes against a local
+// SspiServer over loopback TCP, one connection per handshake. Sweeps worker
+// pool sizes and concurrency levels to find where throughput stops scaling.
+//
+// Usage: node bench/loopback_load_bench.js [handshakes] [concurrencies]
+//            [workerThreads] [securityPackage] [latencyMs] [outFile]
+//
+//   concurrencies, workerThreads - Comma separated lists, e.g. 10,100,1000
+//                                  and 0,4,16. 0 worker threads runs SSPI
+//                                  calls on the libuv thread pool, sized by
+//                                  UV_THREADPOOL_SIZE.
+//   latencyMs - Delay the mock provider adds to every context call, to stand
+//               in for a KDC. Mock provider only.
+//   outFile - Optional, results are also appended to it as JSON lines.
+//
+// Use SSPI_CLIENT_PROVIDER to pick the provider, 'mock' on any platform or
+// 'gssapi' with the KDC from test/integration/krb5kdc. Each handshake in
+// flight holds two sockets, raise ulimit -n for thousands of them.
+
+const fs = require('fs');
+const net = require('net');
+
+const index = require('../src_js/index.js');
+const SspiClientApi = index.SspiClientApi;
+const SspiServerApi = index.SspiServerApi;
+const HandshakeBench = require('./handshake_bench.js');
+
+const c_frameHeaderLength = 4;
+const c_listenBacklog = 4096;
+const c_sampleIntervalMs = 10;
+
+// Splits a stream into length prefixed frames.
+//
+// Signature of onFrame is:
+//  onFrame(frame)
+function readFrames(socket, onFrame) {
+  let pending = Buffer.alloc(0);
+  socket.on('data', (data) => {
+    pending = pending.length ? Buffer.concat([pending, data]) : data;
+    while (pending.length >= c_frameHeaderLength) {
+      const frameLength = pending.readUInt32BE(0);
+      if (pending.length < c_frameHeaderLength + frameLength) {
+        break;
+      }
+
+      const frame = pending.slice(c_frameHeaderLength, c_frameHeaderLength + frameLength);
+      pending = pending.slice(c_frameHeaderLength + frameLength);
+      onFrame(frame);
+    }
+  });
+}
+
+function writeFrame(socket, blob) {
+  const header = Buffer.alloc(c_frameHeaderLength);
+  header.writeUInt32BE(blob.length, 0);
+  socket.write(Buffer.concat([header, blob]));
+}
+
+// Accepts handshakes, a new SspiServer per connection. Replies to every
+// client blob with one frame, empty once the server has nothing more to send.
+function startServer(securityPackage, cb) {
+  const server = net.createServer((socket) => {
+    socket.setNoDelay(true);
+    socket.on('error', () => socket.destroy());
+
+    const sspiServer = new SspiServerApi.SspiServer(securityPackage);
+    readFrames(socket, (clientResponse) => {
+      sspiServer.acceptNextBlob(clientResponse, 0, clientResponse.length, (serverResponse, isDone, errorCode) => {
+        if (errorCode !== 0) {
+          socket.destroy();
+          return;
+        }
+
+        writeFrame(socket, serverResponse);
+      });
+    });
+  });
+
+  server.listen(0, '127.0.0.1', c_listenBacklog, () => cb(server));
+}
+
+// Records the time of each client leg, client1 for the first getNextBlob and
+// so on, and of each round trip to the server, roundTrip1 and so on.
+function recordLeg(legLatenciesMs, name, begin) {
+  const diff = process.hrtime(begin);
+  if (!legLatenciesMs[name]) {
+    legLatenciesMs[name] = [];
+  }
+
+  legLatenciesMs[name].push(diff[0] * 1e3 + diff[1] / 1e6);
+}
+
+function handshakeOp(port, spn, securityPackage, legLatenciesMs) {
+  return (cb) => {
+    const sspiClient = new SspiClientApi.SspiClient(spn, securityPackage);
+    const socket = net.connect(port, '127.0.0.1');
+    socket.setNoDelay(true);
+
+    let leg = 0;
+    let roundTripBegin = null;
+    let completed = false;
+    const done = (err) => {
+      if (!completed) {
+        completed = true;
+        socket.destroy();
+        cb(err);
+      }
+    };
+
+    const clientLeg = (serverResponse) => {
+      leg++;
+      const legName = 'client' + leg;
+      const begin = process.hrtime();
+      const length = serverResponse ? serverResponse.length : 0;
+      sspiClient.getNextBlob(serverResponse, 0, length, (clientResponse, isDone, errorCode, errorString) => {
+        recordLeg(legLatenciesMs, legName, begin);
+        if (errorCode !== 0) {
+          done(new Error('Client failed: ' + errorString));
+        } else if (clientResponse.length === 0) {
+          done(null);
+        } else {
+          roundTripBegin = process.hrtime();
+          writeFrame(socket, clientResponse);
+        }
+      });
+    };
+
+    readFrames(socket, (serverResponse) => {
+      recordLeg(legLatenciesMs, 'roundTrip' + leg, roundTripBegin);
+      if (serverResponse.length === 0) {
+        done(null);
+      } else {
+        clientLeg(serverResponse);
+      }
+    });
+
+    socket.on('error', done);
+    socket.on('close', () => done(new Error('Connection closed by server.')));
+    socket.on('connect', () => clientLeg(null));
+  };
+}
+
+// Samples the worker pool while handshakes run. Busy threads are the ones
+// not waiting for work, a pool near busyFraction 1 with a growing queue is
+// saturated.
+function startSampling() {
+  const samples = { count: 0, busyThreads: 0, threads: 0, queueDepth: 0 };
+  const timer = setInterval(() => {
+    const poolStats = SspiClientApi.getWorkerPoolStats();
+    samples.count++;
+    samples.busyThreads += poolStats.threads - poolStats.idleThreads;
+    samples.threads += poolStats.threads;
+    samples.queueDepth += poolStats.queueDepth;
+  }, c_sampleIntervalMs);
+
+  return () => {
+    clearInterval(timer);
+    return samples;
+  };
+}
+
+function getSaturation(samples) {
+  const poolStats = SspiClientApi.getWorkerPoolStats();
+  const average = (total) => samples.count ? Math.round(total * 10 / samples.count) / 10 : 0;
+
+  // Time waiting for a thread is recorded for both thread pools.
+  let queueWaitP99Us = 0;
+  const queueWait = SspiClientApi.getStats().queueWait || {};
+  Object.keys(queueWait).forEach((packageName) => {
+    Object.keys(queueWait[packageName]).forEach((outcome) => {
+      queueWaitP99Us = Math.max(queueWaitP99Us, queueWait[packageName][outcome].p99Us);
+    });
+  });
+
+  const saturation = { queueWaitP99Us: queueWaitP99Us };
+  if (poolStats.enabled) {
+    saturation.busyThreadsAvg = average(samples.busyThreads);
+    saturation.busyFraction = samples.threads ? Math.round(samples.busyThreads * 100 / samples.threads) / 100 : 0;
+    saturation.peakThreads = poolStats.peakThreads;
+    saturation.queueDepthAvg = average(samples.queueDepth);
+    saturation.peakQueueDepth = poolStats.peakQueueDepth;
+  }
+
+  return saturation;
+}
+
+function summarizeLegs(legLatenciesMs) {
+  const legs = {};
+  Object.keys(legLatenciesMs).sort().forEach((name) => {
+    const summary = HandshakeBench.summarize(name, legLatenciesMs[name], 1);
+    legs[name] = {
+      count: summary.count,
+      p50Ms: summary.p50Ms,
+      p99Ms: summary.p99Ms,
+      p999Ms: summary.p999Ms
+    };
+  });
+
+  return legs;
+}
+
+function runOne(server, options, workerThreads, concurrency, cb) {
+  SspiClientApi.configureWorkerPool({ size: workerThreads });
+  SspiClientApi.utResetWorkerPoolStats();
+  SspiClientApi.resetStats();
+
+  const legLatenciesMs = {};
+  const stopSampling = startSampling();
+  const name = 'loopback-' + options.securityPackage + '-w' + workerThreads + '-c' + concurrency;
+  const op = handshakeOp(server.address().port, options.spn, options.securityPackage, legLatenciesMs);
+
+  HandshakeBench.runConcurrent(name, options.handshakes, concurrency, op, (err, result) => {
+    const samples = stopSampling();
+    cb(err, {
+      name: name,
+      provider: SspiClientApi.getProviderName(),
+      securityPackage: options.securityPackage,
+      workerThreads: workerThreads === 0 ? 'libuv' : workerThreads,
+      concurrency: concurrency,
+      handshakes: result.count,
+      handshakesPerSec: result.opsPerSec,
+      p50Ms: result.p50Ms,
+      p99Ms: result.p99Ms,
+      p999Ms: result.p999Ms,
+      maxMs: result.maxMs,
+      legs: summarizeLegs(legLatenciesMs),
+      saturation: getSaturation(samples)
+    });
+  });
+}
+
+// Runs every combination of options.workerThreads and options.concurrencies.
+//
+// Signature of onResult is:
+//  onResult(result)
+//
+// Signature of cb is:
+//  cb(err)
+function runBenchmark(options, onResult, cb) {
+  options = {
+    handshakes: options.handshakes || 10000,
+    concurrencies: options.concurrencies || [10, 100, 1000],
+    workerThreads: options.workerThreads || [0, 4, 16],
+    securityPackage: options.securityPackage || 'kerberos',
+    latencyMs: options.latencyMs || 0,
+    spn: options.spn || 'MSSQLSvc/localhost:1433'
+  };
+
+  if (options.latencyMs && SspiClientApi.getProviderName() !== 'mock') {
+    cb(new Error('latencyMs needs the mock provider, set SSPI_CLIENT_PROVIDER=mock.'));
+    return;
+  }
+
+  SspiClientApi.ensureInitialization((errorCode, errorString) => {
+    if (errorCode !== 0) {
+      cb(new Error(errorString));
+      return;
+    }
+
+    if (options.latencyMs) {
+      SspiClientApi.utSetMockLatency(options.latencyMs);
+    }
+
+    const runs = [];
+    options.workerThreads.forEach((workerThreads) => {
+      options.concurrencies.forEach((concurrency) => runs.push({ workerThreads, concurrency }));
+    });
+
+    startServer(options.securityPackage, (server) => {
+      const next = (err) => {
+        if (err || runs.length === 0) {
+          server.close();
+          if (options.latencyMs) {
+            SspiClientApi.utSetMockLatency(0);
+          }
+
+          cb(err);
+          return;
+        }
+
+        const run = runs.shift();
+        runOne(server, options, run.workerThreads, run.concurrency, (err, result) => {
+          onResult(result);
+          next(err);
+        });
+      };
+
+      next(null);
+    });
+  });
+}
+
+module.exports.runBenchmark = runBenchmark;
+
+if (require.main === module) {
+  const parseList = (arg) => arg ? arg.split(',').map((value) => parseInt(value, 10)) : undefined;
+  const options = {
+    handshakes: parseInt(process.argv[2] || '10000', 10),
+    concurrencies: parseList(process.argv[3]),
+    workerThreads: parseList(process.argv[4]),
+    securityPackage: process.argv[5],
+    latencyMs: parseInt(process.argv[6] || '0', 10)
+  };
+  const outFile = process.argv[7];
+
+  runBenchmark(options, (result) => {
+    const line = JSON.stringify(result);
+    console.log(line);
+    if (outFile) {
+      fs.appendFileSync(outFile, line + '\n');
+    }
+  }, (err) => {
+    if (err) {
+      console.log('Benchmark failed: ', err.message);
+      process.exitCode = 1;
+    }
+  });
+}
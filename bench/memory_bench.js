@@ -0,0 +1,100 @@
+'use strict';
+
+// Measures native memory held per in-flight handshake: starts count
+// handshakes per security package, keeps the first client token of each
+// alive and reports the token buffer bytes in use divided by count.
+//
+// Usage: node --expose-gc bench/memory_bench.js [count] [spn]
+//
+// Use SSPI_CLIENT_PROVIDER to pick the provider, 'mock' on any platform.
+
+const SspiClientApi = require('../src_js/index.js').SspiClientApi;
+
+function measurePackage(securityPackage, count, spn, cb) {
+  if (global.gc) {
+    global.gc();
+  }
+
+  const before = SspiClientApi.getBufferPoolStats();
+  const externalBefore = process.memoryUsage().external;
+  const clientResponses = [];
+  let failed = null;
+
+  for (let i = 0; i < count; i++) {
+    const sspiClient = new SspiClientApi.SspiClient(spn, securityPackage);
+    sspiClient.getNextBlob(null, 0, 0, (clientResponse, isDone, errorCode, errorString) => {
+      if (errorCode !== 0) {
+        failed = failed || new Error(errorString);
+      }
+
+      clientResponses.push(clientResponse);
+      if (clientResponses.length < count) {
+        return;
+      }
+
+      const after = SspiClientApi.getBufferPoolStats();
+      const tokenBytes = clientResponses.reduce((total, response) => total + response.length, 0);
+      cb(failed, {
+        name: SspiClientApi.getProviderName() + '-inflight-' + securityPackage,
+        count: count,
+        tokenBytesPerHandshake: Math.round(tokenBytes / count),
+        bufferBytesPerHandshake: Math.round((after.bytesInUse - before.bytesInUse) / count),
+        externalBytesPerHandshake: Math.round((process.memoryUsage().external - externalBefore) / count)
+      });
+    });
+  }
+}
+
+// Signature of cb is:
+//  cb(err, results)
+function runBenchmark(options, cb) {
+  const count = options.count || 1000;
+  const spn = options.spn || 'MSSQLSvc/localhost:1433';
+  const packages = ['negotiate', 'kerberos', 'ntlm'];
+  const results = [];
+
+  SspiClientApi.ensureInitialization((errorCode, errorString) => {
+    if (errorCode !== 0) {
+      cb(new Error(errorString));
+      return;
+    }
+
+    const next = () => {
+      if (results.length === packages.length) {
+        cb(null, results);
+        return;
+      }
+
+      measurePackage(packages[results.length], count, spn, (err, result) => {
+        if (err) {
+          cb(err);
+          return;
+        }
+
+        results.push(result);
+        next();
+      });
+    };
+
+    next();
+  });
+}
+
+module.exports.runBenchmark = runBenchmark;
+
+if (require.main === module) {
+  const options = {
+    count: parseInt(process.argv[2] || '1000', 10),
+    spn: process.argv[3]
+  };
+
+  runBenchmark(options, (err, results) => {
+    if (err) {
+      console.log('Benchmark failed: ', err.message);
+      process.exitCode = 1;
+      return;
+    }
+
+    results.forEach((result) => console.log(JSON.stringify(result)));
+  });
+}
@@ -0,0 +1,152 @@
+'use strict';
+
+// Throughput of message protection over a context established in process,
+// per operation, message size and messages per call. Needs the mock
+// provider, set SSPI_CLIENT_PROVIDER=mock.
+//
+// Usage: node bench/message_bench.js [totalBytes] [messageSizes] [batchSizes]
+
+const SspiClientApi = require('../src_js/index.js').SspiClientApi;
+const Loopback = require('../test/utils/loopback.js');
+
+const spn = 'MSSQLSvc/localhost:1433';
+
+function makeMessages(count, messageSize, tokenLength) {
+  const messages = [];
+  for (let i = 0; i < count; i++) {
+    messages.push({ token: Buffer.alloc(tokenLength), data: Buffer.alloc(messageSize, i) });
+  }
+
+  return messages;
+}
+
+// Protects then unprotects totalBytes worth of messages, batchSize messages
+// per call, timing each direction separately. Buffers are reused across
+// calls as a connection would reuse its send and receive buffers.
+//
+// Signature of cb is:
+//  cb(err, results)
+function runPair(pair, protect, unprotect, messageSize, batchSize, options, cb) {
+  const sizes = pair.sspiClient.getMessageSizes();
+  const tokenLength = protect === 'sign' ? sizes.maxSignature : sizes.securityTrailer;
+  const messages = makeMessages(batchSize, messageSize, tokenLength);
+  const calls = Math.max(1, Math.round(options.totalBytes / (messageSize * batchSize)));
+
+  let call = 0;
+  let protectMs = 0;
+  let unprotectMs = 0;
+  const result = (operation, elapsedMs) => ({
+    operation: operation,
+    messageSize: messageSize,
+    batchSize: batchSize,
+    calls: calls,
+    mbPerSec: Math.round(messageSize * batchSize * calls / 1e3 / elapsedMs * 10) / 10,
+    messagesPerSec: Math.round(batchSize * calls * 1000 / elapsedMs)
+  });
+
+  const next = () => {
+    if (call === calls) {
+      cb(null, [ result(protect, protectMs), result(unprotect, unprotectMs) ]);
+      return;
+    }
+
+    let begin = process.hrtime();
+    pair.sspiClient[protect](messages, (tokenLengths, errorCode, errorString) => {
+      if (errorCode !== 0) {
+        cb(new Error(errorString));
+        return;
+      }
+
+      let diff = process.hrtime(begin);
+      protectMs += diff[0] * 1e3 + diff[1] / 1e6;
+
+      begin = process.hrtime();
+      pair.sspiServer[unprotect](messages, (tokenLengths, errorCode, errorString) => {
+        if (errorCode !== 0) {
+          cb(new Error(errorString));
+          return;
+        }
+
+        diff = process.hrtime(begin);
+        unprotectMs += diff[0] * 1e3 + diff[1] / 1e6;
+        call++;
+        next();
+      });
+    });
+  };
+
+  next();
+}
+
+// Signature of cb is:
+//  cb(err, results)
+function runBenchmark(options, cb) {
+  options = {
+    totalBytes: options.totalBytes || 64 * 1024 * 1024,
+    messageSizes: options.messageSizes || [ 512, 8192, 65536 ],
+    batchSizes: options.batchSizes || [ 1, 16 ]
+  };
+
+  if (SspiClientApi.getProviderName() !== 'mock') {
+    cb(new Error('Needs the mock provider, set SSPI_CLIENT_PROVIDER=mock.'));
+    return;
+  }
+
+  const cases = [];
+  [ [ 'sign', 'verify' ], [ 'encrypt', 'decrypt' ] ].forEach((operations) => {
+    options.messageSizes.forEach((messageSize) => {
+      options.batchSizes.forEach((batchSize) => {
+        cases.push({ protect: operations[0], unprotect: operations[1], messageSize: messageSize, batchSize: batchSize });
+      });
+    });
+  });
+
+  Loopback.runHandshake(spn, 'kerberos', (err, pair) => {
+    if (err) {
+      cb(err);
+      return;
+    }
+
+    let results = [];
+    const runCase = (index) => {
+      if (index === cases.length) {
+        cb(null, results);
+        return;
+      }
+
+      const c = cases[index];
+      runPair(pair, c.protect, c.unprotect, c.messageSize, c.batchSize, options, (err, caseResults) => {
+        if (err) {
+          cb(err);
+          return;
+        }
+
+        results = results.concat(caseResults);
+        runCase(index + 1);
+      });
+    };
+
+    runCase(0);
+  });
+}
+
+module.exports.runBenchmark = runBenchmark;
+
+if (require.main === module) {
+  const parseList = (arg) => (arg ? arg.split(',').map((value) => parseInt(value, 10)) : undefined);
+  const options = {
+    totalBytes: parseInt(process.argv[2] || '67108864', 10),
+    messageSizes: parseList(process.argv[3]),
+    batchSizes: parseList(process.argv[4])
+  };
+
+  runBenchmark(options, (err, results) => {
+    if (err) {
+      console.log('Benchmark failed: ', err.message);
+      process.exitCode = 1;
+      return;
+    }
+
+    results.forEach((result) => console.log(JSON.stringify(result)));
+  });
+}
@@ -0,0 +1,363 @@
+// Micro-benchmarks for the native hot paths, run without Node.js: the canned
+// and mock provider GetNextBlob paths, token buffer allocation on one thread
+// and release on another, and UTF-8 to UTF-16 conversion. Prints one JSON line
+// per benchmark with ops/sec and heap allocations per op, counted through a
+// replaced global operator new.
+//
+// Built by node-gyp along with the addon:
+//   build/Release/sspi-client-bench [durationMs] [nameFilter]
+
+#include "node_version_support.h"
+
+#include <stdio.h>
+
+#ifdef IS_SUPPORTED_NODE_VERSION
+
+#include "mock_sspi_provider.h"
+#include "sspi_impl.h"
+#include "sspi_provider.h"
+#include "sspi_server_impl.h"
+#include "token_buffer_pool.h"
+#include "utils.h"
+
+#include <atomic>
+#include <chrono>
+#include <condition_variable>
+#include <memory>
+#include <mutex>
+#include <new>
+#include <stdlib.h>
+#include <string.h>
+#include <string>
+#include <thread>
+#include <vector>
+
+static std::atomic<uint64_t> s_allocations(0);
+
+// Builds with -fno-exceptions, a failed allocation ends the run.
+static void* CountedAllocate(size_t size)
+{
+    s_allocations.fetch_add(1, std::memory_order_relaxed);
+    void* p = malloc(size > 0 ? size : 1);
+    if (p == nullptr)
+    {
+        fprintf(stderr, "Out of memory.\n");
+        abort();
+    }
+
+    return p;
+}
+
+void* operator new(size_t size)
+{
+    return CountedAllocate(size);
+}
+
+void* operator new[](size_t size)
+{
+    return CountedAllocate(size);
+}
+
+void operator delete(void* p) noexcept
+{
+    free(p);
+}
+
+void operator delete[](void* p) noexcept
+{
+    free(p);
+}
+
+void operator delete(void* p, size_t) noexcept
+{
+    free(p);
+}
+
+void operator delete[](void* p, size_t) noexcept
+{
+    free(p);
+}
+
+namespace
+{
+    const int c_batchSize = 64;
+    const int c_warmupOps = 256;
+
+    const char* c_spn = "MSSQLSvc/sqlserver01.corp.example.com:1433";
+
+    struct Options
+    {
+        int durationMs;
+        std::string nameFilter;
+    };
+
+    // Runs op in batches for at least durationMs and prints the result.
+    template <typename Op>
+    void Run(const Options& options, const std::string& name, Op op)
+    {
+        if (name.find(options.nameFilter) == std::string::npos)
+        {
+            return;
+        }
+
+        for (int i = 0; i < c_warmupOps; i++)
+        {
+            op();
+        }
+
+        uint64_t ops = 0;
+        uint64_t allocationsBefore = s_allocations.load();
+        std::chrono::steady_clock::time_point begin = std::chrono::steady_clock::now();
+        std::chrono::steady_clock::duration elapsed;
+        do
+        {
+            for (int i = 0; i < c_batchSize; i++)
+            {
+                op();
+            }
+
+            ops += c_batchSize;
+            elapsed = std::chrono::steady_clock::now() - begin;
+        } while (elapsed < std::chrono::milliseconds(options.durationMs));
+
+        uint64_t allocations = s_allocations.load() - allocationsBefore;
+        double elapsedNs = static_cast<double>(std::chrono::duration_cast<std::chrono::nanoseconds>(elapsed).count());
+
+        printf("{\"name\":\"%s\",\"ops\":%llu,\"opsPerSec\":%.0f,\"nsPerOp\":%.1f,\"allocationsPerOp\":%.2f}\n",
+            name.c_str(),
+            static_cast<unsigned long long>(ops),
+            ops * 1e9 / elapsedNs,
+            elapsedNs / ops,
+            static_cast<double>(allocations) / ops);
+        fflush(stdout);
+    }
+
+    void CheckStatus(SECURITY_STATUS securityStatus, const std::string& errorString)
+    {
+        if (securityStatus < 0)
+        {
+            fprintf(stderr, "Failed with error code 0x%X: %s\n", securityStatus, errorString.c_str());
+            exit(1);
+        }
+    }
+
+    // A new client per op, as for every connection. Canned responses come
+    // with fixed error codes, there's nothing to check.
+    void CannedGetNextBlob(const std::vector<char>& serverResponse)
+    {
+        SspiImpl sspiImpl(c_spn, nullptr);
+        sspiImpl.UtEnableCannedResponse(true);
+
+        char* outBlob;
+        int outBlobLength;
+        bool isDone;
+        std::string errorString;
+        sspiImpl.GetNextBlob(
+            serverResponse.data(),
+            static_cast<int>(serverResponse.size()),
+            &outBlob,
+            &outBlobLength,
+            &isDone,
+            &errorString);
+        SspiImpl::FreeBlob(outBlob);
+    }
+
+    void MockFirstLeg(const char* securityPackage)
+    {
+        SspiImpl sspiImpl(c_spn, securityPackage);
+
+        char* outBlob;
+        int outBlobLength;
+        bool isDone;
+        std::string errorString;
+        CheckStatus(sspiImpl.GetNextBlob(nullptr, 0, &outBlob, &outBlobLength, &isDone, &errorString), errorString);
+        SspiImpl::FreeBlob(outBlob);
+    }
+
+    void MockHandshake(const char* securityPackage)
+    {
+        SspiImpl sspiImpl(c_spn, securityPackage);
+        SspiServerImpl sspiServerImpl(securityPackage);
+
+        char* clientBlob = nullptr;
+        int clientBlobLength = 0;
+        char* serverBlob = nullptr;
+        int serverBlobLength = 0;
+        bool isClientDone = false;
+        bool isServerDone = false;
+        std::string errorString;
+
+        while (true)
+        {
+            CheckStatus(
+                sspiImpl.GetNextBlob(serverBlob, serverBlobLength, &clientBlob, &clientBlobLength, &isClientDone, &errorString),
+                errorString);
+            SspiImpl::FreeBlob(serverBlob);
+            serverBlob = nullptr;
+            if (clientBlobLength == 0)
+            {
+                break;
+            }
+
+            CheckStatus(
+                sspiServerImpl.AcceptNextBlob(clientBlob, clientBlobLength, &serverBlob, &serverBlobLength, &isServerDone, &errorString),
+                errorString);
+            SspiImpl::FreeBlob(clientBlob);
+            clientBlob = nullptr;
+            if (serverBlobLength == 0)
+            {
+                break;
+            }
+        }
+
+        SspiImpl::FreeBlob(clientBlob);
+        SspiImpl::FreeBlob(serverBlob);
+    }
+
+    // Allocates blobs on its own thread, as worker threads do, for another
+    // thread to free, as the V8 free callbacks on the main thread do.
+    class BlobProducer
+    {
+    public:
+        explicit BlobProducer(int blobLength) :
+            m_blobLength(blobLength),
+            m_blobs(c_capacity),
+            m_head(0),
+            m_count(0),
+            m_stop(false),
+            m_thread(&BlobProducer::Produce, this)
+        {
+        }
+
+        ~BlobProducer()
+        {
+            {
+                std::lock_guard<std::mutex> lock(m_mutex);
+                m_stop = true;
+            }
+
+            m_notFull.notify_one();
+            m_thread.join();
+
+            for (; m_count > 0; m_count--)
+            {
+                SspiImpl::FreeBlob(m_blobs[m_head]);
+                m_head = (m_head + 1) % c_capacity;
+            }
+        }
+
+        char* Take()
+        {
+            std::unique_lock<std::mutex> lock(m_mutex);
+            m_notEmpty.wait(lock, [this]() { return m_count > 0; });
+            char* blob = m_blobs[m_head];
+            m_head = (m_head + 1) % c_capacity;
+            m_count--;
+            lock.unlock();
+            m_notFull.notify_one();
+            return blob;
+        }
+
+    private:
+        static const size_t c_capacity = 64;
+
+        // The only producer, so a free slot stays free while it allocates.
+        void Produce()
+        {
+            std::unique_lock<std::mutex> lock(m_mutex);
+            while (true)
+            {
+                m_notFull.wait(lock, [this]() { return m_stop || m_count < c_capacity; });
+                if (m_stop)
+                {
+                    return;
+                }
+
+                lock.unlock();
+                char* blob = SspiImpl::AllocateBlob(m_blobLength);
+                lock.lock();
+                m_blobs[(m_head + m_count) % c_capacity] = blob;
+                m_count++;
+                m_notEmpty.notify_one();
+            }
+        }
+
+        int m_blobLength;
+        std::vector<char*> m_blobs;
+        size_t m_head;
+        size_t m_count;
+        bool m_stop;
+        std::mutex m_mutex;
+        std::condition_variable m_notEmpty;
+        std::condition_variable m_notFull;
+        std::thread m_thread;
+    };
+
+    void ConvertSpn(const char* spn)
+    {
+        std::unique_ptr<WCHAR[]> spnMultiByte;
+        char errorString[256] = "";
+        CheckStatus(ConvertUtf8ToMultiByte("spn", spn, &spnMultiByte, errorString, sizeof(errorString)), errorString);
+    }
+}
+
+int main(int argc, char* argv[])
+{
+    Options options;
+    options.durationMs = argc > 1 ? atoi(argv[1]) : 1000;
+    options.nameFilter = argc > 2 ? argv[2] : "";
+
+    if (!SspiProvider::SetDefault(MockSspiProvider::c_name))
+    {
+        fprintf(stderr, "Mock provider not available.\n");
+        return 1;
+    }
+
+    std::vector<std::string> availablePackages;
+    int defaultPackageIndex;
+    std::string errorString;
+    CheckStatus(SspiImpl::Initialize(&availablePackages, &defaultPackageIndex, &errorString), errorString);
+
+    std::vector<char> emptyResponse;
+    std::vector<char> serverResponse(1024, 0x5A);
+    Run(options, "canned-getNextBlob", [&emptyResponse]() { CannedGetNextBlob(emptyResponse); });
+    Run(options, "canned-getNextBlob-1k", [&serverResponse]() { CannedGetNextBlob(serverResponse); });
+
+    const char* c_packages[] = { "negotiate", "kerberos", "ntlm" };
+    for (size_t i = 0; i < sizeof(c_packages) / sizeof(c_packages[0]); i++)
+    {
+        const char* securityPackage = c_packages[i];
+        Run(options, std::string("mock-firstLeg-") + securityPackage, [securityPackage]() { MockFirstLeg(securityPackage); });
+        Run(options, std::string("mock-handshake-") + securityPackage, [securityPackage]() { MockHandshake(securityPackage); });
+    }
+
+    const int c_blobLengths[] = { 64, 1620, 48256 };
+    for (int pooled = 1; pooled >= 0; pooled--)
+    {
+        TokenBufferPool::GetInstance()->SetEnabled(pooled != 0);
+        for (size_t i = 0; i < sizeof(c_blobLengths) / sizeof(c_blobLengths[0]); i++)
+        {
+            BlobProducer producer(c_blobLengths[i]);
+            Run(options,
+                std::string(pooled ? "blob-pooled-" : "blob-heap-") + std::to_string(c_blobLengths[i]),
+                [&producer]() { SspiImpl::FreeBlob(producer.Take()); });
+        }
+    }
+
+    TokenBufferPool::GetInstance()->SetEnabled(true);
+
+    Run(options, "utf8ToUtf16-ascii", []() { ConvertSpn(c_spn); });
+    Run(options, "utf8ToUtf16-nonAscii", []() { ConvertSpn("MSSQLSvc/s\xC3\xB8rver-\xE6\x9D\xB1\xE4\xBA\xAC.corp.example.com:1433"); });
+
+    return 0;
+}
+
+#else   // IS_SUPPORTED_NODE_VERSION
+
+int main()
+{
+    printf("Not supported on this version of Node.js.\n");
+    return 0;
+}
+
+#endif  // IS_SUPPORTED_NODE_VERSION
@@ -0,0 +1,142 @@
+'use strict';
+
+// Replays handshakes recorded with startTranscriptRecording through the whole
+// JS and native client stack, no KDC or server needed. Each handshake feeds
+// the client the server tokens of a recorded handshake and checks the client
+// sends what was recorded. Needs the replay provider, set
+// SSPI_CLIENT_PROVIDER=replay.
+//
+// Usage: node bench/replay_bench.js transcriptFile [handshakes] [concurrency] [realTime]
+//
+//   realTime - 'true' to have each leg take as long as it did when recorded,
+//              otherwise legs are served as fast as possible.
+
+const index = require('../src_js/index.js');
+const SspiClientApi = index.SspiClientApi;
+const Transcript = index.Transcript;
+const HandshakeBench = require('./handshake_bench.js');
+
+function tokenKey(securityPackage, spn, token) {
+  return securityPackage.toLowerCase() + ' ' + spn + ' ' + (token ? token.toString('base64') : '');
+}
+
+function tokensEqual(buffer, token) {
+  return (buffer ? buffer.length : 0) === token.length && (token.length === 0 || buffer.equals(token));
+}
+
+// The provider picks the handshake to replay, the first output token tells
+// which one it is, or one just like it.
+function indexByFirstToken(handshakes) {
+  const handshakesByFirstToken = new Map();
+  handshakes.forEach((handshake) => {
+    const key = tokenKey(handshake.securityPackage, handshake.spn, handshake.legs[0].outToken);
+    if (!handshakesByFirstToken.has(key)) {
+      handshakesByFirstToken.set(key, handshake);
+    }
+  });
+
+  return handshakesByFirstToken;
+}
+
+function replayOp(handshakes, handshakesByFirstToken) {
+  let next = 0;
+  return (cb) => {
+    const recorded = handshakes[next++ % handshakes.length];
+    const sspiClient = new SspiClientApi.SspiClient(recorded.spn, recorded.securityPackage);
+    let handshake = null;
+    let leg = 0;
+
+    const step = (serverResponse) => {
+      const length = serverResponse ? serverResponse.length : 0;
+      sspiClient.getNextBlob(serverResponse, 0, length, (clientResponse, isDone, errorCode, errorString) => {
+        if (handshake === null) {
+          handshake = handshakesByFirstToken.get(tokenKey(recorded.securityPackage, recorded.spn, clientResponse))
+            || recorded;
+        }
+
+        const expected = handshake.legs[leg];
+        if (errorCode !== expected.status
+          || (errorCode === 0 && !tokensEqual(clientResponse, expected.outToken))) {
+          cb(new Error('Leg ' + leg + ' of ' + recorded.spn + ' differs from the recording: ' + errorString));
+          return;
+        }
+
+        leg++;
+        if (errorCode !== 0 || isDone || leg === handshake.legs.length) {
+          cb(null);
+          return;
+        }
+
+        step(handshake.legs[leg].inToken);
+      });
+    };
+
+    step(null);
+  };
+}
+
+// Signature of cb is:
+//  cb(err, result)
+function runBenchmark(options, cb) {
+  if (SspiClientApi.getProviderName() !== 'replay') {
+    cb(new Error('Needs the replay provider, set SSPI_CLIENT_PROVIDER=replay.'));
+    return;
+  }
+
+  const handshakes = Transcript.readHandshakes(options.transcriptFile).filter((handshake) => handshake.spn !== '');
+  if (handshakes.length === 0) {
+    cb(new Error('No handshakes in \'' + options.transcriptFile + '\'.'));
+    return;
+  }
+
+  SspiClientApi.loadReplayTranscripts(options.transcriptFile, { realTime: options.realTime });
+  SspiClientApi.ensureInitialization((errorCode, errorString) => {
+    if (errorCode !== 0) {
+      cb(new Error(errorString));
+      return;
+    }
+
+    const statsBefore = SspiClientApi.getTranscriptStats();
+    const name = 'replay' + (options.realTime ? '-realtime' : '') + '-c' + options.concurrency;
+    const op = replayOp(handshakes, indexByFirstToken(handshakes));
+    HandshakeBench.runConcurrent(name, options.handshakes, options.concurrency, op, (err, result) => {
+      if (err) {
+        cb(err);
+        return;
+      }
+
+      const stats = SspiClientApi.getTranscriptStats();
+      result.recordedHandshakes = handshakes.length;
+      result.concurrency = options.concurrency;
+      result.legsPerSec = Math.round((stats.served - statsBefore.served) * result.opsPerSec / result.count);
+      result.mismatches = stats.mismatches - statsBefore.mismatches;
+      cb(null, result);
+    });
+  });
+}
+
+module.exports.runBenchmark = runBenchmark;
+
+if (require.main === module) {
+  const options = {
+    transcriptFile: process.argv[2],
+    handshakes: parseInt(process.argv[3] || '20000', 10),
+    concurrency: parseInt(process.argv[4] || '64', 10),
+    realTime: process.argv[5] === 'true'
+  };
+
+  if (options.transcriptFile === undefined) {
+    console.log('Usage: node bench/replay_bench.js transcriptFile [handshakes] [concurrency] [realTime]');
+    process.exitCode = 1;
+  } else {
+    runBenchmark(options, (err, result) => {
+      if (err) {
+        console.log('Benchmark failed: ', err.message);
+        process.exitCode = 1;
+        return;
+      }
+
+      console.log(JSON.stringify(result));
+    });
+  }
+}
@@ -0,0 +1,264 @@
+// Simulates the worker pool's queue under mixed load with TaskScheduler, so
+// scheduling policies can be compared without a KDC or real threads. Time is
+// simulated; the same seed gives the same results.
+//
+// The load is logins from quiet tenants, a noisy tenant sending many more,
+// and periodic bursts of background first leg pool refills for the noisy
+// tenant's SPN. Prints one JSON line per policy and kind of work with the
+// time from queueing to completion.
+//
+// Built by node-gyp along with the addon:
+//   build/Release/sspi-client-scheduler-sim [durationSec] [threads] [seed]
+
+#include "node_version_support.h"
+
+#include <stdio.h>
+
+#ifdef IS_SUPPORTED_NODE_VERSION
+
+#include "task_scheduler.h"
+#include "worker_pool.h"
+
+#include <algorithm>
+#include <chrono>
+#include <map>
+#include <random>
+#include <stdlib.h>
+#include <string>
+#include <vector>
+
+namespace
+{
+    const int c_quietTenants = 7;
+    const double c_quietLoginsPerSec = 40;
+    const double c_noisyLoginsPerSec = 300;
+    const int c_refillBurst = 200;
+    const int c_refillIntervalMs = 2000;
+
+    // Mean time a thread spends in one SSPI call.
+    const double c_meanServiceUs = 5000;
+
+    enum Kind
+    {
+        c_kindQuiet,
+        c_kindNoisy,
+        c_kindRefill,
+        c_kindCount
+    };
+
+    const char* c_kindNames[] = { "quietLogin", "noisyLogin", "refill" };
+
+    struct Job
+    {
+        Kind kind;
+        std::string tenant;
+        int64_t arrivalUs;
+        int64_t serviceUs;
+        int64_t completedUs;
+    };
+
+    struct Options
+    {
+        int durationSec;
+        int threads;
+        unsigned int seed;
+    };
+
+    TaskScheduler::TimePoint ToTimePoint(int64_t us)
+    {
+        return TaskScheduler::TimePoint() + std::chrono::microseconds(us);
+    }
+
+    void AddPoissonArrivals(
+        std::mt19937* random,
+        Kind kind,
+        const std::string& tenant,
+        double perSec,
+        int64_t durationUs,
+        std::vector<Job>* jobs)
+    {
+        std::exponential_distribution<double> gap(perSec / 1e6);
+        for (double t = gap(*random); t < durationUs; t += gap(*random))
+        {
+            Job job = { kind, tenant, static_cast<int64_t>(t), 0, -1 };
+            jobs->push_back(job);
+        }
+    }
+
+    // Same jobs, in arrival order, for every policy.
+    std::vector<Job> MakeJobs(const Options& options)
+    {
+        std::mt19937 random(options.seed);
+        int64_t durationUs = static_cast<int64_t>(options.durationSec) * 1000000;
+
+        std::vector<Job> jobs;
+        for (int i = 0; i < c_quietTenants; i++)
+        {
+            std::string tenant = "MSSQLSvc/quiet" + std::to_string(i) + ".example.com:1433";
+            AddPoissonArrivals(&random, c_kindQuiet, tenant, c_quietLoginsPerSec, durationUs, &jobs);
+        }
+
+        const std::string noisyTenant = "MSSQLSvc/noisy.example.com:1433";
+        AddPoissonArrivals(&random, c_kindNoisy, noisyTenant, c_noisyLoginsPerSec, durationUs, &jobs);
+        for (int64_t t = 0; t < durationUs; t += c_refillIntervalMs * 1000)
+        {
+            for (int i = 0; i < c_refillBurst; i++)
+            {
+                Job job = { c_kindRefill, noisyTenant, t, 0, -1 };
+                jobs.push_back(job);
+            }
+        }
+
+        std::stable_sort(jobs.begin(), jobs.end(), [](const Job& left, const Job& right)
+        {
+            return left.arrivalUs < right.arrivalUs;
+        });
+
+        std::exponential_distribution<double> service(1 / c_meanServiceUs);
+        for (size_t i = 0; i < jobs.size(); i++)
+        {
+            jobs[i].serviceUs = static_cast<int64_t>(service(random)) + 1;
+        }
+
+        return jobs;
+    }
+
+    struct Running
+    {
+        int64_t completesUs;
+        size_t jobIndex;
+        ScheduledTask scheduledTask;
+    };
+
+    // Runs jobs through a scheduler on options.threads simulated threads.
+    // Returns the deadline misses.
+    uint64_t Simulate(const Options& options, SchedulingPolicy policy, std::vector<Job>* jobs)
+    {
+        TaskScheduler scheduler;
+        scheduler.Configure(policy, std::map<std::string, int>());
+
+        std::vector<Running> running;
+        size_t startedJob = 0;
+        size_t nextArrival = 0;
+        int64_t nowUs = 0;
+        while (nextArrival < jobs->size() || !running.empty() || !scheduler.IsEmpty())
+        {
+            // Next event: an arrival or a thread completing, completions
+            // first at the same time.
+            auto firstCompletion = std::min_element(running.begin(), running.end(),
+                [](const Running& left, const Running& right) { return left.completesUs < right.completesUs; });
+            if (firstCompletion != running.end()
+                && (nextArrival == jobs->size() || firstCompletion->completesUs <= (*jobs)[nextArrival].arrivalUs))
+            {
+                nowUs = firstCompletion->completesUs;
+                Job& job = (*jobs)[firstCompletion->jobIndex];
+                job.completedUs = nowUs;
+                scheduler.Complete(firstCompletion->scheduledTask, job.serviceUs);
+                running.erase(firstCompletion);
+            }
+            else
+            {
+                Job& job = (*jobs)[nextArrival];
+                nowUs = job.arrivalUs;
+                int deadlineMs = WorkerPool::c_defaultDeadlineMs;
+                if (job.kind == c_kindRefill)
+                {
+                    deadlineMs = WorkerPool::c_defaultBackgroundDeadlineMs;
+                }
+
+                size_t jobIndex = nextArrival;
+                scheduler.Push(
+                    [&startedJob, jobIndex]() { startedJob = jobIndex; },
+                    job.tenant,
+                    ToTimePoint(nowUs),
+                    ToTimePoint(nowUs + deadlineMs * 1000));
+                nextArrival++;
+            }
+
+            while (static_cast<int>(running.size()) < options.threads && !scheduler.IsEmpty())
+            {
+                Running started;
+                scheduler.Pop(ToTimePoint(nowUs), &started.scheduledTask);
+                started.scheduledTask.task();
+                started.jobIndex = startedJob;
+                started.completesUs = nowUs + (*jobs)[startedJob].serviceUs;
+                running.push_back(started);
+            }
+        }
+
+        return scheduler.GetDeadlineMisses();
+    }
+
+    double Percentile(const std::vector<double>& sorted, double fraction)
+    {
+        size_t index = static_cast<size_t>(fraction * (sorted.size() - 1));
+        return sorted[index];
+    }
+
+    void Report(const char* policyName, const std::vector<Job>& jobs, uint64_t deadlineMisses)
+    {
+        for (int kind = 0; kind < c_kindCount; kind++)
+        {
+            std::vector<double> latenciesMs;
+            for (size_t i = 0; i < jobs.size(); i++)
+            {
+                if (jobs[i].kind == kind)
+                {
+                    latenciesMs.push_back((jobs[i].completedUs - jobs[i].arrivalUs) / 1000.0);
+                }
+            }
+
+            if (latenciesMs.empty())
+            {
+                continue;
+            }
+
+            std::sort(latenciesMs.begin(), latenciesMs.end());
+            printf("{\"policy\":\"%s\",\"kind\":\"%s\",\"count\":%u,\"p50Ms\":%.1f,\"p99Ms\":%.1f,"
+                "\"p999Ms\":%.1f,\"maxMs\":%.1f,\"deadlineMisses\":%llu}\n",
+                policyName,
+                c_kindNames[kind],
+                static_cast<unsigned int>(latenciesMs.size()),
+                Percentile(latenciesMs, 0.5),
+                Percentile(latenciesMs, 0.99),
+                Percentile(latenciesMs, 0.999),
+                latenciesMs.back(),
+                static_cast<unsigned long long>(deadlineMisses));
+        }
+    }
+}
+
+int main(int argc, char* argv[])
+{
+    Options options;
+    options.durationSec = argc > 1 ? atoi(argv[1]) : 60;
+    options.threads = argc > 2 ? atoi(argv[2]) : WorkerPool::c_defaultSize;
+    options.seed = argc > 3 ? static_cast<unsigned int>(atoi(argv[3])) : 1;
+    if (options.durationSec <= 0 || options.threads <= 0)
+    {
+        fprintf(stderr, "Usage: %s [durationSec] [threads] [seed]\n", argv[0]);
+        return 1;
+    }
+
+    const std::vector<Job> jobs = MakeJobs(options);
+
+    std::vector<Job> fifoJobs = jobs;
+    uint64_t fifoDeadlineMisses = Simulate(options, c_schedulingFifo, &fifoJobs);
+    Report("fifo", fifoJobs, fifoDeadlineMisses);
+
+    std::vector<Job> fairJobs = jobs;
+    uint64_t fairDeadlineMisses = Simulate(options, c_schedulingFair, &fairJobs);
+    Report("fair", fairJobs, fairDeadlineMisses);
+
+    return 0;
+}
+
+#else   // IS_SUPPORTED_NODE_VERSION
+
+int main()
+{
+    printf("Not supported on this version of Node.js.\n");
+    return 0;
+}
+
+#endif  // IS_SUPPORTED_NODE_VERSION
@@ -0,0 +1,145 @@
+'use strict';
+
+// Bulk transfer over loopback TCP through a SealedChannel, against the same
+// transfer over the bare socket, for a few frame sizes. Needs the mock
+// provider, set SSPI_CLIENT_PROVIDER=mock.
+//
+// Usage: node bench/sealed_channel_bench.js [totalBytes] [frameSizes] [chunkSize]
+
+const net = require('net');
+
+const SspiClientApi = require('../src_js/index.js').SspiClientApi;
+const SealedChannel = require('../src_js/index.js').SealedChannel;
+const Loopback = require('../test/utils/loopback.js');
+
+const spn = 'MSSQLSvc/localhost:1433';
+
+// Sends totalBytes from client to server in chunkSize writes, honouring
+// backpressure, and times until the server has read everything.
+//
+// Signature of cb is:
+//  cb(err, result)
+function runTransfer(name, wrap, options, cb) {
+  const chunk = Buffer.alloc(options.chunkSize, 1);
+  let begin = null;
+
+  const server = net.createServer((serverSocket) => {
+    const serverStream = wrap ? wrap(serverSocket, 'server') : serverSocket;
+    let received = 0;
+    serverStream.on('data', (data) => {
+      received += data.length;
+    });
+    serverStream.on('error', (err) => cb(err));
+    serverStream.on('end', () => {
+      const diff = process.hrtime(begin);
+      const elapsedMs = diff[0] * 1e3 + diff[1] / 1e6;
+      server.close();
+      cb(null, {
+        name: name,
+        totalBytes: received,
+        chunkSize: options.chunkSize,
+        mbPerSec: Math.round(received / 1e3 / elapsedMs * 10) / 10
+      });
+    });
+  });
+
+  server.listen(0, '127.0.0.1', () => {
+    const clientSocket = net.connect(server.address().port, '127.0.0.1', () => {
+      const clientStream = wrap ? wrap(clientSocket, 'client') : clientSocket;
+      let sent = 0;
+      const writeMore = () => {
+        while (sent < options.totalBytes) {
+          sent += chunk.length;
+          if (!clientStream.write(chunk)) {
+            clientStream.once('drain', writeMore);
+            return;
+          }
+        }
+
+        clientStream.end();
+      };
+
+      begin = process.hrtime();
+      writeMore();
+    });
+  });
+}
+
+// Signature of cb is:
+//  cb(err, results)
+function runBenchmark(options, cb) {
+  options = {
+    totalBytes: options.totalBytes || 256 * 1024 * 1024,
+    frameSizes: options.frameSizes || [ 4096, 16384, 65536 ],
+    chunkSize: options.chunkSize || 64 * 1024
+  };
+
+  if (SspiClientApi.getProviderName() !== 'mock') {
+    cb(new Error('Needs the mock provider, set SSPI_CLIENT_PROVIDER=mock.'));
+    return;
+  }
+
+  const modes = [ { name: 'plain', frameSize: 0 } ];
+  options.frameSizes.forEach((frameSize) => modes.push({ name: 'sealed-' + frameSize, frameSize: frameSize }));
+
+  const results = [];
+  const runMode = (index) => {
+    if (index === modes.length) {
+      cb(null, results);
+      return;
+    }
+
+    const mode = modes[index];
+    const transfer = (wrap) => runTransfer(mode.name, wrap, options, (err, result) => {
+      if (err) {
+        cb(err);
+        return;
+      }
+
+      result.frameSize = mode.frameSize;
+      results.push(result);
+      runMode(index + 1);
+    });
+
+    if (mode.frameSize === 0) {
+      transfer(null);
+      return;
+    }
+
+    // A fresh pair of contexts for each mode, as each transfer uses up
+    // sequence numbers.
+    Loopback.runHandshake(spn, 'kerberos', (err, pair) => {
+      if (err) {
+        cb(err);
+        return;
+      }
+
+      transfer((socket, side) => new SealedChannel(
+        side === 'client' ? pair.sspiClient : pair.sspiServer,
+        socket,
+        { maxFrameSize: mode.frameSize }));
+    });
+  };
+
+  runMode(0);
+}
+
+module.exports.runBenchmark = runBenchmark;
+
+if (require.main === module) {
+  const options = {
+    totalBytes: parseInt(process.argv[2] || '268435456', 10),
+    frameSizes: process.argv[3] ? process.argv[3].split(',').map((value) => parseInt(value, 10)) : undefined,
+    chunkSize: parseInt(process.argv[4] || '65536', 10)
+  };
+
+  runBenchmark(options, (err, results) => {
+    if (err) {
+      console.log('Benchmark failed: ', err.message);
+      process.exitCode = 1;
+      return;
+    }
+
+    results.forEach((result) => console.log(JSON.stringify(result)));
+  });
+}
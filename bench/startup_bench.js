@@ -0,0 +1,115 @@
+'use strict';
+
+// Time from require to the first token, in fresh processes since the addon
+// and package enumeration are only loaded once per process. Each run reports
+// the time to require the package, to load the addon on first use and to get
+// the first token of a client, all measured from before the require.
+//
+// Usage: node bench/startup_bench.js [runs] [securityPackage]
+//
+// With the mock provider (SSPI_CLIENT_PROVIDER=mock) this measures the
+// package itself, with a real provider it includes the provider's own
+// startup.
+
+const childProcess = require('child_process');
+const path = require('path');
+
+const spn = 'MSSQLSvc/localhost:1433';
+
+function elapsedMs(begin) {
+  const diff = process.hrtime(begin);
+  return diff[0] * 1e3 + diff[1] / 1e6;
+}
+
+// Runs in the child process, prints one JSON line with its timings.
+function runChild(securityPackage) {
+  const begin = process.hrtime();
+  const index = require('../src_js/index.js');
+  const requireMs = elapsedMs(begin);
+
+  const SspiClientApi = index.SspiClientApi;
+  const providerName = SspiClientApi.getProviderName();
+  const addonLoadedMs = elapsedMs(begin);
+
+  const sspiClient = securityPackage
+    ? new SspiClientApi.SspiClient(spn, securityPackage)
+    : new SspiClientApi.SspiClient(spn);
+  sspiClient.getNextBlob(null, 0, 0, (clientResponse, isDone, errorCode, errorString) => {
+    const firstTokenMs = elapsedMs(begin);
+    console.log(JSON.stringify({
+      providerName: providerName,
+      requireMs: requireMs,
+      addonLoadedMs: addonLoadedMs,
+      firstTokenMs: firstTokenMs,
+      errorCode: errorCode,
+      errorString: errorString
+    }));
+  });
+}
+
+function percentile(sorted, fraction) {
+  return sorted[Math.min(sorted.length - 1, Math.floor(sorted.length * fraction))];
+}
+
+function summarize(values) {
+  const sorted = values.slice().sort((a, b) => a - b);
+  const round = (value) => Math.round(value * 1000) / 1000;
+  return {
+    minMs: round(sorted[0]),
+    p50Ms: round(percentile(sorted, 0.5)),
+    maxMs: round(sorted[sorted.length - 1])
+  };
+}
+
+// Signature of cb is:
+//  cb(err, result)
+function runBenchmark(options, cb) {
+  const runs = [];
+  for (let i = 0; i < options.runs; i++) {
+    const output = childProcess.execFileSync(
+      process.execPath,
+      [ __filename, '--child', options.securityPackage || '' ],
+      { cwd: path.join(__dirname, '..'), env: process.env, encoding: 'utf8' });
+
+    const run = JSON.parse(output);
+    if (run.errorCode !== 0) {
+      cb(new Error(run.errorString));
+      return;
+    }
+
+    runs.push(run);
+  }
+
+  cb(null, {
+    name: 'startup',
+    providerName: runs[0].providerName,
+    securityPackage: options.securityPackage || 'default',
+    runs: options.runs,
+    require: summarize(runs.map((run) => run.requireMs)),
+    addonLoaded: summarize(runs.map((run) => run.addonLoadedMs)),
+    firstToken: summarize(runs.map((run) => run.firstTokenMs))
+  });
+}
+
+module.exports.runBenchmark = runBenchmark;
+
+if (require.main === module) {
+  if (process.argv[2] === '--child') {
+    runChild(process.argv[3]);
+  } else {
+    const options = {
+      runs: parseInt(process.argv[2] || '20', 10),
+      securityPackage: process.argv[3]
+    };
+
+    runBenchmark(options, (err, result) => {
+      if (err) {
+        console.log('Benchmark failed: ', err.message);
+        process.exitCode = 1;
+        return;
+      }
+
+      console.log(JSON.stringify(result));
+    });
+  }
+}
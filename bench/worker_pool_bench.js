@@ -0,0 +1,134 @@
+'use strict';
+
+// Shows SSPI calls blocked on a slow KDC holding up fs work when they share
+// the libuv thread pool, and not when they run on the module's own worker
+// pool. The mock provider simulates the slow KDC, so run with
+// SSPI_CLIENT_PROVIDER=mock.
+//
+// Usage: node bench/worker_pool_bench.js [handshakes] [latencyMs] [fsOps]
+//
+// Each mode starts handshakes concurrent handshakes, with every context call
+// taking latencyMs, then times fsOps sequential fs.stat calls while they run.
+
+const fs = require('fs');
+
+const SspiClientApi = require('../src_js/index.js').SspiClientApi;
+const HandshakeBench = require('./handshake_bench.js');
+const Loopback = require('../test/utils/loopback.js');
+
+function timeFsOps(count, cb) {
+  const latenciesMs = [];
+  const begin = process.hrtime();
+
+  const next = () => {
+    if (latenciesMs.length === count) {
+      const total = process.hrtime(begin);
+      cb(HandshakeBench.summarize('fs.stat', latenciesMs, total[0] * 1e3 + total[1] / 1e6));
+      return;
+    }
+
+    const opBegin = process.hrtime();
+    fs.stat(__filename, () => {
+      const diff = process.hrtime(opBegin);
+      latenciesMs.push(diff[0] * 1e3 + diff[1] / 1e6);
+      next();
+    });
+  };
+
+  next();
+}
+
+function runMode(name, workerPoolSize, options, cb) {
+  SspiClientApi.configureWorkerPool({ size: workerPoolSize });
+  SspiClientApi.utResetWorkerPoolStats();
+
+  let handshakeResult = null;
+  let fsResult = null;
+  const done = () => {
+    if (handshakeResult && fsResult) {
+      cb(null, {
+        name: name,
+        handshakeP50Ms: handshakeResult.p50Ms,
+        fsStatP50Ms: fsResult.p50Ms,
+        fsStatP99Ms: fsResult.p99Ms,
+        fsStatMaxMs: fsResult.maxMs,
+        workerPool: SspiClientApi.getWorkerPoolStats()
+      });
+    }
+  };
+
+  const handshakeOp = (opCb) => Loopback.runHandshake(options.spn, 'kerberos', opCb);
+  HandshakeBench.runConcurrent(name, options.handshakes, options.handshakes, handshakeOp, (err, result) => {
+    if (err) {
+      cb(err);
+      return;
+    }
+
+    handshakeResult = result;
+    done();
+  });
+
+  // Let the handshakes take the threads first.
+  setTimeout(() => {
+    timeFsOps(options.fsOps, (result) => {
+      fsResult = result;
+      done();
+    });
+  }, 10);
+}
+
+// Signature of cb is:
+//  cb(err, results)
+function runBenchmark(options, cb) {
+  options = {
+    handshakes: options.handshakes || 16,
+    latencyMs: options.latencyMs || 50,
+    fsOps: options.fsOps || 20,
+    spn: options.spn || 'MSSQLSvc/localhost:1433'
+  };
+
+  if (SspiClientApi.getProviderName() !== 'mock') {
+    cb(new Error('Needs the mock provider, set SSPI_CLIENT_PROVIDER=mock.'));
+    return;
+  }
+
+  SspiClientApi.ensureInitialization((errorCode, errorString) => {
+    if (errorCode !== 0) {
+      cb(new Error(errorString));
+      return;
+    }
+
+    SspiClientApi.utSetMockLatency(options.latencyMs);
+    runMode('libuv-pool', 0, options, (err, libuvResult) => {
+      if (err) {
+        cb(err);
+        return;
+      }
+
+      runMode('dedicated-pool', options.handshakes, options, (err, dedicatedResult) => {
+        SspiClientApi.utSetMockLatency(0);
+        cb(err, [libuvResult, dedicatedResult]);
+      });
+    });
+  });
+}
+
+module.exports.runBenchmark = runBenchmark;
+
+if (require.main === module) {
+  const options = {
+    handshakes: parseInt(process.argv[2] || '16', 10),
+    latencyMs: parseInt(process.argv[3] || '50', 10),
+    fsOps: parseInt(process.argv[4] || '20', 10)
+  };
+
+  runBenchmark(options, (err, results) => {
+    if (err) {
+      console.log('Benchmark failed: ', err.message);
+      process.exitCode = 1;
+      return;
+    }
+
+    results.forEach((result) => console.log(JSON.stringify(result)));
+  });
+}
@@ -1,24 +1,117 @@
 {
+  "variables": {
+    # 1 also builds the benchmarks and test tools, e.g.
+    # node-gyp rebuild -- -Dbuild_dev_tools=1
+    "build_dev_tools%": 0,
+    "core_sources": [
+      "src_native/utils.cpp",
+      "src_native/sspi_impl.cpp",
+      "src_native/sspi_server_impl.cpp",
+      "src_native/sspi_provider.cpp",
+      "src_native/mock_sspi_provider.cpp",
+      "src_native/credential_cache.cpp",
+      "src_native/token_buffer_pool.cpp",
+      "src_native/worker_pool.cpp",
+      "src_native/first_leg_pool.cpp",
+      "src_native/spn_resolver.cpp",
+      "src_native/trace.cpp",
+      "src_native/latency_stats.cpp",
+      "src_native/message_batch.cpp",
+      "src_native/expiry_refresher.cpp",
+      "src_native/handshake_admission.cpp",
+      "src_native/task_scheduler.cpp",
+      "src_native/transcript.cpp",
+      "src_native/replay_sspi_provider.cpp"
+    ]
+  },
+  "target_defaults": {
+    "include_dirs": [
+      "<!(node -e \"require('nan')\")"
+    ],
+    "conditions": [
+      [
+        "OS==\"win\"",
+        {
+          "sources": [
+            "src_native/windows_sspi_provider.cpp"
+          ]
+        }
+      ],
+      [
+        "OS==\"linux\"",
+        {
+          "sources": [
+            "src_native/gssapi_sspi_provider.cpp"
+          ],
+          "defines": [
+            "SSPI_CLIENT_HAVE_GSSAPI"
+          ],
+          "libraries": [
+            "-lgssapi_krb5"
+          ]
+        }
+      ]
+    ]
+  },
   "targets": [
     {
       "target_name": "sspi-client",
       "sources": [
-      ],
-      "include_dirs": [
-        "<!(node -e \"require('nan')\")"
-      ],
-      "conditions": [
-        [
-          "OS==\"win\"",
+        "src_native/sspi_client.cpp",
+        "<@(core_sources)"
+      ]
+    }
+  ],
+  "conditions": [
+    [
+      "build_dev_tools==1",
+      {
+        "targets": [
+          {
+            "target_name": "sspi-client-bench",
+            "type": "executable",
+            "win_delay_load_hook": "false",
+            "include_dirs": [
+              "src_native"
+            ],
+            "sources": [
+              "bench/native_bench.cpp",
+              "<@(core_sources)"
+            ]
+          },
           {
+            "target_name": "sspi-client-scheduler-sim",
+            "type": "executable",
+            "win_delay_load_hook": "false",
+            "include_dirs": [
+              "src_native"
+            ],
             "sources": [
-              "src_native/sspi_client.cpp",
-              "src_native/utils.cpp",
-              "src_native/sspi_impl.cpp"
+              "bench/scheduler_sim.cpp",
+              "<@(core_sources)"
             ]
           }
         ]
-      ]
-    }
+      }
+    ],
+    [
+      "OS==\"linux\" and build_dev_tools==1",
+      {
+        "targets": [
+          {
+            "target_name": "sspi-test-server",
+            "type": "executable",
+            "include_dirs": [
+              "src_native",
+              "test/sspi_test_server"
+            ],
+            "sources": [
+              "test/sspi_test_server/epoll_test_server.cpp",
+              "<@(core_sources)"
+            ]
+          }
+        ]
+      }
+    ]
   ]
 }
@@ -3,6 +3,7 @@
 const dns = require('dns');
 const net = require('net');
 const os = require('os');
+const platform = require('./platform');
 
 const localhostIdentifier = 'localhost';
 
@@ -50,9 +51,7 @@ function getFqdnForHostname(hostname, cb) {
 // Signature of cb is:
 //  cb(err, fqdn)
 function getFqdn(hostidentifier, cb) {
-  if (os.type() !== 'Windows_NT') {
-    throw new Error('Package currently not-supported on non-Windows platforms.');
-  }
+  platform.throwIfNotSupported();
 
   if (net.isIP(hostidentifier)) {
     getFqdnForIpAddress(hostidentifier, cb);
@@ -1,6 +1,23 @@
 'use strict';
 
-var os = require('os');
+var platform = require('./platform');
+
+// Exported modules are required on first access, and the native addon is
+// loaded on first use, so requiring the package is cheap for applications
+// that may never authenticate.
+function defineLazyExport(name, load) {
+  var value;
+  Object.defineProperty(module.exports, name, {
+    enumerable: true,
+    get: function () {
+      if (value === undefined) {
+        value = load();
+      }
+
+      return value;
+    }
+  });
+}
 
 // require and export only for platforms where the module is supported.
 // Individual module require'ed use features of node.js that would trigger
@@ -8,10 +25,14 @@ var os = require('os');
 // in applications like Tedious which supports older version of node.js, even
 // if the functionality itself won't be available. The application can decide
 // what to do if the module is not supported on the platform where it's running.
-if (require('semver').gte(process.version, '4.0.0') && os.type() === 'Windows_NT') {
+if (parseInt(process.versions.node.split('.')[0], 10) >= 4 && platform.isSupported()) {
   module.exports.ModuleSupported = true;
 
-  module.exports.SspiClientApi = require('./sspi_client');
-  module.exports.Fqdn = require('./fqdn');
-  module.exports.MakeSpn = require('./make_spn');
+  defineLazyExport('SspiClientApi', function () { return require('./sspi_client'); });
+  defineLazyExport('SspiServerApi', function () { return require('./sspi_server'); });
+  defineLazyExport('SealedChannel', function () { return require('./sealed_channel').SealedChannel; });
+  defineLazyExport('Fqdn', function () { return require('./fqdn'); });
+  defineLazyExport('MakeSpn', function () { return require('./make_spn'); });
+  defineLazyExport('SpnResolver', function () { return require('./spn_resolver'); });
+  defineLazyExport('Transcript', function () { return require('./transcript'); });
 }
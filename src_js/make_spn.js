@@ -1,11 +1,9 @@
 'use strict';
 
-const os = require('os');
+const platform = require('./platform');
 
 function makeSpn(serviceClassname, fqdn, instanceNameOrPort) {
-  if (os.type() !== 'Windows_NT') {
-    throw new Error('Package currently not-supported on non-Windows platforms.');
-  }
+  platform.throwIfNotSupported();
 
   return serviceClassname + '/' + fqdn + ':' + instanceNameOrPort;
 }
@@ -0,0 +1,77 @@
+'use strict';
+
+// Message protection shared by SspiClient and SspiServer, on top of the
+// processMessages and getMessageSizes native methods of both.
+
+// Same values as MessageOperation in the native layer.
+const c_operationSign = 0;
+const c_operationVerify = 1;
+const c_operationEncrypt = 2;
+const c_operationDecrypt = 3;
+
+// Checks messages and flattens them into the arrays processMessages takes:
+// a token per message, the data segments of all messages in order and the
+// number of segments per message. Buffers are not copied.
+function flattenMessages(messages) {
+  if (!Array.isArray(messages)) {
+    throw new TypeError('Invalid argument type for \'messages\'.');
+  }
+
+  const tokens = new Array(messages.length);
+  const segments = [];
+  const segmentCounts = new Array(messages.length);
+  messages.forEach((message, i) => {
+    if (typeof (message) !== 'object' || message === null || !(message.token instanceof Buffer)) {
+      throw new TypeError('Invalid argument type for \'messages[' + i + '].token\'.');
+    }
+
+    const data = Array.isArray(message.data) ? message.data : [ message.data ];
+    data.forEach((segment) => {
+      if (!(segment instanceof Buffer)) {
+        throw new TypeError('Invalid argument type for \'messages[' + i + '].data\'.');
+      }
+
+      segments.push(segment);
+    });
+
+    tokens[i] = message.token;
+    segmentCounts[i] = data.length;
+  });
+
+  return { tokens: tokens, segments: segments, segmentCounts: segmentCounts };
+}
+
+// Runs operation on messages with nativeImpl, scheduled with the tenant and
+// deadlineMs of scheduling, see SspiClient.sign and the other message methods
+// for the arguments. scheduling and cb are checked by the caller.
+function processMessages(nativeImpl, operation, messages, scheduling, cb) {
+  const flattened = flattenMessages(messages);
+  if (messages.length === 0) {
+    setImmediate(cb, [], 0, '');
+    return;
+  }
+
+  nativeImpl.processMessages(operation, flattened.tokens, flattened.segments, flattened.segmentCounts,
+    scheduling.tenant, scheduling.deadlineMs, cb);
+}
+
+// Throws if the context is not established.
+function getMessageSizes(nativeImpl) {
+  const result = nativeImpl.getMessageSizes();
+  if (result.errorCode !== 0) {
+    throw new Error(result.errorString);
+  }
+
+  return {
+    maxSignature: result.maxSignature,
+    securityTrailer: result.securityTrailer,
+    blockSize: result.blockSize
+  };
+}
+
+module.exports.c_operationSign = c_operationSign;
+module.exports.c_operationVerify = c_operationVerify;
+module.exports.c_operationEncrypt = c_operationEncrypt;
+module.exports.c_operationDecrypt = c_operationDecrypt;
+module.exports.processMessages = processMessages;
+module.exports.getMessageSizes = getMessageSizes;
@@ -0,0 +1,40 @@
+'use strict';
+
+const platform = require('./platform');
+
+// The native binding, loaded on first use rather than on require, so an
+// application that pulls in the package but never authenticates doesn't pay
+// for loading the addon. Undefined on platforms where the module is not
+// supported.
+let sspiClientNative = null;
+
+// Loads the native binding once and selects the SSPI provider requested
+// through the environment, and the transcripts it replays if any, before
+// anything runs on it.
+function get() {
+  if (sspiClientNative === null) {
+    if (!platform.isSupported()) {
+      sspiClientNative = undefined;
+      return sspiClientNative;
+    }
+
+    const binding = require('bindings')('sspi-client');
+    if (platform.requestedProviderName !== undefined
+      && !binding.setProvider(platform.requestedProviderName)) {
+      throw new Error('Unknown SSPI provider \'' + platform.requestedProviderName + '\'.');
+    }
+
+    if (platform.requestedProviderName === 'replay' && platform.replayFile !== undefined) {
+      const errorString = binding.loadReplayTranscripts(platform.replayFile, false);
+      if (errorString !== '') {
+        throw new Error(errorString);
+      }
+    }
+
+    sspiClientNative = binding;
+  }
+
+  return sspiClientNative;
+}
+
+module.exports.get = get;
@@ -0,0 +1,33 @@
+'use strict';
+
+const os = require('os');
+
+// Name of the SSPI provider requested through the environment, if any. The
+// native module uses the platform provider when this is not set.
+//  - 'windows': Windows SSPI, the default on Windows.
+//  - 'gssapi': GSSAPI (MIT krb5), the default on Linux.
+//  - 'mock': Deterministic in-process provider, runs anywhere. Meant for
+//            testing and benchmarking without a domain.
+//  - 'replay': Serves handshakes recorded with startTranscriptRecording,
+//              runs anywhere. Transcripts are loaded from
+//              SSPI_CLIENT_REPLAY_FILE if set.
+const requestedProviderName = process.env.SSPI_CLIENT_PROVIDER;
+const replayFile = process.env.SSPI_CLIENT_REPLAY_FILE;
+
+function isSupported() {
+  return os.type() === 'Windows_NT'
+    || os.type() === 'Linux'
+    || requestedProviderName === 'mock'
+    || requestedProviderName === 'replay';
+}
+
+function throwIfNotSupported() {
+  if (!isSupported()) {
+    throw new Error('Package currently not-supported on platforms other than Windows and Linux.');
+  }
+}
+
+module.exports.requestedProviderName = requestedProviderName;
+module.exports.replayFile = replayFile;
+module.exports.isSupported = isSupported;
+module.exports.throwIfNotSupported = throwIfNotSupported;
@@ -0,0 +1,39 @@
+'use strict';
+
+// Options shared by the calls that queue work on the native worker pool, see
+// configureScheduler:
+//   tenant - Whose share of the worker pool the work counts against.
+//   deadlineMs - Milliseconds from now the work should start by, 0 for the
+//                configured deadline.
+
+// Shared with the validation of the other numeric options.
+function isNonNegativeInteger(val) {
+  return typeof (val) === 'number'
+      && Math.floor(val) === val
+      && val >= 0;
+}
+
+// Returns { tenant, deadlineMs } from options, undefined or an object, with
+// the defaults filled in. name is what options is called in error messages.
+function getScheduling(options, name, defaultTenant, defaultDeadlineMs) {
+  if (options !== undefined && (typeof (options) !== 'object' || options === null)) {
+    throw new TypeError('Invalid argument type for \'' + name + '\'.');
+  }
+
+  const deadlineMs = options === undefined || options.deadlineMs === undefined
+    ? defaultDeadlineMs
+    : options.deadlineMs;
+  if (!isNonNegativeInteger(deadlineMs)) {
+    throw new TypeError('\'' + name + '.deadlineMs\' must be a non-negative integer.');
+  }
+
+  const tenant = options === undefined || options.tenant === undefined ? defaultTenant : options.tenant;
+  if (typeof (tenant) !== 'string') {
+    throw new TypeError('Invalid argument type for \'' + name + '.tenant\'.');
+  }
+
+  return { tenant: tenant, deadlineMs: deadlineMs };
+}
+
+module.exports.isNonNegativeInteger = isNonNegativeInteger;
+module.exports.getScheduling = getScheduling;
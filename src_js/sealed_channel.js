@@ -0,0 +1,371 @@
+'use strict';
+
+const Duplex = require('stream').Duplex;
+
+// Each frame on the wire is a header of token length and data length, both
+// 32 bit big endian, followed by the security trailer and the sealed data.
+const c_frameHeaderSize = 8;
+
+const c_defaultMaxFrameSize = 16 * 1024;
+const c_defaultMaxBatchBytes = 256 * 1024;
+const c_defaultMaxBatchFrames = 64;
+const c_defaultMaxInFlightBytes = 1024 * 1024;
+
+// Batch buffers kept for reuse once the socket has flushed them.
+const c_maxFreeBatchBuffers = 4;
+
+function makeError(errorCode, errorString) {
+  const err = new Error(errorString);
+  err.errorCode = errorCode;
+  return err;
+}
+
+// Plaintext stream over an established context and a socket, e.g. a
+// net.Socket the handshake ran on. Data written is framed, encrypted and
+// written to the socket, frames read from the socket are decrypted and
+// pushed as data to read. Both ends of a connection need a SealedChannel.
+//
+// Writes are copied into reused batch buffers, many frames per buffer, and
+// each batch is encrypted in a single native call on a worker thread while
+// the next one fills up and the previous one is written out. Received frames
+// are decrypted in place, also in batches, and pushed without copying. Calls
+// on the context are serialized, so frames are sealed and unsealed strictly
+// in order, as the sequence numbers of the context require. The context must
+// not be used for anything else while the channel is open.
+//
+// context - SspiClient or SspiServer, done with the handshake.
+// socket - Duplex stream to the peer, the channel reads and ends it. Like
+//          net.Socket, it must be done with a written buffer once it calls
+//          back the write, as the buffer is then reused.
+// options - Optional, all sizes in bytes:
+//   maxFrameSize - Maximum data per frame, 16KB by default. Must be the
+//                  same on both ends.
+//   maxBatchBytes - Maximum data per native call, 256KB by default.
+//   maxBatchFrames - Maximum frames per native call, 64 by default.
+//   maxInFlightBytes - Written data not yet flushed to the socket, and
+//                      received data not yet read, above which the channel
+//                      stops accepting more. 1MB by default.
+class SealedChannel extends Duplex {
+  constructor(context, socket, options) {
+    options = options || {};
+    super({ highWaterMark: options.maxInFlightBytes || c_defaultMaxInFlightBytes });
+
+    this.context = context;
+    this.socket = socket;
+    this.maxFrameSize = options.maxFrameSize || c_defaultMaxFrameSize;
+    this.maxBatchBytes = Math.max(options.maxBatchBytes || c_defaultMaxBatchBytes, this.maxFrameSize);
+    this.maxBatchFrames = options.maxBatchFrames || c_defaultMaxBatchFrames;
+    this.maxInFlightBytes = options.maxInFlightBytes || c_defaultMaxInFlightBytes;
+
+    // Throws if the context is not established.
+    this.securityTrailer = context.getMessageSizes().securityTrailer;
+    this.batchBufferSize = this.maxBatchBytes + this.maxBatchFrames * (c_frameHeaderSize + this.securityTrailer);
+    this.freeBatchBuffers = [];
+
+    // Send side: written chunks waiting to be sealed, and bytes written to
+    // the channel but not yet flushed by the socket.
+    this.sendChunks = [];
+    this.sendChunkOffset = 0;
+    this.sendQueuedBytes = 0;
+    this.sendInFlightBytes = 0;
+    this.pendingWriteCb = null;
+    this.finalCb = null;
+
+    // Receive side: bytes of an incomplete frame, and complete frames
+    // waiting to be unsealed.
+    this.receivePending = null;
+    this.receiveFrames = [];
+    this.receiveQueuedBytes = 0;
+    this.socketEnded = false;
+
+    this.busy = false;
+    this.unsealNext = false;
+    this.failed = false;
+
+    socket.on('data', (chunk) => this.onSocketData(chunk));
+    socket.on('end', () => {
+      this.socketEnded = true;
+      this.pump();
+    });
+    socket.on('error', (err) => this.destroyWithError(err));
+  }
+
+  _write(chunk, encoding, cb) {
+    if (chunk.length > 0) {
+      this.sendChunks.push(chunk);
+      this.sendQueuedBytes += chunk.length;
+      this.sendInFlightBytes += chunk.length;
+    }
+
+    this.pump();
+
+    // The writer may reuse chunk once called back, same rule as for the
+    // socket. Whatever the pump didn't copy into a batch buffer is copied
+    // now.
+    this.copyUnsealedChunk(chunk);
+
+    // Accept more right away unless too much is in flight, the sealing
+    // and the socket then catch up while the writer fills the next batch.
+    if (this.sendInFlightBytes < this.maxInFlightBytes) {
+      cb();
+    } else {
+      this.pendingWriteCb = cb;
+    }
+  }
+
+  // Flushes what's left, then ends the socket. Errors until then go to cb.
+  _final(cb) {
+    this.finalCb = cb;
+    this.pump();
+  }
+
+  _read() {
+    if (this.receiveQueuedBytes < this.maxInFlightBytes) {
+      this.socket.resume();
+    }
+  }
+
+  destroyWithError(err) {
+    if (this.failed) {
+      return;
+    }
+
+    this.failed = true;
+    this.socket.destroy();
+
+    // A writer waiting on a callback gets the error through it, the stream
+    // then emits it.
+    const cb = this.finalCb || this.pendingWriteCb;
+    this.finalCb = null;
+    this.pendingWriteCb = null;
+    if (cb !== null) {
+      cb(err);
+    } else {
+      this.emit('error', err);
+    }
+  }
+
+  // Runs the next native call if none is in flight. Unseal and seal take
+  // turns when both have work.
+  pump() {
+    if (this.busy || this.failed) {
+      return;
+    }
+
+    const canUnseal = this.receiveFrames.length > 0;
+    const canSeal = this.sendQueuedBytes > 0;
+    if (canUnseal && (this.unsealNext || !canSeal)) {
+      this.unsealNext = false;
+      this.unsealBatch();
+    } else if (canSeal) {
+      this.unsealNext = true;
+      this.sealBatch();
+    } else {
+      if (this.finalCb !== null && this.sendInFlightBytes === 0) {
+        const cb = this.finalCb;
+        this.finalCb = null;
+        this.socket.end();
+        cb();
+      }
+
+      if (this.socketEnded) {
+        this.socketEnded = false;
+        if (this.receivePending !== null) {
+          this.destroyWithError(new Error('Connection closed in the middle of a frame.'));
+          return;
+        }
+
+        this.push(null);
+      }
+    }
+  }
+
+  takeBatchBuffer() {
+    return this.freeBatchBuffers.pop() || Buffer.allocUnsafe(this.batchBufferSize);
+  }
+
+  // Lays frames out in a batch buffer, copying queued chunks into their data
+  // areas, and encrypts them in place.
+  sealBatch() {
+    const batchBuffer = this.takeBatchBuffer();
+    const messages = [];
+    let offset = 0;
+    let batchBytes = 0;
+    while (this.sendQueuedBytes > 0
+      && messages.length < this.maxBatchFrames
+      && batchBytes < this.maxBatchBytes) {
+      const frameDataSize = Math.min(this.sendQueuedBytes, this.maxFrameSize, this.maxBatchBytes - batchBytes);
+      const tokenOffset = offset + c_frameHeaderSize;
+      const dataOffset = tokenOffset + this.securityTrailer;
+      this.copySendData(batchBuffer, dataOffset, frameDataSize);
+      messages.push({
+        token: batchBuffer.slice(tokenOffset, dataOffset),
+        data: batchBuffer.slice(dataOffset, dataOffset + frameDataSize)
+      });
+
+      offset = dataOffset + frameDataSize;
+      batchBytes += frameDataSize;
+    }
+
+    this.busy = true;
+    this.context.encrypt(messages, (tokenLengths, errorCode, errorString) => {
+      this.busy = false;
+      if (errorCode !== 0) {
+        this.destroyWithError(makeError(errorCode, errorString));
+        return;
+      }
+
+      const length = this.writeFrameHeaders(batchBuffer, messages, tokenLengths);
+      this.socket.write(batchBuffer.slice(0, length), () => this.onBatchFlushed(batchBuffer, batchBytes));
+      this.pump();
+    });
+  }
+
+  // Replaces chunk, if still queued, by a copy of its bytes not sealed yet.
+  copyUnsealedChunk(chunk) {
+    const index = this.sendChunks.lastIndexOf(chunk);
+    if (index === -1) {
+      return;
+    }
+
+    const offset = index === 0 ? this.sendChunkOffset : 0;
+    this.sendChunks[index] = Buffer.from(chunk.slice(offset));
+    if (index === 0) {
+      this.sendChunkOffset = 0;
+    }
+  }
+
+  copySendData(target, targetOffset, length) {
+    while (length > 0) {
+      const chunk = this.sendChunks[0];
+      const copied = chunk.copy(target, targetOffset, this.sendChunkOffset,
+        Math.min(chunk.length, this.sendChunkOffset + length));
+      targetOffset += copied;
+      length -= copied;
+      this.sendQueuedBytes -= copied;
+      this.sendChunkOffset += copied;
+      if (this.sendChunkOffset === chunk.length) {
+        this.sendChunks.shift();
+        this.sendChunkOffset = 0;
+      }
+    }
+  }
+
+  // Fills in the header of each frame. Where a trailer came out shorter
+  // than securityTrailer, the rest of the batch, trailers and data of the
+  // later frames, moves down to close the gap. Frames only ever move down,
+  // so a header never lands on bytes of its frame that still have to move.
+  // Returns the length of the batch.
+  writeFrameHeaders(batchBuffer, messages, tokenLengths) {
+    let offset = 0;
+    messages.forEach((message, i) => {
+      const tokenLength = tokenLengths[i];
+      batchBuffer.writeUInt32BE(tokenLength, offset);
+      batchBuffer.writeUInt32BE(message.data.length, offset + 4);
+      offset += c_frameHeaderSize;
+
+      const tokenOffset = message.token.byteOffset - batchBuffer.byteOffset;
+      if (tokenOffset > offset) {
+        batchBuffer.copy(batchBuffer, offset, tokenOffset, tokenOffset + tokenLength);
+      }
+
+      offset += tokenLength;
+
+      const dataOffset = message.data.byteOffset - batchBuffer.byteOffset;
+      if (dataOffset > offset) {
+        batchBuffer.copy(batchBuffer, offset, dataOffset, dataOffset + message.data.length);
+      }
+
+      offset += message.data.length;
+    });
+
+    return offset;
+  }
+
+  onBatchFlushed(batchBuffer, batchBytes) {
+    if (this.freeBatchBuffers.length < c_maxFreeBatchBuffers) {
+      this.freeBatchBuffers.push(batchBuffer);
+    }
+
+    this.sendInFlightBytes -= batchBytes;
+    if (this.pendingWriteCb !== null && this.sendInFlightBytes < this.maxInFlightBytes) {
+      const cb = this.pendingWriteCb;
+      this.pendingWriteCb = null;
+      cb();
+    }
+
+    this.pump();
+  }
+
+  // Splits received bytes into frames. Frames within a chunk are referenced
+  // in place, only a frame split across chunks is copied.
+  onSocketData(chunk) {
+    if (this.receivePending !== null) {
+      chunk = Buffer.concat([ this.receivePending, chunk ]);
+      this.receivePending = null;
+    }
+
+    let offset = 0;
+    while (chunk.length - offset >= c_frameHeaderSize) {
+      const tokenLength = chunk.readUInt32BE(offset);
+      const dataLength = chunk.readUInt32BE(offset + 4);
+      if (tokenLength > this.securityTrailer || dataLength > this.maxFrameSize) {
+        this.destroyWithError(new Error('Invalid frame header.'));
+        return;
+      }
+
+      const frameEnd = offset + c_frameHeaderSize + tokenLength + dataLength;
+      if (frameEnd > chunk.length) {
+        break;
+      }
+
+      const tokenOffset = offset + c_frameHeaderSize;
+      this.receiveFrames.push({
+        token: chunk.slice(tokenOffset, tokenOffset + tokenLength),
+        data: chunk.slice(tokenOffset + tokenLength, frameEnd)
+      });
+      this.receiveQueuedBytes += dataLength;
+      offset = frameEnd;
+    }
+
+    if (offset < chunk.length) {
+      this.receivePending = chunk.slice(offset);
+    }
+
+    if (this.receiveQueuedBytes >= this.maxInFlightBytes) {
+      this.socket.pause();
+    }
+
+    this.pump();
+  }
+
+  unsealBatch() {
+    const messages = this.receiveFrames.splice(0, this.maxBatchFrames);
+    this.busy = true;
+    this.context.decrypt(messages, (tokenLengths, errorCode, errorString) => {
+      this.busy = false;
+      if (errorCode !== 0) {
+        this.destroyWithError(makeError(errorCode, errorString));
+        return;
+      }
+
+      let wantsMore = true;
+      messages.forEach((message) => {
+        this.receiveQueuedBytes -= message.data.length;
+        if (message.data.length > 0) {
+          wantsMore = this.push(message.data);
+        }
+      });
+
+      if (!wantsMore) {
+        this.socket.pause();
+      } else if (this.receiveQueuedBytes < this.maxInFlightBytes) {
+        this.socket.resume();
+      }
+
+      this.pump();
+    });
+  }
+}
+
+module.exports.SealedChannel = SealedChannel;
@@ -0,0 +1,177 @@
+'use strict';
+
+const net = require('net');
+const os = require('os');
+const makeSpn = require('./make_spn').makeSpn;
+const platform = require('./platform');
+const native = require('./native');
+const Scheduling = require('./scheduling');
+
+const isNonNegativeInteger = Scheduling.isNonNegativeInteger;
+
+const localhostIdentifier = 'localhost';
+
+function makeResolveError(code, host) {
+  const err = new Error('resolveSpn ' + code + ' ' + host);
+  err.code = code;
+  err.hostname = host;
+  return err;
+}
+
+// Resolves host, an IP address or a hostname, to an FQDN through the native
+// cache. Hits complete on the next turn of the event loop without a trip to
+// a worker thread, misses are looked up with the tenant and deadlineMs of
+// scheduling.
+function resolveFqdn(host, scheduling, cb) {
+  const onResolved = (errorCode, fqdn) => {
+    if (errorCode) {
+      cb(makeResolveError(errorCode, host));
+    } else if (fqdn.toLowerCase() === localhostIdentifier && host !== os.hostname()) {
+      // Loopback addresses reverse to localhost, the SPN is registered for
+      // the machine name.
+      resolveFqdn(os.hostname(), scheduling, cb);
+    } else {
+      cb(null, fqdn);
+    }
+  };
+
+  const cached = native.get().getCachedFqdn(host);
+  if (cached !== undefined) {
+    setImmediate(onResolved, cached.errorCode, cached.fqdn);
+  } else {
+    native.get().resolveFqdn(host, scheduling.tenant, scheduling.deadlineMs, onResolved);
+  }
+}
+
+// Resolves host to an FQDN and puts together the Service Principal Name, like
+// Fqdn.getFqdn followed by MakeSpn.makeSpn. Resolutions are cached natively,
+// failures for a shorter time, and concurrent resolutions of the same host
+// share one lookup. A host with several addresses has them all reverse
+// resolved at once, the first FQDN found wins.
+//
+// serviceClassname - Service class, e.g. 'MSSQLSvc'.
+// host - IP address, hostname, localhost or FQDN.
+// instanceNameOrPort - Instance name or port number.
+// options - Optional object with deadlineMs and tenant for the lookup, same
+//           as for SspiClient.getNextBlob. deadlineMs defaults to the
+//           configured deadline, tenant to host.
+//
+// Signature of cb is:
+//  cb(err, spn)
+// err has the code, e.g. 'ENOTFOUND', and hostname properties dns errors have.
+function resolveSpn(serviceClassname, host, instanceNameOrPort, options, cb) {
+  platform.throwIfNotSupported();
+
+  if (arguments.length === 4) {
+    cb = options;
+    options = undefined;
+  } else if (arguments.length !== 5) {
+    throw new Error('Invalid number of arguments.');
+  }
+
+  if (typeof (serviceClassname) !== 'string') {
+    throw new TypeError('Invalid argument type for \'serviceClassname\'.');
+  }
+
+  if (typeof (host) !== 'string') {
+    throw new TypeError('Invalid argument type for \'host\'.');
+  }
+
+  if (host === '') {
+    throw new RangeError('Empty string argument for \'host\'.');
+  }
+
+  if (typeof (instanceNameOrPort) !== 'string' && typeof (instanceNameOrPort) !== 'number') {
+    throw new TypeError('Invalid argument type for \'instanceNameOrPort\'.');
+  }
+
+  const scheduling = Scheduling.getScheduling(options, 'options', host, 0);
+
+  if (typeof (cb) !== 'function') {
+    throw new TypeError('Invalid argument type for \'cb\'.');
+  }
+
+  const onResolved = (err, fqdn) => {
+    if (err) {
+      cb(err);
+    } else {
+      cb(null, makeSpn(serviceClassname, fqdn, instanceNameOrPort));
+    }
+  };
+
+  if (net.isIP(host)) {
+    resolveFqdn(host, scheduling, onResolved);
+  } else if (host.toLowerCase() === localhostIdentifier) {
+    resolveFqdn(os.hostname(), scheduling, onResolved);
+  } else if (host.indexOf('.') === -1) {
+    resolveFqdn(host, scheduling, onResolved);
+  } else {
+    // host is an FQDN, nothing to resolve.
+    setImmediate(onResolved, null, host);
+  }
+}
+
+// options - Object with:
+//   ttlMs - Optional, how long resolved FQDNs are cached. Defaults to 5
+//           minutes. 0 disables caching, concurrent resolutions of the same
+//           host still share one lookup.
+//   negativeTtlMs - Optional, how long failures are cached. Defaults to 10
+//                   seconds.
+function configureSpnResolver(options) {
+  if (arguments.length !== 1) {
+    throw new Error('Invalid number of arguments.');
+  }
+
+  if (typeof (options) !== 'object' || options === null) {
+    throw new TypeError('Invalid argument type for \'options\'.');
+  }
+
+  if (options.ttlMs !== undefined && !isNonNegativeInteger(options.ttlMs)) {
+    throw new TypeError('\'options.ttlMs\' must be a non-negative integer.');
+  }
+
+  if (options.negativeTtlMs !== undefined && !isNonNegativeInteger(options.negativeTtlMs)) {
+    throw new TypeError('\'options.negativeTtlMs\' must be a non-negative integer.');
+  }
+
+  native.get().configureSpnResolver(
+    options.ttlMs === undefined ? -1 : options.ttlMs,
+    options.negativeTtlMs === undefined ? -1 : options.negativeTtlMs);
+}
+
+// Returns the resolver cache counters:
+//  hits, negativeHits - Resolutions answered from the cache, negativeHits
+//                       those answered with a cached failure.
+//  misses - Resolutions that had to look the host up.
+//  waits - Resolutions that joined a lookup of the same host in flight.
+//  lookups, failures - Lookups made and how many failed.
+//  totalLookupUs, maxLookupUs - Time spent in lookups.
+//  size - Hosts currently cached.
+function getSpnResolverStats() {
+  return native.get().getSpnResolverStats();
+}
+
+// Drops all cached resolutions, e.g. after a DNS change.
+function clearSpnResolverCache() {
+  native.get().clearSpnResolverCache();
+}
+
+// Methods defined below this line are for unit testing only.
+function utResetSpnResolverStats() {
+  native.get().utResetSpnResolverStats();
+}
+
+// Answers lookups from hosts, text in hosts file format, delaying each
+// forward and reverse lookup by delayMs. A first name of '-' on a line makes
+// the reverse lookup of its address fail. Empty hosts restores the system
+// resolver. Clears the cache either way.
+function utSetStubResolver(hosts, delayMs) {
+  native.get().utSetStubResolver(hosts, delayMs || 0);
+}
+
+module.exports.resolveSpn = resolveSpn;
+module.exports.configureSpnResolver = configureSpnResolver;
+module.exports.getSpnResolverStats = getSpnResolverStats;
+module.exports.clearSpnResolverCache = clearSpnResolverCache;
+module.exports.utResetSpnResolverStats = utResetSpnResolverStats;
+module.exports.utSetStubResolver = utSetStubResolver;
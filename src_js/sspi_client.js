@@ -1,19 +1,19 @@
 'use strict';
 
-const os = require('os');
+const MessageProtection = require('./message_protection');
+const platform = require('./platform');
+const native = require('./native');
+const Scheduling = require('./scheduling');
 
-let sspiClientNative;
+const isNonNegativeInteger = Scheduling.isNonNegativeInteger;
 
-if (os.type() === 'Windows_NT') {
-  sspiClientNative = require('bindings')('sspi-client');
-}
-
-// SSPI intialization code must only be invoked once. These two variables track
-// whether the intialization code is invoked, completed execution and if
+// SSPI intialization code runs once per process, the native code takes care
+// of that and calls back everyone waiting on it when it completes. These two
+// variables track whether the intialization completed execution and if
 // initialization succeeded.
-let initializeInvoked = false;
 let initializeExecutionCompleted = false;
 let initializeSucceeded = false;
+let initializePromise = null;
 
 let initializeErrorCode = 0;
 let initializeErrorString = '';
@@ -21,6 +21,18 @@ let initializeErrorString = '';
 let availableSspiPackageNames = [ 'Initialization not completed.' ];
 let defaultSspiPackageName = 'Initialization not completed.';
 
+// Error codes of getNextBlob calls failed without calling the provider, same
+// values as in handshake_admission.h.
+const errorCodes = {
+  queueFull: 0xA0090001,
+  cancelled: 0xA0090002,
+  timedOut: 0xA0090003
+};
+
+// Timeout of getNextBlob calls that don't pass one, 0 for none. See
+// configureHandshakeAdmission.
+let defaultTimeoutMs = 0;
+
 // JavaScript wrapper class on top of the native binding that implements
 // wrappers to invoke Windows SSPI calls. The native bindings will have the
 // minimal code to invoke the Windows SSPI calls. All the error checking,
@@ -35,9 +47,7 @@ class SspiClient {
   //                   If unspecified, the first supported security package
   //                   from the above list will be used.
   constructor(spn, securityPackage) {
-    if (os.type() !== 'Windows_NT') {
-      throw new Error('Package currently not-supported on non-Windows platforms.');
-    }
+    platform.throwIfNotSupported();
 
     if (arguments.length !== 1 && arguments.length != 2) {
       throw new Error('Invalid number of arguments.');
@@ -51,82 +61,95 @@ class SspiClient {
       throw new RangeError('Empty string argument for \'spn\'.');
     }
 
-    if (securityPackage !== undefined && typeof (securityPackage) !== 'string') {
-      throw new TypeError('Invalid argument type for \'securityPackage\'.');
-    }
-
-    if (securityPackage !== undefined) {
-      const negotiateLowerCase = 'negotiate';
-      const kerberosLowerCase = 'kerberos';
-      const ntlmLowerCase = 'ntlm';
-
-      const securityPackageLowerCase = securityPackage.toLowerCase();
-
-      if (securityPackageLowerCase !== negotiateLowerCase
-        && securityPackageLowerCase !== kerberosLowerCase
-        && securityPackageLowerCase !== ntlmLowerCase) {
-        throw new RangeError('\'securityPackage\' if specified must be one of \''
-          + negotiateLowerCase + '\' or \'' + kerberosLowerCase + '\' or \''
-          + ntlmLowerCase + '\'.');
-      }
-    }
+    throwIfInvalidSecurityPackage(securityPackage);
 
     if (securityPackage) {
-      this.sspiClientImpl = new sspiClientNative.SspiClient(spn, securityPackage);
+      this.sspiClientImpl = new (native.get().SspiClient)(spn, securityPackage);
       this.securityPackage = securityPackage;
     } else {
-      this.sspiClientImpl = new sspiClientNative.SspiClient(spn);
+      this.sspiClientImpl = new (native.get().SspiClient)(spn);
     }
 
+    this.spn = spn;
     this.getNextBlobInProgress = false;
+    this.messagesInProgress = false;
+
+    // getNextBlob call not called back yet, see cancel.
+    this.pendingCall = null;
+  }
+
+  // Deletes the security context so the instance can authenticate again with
+  // getNextBlob, as if newly constructed. Cheaper than a new instance: the
+  // native object, the converted SPN and the credential are reused. See also
+  // acquireClient and releaseClient.
+  reset() {
+    if (this.getNextBlobInProgress) {
+      throw new Error('Single invocation of getNextBlob per instance of SspiClient may be in flight.');
+    }
+
+    throwIfMessagesInProgress(this);
+    this.sspiClientImpl.reset();
+  }
+
+  // Returns the expiry times of what the client holds, in milliseconds since
+  // the Unix epoch, 0 if it holds none:
+  //  contextExpiryMs - The established security context. For Kerberos this
+  //                    is when the service ticket expires.
+  //  credentialExpiryMs - The credential the context was created with.
+  getExpiry() {
+    return this.sspiClientImpl.getExpiry();
   }
 
   // Gets the next SSPI blob on the client side to send to the server as
   // part of authentication negotiation.
   //
   // serverResponse - Buffer with SSPI response from the server. Null on first call.
+  //                  Read in place by native code, must not be modified until
+  //                  cb is invoked.
   // serverResponseBeginOffset - Offset within the buffer where the response begins.
   // serverResponseLength - Length of response within the buffer.
+  // options - Optional object with:
+  //   timeoutMs - Fails the call with errorCodes.timedOut if it hasn't
+  //               completed by then, see cancel. Defaults to the timeout set
+  //               with configureHandshakeAdmission.
+  //   deadlineMs - Calls waiting for a worker thread run earliest deadline
+  //                first, see configureScheduler. Defaults to timeoutMs if
+  //                there's one, else to the configured deadline.
+  //   tenant - String, worker threads are shared fairly between tenants.
+  //            Defaults to the SPN.
   //
   // Signature of cb is:
   //  cb(clientResponse, isDone, errorCode, errorString)
   //      clientResponse - Buffer to send to the server.
   //      isDone - boolean that specifies if the negotiation is done.
   //      errorCode - number representing an error code from Windows API.
-  //                  0 is success, non-zer failure.
+  //                  0 is success, non-zer failure. errorCodes.queueFull if
+  //                  too many calls are queued, see
+  //                  configureHandshakeAdmission.
   //      errorString - string error details.
-  getNextBlob(serverResponse, serverResponseBeginOffset, serverResponseLength, cb) {
-    function isNonZeroInteger(val) {
-      return typeof (val) === 'number'
-          && Math.floor(val) === val
-          && val >= 0;
-    }
-
-    if (arguments.length !== 4) {
+  getNextBlob(serverResponse, serverResponseBeginOffset, serverResponseLength, options, cb) {
+    if (arguments.length === 4) {
+      cb = options;
+      options = undefined;
+    } else if (arguments.length !== 5) {
       throw new Error('Invalid number of arguments.');
     }
 
-    if (!isNonZeroInteger(serverResponseLength)) {
-      throw new Error('\'serverResponseLength\' must be a non-negative integer.');
-    }
-
-    if (serverResponseLength > 0) {
-      if (!(serverResponse instanceof Buffer)) {
-        throw new TypeError('Invalid argument type for \'serverResponse\'.');
-      }
+    throwIfInvalidServerResponse(serverResponse, serverResponseBeginOffset, serverResponseLength);
 
-      if (!isNonZeroInteger(serverResponseBeginOffset)) {
-        throw new Error('\'serverResponseBeginOffset\' must be a non-negative integer.');
-      }
+    if (options !== undefined && (typeof (options) !== 'object' || options === null)) {
+      throw new TypeError('Invalid argument type for \'options\'.');
+    }
 
-      if (serverResponseLength > (serverResponse.length - serverResponseBeginOffset)) {
-        throw new RangeError('\'serverResponse\' buffer too small. '
-          + '\'serverResponse\' buffer size=' + serverResponse.length
-          + ', \'serverResponseBeginOffset\'=' + serverResponseBeginOffset
-          + ', \'serverResponseLength\'=' + serverResponseLength);
-      }
+    const timeoutMs = options === undefined || options.timeoutMs === undefined
+      ? defaultTimeoutMs
+      : options.timeoutMs;
+    if (!isNonNegativeInteger(timeoutMs)) {
+      throw new TypeError('\'options.timeoutMs\' must be a non-negative integer.');
     }
 
+    const scheduling = Scheduling.getScheduling(options, 'options', this.spn, timeoutMs);
+
     if (typeof (cb) !== 'function') {
       throw new TypeError('Invalid argument type for \'cb\'.');
     }
@@ -135,32 +158,146 @@ class SspiClient {
       throw new Error('Single invocation of getNextBlob per instance of SspiClient may be in flight.');
     }
 
+    throwIfMessagesInProgress(this);
+
     this.getNextBlobInProgress = true;
+    const call = startCall(this, cb, timeoutMs);
 
-    // Invoke initialization code if it's not already invoked.
-    ensureInitialization();
-
-    // Wait for initialization to complete. If initialization fails, invoke
-    // callback with error information. Else, invoke native implementation.
-    const invokeGetNextBlob = function (sspiClient) {
-      if (!initializeExecutionCompleted) {
-        // You cannot user process.nextTick() here as it will block all
-        // I/O which means initialization in native code will never get
-        // a chance to run and the process will just hang.
-        setImmediate(invokeGetNextBlob, sspiClient);
-      } else if (!initializeSucceeded) {
-        cb(null, null, initializeErrorCode, initializeErrorString);
+    // First leg ready made by the first leg pool, if there's one for this
+    // SPN. Still called back asynchronously like any other call.
+    if (serverResponseLength === 0 && initializeSucceeded) {
+      const clientResponse = this.sspiClientImpl.takePooledFirstLeg();
+      if (clientResponse !== undefined) {
+        setImmediate(() => {
+          releaseCall(this, call);
+          completeCall(this, call, [ clientResponse, false, 0, '' ]);
+        });
+        return;
+      }
+    }
+
+    // Wait for initialization to complete, invoking it if needed. If
+    // initialization fails, invoke callback with error information. Else,
+    // invoke native implementation.
+    const sspiClient = this;
+    whenInitialized(() => {
+      if (!initializeSucceeded) {
+        releaseCall(sspiClient, call);
+        completeCall(sspiClient, call, [ null, null, initializeErrorCode, initializeErrorString ]);
+      } else if (call.isCompleted) {
+        // Cancelled or timed out while waiting on initialization.
+        releaseCall(sspiClient, call);
       } else {
-        sspiClient.sspiClientImpl.getNextBlob(serverResponse, serverResponseBeginOffset, serverResponseLength,
+        const isQueued = sspiClient.sspiClientImpl.getNextBlob(serverResponse, serverResponseBeginOffset, serverResponseLength,
+          scheduling.tenant, scheduling.deadlineMs,
           // Cannot use => function syntax here as that does not have the 'arguments'.
           function() {
-            sspiClient.getNextBlobInProgress = false;
-            cb.apply(null, arguments);
+            releaseCall(sspiClient, call);
+            completeCall(sspiClient, call, arguments);
           });
+
+        if (!isQueued) {
+          setImmediate(() => {
+            releaseCall(sspiClient, call);
+            completeCall(sspiClient, call, [ null, false, errorCodes.queueFull, 'Too many calls queued.' ]);
+          });
+        }
       }
+    });
+  }
+
+  // Calls back the getNextBlob call in flight right away with
+  // errorCodes.cancelled. If it's still queued for a thread it's dropped
+  // there and leaves the admission queue at once, the client may be reset
+  // and reused right away. If it's running, provider calls can't be
+  // interrupted and its result is discarded; getNextBlob and reset keep
+  // throwing until it's done. No effect if no call is in flight.
+  cancel() {
+    cancelCall(this, false);
+  }
+
+  // Signs messages in place with the established context, once getNextBlob
+  // has reported isDone. Messages are processed in order, in one native call,
+  // and the peer must verify them in the same order.
+  //
+  // messages - Array of objects with:
+  //   token - Buffer for the signature, at least maxSignature bytes, see
+  //           getMessageSizes.
+  //   data - Buffer or array of Buffers, the message data. Segments are
+  //          treated as one contiguous message.
+  //   Buffers are read and written in place by native code, they must not be
+  //   modified until cb is invoked.
+  // options - Optional object with deadlineMs and tenant, same as for
+  //           getNextBlob. deadlineMs defaults to the configured deadline.
+  //
+  // Signature of cb is:
+  //  cb(tokenLengths, errorCode, errorString)
+  //      tokenLengths - Array with the length of the token written for each
+  //                     message. Processing stops at the first failure, the
+  //                     failed message is the one at tokenLengths.length.
+  //      errorCode - number representing an error code from the provider.
+  //                  0 is success, non-zero failure.
+  //      errorString - string error details.
+  sign(messages, options, cb) {
+    this.processMessages(MessageProtection.c_operationSign, messages, options, cb, arguments.length);
+  }
+
+  // Verifies messages signed by the peer, same arguments as sign. token is
+  // the received signature.
+  verify(messages, options, cb) {
+    this.processMessages(MessageProtection.c_operationVerify, messages, options, cb, arguments.length);
+  }
+
+  // Encrypts the data of messages in place, same arguments as sign. token
+  // receives the security trailer, at least securityTrailer bytes.
+  encrypt(messages, options, cb) {
+    this.processMessages(MessageProtection.c_operationEncrypt, messages, options, cb, arguments.length);
+  }
+
+  // Decrypts the data of messages encrypted by the peer in place, same
+  // arguments as sign. token is the received security trailer.
+  decrypt(messages, options, cb) {
+    this.processMessages(MessageProtection.c_operationDecrypt, messages, options, cb, arguments.length);
+  }
+
+  // Returns { maxSignature, securityTrailer, blockSize } in bytes for the
+  // established context. Throws if it's not established.
+  getMessageSizes() {
+    if (this.getNextBlobInProgress) {
+      throw new Error('Single invocation of getNextBlob per instance of SspiClient may be in flight.');
+    }
+
+    throwIfMessagesInProgress(this);
+    return MessageProtection.getMessageSizes(this.sspiClientImpl);
+  }
+
+  // Common to the message methods above.
+  processMessages(operation, messages, options, cb, argumentCount) {
+    if (argumentCount === 2) {
+      cb = options;
+      options = undefined;
+    } else if (argumentCount !== 3) {
+      throw new Error('Invalid number of arguments.');
+    }
+
+    const scheduling = Scheduling.getScheduling(options, 'options', this.spn, 0);
+
+    if (typeof (cb) !== 'function') {
+      throw new TypeError('Invalid argument type for \'cb\'.');
+    }
+
+    if (this.getNextBlobInProgress) {
+      throw new Error('Single invocation of getNextBlob per instance of SspiClient may be in flight.');
     }
 
-    invokeGetNextBlob(this);
+    throwIfMessagesInProgress(this);
+
+    const sspiClient = this;
+    MessageProtection.processMessages(this.sspiClientImpl, operation, messages, scheduling, function() {
+      sspiClient.messagesInProgress = false;
+      cb.apply(null, arguments);
+    });
+    this.messagesInProgress = true;
   }
 
   // Class methods below are for unit testing only.
@@ -181,14 +318,355 @@ class SspiClient {
   }
 }
 
-function invokeInitializationDoneCallback(cb) {
+function throwIfInvalidSecurityPackage(securityPackage) {
+  if (securityPackage !== undefined && typeof (securityPackage) !== 'string') {
+    throw new TypeError('Invalid argument type for \'securityPackage\'.');
+  }
+
+  if (securityPackage !== undefined) {
+    const negotiateLowerCase = 'negotiate';
+    const kerberosLowerCase = 'kerberos';
+    const ntlmLowerCase = 'ntlm';
+
+    const securityPackageLowerCase = securityPackage.toLowerCase();
+
+    if (securityPackageLowerCase !== negotiateLowerCase
+      && securityPackageLowerCase !== kerberosLowerCase
+      && securityPackageLowerCase !== ntlmLowerCase) {
+      throw new RangeError('\'securityPackage\' if specified must be one of \''
+        + negotiateLowerCase + '\' or \'' + kerberosLowerCase + '\' or \''
+        + ntlmLowerCase + '\'.');
+    }
+  }
+}
+
+// Tracks a getNextBlob call until cb is invoked, by completeCall or by
+// cancelCall, whichever comes first.
+function startCall(sspiClient, cb, timeoutMs) {
+  const call = { cb: cb, timer: null, isCompleted: false, isReleased: false };
+  if (timeoutMs > 0) {
+    call.timer = setTimeout(() => cancelCall(sspiClient, true), timeoutMs);
+  }
+
+  sspiClient.pendingCall = call;
+  return call;
+}
+
+function completeCall(sspiClient, call, args) {
+  if (call.isCompleted) {
+    return;
+  }
+
+  call.isCompleted = true;
+  if (call.timer !== null) {
+    clearTimeout(call.timer);
+  }
+
+  if (sspiClient.pendingCall === call) {
+    sspiClient.pendingCall = null;
+  }
+
+  call.cb.apply(null, args);
+}
+
+// Clears the in progress flag of the client once for call, when the native
+// layer is done with the client or the call was cancelled before it started.
+// A released call calling back later doesn't touch the flag, the client may
+// be in another call by then.
+function releaseCall(sspiClient, call) {
+  if (call.isReleased) {
+    return;
+  }
+
+  call.isReleased = true;
+  sspiClient.getNextBlobInProgress = false;
+}
+
+function cancelCall(sspiClient, timedOut) {
+  const call = sspiClient.pendingCall;
+  if (call === null) {
+    return;
+  }
+
+  // A call that hadn't started never touches the client, which may be used
+  // again right away. One already running still holds it until it returns.
+  if (sspiClient.sspiClientImpl.cancel(timedOut)) {
+    releaseCall(sspiClient, call);
+  }
+
+  completeCall(sspiClient, call, timedOut
+    ? [ null, false, errorCodes.timedOut, 'Call timed out.' ]
+    : [ null, false, errorCodes.cancelled, 'Call cancelled.' ]);
+}
+
+function throwIfMessagesInProgress(sspiClient) {
+  if (sspiClient.messagesInProgress) {
+    throw new Error('Single invocation of message protection per instance of SspiClient may be in flight.');
+  }
+}
+
+function throwIfInvalidServerResponse(serverResponse, serverResponseBeginOffset, serverResponseLength) {
+  if (!isNonNegativeInteger(serverResponseLength)) {
+    throw new Error('\'serverResponseLength\' must be a non-negative integer.');
+  }
+
+  if (serverResponseLength > 0) {
+    if (!(serverResponse instanceof Buffer)) {
+      throw new TypeError('Invalid argument type for \'serverResponse\'.');
+    }
+
+    if (!isNonNegativeInteger(serverResponseBeginOffset)) {
+      throw new Error('\'serverResponseBeginOffset\' must be a non-negative integer.');
+    }
+
+    if (serverResponseLength > (serverResponse.length - serverResponseBeginOffset)) {
+      throw new RangeError('\'serverResponse\' buffer too small. '
+        + '\'serverResponse\' buffer size=' + serverResponse.length
+        + ', \'serverResponseBeginOffset\'=' + serverResponseBeginOffset
+        + ', \'serverResponseLength\'=' + serverResponseLength);
+    }
+  }
+}
+
+// Gets the next blob for many SspiClient instances as one native job, e.g.
+// the first leg for every connection of a pool being filled. Much cheaper per
+// client than calling getNextBlob on each. The same rules as getNextBlob apply
+// to each request, and no client may appear twice. Each request is admitted,
+// and can be cancelled or time out, like a getNextBlob call of its own.
+//
+// requests - Array of objects with:
+//   client - SspiClient instance.
+//   serverResponse - Same as getNextBlob, optional on the first leg.
+//   serverResponseBeginOffset - Same as getNextBlob, defaults to 0.
+//   serverResponseLength - Same as getNextBlob, defaults to 0.
+//   timeoutMs, deadlineMs, tenant - Same as the getNextBlob options, each
+//                                   request is scheduled on its own.
+//
+// Signature of cb is:
+//  cb(results)
+//      results - Array with one object per request, in the same order, with
+//                clientResponse, isDone, errorCode and errorString as passed
+//                to the getNextBlob callback. Called once every request has
+//                completed, been cancelled or timed out.
+function getNextBlobBatch(requests, cb) {
+  if (arguments.length !== 2) {
+    throw new Error('Invalid number of arguments.');
+  }
+
+  if (!Array.isArray(requests)) {
+    throw new TypeError('Invalid argument type for \'requests\'.');
+  }
+
+  if (typeof (cb) !== 'function') {
+    throw new TypeError('Invalid argument type for \'cb\'.');
+  }
+
+  const clients = new Set();
+  const timeouts = new Array(requests.length);
+  const schedulings = requests.map((request, i) => {
+    if (typeof (request) !== 'object' || request === null || !(request.client instanceof SspiClient)) {
+      throw new TypeError('Invalid argument type for \'requests[' + i + '].client\'.');
+    }
+
+    throwIfInvalidServerResponse(
+      request.serverResponse,
+      request.serverResponseBeginOffset || 0,
+      request.serverResponseLength || 0);
+
+    const timeoutMs = request.timeoutMs === undefined ? defaultTimeoutMs : request.timeoutMs;
+    if (!isNonNegativeInteger(timeoutMs)) {
+      throw new TypeError('\'requests[' + i + '].timeoutMs\' must be a non-negative integer.');
+    }
+
+    const scheduling = Scheduling.getScheduling(request, 'requests[' + i + ']', request.client.spn, timeoutMs);
+
+    if (request.client.getNextBlobInProgress || clients.has(request.client)) {
+      throw new Error('Single invocation of getNextBlob per instance of SspiClient may be in flight.');
+    }
+
+    throwIfMessagesInProgress(request.client);
+
+    clients.add(request.client);
+    timeouts[i] = timeoutMs;
+    return scheduling;
+  });
+
+  if (requests.length === 0) {
+    setImmediate(cb, []);
+    return;
+  }
+
+  const results = new Array(requests.length);
+  let remaining = requests.length;
+  const calls = requests.map((request, i) => {
+    request.client.getNextBlobInProgress = true;
+    return startCall(request.client, function() {
+      results[i] = {
+        clientResponse: arguments[0],
+        isDone: arguments[1],
+        errorCode: arguments[2],
+        errorString: arguments[3]
+      };
+
+      if (--remaining === 0) {
+        cb(results);
+      }
+    }, timeouts[i]);
+  });
+
+  // Completes the calls of the requests at indexes, in order, after clearing
+  // the in progress flags so callbacks can use the clients again. argsOf maps
+  // a request index to the callback arguments.
+  const completeCalls = (indexes, argsOf) => {
+    indexes.forEach((i) => releaseCall(requests[i].client, calls[i]));
+
+    indexes.forEach((i) => completeCall(requests[i].client, calls[i], argsOf(i)));
+  };
+
+  whenInitialized(() => {
+    const indexes = [];
+    requests.forEach((request, i) => {
+      if (calls[i].isCompleted) {
+        // Cancelled or timed out while waiting on initialization.
+        releaseCall(request.client, calls[i]);
+      } else {
+        indexes.push(i);
+      }
+    });
+
+    if (!initializeSucceeded) {
+      completeCalls(indexes, () => [ null, null, initializeErrorCode, initializeErrorString ]);
+    } else if (indexes.length > 0) {
+      const admitted = native.get().getNextBlobBatch(
+        indexes.map((i) => requests[i].client.sspiClientImpl),
+        indexes.map((i) => requests[i].serverResponse || null),
+        indexes.map((i) => requests[i].serverResponseBeginOffset || 0),
+        indexes.map((i) => requests[i].serverResponseLength || 0),
+        indexes.map((i) => schedulings[i].tenant),
+        indexes.map((i) => schedulings[i].deadlineMs),
+        (nativeResults) => completeCalls(
+          indexes.filter((i, j) => admitted[j]),
+          (i) => {
+            const nativeResult = nativeResults[indexes.indexOf(i)];
+            return [
+              nativeResult.clientResponse,
+              nativeResult.isDone,
+              nativeResult.errorCode,
+              nativeResult.errorString
+            ];
+          }));
+
+      // Rejected requests fail fast, as getNextBlob does.
+      completeCalls(
+        indexes.filter((i, j) => !admitted[j]),
+        () => [ null, false, errorCodes.queueFull, 'Too many calls queued.' ]);
+    }
+  });
+}
+
+// Warms the Kerberos ticket cache for spns, e.g. every server an application
+// connects to, at startup. Runs the first leg of a context against each SPN
+// on the native worker pool and throws the context away, so the service
+// ticket request doesn't land on the first real connection. Each SPN is
+// scheduled as its own tenant with the background deadline of
+// configureScheduler.
+//
+// spns - Array of service principal names.
+// securityPackage - Optional, same as for SspiClient.
+//
+// Signature of cb is:
+//  cb(results)
+//      results - Array with one object per SPN, in the same order, with:
+//                spn
+//                elapsedMs - Time the first leg took.
+//                errorCode - number representing an error code from Windows
+//                            API. 0 is success, non-zero failure.
+//                errorString - string error details.
+function prefetchTickets(spns, securityPackage, cb) {
+  if (arguments.length === 2) {
+    cb = securityPackage;
+    securityPackage = undefined;
+  } else if (arguments.length !== 3) {
+    throw new Error('Invalid number of arguments.');
+  }
+
+  if (!Array.isArray(spns)) {
+    throw new TypeError('Invalid argument type for \'spns\'.');
+  }
+
+  spns.forEach((spn, i) => {
+    if (typeof (spn) !== 'string') {
+      throw new TypeError('Invalid argument type for \'spns[' + i + ']\'.');
+    }
+
+    if (spn === '') {
+      throw new RangeError('Empty string argument for \'spns[' + i + ']\'.');
+    }
+  });
+
+  throwIfInvalidSecurityPackage(securityPackage);
+
+  if (typeof (cb) !== 'function') {
+    throw new TypeError('Invalid argument type for \'cb\'.');
+  }
+
+  whenInitialized(() => {
+    if (!initializeSucceeded) {
+      cb(spns.map((spn) => ({
+        spn: spn,
+        elapsedMs: 0,
+        errorCode: initializeErrorCode,
+        errorString: initializeErrorString
+      })));
+    } else if (spns.length === 0) {
+      setImmediate(cb, []);
+    } else {
+      native.get().prefetchTickets(spns.slice(), securityPackage || '', cb);
+    }
+  });
+}
+
+function onInitializeCompleted(availableSspiPackages, defaultPackageIndex, errorCode, errorString) {
   if (initializeExecutionCompleted) {
-    cb(initializeErrorCode, initializeErrorString);
+    return;
+  }
+
+  initializeExecutionCompleted = true;
+  if (errorCode === 0) {
+    initializeSucceeded = true;
+    availableSspiPackageNames = availableSspiPackages;
+    defaultSspiPackageName = availableSspiPackageNames[defaultPackageIndex];
   } else {
-    setImmediate(invokeInitializationDoneCallback, cb);
+    initializeErrorCode = errorCode;
+    initializeErrorString = errorString;
   }
 }
 
+// Invokes cb once initialization has completed, right away if it already
+// has. Callers waiting on initialization are queued in native code and all
+// called back from its single completion, nothing polls.
+function whenInitialized(cb) {
+  if (initializeExecutionCompleted) {
+    cb();
+    return;
+  }
+
+  native.get().initialize(function () {
+    onInitializeCompleted.apply(null, arguments);
+    cb();
+  });
+}
+
+// Invokes initialization if it's not already invoked.
+//
+// With cb, signature of cb is:
+//  cb(errorCode, errorString)
+//      errorCode - number representing an error code from Windows API.
+//                  0 is success, non-zero failure.
+//      errorString - string error details.
+//
+// Without cb, returns a Promise that resolves when initialization succeeds
+// and rejects with an Error carrying errorCode when it fails.
 function ensureInitialization(cb) {
   if (arguments.length > 1) {
     throw new Error('Invalid number of arguments.');
@@ -198,28 +676,35 @@ function ensureInitialization(cb) {
     throw new TypeError('Invalid argument type for \'cb\'.');
   }
 
-  if (initializeInvoked) {
-    if (cb) {
-      setImmediate(invokeInitializationDoneCallback, cb);
+  if (cb) {
+    if (initializeExecutionCompleted) {
+      setImmediate(cb, initializeErrorCode, initializeErrorString);
+    } else {
+      whenInitialized(() => cb(initializeErrorCode, initializeErrorString));
     }
-  } else {
-    initializeInvoked = true;
-    sspiClientNative.initialize((availableSspiPackages, defaultPackageIndex, errorCode, errorString) => {
-      initializeExecutionCompleted = true;
-      if (errorCode === 0) {
-        initializeSucceeded = true;
-        availableSspiPackageNames = availableSspiPackages;
-        defaultSspiPackageName = availableSspiPackageNames[defaultPackageIndex];
-      } else {
-        initializeErrorCode = errorCode;
-        initializeErrorString = errorString;
-      }
 
-      if (cb) {
-        cb(initializeErrorCode, initializeErrorString);
-      }
+    return undefined;
+  }
+
+  if (!initializePromise) {
+    initializePromise = new Promise((resolve, reject) => {
+      whenInitialized(() => {
+        if (initializeSucceeded) {
+          resolve();
+        } else {
+          const err = new Error(initializeErrorString);
+          err.errorCode = initializeErrorCode;
+          reject(err);
+        }
+      });
     });
+
+    // Callers may invoke ensureInitialization() only to start
+    // initialization early and never look at the result.
+    initializePromise.catch(() => {});
   }
+
+  return initializePromise;
 }
 
 // Initialization must be completed before invoking this function. Any calls to
@@ -246,18 +731,695 @@ function getAvailableSspiPackageNames() {
   return availableSspiPackageNames;
 }
 
+// Name of the provider the native code uses for SSPI calls, 'windows',
+// 'gssapi' or 'mock'. See platform.js for how to select the provider.
+function getProviderName() {
+  return native.get().getProviderName();
+}
+
+// Credential handles are shared by all SspiClient and SspiServer instances
+// using the same package. Returns counters for the process-wide cache:
+//  hits, misses - Lookups that found or did not find a live handle.
+//  waits - Lookups that waited on a concurrent acquisition of the same handle.
+//  acquisitions, failures - Calls made to acquire a handle and how many failed.
+//  evictions - Handles dropped on expiry or by clearCredentialCache.
+//  size - Handles currently cached.
+function getCredentialCacheStats() {
+  return native.get().getCredentialCacheStats();
+}
+
+// Drops all cached credential handles, so the next authentication acquires
+// a fresh one, e.g. after the logged in user's credentials change. Handles in
+// use stay valid until their clients are done with them.
+function clearCredentialCache() {
+  native.get().clearCredentialCache();
+}
+
+// Token buffers returned by getNextBlob and acceptNextBlob come from a
+// size-classed native pool and go back to it when the Buffer is garbage
+// collected. Returns the pool counters:
+//  allocations - Buffers handed out.
+//  threadCacheHits, globalHits - Allocations served from a per-thread cache or
+//                                the global freelist.
+//  heapAllocations, heapFrees - Buffers allocated from and released to the heap.
+//  oversizeAllocations - Allocations too large to pool.
+//  frees - Buffers returned.
+//  bytesInUse, bytesRetained - Bytes held by live Buffers and by the pool.
+function getBufferPoolStats() {
+  return native.get().getBufferPoolStats();
+}
+
+// Token traffic through the native code. Returns the counters inBlobs,
+// inBytes, outBlobs, outBytes and bytesCopied. Input tokens are read in place
+// from the Buffers passed to getNextBlob; bytesCopied counts the bytes copied
+// to right-size output tokens.
+function getBlobStats() {
+  return native.get().getBlobStats();
+}
+
+// SSPI calls run on threads owned by this module rather than the libuv thread
+// pool, so calls blocked on a slow KDC don't hold up fs and dns work.
+//
+// options - Object with:
+//   size - Number of threads, 4 by default. 0 runs SSPI calls on the libuv
+//          thread pool instead.
+//   maxSize - Optional, threads may be added up to this many while calls are
+//             waiting for a thread. Defaults to size.
+//   idleTimeoutMs - Optional, threads past size exit after being idle this
+//                   long. Defaults to 10 seconds.
+function configureWorkerPool(options) {
+  if (arguments.length !== 1) {
+    throw new Error('Invalid number of arguments.');
+  }
+
+  if (typeof (options) !== 'object' || options === null) {
+    throw new TypeError('Invalid argument type for \'options\'.');
+  }
+
+  if (!isNonNegativeInteger(options.size)) {
+    throw new TypeError('\'options.size\' must be a non-negative integer.');
+  }
+
+  const maxSize = options.maxSize === undefined ? options.size : options.maxSize;
+  if (!isNonNegativeInteger(maxSize) || maxSize < options.size) {
+    throw new RangeError('\'options.maxSize\' must be an integer not less than \'options.size\'.');
+  }
+
+  const idleTimeoutMs = options.idleTimeoutMs === undefined ? -1 : options.idleTimeoutMs;
+  if (idleTimeoutMs !== -1 && !isNonNegativeInteger(idleTimeoutMs)) {
+    throw new TypeError('\'options.idleTimeoutMs\' must be a non-negative integer.');
+  }
+
+  native.get().configureWorkerPool(options.size, maxSize, idleTimeoutMs);
+}
+
+// Returns the worker pool configuration and counters:
+//  enabled - false if SSPI calls run on the libuv thread pool.
+//  size, maxSize - Configured number of threads.
+//  threads, idleThreads, peakThreads - Threads running, waiting for work and
+//                                      the most running at once.
+//  queueDepth, peakQueueDepth - Calls waiting for a thread, now and at most.
+//  submitted, completed - Calls queued and run.
+//  totalWaitUs, maxWaitUs - Time calls waited for a thread.
+//  tenants - Tenants with calls queued or running.
+//  deadlineMisses - Calls that started after their deadline.
+function getWorkerPoolStats() {
+  return native.get().getWorkerPoolStats();
+}
+
+// Same values as SchedulingPolicy in the native layer.
+const schedulingPolicies = { fifo: 0, fair: 1 };
+
+// Order in which calls waiting for a worker thread run. Under the default
+// 'fair' policy threads are shared between tenants in proportion to their
+// weights, by time spent in SSPI calls, and each tenant's calls run earliest
+// deadline first. Background work, like refilling first leg pools and
+// renewing tickets, gets backgroundDeadlineMs, so a burst of it runs after
+// logins queued at the same time without being starved by a steady stream
+// of them. 'fifo' runs calls in the order they were queued.
+//
+// options - Object with:
+//   policy - Optional, 'fair' or 'fifo'.
+//   deadlineMs - Optional, deadline of calls that don't pass one.
+//                Defaults to 1 second.
+//   backgroundDeadlineMs - Optional, defaults to 30 seconds.
+//   tenantWeights - Optional object mapping tenants to positive integer
+//                   weights, 1 for tenants missing from it. Replaces the
+//                   weights set before.
+function configureScheduler(options) {
+  if (arguments.length !== 1) {
+    throw new Error('Invalid number of arguments.');
+  }
+
+  if (typeof (options) !== 'object' || options === null) {
+    throw new TypeError('Invalid argument type for \'options\'.');
+  }
+
+  const policy = options.policy === undefined ? 'fair' : options.policy;
+  if (!schedulingPolicies.hasOwnProperty(policy)) {
+    throw new RangeError('\'options.policy\' must be \'fair\' or \'fifo\'.');
+  }
+
+  const deadlineMs = options.deadlineMs === undefined ? 0 : options.deadlineMs;
+  if (!isNonNegativeInteger(deadlineMs)) {
+    throw new TypeError('\'options.deadlineMs\' must be a non-negative integer.');
+  }
+
+  const backgroundDeadlineMs = options.backgroundDeadlineMs === undefined ? 0 : options.backgroundDeadlineMs;
+  if (!isNonNegativeInteger(backgroundDeadlineMs)) {
+    throw new TypeError('\'options.backgroundDeadlineMs\' must be a non-negative integer.');
+  }
+
+  const tenantWeights = options.tenantWeights === undefined ? {} : options.tenantWeights;
+  if (typeof (tenantWeights) !== 'object' || tenantWeights === null) {
+    throw new TypeError('Invalid argument type for \'options.tenantWeights\'.');
+  }
+
+  const tenants = Object.keys(tenantWeights);
+  const weights = tenants.map((tenant) => {
+    const weight = tenantWeights[tenant];
+    if (!isNonNegativeInteger(weight) || weight === 0) {
+      throw new TypeError('Weight of tenant \'' + tenant + '\' must be a positive integer.');
+    }
+
+    return weight;
+  });
+
+  native.get().configureScheduling(schedulingPolicies[policy], deadlineMs, backgroundDeadlineMs, tenants, weights);
+}
+
+// Keeps first legs ready for new SspiClient instances connecting to spn, so
+// their first getNextBlob completes without a trip to a worker thread. The
+// pool is refilled in the background. Opt-in per SPN and security package.
+//
+// spn - Service principal of the destination server, as passed to SspiClient.
+// options - Object with:
+//   size - Number of first legs to keep ready. 0 removes the pool.
+//   securityPackage - Optional, as passed to SspiClient. Pools are only used
+//                     by clients created with the same package.
+//   maxAgeMs - Optional, first legs older than this are discarded. Defaults
+//              to 60 seconds, Kerberos authenticators carry a timestamp the
+//              server checks.
+function configureFirstLegPool(spn, options) {
+  if (arguments.length !== 2) {
+    throw new Error('Invalid number of arguments.');
+  }
+
+  if (typeof (spn) !== 'string') {
+    throw new TypeError('Invalid argument type for \'spn\'.');
+  }
+
+  if (spn === '') {
+    throw new RangeError('Empty string argument for \'spn\'.');
+  }
+
+  if (typeof (options) !== 'object' || options === null) {
+    throw new TypeError('Invalid argument type for \'options\'.');
+  }
+
+  if (!isNonNegativeInteger(options.size)) {
+    throw new TypeError('\'options.size\' must be a non-negative integer.');
+  }
+
+  if (options.securityPackage !== undefined && typeof (options.securityPackage) !== 'string') {
+    throw new TypeError('Invalid argument type for \'options.securityPackage\'.');
+  }
+
+  if (options.maxAgeMs !== undefined && !isNonNegativeInteger(options.maxAgeMs)) {
+    throw new TypeError('\'options.maxAgeMs\' must be a non-negative integer.');
+  }
+
+  // Generating first legs needs the default package, known once initialized.
+  // Pooling is an optimization, a failed initialization shows up on the
+  // getNextBlob calls.
+  whenInitialized(() => {
+    if (initializeSucceeded) {
+      native.get().configureFirstLegPool(spn, options.securityPackage || '', options.size, options.maxAgeMs || 0);
+    }
+  });
+}
+
+// Returns the first leg pool counters, across all SPNs:
+//  hits, misses - Clients of a pooled SPN that found a first leg ready or not.
+//  stale - First legs discarded as too old or about to expire.
+//  generated, failures - First legs generated in the background.
+//  ready, generating - First legs ready now and being generated.
+function getFirstLegPoolStats() {
+  return native.get().getFirstLegPoolStats();
+}
+
+// Reset clients kept for reuse by acquireClient, keyed by SPN and package.
+const clientPools = new Map();
+let maxPooledClientsPerSpn = 0;
+const clientPoolStats = { hits: 0, misses: 0, released: 0, discarded: 0, idle: 0 };
+
+function getClientPoolKey(spn, securityPackage) {
+  return spn + '\0' + (securityPackage || '');
+}
+
+// Keeps clients returned with releaseClient for reuse, so a burst of
+// reconnects to the same server reuses reset clients rather than
+// constructing new ones and leaving the old ones to the garbage collector.
+//
+// options - Object with:
+//   maxPerSpn - Maximum clients kept per SPN and security package. 0, the
+//               default, disables pooling and drops the clients pooled.
+function configureClientPool(options) {
+  if (arguments.length !== 1) {
+    throw new Error('Invalid number of arguments.');
+  }
+
+  if (typeof (options) !== 'object' || options === null) {
+    throw new TypeError('Invalid argument type for \'options\'.');
+  }
+
+  if (!isNonNegativeInteger(options.maxPerSpn)) {
+    throw new TypeError('\'options.maxPerSpn\' must be a non-negative integer.');
+  }
+
+  maxPooledClientsPerSpn = options.maxPerSpn;
+  clientPools.forEach((pool) => {
+    if (pool.length > maxPooledClientsPerSpn) {
+      clientPoolStats.idle -= pool.length - maxPooledClientsPerSpn;
+      pool.length = maxPooledClientsPerSpn;
+    }
+  });
+}
+
+// Returns a reset client for spn and securityPackage from the pool, or a new
+// one if there's none. Same arguments as the SspiClient constructor.
+function acquireClient(spn, securityPackage) {
+  const pool = clientPools.get(getClientPoolKey(spn, securityPackage));
+  if (pool !== undefined && pool.length > 0) {
+    clientPoolStats.hits++;
+    clientPoolStats.idle--;
+    return pool.pop();
+  }
+
+  clientPoolStats.misses++;
+  return securityPackage ? new SspiClient(spn, securityPackage) : new SspiClient(spn);
+}
+
+// Resets sspiClient and keeps it for acquireClient if the pool for its SPN
+// has room. sspiClient must not be used by the caller afterwards. A client
+// with a cancelled getNextBlob call still running is discarded.
+function releaseClient(sspiClient) {
+  if (!(sspiClient instanceof SspiClient)) {
+    throw new TypeError('Invalid argument type for \'sspiClient\'.');
+  }
+
+  if (sspiClient.getNextBlobInProgress) {
+    clientPoolStats.discarded++;
+    return;
+  }
+
+  sspiClient.reset();
+
+  const key = getClientPoolKey(sspiClient.spn, sspiClient.securityPackage);
+  let pool = clientPools.get(key);
+  if ((pool === undefined ? 0 : pool.length) >= maxPooledClientsPerSpn) {
+    clientPoolStats.discarded++;
+    return;
+  }
+
+  if (pool === undefined) {
+    pool = [];
+    clientPools.set(key, pool);
+  }
+
+  clientPoolStats.released++;
+  clientPoolStats.idle++;
+  pool.push(sspiClient);
+}
+
+// Returns the client pool counters, across all SPNs:
+//  hits, misses - acquireClient calls served from the pool or not.
+//  released, discarded - releaseClient calls that pooled the client or
+//                        dropped it as the pool was full.
+//  idle - Clients in the pool now.
+function getClientPoolStats() {
+  return Object.assign({}, clientPoolStats);
+}
+
+// Same defaults as ExpiryRefresher in the native layer.
+const c_defaultRefreshAheadMs = 2 * 60 * 1000;
+const c_defaultRefreshJitterMs = 2 * 60 * 1000;
+const c_defaultRefreshCheckIntervalMs = 30 * 1000;
+
+let expiryRefreshTimer = null;
+
+// Renews credentials and service tickets in the background ahead of their
+// expiry, so logins don't pay for the renewal. Tickets are renewed for the
+// SPNs clients authenticated to, as long as they keep authenticating to them.
+// Renewal times are spread at random per credential and ticket, so processes
+// that started together don't all renew at once. How early a ticket can
+// actually be renewed is up to the provider.
+//
+// options - Object with:
+//   enabled - false stops refreshing.
+//   refreshAheadMs - Optional, renew this long before expiry. Defaults to 2
+//                    minutes.
+//   jitterMs - Optional, renew up to this much earlier still, at random.
+//              Defaults to 2 minutes.
+//   checkIntervalMs - Optional, how often to look for what's due. Defaults to
+//                     30 seconds. The timer doesn't keep the process alive.
+function configureExpiryRefresh(options) {
+  if (arguments.length !== 1) {
+    throw new Error('Invalid number of arguments.');
+  }
+
+  if (typeof (options) !== 'object' || options === null) {
+    throw new TypeError('Invalid argument type for \'options\'.');
+  }
+
+  if (typeof (options.enabled) !== 'boolean') {
+    throw new TypeError('Invalid argument type for \'options.enabled\'.');
+  }
+
+  ['refreshAheadMs', 'jitterMs'].forEach((name) => {
+    if (options[name] !== undefined && !isNonNegativeInteger(options[name])) {
+      throw new TypeError('\'options.' + name + '\' must be a non-negative integer.');
+    }
+  });
+
+  if (options.checkIntervalMs !== undefined
+    && (!isNonNegativeInteger(options.checkIntervalMs) || options.checkIntervalMs === 0)) {
+    throw new TypeError('\'options.checkIntervalMs\' must be a positive integer.');
+  }
+
+  if (expiryRefreshTimer !== null) {
+    clearInterval(expiryRefreshTimer);
+    expiryRefreshTimer = null;
+  }
+
+  native.get().configureExpiryRefresh(
+    options.enabled,
+    options.refreshAheadMs === undefined ? c_defaultRefreshAheadMs : options.refreshAheadMs,
+    options.jitterMs === undefined ? c_defaultRefreshJitterMs : options.jitterMs);
+
+  if (options.enabled) {
+    expiryRefreshTimer = setInterval(
+      () => native.get().refreshExpiring(),
+      options.checkIntervalMs || c_defaultRefreshCheckIntervalMs);
+    expiryRefreshTimer.unref();
+  }
+}
+
+// Looks for credentials and tickets due for renewal right away rather than
+// on the next check of configureExpiryRefresh. Renewals run in the
+// background, see getExpiryRefreshStats.
+function refreshExpiring() {
+  native.get().refreshExpiring();
+}
+
+// Returns the expiry refresh counters:
+//  passes - Checks for what's due.
+//  credentialRefreshes, credentialRefreshFailures - Credentials renewed.
+//  ticketRefreshes, ticketRefreshFailures - Service tickets renewed.
+//  ticketsDropped - Tickets no longer renewed, as nothing authenticated to
+//                   their SPN since the last renewal.
+//  tickets - Tickets tracked for renewal.
+function getExpiryRefreshStats() {
+  return native.get().getExpiryRefreshStats();
+}
+
+// Latency of getNextBlob calls broken down by phase, security package and
+// outcome. Returns an object keyed by phase, then package name ('Negotiate',
+// 'Kerberos', 'NTLM' or 'Other'), then 'success' or 'failure', with count,
+// minUs, meanUs, p50Us, p90Us, p99Us, p999Us and maxUs. Percentiles are
+// within 1/16 of the exact value. Phases:
+//  queueWait - Waiting for a worker thread.
+//  acquireCredentials - Getting the credential handle, on the first leg.
+//  initializeContext, completeToken - The SSPI calls.
+//  callbackDelay - Waiting for the main event loop to run the callback.
+//  total - From the getNextBlob call to the callback.
+// Only phases and packages with samples are included.
+function getStats() {
+  return native.get().getStats();
+}
+
+// Clears the histograms returned by getStats.
+function resetStats() {
+  native.get().resetStats();
+}
+
+// Bounds the getNextBlob calls queued for a thread across all clients, so a
+// stalled KDC or upstream timeouts don't grow the queue without bound, and
+// sets a default timeout per call.
+//
+// options - Object with:
+//   maxQueueDepth - Calls queued beyond this fail right away with
+//                   errorCodes.queueFull. 0, the default, doesn't limit the
+//                   queue.
+//   timeoutMs - Optional, timeout of getNextBlob calls that don't pass one.
+//               0, the default, is none.
+function configureHandshakeAdmission(options) {
+  if (arguments.length !== 1) {
+    throw new Error('Invalid number of arguments.');
+  }
+
+  if (typeof (options) !== 'object' || options === null) {
+    throw new TypeError('Invalid argument type for \'options\'.');
+  }
+
+  if (!isNonNegativeInteger(options.maxQueueDepth)) {
+    throw new TypeError('\'options.maxQueueDepth\' must be a non-negative integer.');
+  }
+
+  if (options.timeoutMs !== undefined && !isNonNegativeInteger(options.timeoutMs)) {
+    throw new TypeError('\'options.timeoutMs\' must be a non-negative integer.');
+  }
+
+  native.get().configureHandshakeAdmission(options.maxQueueDepth);
+  defaultTimeoutMs = options.timeoutMs || 0;
+}
+
+// Returns the counters of getNextBlob calls that reached the native queue:
+//  maxQueueDepth - As configured, 0 for no limit.
+//  queueDepth, peakQueueDepth - Calls waiting for a thread, now and at most.
+//  admitted, rejected - Calls queued and failed as the queue was full.
+//  cancelled, timedOut - Calls cancelled or timed out before completing.
+//  skipped - Of those, calls dropped before they started running.
+function getHandshakeAdmissionStats() {
+  return native.get().getHandshakeAdmissionStats();
+}
+
+const traceLevels = { off: 0, events: 1, debug: 2 };
+
+// Native code records SSPI calls and debug messages to per-thread buffers
+// without blocking. Records are drained in the background to a file, or
+// collected with drainTrace.
+//
+// options - Object with:
+//   level - 'off', 'events' for SSPI calls with their status and duration,
+//           or 'debug' to add the messages enableNativeDebugLogging prints.
+//   file - Optional path records are appended to, '-' for stdout. Without
+//          one, records wait for drainTrace.
+//   flushIntervalMs - Optional, how often the file is written. Defaults to
+//                     100 milliseconds.
+function configureTracing(options) {
+  if (arguments.length !== 1) {
+    throw new Error('Invalid number of arguments.');
+  }
+
+  if (typeof (options) !== 'object' || options === null) {
+    throw new TypeError('Invalid argument type for \'options\'.');
+  }
+
+  if (!traceLevels.hasOwnProperty(options.level)) {
+    throw new RangeError('\'options.level\' must be one of \'off\', \'events\', \'debug\'.');
+  }
+
+  if (options.file !== undefined && (typeof (options.file) !== 'string' || options.file === '')) {
+    throw new TypeError('\'options.file\' must be a non-empty string.');
+  }
+
+  if (options.flushIntervalMs !== undefined && !isNonNegativeInteger(options.flushIntervalMs)) {
+    throw new TypeError('\'options.flushIntervalMs\' must be a non-negative integer.');
+  }
+
+  const useFile = options.file !== undefined;
+  const path = options.file === '-' ? '' : (options.file || '');
+  if (!native.get().configureTracing(traceLevels[options.level], useFile, path, options.flushIntervalMs || 0)) {
+    throw new Error('Failed to open \'' + options.file + '\' for tracing.');
+  }
+}
+
+// Returns the trace records not drained yet, oldest first. Each has
+// timestampUs, microseconds since the Unix epoch, threadId and workerId, a
+// small id for the recording thread. SSPI call records have call, status and
+// durationUs, debug records have message.
+function drainTrace() {
+  return native.get().drainTrace();
+}
+
+// Returns the trace counters:
+//  recorded - Records written.
+//  dropped - Records lost to full buffers, drain more often if not 0.
+//  drained - Records written to the file or returned by drainTrace.
+//  rings - Per-thread buffers allocated.
+function getTraceStats() {
+  return native.get().getTraceStats();
+}
+
+// Appends every getNextBlob call from now on, input and output tokens,
+// status, isDone and duration, to a transcript file at path, creating it if
+// needed. See src_native/transcript.h for the format and transcript.js to
+// read it. Replaces the file being recorded to, if any.
+function startTranscriptRecording(path) {
+  if (arguments.length !== 1) {
+    throw new Error('Invalid number of arguments.');
+  }
+
+  if (typeof (path) !== 'string' || path === '') {
+    throw new TypeError('\'path\' must be a non-empty string.');
+  }
+
+  const errorString = native.get().startTranscriptRecording(path);
+  if (errorString !== '') {
+    throw new Error(errorString);
+  }
+}
+
+function stopTranscriptRecording() {
+  native.get().stopTranscriptRecording();
+}
+
+// Loads a transcript file for the 'replay' provider, to serve to handshakes
+// started from now on. Same as setting SSPI_CLIENT_REPLAY_FILE.
+//
+// options - Optional object with:
+//   realTime - Whether each leg takes as long as it did when recorded.
+//              Defaults to false, legs are served as fast as possible.
+function loadReplayTranscripts(path, options) {
+  if (arguments.length < 1 || arguments.length > 2) {
+    throw new Error('Invalid number of arguments.');
+  }
+
+  if (typeof (path) !== 'string' || path === '') {
+    throw new TypeError('\'path\' must be a non-empty string.');
+  }
+
+  if (options !== undefined && (typeof (options) !== 'object' || options === null)) {
+    throw new TypeError('Invalid argument type for \'options\'.');
+  }
+
+  const realTime = options !== undefined && options.realTime !== undefined ? options.realTime : false;
+  if (typeof (realTime) !== 'boolean') {
+    throw new TypeError('\'options.realTime\' must be a boolean.');
+  }
+
+  const errorString = native.get().loadReplayTranscripts(path, realTime);
+  if (errorString !== '') {
+    throw new Error(errorString);
+  }
+}
+
+// Returns the transcript counters:
+//  recorded, bytes - Legs and bytes appended to the transcript file.
+//  failures - Legs that couldn't be written.
+//  handshakes, legs - Loaded for the 'replay' provider.
+//  served - Legs the 'replay' provider served.
+//  mismatches - Input tokens the 'replay' provider found in no recorded
+//               handshake.
+function getTranscriptStats() {
+  return native.get().getTranscriptStats();
+}
+
 // Methods defined below this line are for unit testing only.
 function enableNativeDebugLogging() {
-    sspiClientNative.enableDebugLogging(true);
+    native.get().enableDebugLogging(true);
 }
 
 function disableNativeDebugLogging() {
-    sspiClientNative.enableDebugLogging(false);
+    native.get().enableDebugLogging(false);
+}
+
+function utResetBlobStats() {
+  native.get().utResetBlobStats();
+}
+
+function utResetBufferPoolStats() {
+  native.get().utResetBufferPoolStats();
+}
+
+// Disabling sends every allocation to the heap, for comparison in benchmarks.
+function utSetBufferPoolEnabled(enable) {
+  native.get().utSetBufferPoolEnabled(enable);
+}
+
+function utResetWorkerPoolStats() {
+  native.get().utResetWorkerPoolStats();
+}
+
+function utResetHandshakeAdmissionStats() {
+  native.get().utResetHandshakeAdmissionStats();
+}
+
+function utResetExpiryRefreshStats() {
+  native.get().utResetExpiryRefreshStats();
+}
+
+// Moves the clock the native layer makes expiry decisions with by offsetMs,
+// so expiry can be tested without waiting. 0 restores it.
+function utSetClockOffset(offsetMs) {
+  native.get().utSetClockOffset(offsetMs);
+}
+
+// Lifetime in milliseconds the mock provider gives new service tickets.
+// Negative restores the default.
+function utSetMockTicketLifetime(lifetimeMs) {
+  native.get().utSetMockTicketLifetime(lifetimeMs);
+}
+
+function utResetFirstLegPoolStats() {
+  native.get().utResetFirstLegPoolStats();
+}
+
+// Delay in milliseconds the mock provider adds to the first Kerberos or
+// Negotiate context for each SPN, like a service ticket request. Purges the
+// mock's ticket cache.
+function utSetMockTicketLatency(latencyMs) {
+  native.get().utSetMockTicketLatency(latencyMs);
+}
+
+// Delay in milliseconds the mock provider adds to every context call.
+function utSetMockLatency(latencyMs) {
+  native.get().utSetMockLatency(latencyMs);
+}
+
+// Lifetime in milliseconds the mock provider reports for new credentials.
+// Negative restores the default.
+function utSetMockCredentialLifetime(lifetimeMs) {
+  native.get().utSetMockCredentialLifetime(lifetimeMs);
 }
 
 module.exports.SspiClient = SspiClient;
 module.exports.ensureInitialization = ensureInitialization;
 module.exports.getAvailableSspiPackageNames = getAvailableSspiPackageNames;
 module.exports.getDefaultSspiPackageName = getDefaultSspiPackageName;
+module.exports.getProviderName = getProviderName;
+module.exports.getCredentialCacheStats = getCredentialCacheStats;
+module.exports.clearCredentialCache = clearCredentialCache;
+module.exports.getBufferPoolStats = getBufferPoolStats;
+module.exports.getBlobStats = getBlobStats;
+module.exports.getNextBlobBatch = getNextBlobBatch;
+module.exports.prefetchTickets = prefetchTickets;
+module.exports.configureWorkerPool = configureWorkerPool;
+module.exports.configureScheduler = configureScheduler;
+module.exports.getWorkerPoolStats = getWorkerPoolStats;
+module.exports.configureFirstLegPool = configureFirstLegPool;
+module.exports.getFirstLegPoolStats = getFirstLegPoolStats;
+module.exports.configureClientPool = configureClientPool;
+module.exports.acquireClient = acquireClient;
+module.exports.releaseClient = releaseClient;
+module.exports.getClientPoolStats = getClientPoolStats;
+module.exports.errorCodes = errorCodes;
+module.exports.configureHandshakeAdmission = configureHandshakeAdmission;
+module.exports.getHandshakeAdmissionStats = getHandshakeAdmissionStats;
+module.exports.configureExpiryRefresh = configureExpiryRefresh;
+module.exports.refreshExpiring = refreshExpiring;
+module.exports.getExpiryRefreshStats = getExpiryRefreshStats;
+module.exports.getStats = getStats;
+module.exports.resetStats = resetStats;
+module.exports.configureTracing = configureTracing;
+module.exports.drainTrace = drainTrace;
+module.exports.getTraceStats = getTraceStats;
+module.exports.startTranscriptRecording = startTranscriptRecording;
+module.exports.stopTranscriptRecording = stopTranscriptRecording;
+module.exports.loadReplayTranscripts = loadReplayTranscripts;
+module.exports.getTranscriptStats = getTranscriptStats;
 module.exports.enableNativeDebugLogging = enableNativeDebugLogging;
 module.exports.disableNativeDebugLogging = disableNativeDebugLogging;
+module.exports.utResetBlobStats = utResetBlobStats;
+module.exports.utResetBufferPoolStats = utResetBufferPoolStats;
+module.exports.utSetBufferPoolEnabled = utSetBufferPoolEnabled;
+module.exports.utSetMockCredentialLifetime = utSetMockCredentialLifetime;
+module.exports.utResetWorkerPoolStats = utResetWorkerPoolStats;
+module.exports.utResetFirstLegPoolStats = utResetFirstLegPoolStats;
+module.exports.utSetMockLatency = utSetMockLatency;
+module.exports.utSetMockTicketLatency = utSetMockTicketLatency;
+module.exports.utResetExpiryRefreshStats = utResetExpiryRefreshStats;
+module.exports.utSetClockOffset = utSetClockOffset;
+module.exports.utSetMockTicketLifetime = utSetMockTicketLifetime;
+module.exports.utResetHandshakeAdmissionStats = utResetHandshakeAdmissionStats;
@@ -0,0 +1,150 @@
+'use strict';
+
+const MessageProtection = require('./message_protection');
+const platform = require('./platform');
+const native = require('./native');
+const Scheduling = require('./scheduling');
+
+// Server side of SSPI authentication. Accepts the blobs generated by
+// SspiClient.getNextBlob and generates the responses to send back. Uses the
+// same provider as SspiClient. This is meant for loopback testing and load
+// generation, mainly with the 'mock' provider.
+class SspiServer {
+  // securityPackage - Should be one of 'negotiate', 'kerberos', 'ntlm'.
+  constructor(securityPackage) {
+    platform.throwIfNotSupported();
+
+    if (arguments.length !== 1) {
+      throw new Error('Invalid number of arguments.');
+    }
+
+    if (typeof (securityPackage) !== 'string') {
+      throw new TypeError('Invalid argument type for \'securityPackage\'.');
+    }
+
+    this.securityPackage = securityPackage;
+    this.sspiServerImpl = new (native.get().SspiServer)(securityPackage);
+    this.acceptNextBlobInProgress = false;
+    this.messagesInProgress = false;
+  }
+
+  // Accepts the next blob from the client.
+  //
+  // clientResponse - Buffer with SSPI blob from the client. Read in place by
+  //                  native code, must not be modified until cb is invoked.
+  // clientResponseBeginOffset - Offset within the buffer where the blob begins.
+  // clientResponseLength - Length of blob within the buffer.
+  // options - Optional object with deadlineMs and tenant, same as for
+  //           SspiClient.getNextBlob. deadlineMs defaults to the configured
+  //           deadline, tenant to the security package.
+  //
+  // Signature of cb is:
+  //  cb(serverResponse, isDone, errorCode, errorString)
+  //      serverResponse - Buffer to send to the client, may be empty when isDone.
+  //      isDone - boolean that specifies if the negotiation is done.
+  //      errorCode - number representing an error code from the provider.
+  //                  0 is success, non-zero failure.
+  //      errorString - string error details.
+  acceptNextBlob(clientResponse, clientResponseBeginOffset, clientResponseLength, options, cb) {
+    if (arguments.length === 4) {
+      cb = options;
+      options = undefined;
+    } else if (arguments.length !== 5) {
+      throw new Error('Invalid number of arguments.');
+    }
+
+    if (!(clientResponse instanceof Buffer)) {
+      throw new TypeError('Invalid argument type for \'clientResponse\'.');
+    }
+
+    if (clientResponseBeginOffset + clientResponseLength > clientResponse.length) {
+      throw new RangeError('\'clientResponse\' buffer too small.');
+    }
+
+    const scheduling = Scheduling.getScheduling(options, 'options', this.securityPackage, 0);
+
+    if (typeof (cb) !== 'function') {
+      throw new TypeError('Invalid argument type for \'cb\'.');
+    }
+
+    if (this.acceptNextBlobInProgress) {
+      throw new Error('Single invocation of acceptNextBlob per instance of SspiServer may be in flight.');
+    }
+
+    this.throwIfMessagesInProgress();
+
+    this.acceptNextBlobInProgress = true;
+
+    const sspiServer = this;
+    this.sspiServerImpl.acceptNextBlob(clientResponse, clientResponseBeginOffset, clientResponseLength,
+      scheduling.tenant, scheduling.deadlineMs,
+      function() {
+        sspiServer.acceptNextBlobInProgress = false;
+        cb.apply(null, arguments);
+      });
+  }
+
+  // Message protection with the established context, once acceptNextBlob
+  // has reported isDone. Same as the SspiClient methods of the same names,
+  // tenant defaults to the security package.
+  sign(messages, options, cb) {
+    this.processMessages(MessageProtection.c_operationSign, messages, options, cb, arguments.length);
+  }
+
+  verify(messages, options, cb) {
+    this.processMessages(MessageProtection.c_operationVerify, messages, options, cb, arguments.length);
+  }
+
+  encrypt(messages, options, cb) {
+    this.processMessages(MessageProtection.c_operationEncrypt, messages, options, cb, arguments.length);
+  }
+
+  decrypt(messages, options, cb) {
+    this.processMessages(MessageProtection.c_operationDecrypt, messages, options, cb, arguments.length);
+  }
+
+  getMessageSizes() {
+    this.throwIfBusy();
+    return MessageProtection.getMessageSizes(this.sspiServerImpl);
+  }
+
+  processMessages(operation, messages, options, cb, argumentCount) {
+    if (argumentCount === 2) {
+      cb = options;
+      options = undefined;
+    } else if (argumentCount !== 3) {
+      throw new Error('Invalid number of arguments.');
+    }
+
+    const scheduling = Scheduling.getScheduling(options, 'options', this.securityPackage, 0);
+
+    if (typeof (cb) !== 'function') {
+      throw new TypeError('Invalid argument type for \'cb\'.');
+    }
+
+    this.throwIfBusy();
+
+    const sspiServer = this;
+    MessageProtection.processMessages(this.sspiServerImpl, operation, messages, scheduling, function() {
+      sspiServer.messagesInProgress = false;
+      cb.apply(null, arguments);
+    });
+    this.messagesInProgress = true;
+  }
+
+  throwIfBusy() {
+    if (this.acceptNextBlobInProgress) {
+      throw new Error('Single invocation of acceptNextBlob per instance of SspiServer may be in flight.');
+    }
+
+    this.throwIfMessagesInProgress();
+  }
+
+  throwIfMessagesInProgress() {
+    if (this.messagesInProgress) {
+      throw new Error('Single invocation of message protection per instance of SspiServer may be in flight.');
+    }
+  }
+}
+
+module.exports.SspiServer = SspiServer;
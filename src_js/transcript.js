@@ -0,0 +1,112 @@
+'use strict';
+
+// Reads transcript files written by startTranscriptRecording, without the
+// native module. Layout is described in src_native/transcript.h.
+
+const fs = require('fs');
+
+const c_magic = 'SSPITRN1';
+const c_version = 1;
+const c_headerSize = 16;
+const c_recordHeaderSize = 48;
+const c_flagIsDone = 0x1;
+
+// Returns the records in buffer in file order, each with contextId, a hex
+// string, timestampUs, durationUs, status, isDone, leg, securityPackage, spn,
+// inToken and outToken. Tokens are slices of buffer. A record cut short at
+// the end is left out.
+function parseRecords(buffer) {
+  if (buffer.length < c_headerSize
+    || buffer.toString('ascii', 0, 8) !== c_magic
+    || buffer.readUInt32LE(8) !== c_version
+    || buffer.readUInt32LE(12) < c_headerSize) {
+    throw new Error('Not a transcript file.');
+  }
+
+  const records = [];
+  let offset = buffer.readUInt32LE(12);
+  while (buffer.length - offset >= c_recordHeaderSize) {
+    const recordSize = buffer.readUInt32LE(offset);
+    const securityPackageLength = buffer.readUInt16LE(offset + 34);
+    const spnLength = buffer.readUInt16LE(offset + 36);
+    const inTokenLength = buffer.readUInt32LE(offset + 40);
+    const outTokenLength = buffer.readUInt32LE(offset + 44);
+    const contentSize = c_recordHeaderSize + securityPackageLength + spnLength + inTokenLength + outTokenLength;
+    if (recordSize < contentSize || recordSize > buffer.length - offset) {
+      break;
+    }
+
+    let p = offset + c_recordHeaderSize;
+    const record = {
+      contextId: buffer.readUInt32LE(offset + 12).toString(16) + ('0000000' + buffer.readUInt32LE(offset + 8).toString(16)).slice(-8),
+      timestampUs: buffer.readUInt32LE(offset + 20) * 0x100000000 + buffer.readUInt32LE(offset + 16),
+      durationUs: buffer.readUInt32LE(offset + 24),
+      status: buffer.readUInt32LE(offset + 28),
+      isDone: (buffer.readUInt32LE(offset + 4) & c_flagIsDone) !== 0,
+      leg: buffer.readUInt16LE(offset + 32)
+    };
+
+    record.securityPackage = buffer.toString('utf8', p, p + securityPackageLength);
+    p += securityPackageLength;
+    record.spn = buffer.toString('utf8', p, p + spnLength);
+    p += spnLength;
+    record.inToken = buffer.slice(p, p + inTokenLength);
+    p += inTokenLength;
+    record.outToken = buffer.slice(p, p + outTokenLength);
+
+    records.push(record);
+    offset += recordSize;
+  }
+
+  return records;
+}
+
+// Groups records into handshakes, in the order their first legs were
+// recorded, the way the 'replay' provider does. Each has contextId,
+// securityPackage, spn and legs, with inToken, outToken, status, isDone,
+// timestampUs and durationUs. Handshakes whose first leg wasn't recorded are
+// left out, as are legs after one that's missing.
+function groupHandshakes(records) {
+  const handshakes = [];
+  const handshakesByContextId = new Map();
+  records.forEach((record) => {
+    let handshake = handshakesByContextId.get(record.contextId);
+    if (handshake === undefined) {
+      if (record.leg !== 0) {
+        return;
+      }
+
+      handshake = {
+        contextId: record.contextId,
+        securityPackage: record.securityPackage,
+        spn: record.spn,
+        legs: []
+      };
+      handshakesByContextId.set(record.contextId, handshake);
+      handshakes.push(handshake);
+    }
+
+    if (record.leg === handshake.legs.length) {
+      handshake.legs.push({
+        inToken: record.inToken,
+        outToken: record.outToken,
+        status: record.status,
+        isDone: record.isDone,
+        timestampUs: record.timestampUs,
+        durationUs: record.durationUs
+      });
+    }
+  });
+
+  return handshakes;
+}
+
+// Returns the handshakes recorded in the transcript file at path, see
+// groupHandshakes.
+function readHandshakes(path) {
+  return groupHandshakes(parseRecords(fs.readFileSync(path)));
+}
+
+module.exports.parseRecords = parseRecords;
+module.exports.groupHandshakes = groupHandshakes;
+module.exports.readHandshakes = readHandshakes;
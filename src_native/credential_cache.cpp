@@ -0,0 +1,299 @@
+#include "node_version_support.h"
+#ifdef IS_SUPPORTED_NODE_VERSION
+
+#include "credential_cache.h"
+
+#include "utils.h"
+#include "worker_pool.h"
+
+#include <vector>
+
+CachedCredential::CachedCredential(SspiProvider* provider, const CredHandle& credHandle, int64_t expiryUnixMs) :
+    m_provider(provider),
+    m_credHandle(credHandle),
+    m_expiryUnixMs(expiryUnixMs)
+{
+}
+
+CachedCredential::~CachedCredential()
+{
+    TraceCallTimer traceTimer;
+    SECURITY_STATUS securityStatus = m_provider->FreeCredentials(&m_credHandle);
+    traceTimer.Complete(c_traceCallFreeCredentials, securityStatus);
+    if (securityStatus != SEC_E_OK)
+    {
+        DebugLog(
+            "%d: FreeCredentialHandle failed with error code: %ld.\n",
+            GetCurrentThreadId(),
+            securityStatus);
+    }
+}
+
+CredHandle* CachedCredential::GetHandle()
+{
+    return &m_credHandle;
+}
+
+int64_t CachedCredential::GetExpiryUnixMs() const
+{
+    return m_expiryUnixMs;
+}
+
+bool CredentialCache::Key::operator<(const Key& other) const
+{
+    if (provider != other.provider)
+    {
+        return provider < other.provider;
+    }
+
+    if (credentialUse != other.credentialUse)
+    {
+        return credentialUse < other.credentialUse;
+    }
+
+    if (securityPackage != other.securityPackage)
+    {
+        return securityPackage < other.securityPackage;
+    }
+
+    return principal < other.principal;
+}
+
+// static
+CredentialCache* CredentialCache::GetInstance()
+{
+    // Intentionally leaked, calls on worker threads may still be using cached
+    // credentials, and refreshes may still be running on worker pool threads,
+    // while static destructors run at process exit.
+    static CredentialCache* s_credentialCache = new CredentialCache();
+    return s_credentialCache;
+}
+
+CredentialCache::CredentialCache() :
+    m_mutex(),
+    m_acquireCompleted(),
+    m_slots(),
+    m_random(static_cast<unsigned int>(GetUnixTimeMs())),
+    m_stats()
+{
+}
+
+CredentialCache::~CredentialCache()
+{
+}
+
+SECURITY_STATUS CredentialCache::Acquire(
+    SspiProvider* provider,
+    const WCHAR* principal,
+    const WCHAR* securityPackage,
+    unsigned long credentialUse,
+    std::shared_ptr<CachedCredential>* credential)
+{
+    Key key;
+    key.provider = provider;
+    key.credentialUse = credentialUse;
+
+    // Package names are case insensitive.
+    for (const WCHAR* p = securityPackage; *p; p++)
+    {
+        key.securityPackage.push_back((*p >= 'A' && *p <= 'Z') ? static_cast<WCHAR>(*p - 'A' + 'a') : *p);
+    }
+
+    if (principal != nullptr)
+    {
+        key.principal.assign(principal);
+    }
+
+    // Declared before the lock so an evicted credential is freed after the
+    // lock is released.
+    std::shared_ptr<Slot> evictedSlot;
+
+    std::unique_lock<std::mutex> lock(m_mutex);
+
+    std::map<Key, std::shared_ptr<Slot>>::iterator it = m_slots.find(key);
+    if (it != m_slots.end())
+    {
+        std::shared_ptr<Slot> slot = it->second;
+        if (slot->isAcquiring)
+        {
+            m_stats.waits++;
+            m_acquireCompleted.wait(lock, [&slot]() { return !slot->isAcquiring; });
+            *credential = slot->credential;
+            return slot->securityStatus;
+        }
+
+        if (GetUnixTimeMs() < slot->credential->GetExpiryUnixMs())
+        {
+            m_stats.hits++;
+            *credential = slot->credential;
+            return SEC_E_OK;
+        }
+
+        m_stats.evictions++;
+        evictedSlot = slot;
+        m_slots.erase(it);
+    }
+
+    m_stats.misses++;
+
+    std::shared_ptr<Slot> slot(new Slot());
+    slot->isAcquiring = true;
+    slot->securityStatus = SEC_E_INTERNAL_ERROR;
+    slot->securityPackage.assign(securityPackage);
+    if (principal != nullptr)
+    {
+        slot->principal.assign(principal);
+    }
+
+    slot->jitterFraction = std::uniform_real_distribution<double>(0.0, 1.0)(m_random);
+    slot->isRefreshing = false;
+    m_slots[key] = slot;
+
+    // Acquire without holding the lock, acquisitions of other credentials
+    // must not wait for this one.
+    lock.unlock();
+
+    CredHandle credHandle;
+    SecInvalidateHandle(&credHandle);
+    TimeStamp timeExpiry;
+    TraceCallTimer traceTimer;
+    SECURITY_STATUS securityStatus = provider->AcquireCredentials(
+        principal,
+        securityPackage,
+        credentialUse,
+        &credHandle,
+        &timeExpiry);
+    traceTimer.Complete(c_traceCallAcquireCredentials, securityStatus);
+
+    lock.lock();
+
+    if (securityStatus == SEC_E_OK)
+    {
+        m_stats.acquisitions++;
+        slot->credential.reset(new CachedCredential(provider, credHandle, TimeStampToUnixMs(timeExpiry)));
+    }
+    else
+    {
+        // Failures are not cached, the next caller tries again.
+        m_stats.failures++;
+        it = m_slots.find(key);
+        if (it != m_slots.end() && it->second == slot)
+        {
+            m_slots.erase(it);
+        }
+    }
+
+    slot->isAcquiring = false;
+    slot->securityStatus = securityStatus;
+    *credential = slot->credential;
+
+    lock.unlock();
+    m_acquireCompleted.notify_all();
+
+    return securityStatus;
+}
+
+void CredentialCache::Clear()
+{
+    // Freed after the lock is released.
+    std::vector<std::shared_ptr<Slot>> evictedSlots;
+
+    std::lock_guard<std::mutex> lock(m_mutex);
+
+    // Slots being acquired stay, their waiters still need the result.
+    for (std::map<Key, std::shared_ptr<Slot>>::iterator it = m_slots.begin(); it != m_slots.end();)
+    {
+        if (it->second->isAcquiring)
+        {
+            ++it;
+        }
+        else
+        {
+            m_stats.evictions++;
+            evictedSlots.push_back(it->second);
+            it = m_slots.erase(it);
+        }
+    }
+}
+
+int CredentialCache::RefreshExpiring(int64_t refreshAheadMs, int64_t jitterMs)
+{
+    int64_t nowMs = GetUnixTimeMs();
+    int started = 0;
+
+    std::lock_guard<std::mutex> lock(m_mutex);
+    for (std::map<Key, std::shared_ptr<Slot>>::iterator it = m_slots.begin(); it != m_slots.end(); ++it)
+    {
+        std::shared_ptr<Slot> slot = it->second;
+        if (slot->isAcquiring || slot->isRefreshing)
+        {
+            continue;
+        }
+
+        int64_t refreshAtMs = slot->credential->GetExpiryUnixMs()
+            - refreshAheadMs
+            - static_cast<int64_t>(slot->jitterFraction * jitterMs);
+        if (nowMs < refreshAtMs)
+        {
+            continue;
+        }
+
+        slot->isRefreshing = true;
+        started++;
+
+        // this is never destroyed, see GetInstance, so the task may outlive
+        // the pass that queued it.
+        Key key = it->first;
+        WorkerPool::GetInstance()->SubmitBackground(std::string(), [this, key, slot]()
+        {
+            Refresh(key, slot);
+        });
+    }
+
+    return started;
+}
+
+void CredentialCache::Refresh(const Key& key, const std::shared_ptr<Slot>& slot)
+{
+    DebugLog("%d: Worker thread: CredentialCache::Refresh.\n", GetCurrentThreadId());
+
+    CredHandle credHandle;
+    SecInvalidateHandle(&credHandle);
+    TimeStamp timeExpiry;
+    TraceCallTimer traceTimer;
+    SECURITY_STATUS securityStatus = key.provider->AcquireCredentials(
+        slot->principal.empty() ? nullptr : slot->principal.c_str(),
+        slot->securityPackage.c_str(),
+        key.credentialUse,
+        &credHandle,
+        &timeExpiry);
+    traceTimer.Complete(c_traceCallAcquireCredentials, securityStatus);
+
+    // The replaced credential is freed after the lock is released, once
+    // everyone using it lets go.
+    std::shared_ptr<CachedCredential> replacedCredential;
+
+    std::lock_guard<std::mutex> lock(m_mutex);
+    slot->isRefreshing = false;
+    if (securityStatus != SEC_E_OK)
+    {
+        // Tried again on the next pass, the current credential stays until
+        // it expires.
+        m_stats.refreshFailures++;
+        return;
+    }
+
+    m_stats.refreshes++;
+    replacedCredential = slot->credential;
+    slot->credential.reset(new CachedCredential(key.provider, credHandle, TimeStampToUnixMs(timeExpiry)));
+    slot->jitterFraction = std::uniform_real_distribution<double>(0.0, 1.0)(m_random);
+}
+
+void CredentialCache::GetStats(CredentialCacheStats* stats)
+{
+    std::lock_guard<std::mutex> lock(m_mutex);
+    *stats = m_stats;
+    stats->size = m_slots.size();
+}
+
+#endif  // IS_SUPPORTED_NODE_VERSION
@@ -0,0 +1,121 @@
+#pragma once
+
+#include "sspi_platform.h"
+#include "sspi_provider.h"
+
+#include <condition_variable>
+#include <map>
+#include <memory>
+#include <mutex>
+#include <random>
+#include <string>
+
+// Credential handle shared by everyone using the same provider, package,
+// principal and direction. The handle is freed when the last user lets go of
+// it and the cache no longer holds it.
+class CachedCredential
+{
+public:
+    CachedCredential(SspiProvider* provider, const CredHandle& credHandle, int64_t expiryUnixMs);
+    ~CachedCredential();
+
+    CredHandle* GetHandle();
+    int64_t GetExpiryUnixMs() const;
+
+private:
+    // Not implemented.
+    CachedCredential(const CachedCredential&);
+    CachedCredential& operator=(const CachedCredential&);
+
+    SspiProvider* m_provider;
+    CredHandle m_credHandle;
+    int64_t m_expiryUnixMs;
+};
+
+struct CredentialCacheStats
+{
+    uint64_t hits;
+    uint64_t misses;
+    uint64_t waits;
+    uint64_t acquisitions;
+    uint64_t failures;
+    uint64_t evictions;
+    uint64_t refreshes;
+    uint64_t refreshFailures;
+    uint64_t size;
+};
+
+// Process-wide, thread-safe cache of credential handles. Concurrent first
+// time acquisitions of the same credential are single-flighted: one caller
+// acquires, the others wait for its result. Entries are evicted once the
+// expiry reported by the provider passes; callers holding an evicted
+// credential keep using it until they release it. RefreshExpiring replaces
+// entries ahead of their expiry, so callers never wait for an acquisition
+// once an entry exists.
+class CredentialCache
+{
+public:
+    static CredentialCache* GetInstance();
+
+    // principal may be nullptr for the logged in user.
+    SECURITY_STATUS Acquire(
+        SspiProvider* provider,
+        const WCHAR* principal,
+        const WCHAR* securityPackage,
+        unsigned long credentialUse,
+        std::shared_ptr<CachedCredential>* credential);
+
+    // Drops all entries. Credentials in use stay valid until released.
+    void Clear();
+
+    // Acquires replacements, on the WorkerPool, for entries that expire
+    // within refreshAheadMs plus a share of jitterMs picked at random per
+    // entry, so processes that acquired at the same time refresh at
+    // different times. Acquire returns the current credential until its
+    // replacement is in. Returns the number of refreshes started.
+    int RefreshExpiring(int64_t refreshAheadMs, int64_t jitterMs);
+
+    void GetStats(CredentialCacheStats* stats);
+
+private:
+    CredentialCache();
+
+    // Not implemented. Never destroyed, see GetInstance.
+    CredentialCache(const CredentialCache&);
+    CredentialCache& operator=(const CredentialCache&);
+    ~CredentialCache();
+
+    struct Key
+    {
+        SspiProvider* provider;
+        std::basic_string<WCHAR> securityPackage;
+        std::basic_string<WCHAR> principal;
+        unsigned long credentialUse;
+
+        bool operator<(const Key& other) const;
+    };
+
+    struct Slot
+    {
+        std::shared_ptr<CachedCredential> credential;
+        bool isAcquiring;
+        SECURITY_STATUS securityStatus;
+
+        // Arguments the credential was acquired with, to refresh it.
+        std::basic_string<WCHAR> principal;
+        std::basic_string<WCHAR> securityPackage;
+
+        // Share of the refresh jitter for this credential, 0 to 1.
+        double jitterFraction;
+        bool isRefreshing;
+    };
+
+    // Runs on a WorkerPool thread.
+    void Refresh(const Key& key, const std::shared_ptr<Slot>& slot);
+
+    std::mutex m_mutex;
+    std::condition_variable m_acquireCompleted;
+    std::map<Key, std::shared_ptr<Slot>> m_slots;
+    std::minstd_rand m_random;
+    CredentialCacheStats m_stats;
+};
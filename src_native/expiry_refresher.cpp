@@ -0,0 +1,206 @@
+#include "node_version_support.h"
+#ifdef IS_SUPPORTED_NODE_VERSION
+
+#include "expiry_refresher.h"
+
+#include "credential_cache.h"
+#include "first_leg_pool.h"
+#include "sspi_impl.h"
+#include "utils.h"
+#include "worker_pool.h"
+
+// static
+ExpiryRefresher* ExpiryRefresher::GetInstance()
+{
+    // Intentionally leaked, refreshes may still be running on worker pool
+    // threads while static destructors run at process exit.
+    static ExpiryRefresher* s_expiryRefresher = new ExpiryRefresher();
+    return s_expiryRefresher;
+}
+
+ExpiryRefresher::ExpiryRefresher() :
+    m_enabled(false),
+    m_mutex(),
+    m_refreshAheadMs(c_defaultRefreshAheadMs),
+    m_jitterMs(c_defaultJitterMs),
+    m_tickets(),
+    m_random(static_cast<unsigned int>(GetUnixTimeMs())),
+    m_passes(0),
+    m_ticketRefreshes(0),
+    m_ticketRefreshFailures(0),
+    m_ticketsDropped(0)
+{
+}
+
+ExpiryRefresher::~ExpiryRefresher()
+{
+}
+
+void ExpiryRefresher::Configure(bool enabled, int64_t refreshAheadMs, int64_t jitterMs)
+{
+    DebugLog("%d: Main event loop: ExpiryRefresher::Configure: enabled=%d.\n", GetCurrentThreadId(), enabled);
+
+    std::lock_guard<std::mutex> lock(m_mutex);
+    m_refreshAheadMs = refreshAheadMs;
+    m_jitterMs = jitterMs;
+    m_enabled.store(enabled);
+    if (!enabled)
+    {
+        m_tickets.clear();
+    }
+}
+
+void ExpiryRefresher::TrackContext(const std::string& spn, const std::string& securityPackage, int64_t expiryUnixMs)
+{
+    if (!m_enabled.load())
+    {
+        return;
+    }
+
+    std::lock_guard<std::mutex> lock(m_mutex);
+
+    std::string key = MakeSpnPackageKey(spn, securityPackage);
+    std::map<std::string, Ticket>::iterator it = m_tickets.find(key);
+    if (it == m_tickets.end())
+    {
+        Ticket ticket;
+        ticket.spn = spn;
+        ticket.securityPackage = securityPackage;
+        ticket.expiryUnixMs = 0;
+        ticket.jitterFraction = 0;
+        ticket.isRefreshing = false;
+        it = m_tickets.insert(std::make_pair(key, ticket)).first;
+    }
+
+    Ticket& ticket = it->second;
+    ticket.isUsedSinceRefresh = true;
+    if (ticket.expiryUnixMs != expiryUnixMs)
+    {
+        ticket.expiryUnixMs = expiryUnixMs;
+        ticket.jitterFraction = std::uniform_real_distribution<double>(0.0, 1.0)(m_random);
+    }
+}
+
+void ExpiryRefresher::RefreshDue()
+{
+    if (!m_enabled.load())
+    {
+        return;
+    }
+
+    int64_t refreshAheadMs;
+    int64_t jitterMs;
+    {
+        std::lock_guard<std::mutex> lock(m_mutex);
+        m_passes++;
+        refreshAheadMs = m_refreshAheadMs;
+        jitterMs = m_jitterMs;
+    }
+
+    CredentialCache::GetInstance()->RefreshExpiring(refreshAheadMs, jitterMs);
+
+    int64_t nowMs = GetUnixTimeMs();
+    std::lock_guard<std::mutex> lock(m_mutex);
+    for (std::map<std::string, Ticket>::iterator it = m_tickets.begin(); it != m_tickets.end();)
+    {
+        Ticket& ticket = it->second;
+        int64_t refreshAtMs = ticket.expiryUnixMs
+            - refreshAheadMs
+            - static_cast<int64_t>(ticket.jitterFraction * jitterMs);
+        if (ticket.isRefreshing || nowMs < refreshAtMs)
+        {
+            ++it;
+            continue;
+        }
+
+        if (!ticket.isUsedSinceRefresh)
+        {
+            m_ticketsDropped++;
+            it = m_tickets.erase(it);
+            continue;
+        }
+
+        ticket.isRefreshing = true;
+        ticket.isUsedSinceRefresh = false;
+
+        std::string key = it->first;
+        std::string spn = ticket.spn;
+        std::string securityPackage = ticket.securityPackage;
+        WorkerPool::GetInstance()->SubmitBackground(spn, [this, key, spn, securityPackage]()
+        {
+            RefreshTicket(key, spn, securityPackage);
+        });
+
+        ++it;
+    }
+}
+
+void ExpiryRefresher::RefreshTicket(const std::string& key, const std::string& spn, const std::string& securityPackage)
+{
+    DebugLog("%d: Worker thread: ExpiryRefresher::RefreshTicket: spn=%s.\n", GetCurrentThreadId(), spn.c_str());
+
+    FirstLeg firstLeg;
+    std::string errorString;
+    SECURITY_STATUS securityStatus = SspiImpl::GenerateFirstLeg(spn, securityPackage, &firstLeg, &errorString);
+
+    int64_t expiryUnixMs = 0;
+    if (securityStatus == SEC_E_OK)
+    {
+        expiryUnixMs = firstLeg.expiryUnixMs;
+        FirstLegPool::Discard(&firstLeg);
+    }
+
+    std::lock_guard<std::mutex> lock(m_mutex);
+    std::map<std::string, Ticket>::iterator it = m_tickets.find(key);
+    if (securityStatus != SEC_E_OK)
+    {
+        // Tried again on the next pass if the SPN is logged in to meanwhile,
+        // a KDC that's down shouldn't be hammered in the background.
+        DebugLog("%d: Worker thread: ExpiryRefresher::RefreshTicket: %s\n", GetCurrentThreadId(), errorString.c_str());
+        m_ticketRefreshFailures++;
+        if (it != m_tickets.end())
+        {
+            it->second.isRefreshing = false;
+        }
+
+        return;
+    }
+
+    m_ticketRefreshes++;
+    if (it != m_tickets.end())
+    {
+        Ticket& ticket = it->second;
+        ticket.isRefreshing = false;
+        if (ticket.expiryUnixMs < expiryUnixMs)
+        {
+            ticket.expiryUnixMs = expiryUnixMs;
+            ticket.jitterFraction = std::uniform_real_distribution<double>(0.0, 1.0)(m_random);
+        }
+    }
+}
+
+void ExpiryRefresher::GetStats(ExpiryRefresherStats* stats)
+{
+    CredentialCacheStats credentialCacheStats;
+    CredentialCache::GetInstance()->GetStats(&credentialCacheStats);
+
+    std::lock_guard<std::mutex> lock(m_mutex);
+    stats->passes = m_passes;
+    stats->credentialRefreshes = credentialCacheStats.refreshes;
+    stats->credentialRefreshFailures = credentialCacheStats.refreshFailures;
+    stats->ticketRefreshes = m_ticketRefreshes;
+    stats->ticketRefreshFailures = m_ticketRefreshFailures;
+    stats->ticketsDropped = m_ticketsDropped;
+    stats->tickets = m_tickets.size();
+}
+
+void ExpiryRefresher::ResetStats()
+{
+    std::lock_guard<std::mutex> lock(m_mutex);
+    m_passes = 0;
+    m_ticketRefreshes = 0;
+    m_ticketRefreshFailures = 0;
+    m_ticketsDropped = 0;
+}
+
+#endif  // IS_SUPPORTED_NODE_VERSION
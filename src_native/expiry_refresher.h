@@ -0,0 +1,90 @@
+#pragma once
+
+#include <atomic>
+#include <map>
+#include <mutex>
+#include <random>
+#include <stdint.h>
+#include <string>
+
+struct ExpiryRefresherStats
+{
+    uint64_t passes;
+    uint64_t credentialRefreshes;
+    uint64_t credentialRefreshFailures;
+    uint64_t ticketRefreshes;
+    uint64_t ticketRefreshFailures;
+    uint64_t ticketsDropped;
+    uint64_t tickets;
+};
+
+// Process-wide, thread-safe background renewal of what logins would
+// otherwise renew inline once it expires: credential handles, through
+// CredentialCache::RefreshExpiring, and service tickets. Tickets are tracked
+// per SPN and security package from the expiry of completed client contexts.
+// A ticket is refreshed ahead of its expiry by running a first leg for its
+// SPN on the WorkerPool, which renews the ticket if the provider considers it
+// close enough to expiry. Refresh times are spread with a random jitter per
+// entry, so a fleet that logged in together doesn't renew together.
+//
+// Tickets of SPNs not logged in to since their last refresh are dropped
+// rather than refreshed again. Disabled until configured. RefreshDue only
+// starts work, cheap enough for the main event loop; the JavaScript layer
+// calls it on a timer.
+class ExpiryRefresher
+{
+public:
+    static ExpiryRefresher* GetInstance();
+
+    // Refreshes are due refreshAheadMs plus up to jitterMs before expiry.
+    // Disabling drops the tracked tickets.
+    void Configure(bool enabled, int64_t refreshAheadMs, int64_t jitterMs);
+
+    // Called for each client context that completes. Cheap when disabled.
+    void TrackContext(const std::string& spn, const std::string& securityPackage, int64_t expiryUnixMs);
+
+    // Starts refreshes of the credentials and tickets that are due.
+    void RefreshDue();
+
+    void GetStats(ExpiryRefresherStats* stats);
+    void ResetStats();
+
+    static const int64_t c_defaultRefreshAheadMs = 2 * 60 * 1000;
+    static const int64_t c_defaultJitterMs = 2 * 60 * 1000;
+
+private:
+    ExpiryRefresher();
+
+    // Not implemented. Never destroyed, see GetInstance.
+    ExpiryRefresher(const ExpiryRefresher&);
+    ExpiryRefresher& operator=(const ExpiryRefresher&);
+    ~ExpiryRefresher();
+
+    struct Ticket
+    {
+        std::string spn;
+        std::string securityPackage;
+        int64_t expiryUnixMs;
+
+        // Share of the jitter for this ticket, 0 to 1.
+        double jitterFraction;
+        bool isRefreshing;
+        bool isUsedSinceRefresh;
+    };
+
+    // Runs on a WorkerPool thread.
+    void RefreshTicket(const std::string& key, const std::string& spn, const std::string& securityPackage);
+
+    std::atomic<bool> m_enabled;
+
+    std::mutex m_mutex;
+    int64_t m_refreshAheadMs;
+    int64_t m_jitterMs;
+    std::map<std::string, Ticket> m_tickets;
+    std::minstd_rand m_random;
+
+    uint64_t m_passes;
+    uint64_t m_ticketRefreshes;
+    uint64_t m_ticketRefreshFailures;
+    uint64_t m_ticketsDropped;
+};
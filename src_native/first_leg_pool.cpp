@@ -0,0 +1,277 @@
+#include "node_version_support.h"
+#ifdef IS_SUPPORTED_NODE_VERSION
+
+#include "first_leg_pool.h"
+
+#include "sspi_impl.h"
+#include "utils.h"
+#include "worker_pool.h"
+
+// static
+FirstLegPool* FirstLegPool::GetInstance()
+{
+    // Intentionally leaked, refills may still be running on worker pool
+    // threads while static destructors run at process exit.
+    static FirstLegPool* s_firstLegPool = new FirstLegPool();
+    return s_firstLegPool;
+}
+
+FirstLegPool::FirstLegPool() :
+    m_mutex(),
+    m_pools(),
+    m_hits(0),
+    m_misses(0),
+    m_stale(0),
+    m_generated(0),
+    m_failures(0)
+{
+}
+
+FirstLegPool::~FirstLegPool()
+{
+}
+
+// static
+bool FirstLegPool::IsStale(const FirstLeg& firstLeg, int64_t maxAgeMs, int64_t nowMs)
+{
+    return nowMs - firstLeg.createdUnixMs >= maxAgeMs
+        || nowMs >= firstLeg.expiryUnixMs - c_expiryMarginMs;
+}
+
+void FirstLegPool::Configure(const std::string& spn, const std::string& securityPackage, int size, int64_t maxAgeMs)
+{
+    DebugLog("%d: Main event loop: FirstLegPool::Configure: spn=%s, size=%d.\n",
+        GetCurrentThreadId(),
+        spn.c_str(),
+        size);
+
+    // Discarded after the lock is released, deleting contexts calls into the
+    // provider.
+    std::vector<FirstLeg> discarded;
+
+    {
+        std::lock_guard<std::mutex> lock(m_mutex);
+
+        std::string key = MakeSpnPackageKey(spn, securityPackage);
+        std::map<std::string, std::shared_ptr<Pool>>::iterator it = m_pools.find(key);
+
+        if (size <= 0)
+        {
+            if (it != m_pools.end())
+            {
+                // Refills still running see size 0 and discard their legs.
+                it->second->size = 0;
+                discarded.assign(it->second->ready.begin(), it->second->ready.end());
+                m_pools.erase(it);
+            }
+        }
+        else
+        {
+            std::shared_ptr<Pool> pool;
+            if (it == m_pools.end())
+            {
+                pool = std::make_shared<Pool>();
+                pool->spn = spn;
+                pool->securityPackage = securityPackage;
+                pool->generating = 0;
+                m_pools[key] = pool;
+            }
+            else
+            {
+                pool = it->second;
+            }
+
+            pool->size = size;
+            pool->maxAgeMs = maxAgeMs > 0 ? maxAgeMs : c_defaultMaxAgeMs;
+            while (static_cast<int>(pool->ready.size()) > size)
+            {
+                discarded.push_back(pool->ready.back());
+                pool->ready.pop_back();
+            }
+
+            Refill(pool);
+        }
+    }
+
+    for (size_t i = 0; i < discarded.size(); i++)
+    {
+        Discard(&discarded[i]);
+    }
+}
+
+bool FirstLegPool::Take(
+    const std::string& spn,
+    const std::string& securityPackage,
+    SspiProvider* provider,
+    FirstLeg* firstLeg)
+{
+    std::vector<FirstLeg> discarded;
+    bool isHit = false;
+
+    {
+        std::lock_guard<std::mutex> lock(m_mutex);
+
+        std::map<std::string, std::shared_ptr<Pool>>::iterator it = m_pools.find(MakeSpnPackageKey(spn, securityPackage));
+        if (it == m_pools.end())
+        {
+            return false;
+        }
+
+        std::shared_ptr<Pool> pool = it->second;
+        int64_t nowMs = GetUnixTimeMs();
+        while (!pool->ready.empty())
+        {
+            FirstLeg readyLeg = pool->ready.front();
+            pool->ready.pop_front();
+
+            // Legs from a provider the client doesn't use are of no use to
+            // anyone after a provider switch either.
+            if (readyLeg.provider != provider || IsStale(readyLeg, pool->maxAgeMs, nowMs))
+            {
+                m_stale++;
+                discarded.push_back(readyLeg);
+                continue;
+            }
+
+            *firstLeg = readyLeg;
+            isHit = true;
+            break;
+        }
+
+        if (isHit)
+        {
+            m_hits++;
+        }
+        else
+        {
+            m_misses++;
+        }
+
+        Refill(pool);
+    }
+
+    for (size_t i = 0; i < discarded.size(); i++)
+    {
+        Discard(&discarded[i]);
+    }
+
+    return isHit;
+}
+
+// Called with m_mutex held.
+void FirstLegPool::Refill(const std::shared_ptr<Pool>& pool)
+{
+    int missing = pool->size - static_cast<int>(pool->ready.size()) - pool->generating;
+    for (int i = 0; i < missing; i++)
+    {
+        pool->generating++;
+        WorkerPool::GetInstance()->SubmitBackground(pool->spn, [this, pool]()
+        {
+            Generate(pool);
+        });
+    }
+}
+
+void FirstLegPool::Generate(const std::shared_ptr<Pool>& pool)
+{
+    DebugLog("%d: Worker thread: FirstLegPool::Generate: spn=%s.\n", GetCurrentThreadId(), pool->spn.c_str());
+
+    // spn and securityPackage never change once the pool is created.
+    FirstLeg firstLeg;
+    std::string errorString;
+    SECURITY_STATUS securityStatus = SspiImpl::GenerateFirstLeg(
+        pool->spn,
+        pool->securityPackage,
+        &firstLeg,
+        &errorString);
+
+    bool isKept = false;
+
+    {
+        std::lock_guard<std::mutex> lock(m_mutex);
+        pool->generating--;
+
+        // Failures are not retried until the next Take, a KDC that's down
+        // shouldn't be hammered in the background.
+        if (securityStatus != SEC_E_OK)
+        {
+            DebugLog("%d: Worker thread: FirstLegPool::Generate: %s\n", GetCurrentThreadId(), errorString.c_str());
+            m_failures++;
+            return;
+        }
+
+        m_generated++;
+        if (IsStale(firstLeg, pool->maxAgeMs, GetUnixTimeMs()))
+        {
+            m_stale++;
+        }
+        else if (static_cast<int>(pool->ready.size()) < pool->size)
+        {
+            pool->ready.push_back(firstLeg);
+            isKept = true;
+        }
+    }
+
+    if (!isKept)
+    {
+        Discard(&firstLeg);
+    }
+}
+
+// static
+void FirstLegPool::Discard(FirstLeg* firstLeg)
+{
+    if (SecIsValidHandle(&firstLeg->ctxtHandle))
+    {
+        TraceCallTimer traceTimer;
+        SECURITY_STATUS securityStatus = firstLeg->provider->DeleteContext(&firstLeg->ctxtHandle);
+        traceTimer.Complete(c_traceCallDeleteContext, securityStatus);
+        if (securityStatus != SEC_E_OK)
+        {
+            DebugLog(
+                "%d: DeleteSecurityContext failed with error code: %ld.\n",
+                GetCurrentThreadId(),
+                securityStatus);
+        }
+
+        SecInvalidateHandle(&firstLeg->ctxtHandle);
+    }
+
+    if (firstLeg->outBlob != nullptr)
+    {
+        SspiImpl::FreeBlob(firstLeg->outBlob);
+        firstLeg->outBlob = nullptr;
+    }
+
+    firstLeg->credential.reset();
+}
+
+void FirstLegPool::GetStats(FirstLegPoolStats* stats)
+{
+    std::lock_guard<std::mutex> lock(m_mutex);
+    stats->hits = m_hits;
+    stats->misses = m_misses;
+    stats->stale = m_stale;
+    stats->generated = m_generated;
+    stats->failures = m_failures;
+    stats->ready = 0;
+    stats->generating = 0;
+
+    for (std::map<std::string, std::shared_ptr<Pool>>::iterator it = m_pools.begin(); it != m_pools.end(); ++it)
+    {
+        stats->ready += it->second->ready.size();
+        stats->generating += it->second->generating;
+    }
+}
+
+void FirstLegPool::ResetStats()
+{
+    std::lock_guard<std::mutex> lock(m_mutex);
+    m_hits = 0;
+    m_misses = 0;
+    m_stale = 0;
+    m_generated = 0;
+    m_failures = 0;
+}
+
+#endif  // IS_SUPPORTED_NODE_VERSION
@@ -0,0 +1,116 @@
+#pragma once
+
+#include "credential_cache.h"
+#include "sspi_platform.h"
+#include "sspi_provider.h"
+
+#include <deque>
+#include <map>
+#include <memory>
+#include <mutex>
+#include <stdint.h>
+#include <string>
+#include <vector>
+
+// Security context after the first InitializeContext call, with the token it
+// produced. Ownership of the context and the token goes to whoever takes it
+// from the pool.
+struct FirstLeg
+{
+    SspiProvider* provider;
+    std::shared_ptr<CachedCredential> credential;
+    CtxtHandle ctxtHandle;
+
+    // Allocated with SspiImpl::AllocateBlob.
+    char* outBlob;
+    int outBlobLength;
+    int blobBufferSize;
+
+    int64_t createdUnixMs;
+    int64_t expiryUnixMs;
+};
+
+struct FirstLegPoolStats
+{
+    uint64_t hits;
+    uint64_t misses;
+    uint64_t stale;
+    uint64_t generated;
+    uint64_t failures;
+    uint64_t ready;
+    uint64_t generating;
+};
+
+// Process-wide, thread-safe pools of first legs, one per SPN and security
+// package that was opted in. The first leg takes no input, so it can be
+// generated before the connection to the server is up; a client that finds
+// one ready skips its first trip to a worker thread. Pools are refilled in the
+// background on the WorkerPool.
+//
+// Legs are stale once their context is about to expire or they are older than
+// the pool's maxAgeMs, as Kerberos authenticators carry a timestamp the
+// server checks against its clock. Stale legs are discarded, never handed out.
+class FirstLegPool
+{
+public:
+    static FirstLegPool* GetInstance();
+
+    // Keeps size legs ready for spn and securityPackage, empty for the
+    // default package. Size 0 removes the pool. Initialization must have
+    // completed.
+    void Configure(const std::string& spn, const std::string& securityPackage, int size, int64_t maxAgeMs);
+
+    // Takes a ready leg generated with provider. Returns false if there's
+    // none, counting a miss if there's a pool for spn and securityPackage.
+    bool Take(
+        const std::string& spn,
+        const std::string& securityPackage,
+        SspiProvider* provider,
+        FirstLeg* firstLeg);
+
+    // Deletes the context and frees the token of a leg nobody took.
+    static void Discard(FirstLeg* firstLeg);
+
+    void GetStats(FirstLegPoolStats* stats);
+    void ResetStats();
+
+    static const int64_t c_defaultMaxAgeMs = 60 * 1000;
+
+    // Legs whose context expires within this much are stale.
+    static const int64_t c_expiryMarginMs = 5 * 1000;
+
+private:
+    FirstLegPool();
+
+    // Not implemented. Never destroyed, see GetInstance.
+    FirstLegPool(const FirstLegPool&);
+    FirstLegPool& operator=(const FirstLegPool&);
+    ~FirstLegPool();
+
+    struct Pool
+    {
+        std::string spn;
+        std::string securityPackage;
+        int size;
+        int64_t maxAgeMs;
+        int generating;
+        std::deque<FirstLeg> ready;
+    };
+
+    static bool IsStale(const FirstLeg& firstLeg, int64_t maxAgeMs, int64_t nowMs);
+
+    // Called with m_mutex held.
+    void Refill(const std::shared_ptr<Pool>& pool);
+
+    // Runs on a WorkerPool thread.
+    void Generate(const std::shared_ptr<Pool>& pool);
+
+    std::mutex m_mutex;
+    std::map<std::string, std::shared_ptr<Pool>> m_pools;
+
+    uint64_t m_hits;
+    uint64_t m_misses;
+    uint64_t m_stale;
+    uint64_t m_generated;
+    uint64_t m_failures;
+};
@@ -0,0 +1,997 @@
+#include "node_version_support.h"
+#ifdef IS_SUPPORTED_NODE_VERSION
+
+#include "gssapi_sspi_provider.h"
+
+#include "utils.h"
+
+#include <gssapi/gssapi.h>
+#include <gssapi/gssapi_ext.h>
+#include <gssapi/gssapi_krb5.h>
+
+#include <chrono>
+#include <memory>
+#include <string.h>
+#include <strings.h>
+#include <vector>
+
+namespace
+{
+    gss_OID_desc c_spnegoMechOid = { 6, const_cast<char*>("\x2b\x06\x01\x05\x05\x02") };
+    gss_OID_desc c_krb5MechOid = { 9, const_cast<char*>("\x2a\x86\x48\x86\xf7\x12\x01\x02\x02") };
+    gss_OID_desc c_ntlmMechOid = { 10, const_cast<char*>("\x2b\x06\x01\x04\x01\x82\x37\x02\x02\x0a") };
+
+    struct GssapiPackage
+    {
+        const char* name;
+        gss_OID mech;
+        unsigned long maxTokenSize;
+    };
+
+    // GSSAPI does not report a maximum token size. Use what Windows reports
+    // for the same packages.
+    const GssapiPackage c_packages[] =
+    {
+        { "Negotiate", &c_spnegoMechOid, 48256 },
+        { "Kerberos", &c_krb5MechOid, 48000 },
+        { "NTLM", &c_ntlmMechOid, 2888 }
+    };
+
+    const int c_numPackages = sizeof(c_packages) / sizeof(c_packages[0]);
+
+    const ULONG_PTR c_credentialTag = 0x47435244;   // 'GCRD'
+    const ULONG_PTR c_contextTag = 0x47435458;      // 'GCTX'
+
+    // Principal names and SPNs are ASCII in practice but convert properly
+    // anyway.
+    std::string ConvertMultiByteToUtf8(const WCHAR* multiByteStr)
+    {
+        std::string utf8Str;
+        for (const WCHAR* p = multiByteStr; *p; p++)
+        {
+            uint32_t codePoint = *p;
+            if (codePoint >= 0xD800 && codePoint <= 0xDBFF && p[1] >= 0xDC00 && p[1] <= 0xDFFF)
+            {
+                codePoint = 0x10000 + ((codePoint - 0xD800) << 10) + (p[1] - 0xDC00);
+                p++;
+            }
+
+            if (codePoint < 0x80)
+            {
+                utf8Str.push_back(static_cast<char>(codePoint));
+            }
+            else if (codePoint < 0x800)
+            {
+                utf8Str.push_back(static_cast<char>(0xC0 | (codePoint >> 6)));
+                utf8Str.push_back(static_cast<char>(0x80 | (codePoint & 0x3F)));
+            }
+            else if (codePoint < 0x10000)
+            {
+                utf8Str.push_back(static_cast<char>(0xE0 | (codePoint >> 12)));
+                utf8Str.push_back(static_cast<char>(0x80 | ((codePoint >> 6) & 0x3F)));
+                utf8Str.push_back(static_cast<char>(0x80 | (codePoint & 0x3F)));
+            }
+            else
+            {
+                utf8Str.push_back(static_cast<char>(0xF0 | (codePoint >> 18)));
+                utf8Str.push_back(static_cast<char>(0x80 | ((codePoint >> 12) & 0x3F)));
+                utf8Str.push_back(static_cast<char>(0x80 | ((codePoint >> 6) & 0x3F)));
+                utf8Str.push_back(static_cast<char>(0x80 | (codePoint & 0x3F)));
+            }
+        }
+
+        return utf8Str;
+    }
+
+    int FindPackage(const WCHAR* securityPackage)
+    {
+        std::string name = ConvertMultiByteToUtf8(securityPackage);
+        for (int i = 0; i < c_numPackages; i++)
+        {
+            if (strcasecmp(name.c_str(), c_packages[i].name) == 0)
+            {
+                return i;
+            }
+        }
+
+        return -1;
+    }
+
+    void LogGssStatus(const char* call, OM_uint32 majorStatus, OM_uint32 minorStatus)
+    {
+        OM_uint32 statuses[2] = { majorStatus, minorStatus };
+        int statusTypes[2] = { GSS_C_GSS_CODE, GSS_C_MECH_CODE };
+
+        for (int i = 0; i < 2; i++)
+        {
+            OM_uint32 messageContext = 0;
+            do
+            {
+                OM_uint32 displayMinorStatus;
+                gss_buffer_desc message = GSS_C_EMPTY_BUFFER;
+                OM_uint32 displayMajorStatus = gss_display_status(
+                    &displayMinorStatus,
+                    statuses[i],
+                    statusTypes[i],
+                    GSS_C_NO_OID,
+                    &messageContext,
+                    &message);
+
+                if (GSS_ERROR(displayMajorStatus))
+                {
+                    break;
+                }
+
+                DebugLog("%d: Worker thread: %s: %.*s.\n",
+                    GetCurrentThreadId(),
+                    call,
+                    static_cast<int>(message.length),
+                    static_cast<const char*>(message.value));
+                gss_release_buffer(&displayMinorStatus, &message);
+            } while (messageContext != 0);
+        }
+    }
+
+    // Maps GSSAPI errors to the closest SSPI status so callers see the same
+    // error codes on every platform.
+    SECURITY_STATUS MapGssStatus(const char* call, OM_uint32 majorStatus, OM_uint32 minorStatus)
+    {
+        if (majorStatus == GSS_S_COMPLETE)
+        {
+            return SEC_E_OK;
+        }
+
+        if (majorStatus == GSS_S_CONTINUE_NEEDED)
+        {
+            return SEC_I_CONTINUE_NEEDED;
+        }
+
+        LogGssStatus(call, majorStatus, minorStatus);
+
+        switch (GSS_ROUTINE_ERROR(majorStatus))
+        {
+        case GSS_S_BAD_MECH:
+            return SEC_E_SECPKG_NOT_FOUND;
+        case GSS_S_BAD_NAME:
+        case GSS_S_BAD_NAMETYPE:
+            return SEC_E_TARGET_UNKNOWN;
+        case GSS_S_NO_CRED:
+        case GSS_S_DEFECTIVE_CREDENTIAL:
+            return SEC_E_NO_CREDENTIALS;
+        case GSS_S_CREDENTIALS_EXPIRED:
+        case GSS_S_CONTEXT_EXPIRED:
+            return SEC_E_CONTEXT_EXPIRED;
+        case GSS_S_NO_CONTEXT:
+            return SEC_E_INVALID_HANDLE;
+        case GSS_S_DEFECTIVE_TOKEN:
+            return SEC_E_INVALID_TOKEN;
+        case GSS_S_BAD_SIG:
+            return SEC_E_MESSAGE_ALTERED;
+        case GSS_S_UNAVAILABLE:
+            return SEC_E_UNSUPPORTED_FUNCTION;
+        case GSS_S_UNAUTHORIZED:
+            return SEC_E_LOGON_DENIED;
+        default:
+            break;
+        }
+
+        if (majorStatus & (GSS_S_DUPLICATE_TOKEN | GSS_S_OLD_TOKEN | GSS_S_UNSEQ_TOKEN | GSS_S_GAP_TOKEN))
+        {
+            return SEC_E_OUT_OF_SEQUENCE;
+        }
+
+        return SEC_E_INTERNAL_ERROR;
+    }
+
+    OM_uint32 MapContextReq(unsigned long contextReq, bool isServer)
+    {
+        OM_uint32 flags = 0;
+        if (!isServer && (contextReq & ISC_REQ_DELEGATE))
+        {
+            flags |= GSS_C_DELEG_FLAG;
+        }
+
+        if (contextReq & ISC_REQ_MUTUAL_AUTH)
+        {
+            flags |= GSS_C_MUTUAL_FLAG;
+        }
+
+        if (contextReq & ISC_REQ_REPLAY_DETECT)
+        {
+            flags |= GSS_C_REPLAY_FLAG;
+        }
+
+        if (contextReq & ISC_REQ_SEQUENCE_DETECT)
+        {
+            flags |= GSS_C_SEQUENCE_FLAG;
+        }
+
+        if (contextReq & ISC_REQ_CONFIDENTIALITY)
+        {
+            flags |= GSS_C_CONF_FLAG;
+        }
+
+        if (contextReq & (isServer ? ASC_REQ_INTEGRITY : ISC_REQ_INTEGRITY))
+        {
+            flags |= GSS_C_INTEG_FLAG;
+        }
+
+        return flags;
+    }
+
+    void SetExpiry(OM_uint32 lifetimeSeconds, TimeStamp* timeExpiry)
+    {
+        // Report indefinite lifetimes as a year from now.
+        int64_t lifetimeMs = lifetimeSeconds == GSS_C_INDEFINITE
+            ? 365LL * 24 * 60 * 60 * 1000
+            : static_cast<int64_t>(lifetimeSeconds) * 1000;
+
+        int64_t nowMs = std::chrono::duration_cast<std::chrono::milliseconds>(
+            std::chrono::system_clock::now().time_since_epoch()).count();
+
+        UnixMsToTimeStamp(nowMs + lifetimeMs, timeExpiry);
+    }
+
+    // SecBufferDesc of a message as a gss_iov_buffer_desc array for the
+    // gss_*_iov calls, which work on the caller's memory in place like SSPI.
+    // The token buffer is the header of a wrap token, with the trailer
+    // rotated into it as Windows does when there's no separate trailer, or
+    // the MIC token of a signature. No allocation for the usual handful of
+    // buffers.
+    class IovMessage
+    {
+    public:
+        IovMessage(SecBufferDesc* message, OM_uint32 tokenType)
+            : m_message(message),
+            m_more(),
+            m_iov(m_fixed)
+        {
+            if (message->cBuffers > c_fixedCount)
+            {
+                m_more.resize(message->cBuffers);
+                m_iov = m_more.data();
+            }
+
+            for (unsigned long i = 0; i < message->cBuffers; i++)
+            {
+                const SecBuffer& secBuffer = message->pBuffers[i];
+                switch (secBuffer.BufferType & 0x0FFFFFFF)
+                {
+                case SECBUFFER_TOKEN:
+                    m_iov[i].type = tokenType;
+                    break;
+                case SECBUFFER_DATA:
+                    m_iov[i].type = GSS_IOV_BUFFER_TYPE_DATA;
+                    break;
+                case SECBUFFER_PADDING:
+                    m_iov[i].type = GSS_IOV_BUFFER_TYPE_PADDING;
+                    break;
+                case SECBUFFER_STREAM:
+                    m_iov[i].type = GSS_IOV_BUFFER_TYPE_STREAM;
+                    break;
+                default:
+                    m_iov[i].type = GSS_IOV_BUFFER_TYPE_EMPTY;
+                    break;
+                }
+
+                m_iov[i].buffer.value = secBuffer.pvBuffer;
+                m_iov[i].buffer.length = secBuffer.cbBuffer;
+            }
+        }
+
+        gss_iov_buffer_desc* Get()
+        {
+            return m_iov;
+        }
+
+        int GetCount() const
+        {
+            return static_cast<int>(m_message->cBuffers);
+        }
+
+        // Token and padding lengths are updated by wrap, unwrap of a stream
+        // points the data buffer into it.
+        void CopyBack()
+        {
+            for (unsigned long i = 0; i < m_message->cBuffers; i++)
+            {
+                m_message->pBuffers[i].pvBuffer = m_iov[i].buffer.value;
+                m_message->pBuffers[i].cbBuffer = static_cast<ULONG>(m_iov[i].buffer.length);
+            }
+        }
+
+    private:
+        static const unsigned long c_fixedCount = 8;
+
+        SecBufferDesc* m_message;
+        gss_iov_buffer_desc m_fixed[c_fixedCount];
+        std::vector<gss_iov_buffer_desc> m_more;
+        gss_iov_buffer_desc* m_iov;
+    };
+
+    SecBuffer* FindTokenBuffer(SecBufferDesc* desc)
+    {
+        if (desc == nullptr)
+        {
+            return nullptr;
+        }
+
+        for (unsigned long i = 0; i < desc->cBuffers; i++)
+        {
+            if ((desc->pBuffers[i].BufferType & 0x0FFFFFFF) == SECBUFFER_TOKEN)
+            {
+                return &desc->pBuffers[i];
+            }
+        }
+
+        return nullptr;
+    }
+}
+
+struct GssapiSspiProvider::Credential
+{
+    ULONG_PTR tag;
+    int packageIndex;
+    gss_cred_id_t cred;
+};
+
+struct GssapiSspiProvider::Context
+{
+    ULONG_PTR tag;
+    int packageIndex;
+    bool isServer;
+    gss_ctx_id_t ctx;
+    gss_name_t targetName;
+
+    // Output token not yet handed to the caller, see class comments.
+    std::vector<char> pendingOutput;
+    SECURITY_STATUS pendingStatus;
+    bool hasPendingOutput;
+};
+
+const char* GssapiSspiProvider::c_name = "gssapi";
+
+const char* GssapiSspiProvider::GetName() const
+{
+    return c_name;
+}
+
+SECURITY_STATUS GssapiSspiProvider::EnumeratePackages(std::vector<SspiPackageInfo>* packages)
+{
+    OM_uint32 minorStatus;
+    gss_OID_set mechs = GSS_C_NO_OID_SET;
+
+    OM_uint32 majorStatus = gss_indicate_mechs(&minorStatus, &mechs);
+    if (GSS_ERROR(majorStatus))
+    {
+        return MapGssStatus("gss_indicate_mechs", majorStatus, minorStatus);
+    }
+
+    for (int i = 0; i < c_numPackages; i++)
+    {
+        int isPresent = 0;
+        gss_test_oid_set_member(&minorStatus, c_packages[i].mech, mechs, &isPresent);
+        if (isPresent)
+        {
+            SspiPackageInfo packageInfo;
+            packageInfo.name.assign(c_packages[i].name);
+            packageInfo.maxTokenSize = c_packages[i].maxTokenSize;
+            packages->push_back(packageInfo);
+        }
+    }
+
+    gss_release_oid_set(&minorStatus, &mechs);
+    return SEC_E_OK;
+}
+
+SECURITY_STATUS GssapiSspiProvider::AcquireCredentials(
+    const WCHAR* principal,
+    const WCHAR* securityPackage,
+    unsigned long credentialUse,
+    CredHandle* credHandle,
+    TimeStamp* timeExpiry)
+{
+    int packageIndex = FindPackage(securityPackage);
+    if (packageIndex < 0)
+    {
+        return SEC_E_SECPKG_NOT_FOUND;
+    }
+
+    OM_uint32 minorStatus;
+    OM_uint32 majorStatus;
+
+    gss_name_t desiredName = GSS_C_NO_NAME;
+    if (principal != nullptr)
+    {
+        std::string principalUtf8 = ConvertMultiByteToUtf8(principal);
+        gss_buffer_desc nameBuffer;
+        nameBuffer.value = const_cast<char*>(principalUtf8.c_str());
+        nameBuffer.length = principalUtf8.length();
+
+        majorStatus = gss_import_name(&minorStatus, &nameBuffer, GSS_KRB5_NT_PRINCIPAL_NAME, &desiredName);
+        if (GSS_ERROR(majorStatus))
+        {
+            return MapGssStatus("gss_import_name", majorStatus, minorStatus);
+        }
+    }
+
+    gss_OID_set_desc mechs;
+    mechs.count = 1;
+    mechs.elements = c_packages[packageIndex].mech;
+
+    gss_cred_usage_t usage = (credentialUse & SECPKG_CRED_INBOUND)
+        ? ((credentialUse & SECPKG_CRED_OUTBOUND) ? GSS_C_BOTH : GSS_C_ACCEPT)
+        : GSS_C_INITIATE;
+
+    gss_cred_id_t cred = GSS_C_NO_CREDENTIAL;
+    OM_uint32 lifetimeSeconds = 0;
+    majorStatus = gss_acquire_cred(
+        &minorStatus,
+        desiredName,        // Principal, default if GSS_C_NO_NAME.
+        GSS_C_INDEFINITE,   // Lifetime requested.
+        &mechs,             // Mechanism for the package.
+        usage,              // Initiate, accept or both.
+        &cred,
+        nullptr,            // Actual mechanisms - unused.
+        &lifetimeSeconds);
+
+    if (desiredName != GSS_C_NO_NAME)
+    {
+        OM_uint32 releaseMinorStatus;
+        gss_release_name(&releaseMinorStatus, &desiredName);
+    }
+
+    if (GSS_ERROR(majorStatus))
+    {
+        return MapGssStatus("gss_acquire_cred", majorStatus, minorStatus);
+    }
+
+    Credential* credential = new Credential();
+    credential->tag = c_credentialTag;
+    credential->packageIndex = packageIndex;
+    credential->cred = cred;
+
+    credHandle->dwLower = reinterpret_cast<ULONG_PTR>(credential);
+    credHandle->dwUpper = c_credentialTag;
+    SetExpiry(lifetimeSeconds, timeExpiry);
+    return SEC_E_OK;
+}
+
+SECURITY_STATUS GssapiSspiProvider::FreeCredentials(CredHandle* credHandle)
+{
+    Credential* credential = GetCredential(credHandle);
+    if (credential == nullptr)
+    {
+        return SEC_E_INVALID_HANDLE;
+    }
+
+    OM_uint32 minorStatus;
+    gss_release_cred(&minorStatus, &credential->cred);
+
+    credential->tag = 0;
+    delete credential;
+    return SEC_E_OK;
+}
+
+SECURITY_STATUS GssapiSspiProvider::InitializeContext(
+    CredHandle* credHandle,
+    CtxtHandle* ctxtHandle,
+    const WCHAR* targetName,
+    unsigned long contextReq,
+    SecBufferDesc* input,
+    CtxtHandle* newCtxtHandle,
+    SecBufferDesc* output,
+    unsigned long* contextAttr,
+    TimeStamp* timeExpiry)
+{
+    Credential* credential = GetCredential(credHandle);
+    if (credential == nullptr)
+    {
+        return SEC_E_INVALID_HANDLE;
+    }
+
+    OM_uint32 minorStatus;
+    OM_uint32 majorStatus;
+
+    Context* context;
+    std::unique_ptr<Context> newContext;
+    if (ctxtHandle == nullptr)
+    {
+        if (targetName == nullptr || *targetName == 0)
+        {
+            return SEC_E_TARGET_UNKNOWN;
+        }
+
+        newContext.reset(new Context());
+        newContext->tag = c_contextTag;
+        newContext->packageIndex = credential->packageIndex;
+        newContext->isServer = false;
+        newContext->ctx = GSS_C_NO_CONTEXT;
+        newContext->targetName = GSS_C_NO_NAME;
+        newContext->pendingStatus = SEC_E_OK;
+        newContext->hasPendingOutput = false;
+
+        // SPNs are in the service/host:port form, which is also a valid
+        // Kerberos principal name in the default realm.
+        std::string targetNameUtf8 = ConvertMultiByteToUtf8(targetName);
+        gss_buffer_desc nameBuffer;
+        nameBuffer.value = const_cast<char*>(targetNameUtf8.c_str());
+        nameBuffer.length = targetNameUtf8.length();
+
+        majorStatus = gss_import_name(&minorStatus, &nameBuffer, GSS_KRB5_NT_PRINCIPAL_NAME, &newContext->targetName);
+        if (GSS_ERROR(majorStatus))
+        {
+            return MapGssStatus("gss_import_name", majorStatus, minorStatus);
+        }
+
+        context = newContext.get();
+    }
+    else
+    {
+        context = GetContext(ctxtHandle);
+        if (context == nullptr || context->isServer)
+        {
+            return SEC_E_INVALID_HANDLE;
+        }
+
+        if (context->hasPendingOutput)
+        {
+            return DeliverPendingOutput(context, output);
+        }
+    }
+
+    gss_buffer_desc inputToken = GSS_C_EMPTY_BUFFER;
+    SecBuffer* inSecBuffer = FindTokenBuffer(input);
+    if (inSecBuffer != nullptr)
+    {
+        inputToken.value = inSecBuffer->pvBuffer;
+        inputToken.length = inSecBuffer->cbBuffer;
+    }
+
+    gss_buffer_desc outputToken = GSS_C_EMPTY_BUFFER;
+    OM_uint32 retFlags = 0;
+    OM_uint32 lifetimeSeconds = 0;
+
+    majorStatus = gss_init_sec_context(
+        &minorStatus,
+        credential->cred,
+        &context->ctx,
+        context->targetName,
+        c_packages[context->packageIndex].mech,
+        MapContextReq(contextReq, false),
+        GSS_C_INDEFINITE,   // Lifetime requested.
+        GSS_C_NO_CHANNEL_BINDINGS,
+        &inputToken,
+        nullptr,            // Actual mechanism - unused.
+        &outputToken,
+        &retFlags,
+        &lifetimeSeconds);
+
+    SECURITY_STATUS securityStatus = MapGssStatus("gss_init_sec_context", majorStatus, minorStatus);
+    if (securityStatus == SEC_E_OK || securityStatus == SEC_I_CONTINUE_NEEDED)
+    {
+        context->pendingOutput.assign(
+            static_cast<char*>(outputToken.value),
+            static_cast<char*>(outputToken.value) + outputToken.length);
+        context->pendingStatus = securityStatus;
+        context->hasPendingOutput = true;
+    }
+
+    gss_release_buffer(&minorStatus, &outputToken);
+
+    if (securityStatus != SEC_E_OK && securityStatus != SEC_I_CONTINUE_NEEDED)
+    {
+        if (newContext)
+        {
+            DeleteContextState(newContext.get());
+        }
+
+        return securityStatus;
+    }
+
+    if (newContext)
+    {
+        newCtxtHandle->dwLower = reinterpret_cast<ULONG_PTR>(newContext.release());
+        newCtxtHandle->dwUpper = c_contextTag;
+    }
+
+    *contextAttr = contextReq;
+    SetExpiry(lifetimeSeconds, timeExpiry);
+    return DeliverPendingOutput(context, output);
+}
+
+SECURITY_STATUS GssapiSspiProvider::AcceptContext(
+    CredHandle* credHandle,
+    CtxtHandle* ctxtHandle,
+    SecBufferDesc* input,
+    unsigned long contextReq,
+    CtxtHandle* newCtxtHandle,
+    SecBufferDesc* output,
+    unsigned long* contextAttr,
+    TimeStamp* timeExpiry)
+{
+    Credential* credential = GetCredential(credHandle);
+    if (credential == nullptr)
+    {
+        return SEC_E_INVALID_HANDLE;
+    }
+
+    OM_uint32 minorStatus;
+    OM_uint32 majorStatus;
+
+    Context* context;
+    std::unique_ptr<Context> newContext;
+    if (ctxtHandle == nullptr)
+    {
+        newContext.reset(new Context());
+        newContext->tag = c_contextTag;
+        newContext->packageIndex = credential->packageIndex;
+        newContext->isServer = true;
+        newContext->ctx = GSS_C_NO_CONTEXT;
+        newContext->targetName = GSS_C_NO_NAME;
+        newContext->pendingStatus = SEC_E_OK;
+        newContext->hasPendingOutput = false;
+        context = newContext.get();
+    }
+    else
+    {
+        context = GetContext(ctxtHandle);
+        if (context == nullptr || !context->isServer)
+        {
+            return SEC_E_INVALID_HANDLE;
+        }
+
+        if (context->hasPendingOutput)
+        {
+            return DeliverPendingOutput(context, output);
+        }
+    }
+
+    SecBuffer* inSecBuffer = FindTokenBuffer(input);
+    if (inSecBuffer == nullptr)
+    {
+        return SEC_E_INVALID_TOKEN;
+    }
+
+    gss_buffer_desc inputToken;
+    inputToken.value = inSecBuffer->pvBuffer;
+    inputToken.length = inSecBuffer->cbBuffer;
+
+    gss_buffer_desc outputToken = GSS_C_EMPTY_BUFFER;
+    OM_uint32 retFlags = 0;
+    OM_uint32 lifetimeSeconds = 0;
+
+    majorStatus = gss_accept_sec_context(
+        &minorStatus,
+        &context->ctx,
+        credential->cred,
+        &inputToken,
+        GSS_C_NO_CHANNEL_BINDINGS,
+        nullptr,            // Client name - unused.
+        nullptr,            // Actual mechanism - unused.
+        &outputToken,
+        &retFlags,
+        &lifetimeSeconds,
+        nullptr);           // Delegated credential - unused.
+
+    SECURITY_STATUS securityStatus = MapGssStatus("gss_accept_sec_context", majorStatus, minorStatus);
+    if (securityStatus == SEC_E_OK || securityStatus == SEC_I_CONTINUE_NEEDED)
+    {
+        context->pendingOutput.assign(
+            static_cast<char*>(outputToken.value),
+            static_cast<char*>(outputToken.value) + outputToken.length);
+        context->pendingStatus = securityStatus;
+        context->hasPendingOutput = true;
+    }
+
+    gss_release_buffer(&minorStatus, &outputToken);
+
+    if (securityStatus != SEC_E_OK && securityStatus != SEC_I_CONTINUE_NEEDED)
+    {
+        if (newContext)
+        {
+            DeleteContextState(newContext.get());
+        }
+
+        return securityStatus;
+    }
+
+    if (newContext)
+    {
+        newCtxtHandle->dwLower = reinterpret_cast<ULONG_PTR>(newContext.release());
+        newCtxtHandle->dwUpper = c_contextTag;
+    }
+
+    *contextAttr = contextReq;
+    SetExpiry(lifetimeSeconds, timeExpiry);
+    return DeliverPendingOutput(context, output);
+}
+
+SECURITY_STATUS GssapiSspiProvider::CompleteToken(
+    CtxtHandle* ctxtHandle,
+    SecBufferDesc* token)
+{
+    // GSSAPI tokens are always complete.
+    return GetContext(ctxtHandle) != nullptr ? SEC_E_OK : SEC_E_INVALID_HANDLE;
+}
+
+SECURITY_STATUS GssapiSspiProvider::DeleteContext(CtxtHandle* ctxtHandle)
+{
+    Context* context = GetContext(ctxtHandle);
+    if (context == nullptr)
+    {
+        return SEC_E_INVALID_HANDLE;
+    }
+
+    DeleteContextState(context);
+    return SEC_E_OK;
+}
+
+SECURITY_STATUS GssapiSspiProvider::QueryContextSizes(
+    CtxtHandle* ctxtHandle,
+    SecPkgContext_Sizes* sizes)
+{
+    Context* context = GetContext(ctxtHandle);
+    if (context == nullptr || context->ctx == GSS_C_NO_CONTEXT)
+    {
+        return SEC_E_INVALID_HANDLE;
+    }
+
+    OM_uint32 minorStatus;
+
+    // Header, trailer included, and padding of an empty sealed message.
+    gss_iov_buffer_desc wrapIov[3];
+    wrapIov[0].type = GSS_IOV_BUFFER_TYPE_HEADER;
+    wrapIov[1].type = GSS_IOV_BUFFER_TYPE_DATA;
+    wrapIov[2].type = GSS_IOV_BUFFER_TYPE_PADDING;
+    for (int i = 0; i < 3; i++)
+    {
+        wrapIov[i].buffer.value = nullptr;
+        wrapIov[i].buffer.length = 0;
+    }
+
+    OM_uint32 majorStatus = gss_wrap_iov_length(
+        &minorStatus,
+        context->ctx,
+        1,                  // Confidentiality requested.
+        GSS_C_QOP_DEFAULT,
+        nullptr,            // Confidentiality state - unused.
+        wrapIov,
+        3);
+    if (GSS_ERROR(majorStatus))
+    {
+        return MapGssStatus("gss_wrap_iov_length", majorStatus, minorStatus);
+    }
+
+    gss_iov_buffer_desc micIov[2];
+    micIov[0].type = GSS_IOV_BUFFER_TYPE_DATA;
+    micIov[1].type = GSS_IOV_BUFFER_TYPE_MIC_TOKEN;
+    for (int i = 0; i < 2; i++)
+    {
+        micIov[i].buffer.value = nullptr;
+        micIov[i].buffer.length = 0;
+    }
+
+    majorStatus = gss_get_mic_iov_length(&minorStatus, context->ctx, GSS_C_QOP_DEFAULT, micIov, 2);
+    if (GSS_ERROR(majorStatus))
+    {
+        return MapGssStatus("gss_get_mic_iov_length", majorStatus, minorStatus);
+    }
+
+    sizes->cbMaxToken = c_packages[context->packageIndex].maxTokenSize;
+    sizes->cbMaxSignature = static_cast<ULONG>(micIov[1].buffer.length);
+    sizes->cbBlockSize = wrapIov[2].buffer.length > 0 ? static_cast<ULONG>(wrapIov[2].buffer.length) : 1;
+    sizes->cbSecurityTrailer = static_cast<ULONG>(wrapIov[0].buffer.length);
+    return SEC_E_OK;
+}
+
+SECURITY_STATUS GssapiSspiProvider::MakeSignature(
+    CtxtHandle* ctxtHandle,
+    unsigned long qop,
+    SecBufferDesc* message,
+    unsigned long seqNo)
+{
+    Context* context = GetContext(ctxtHandle);
+    if (context == nullptr || context->ctx == GSS_C_NO_CONTEXT)
+    {
+        return SEC_E_INVALID_HANDLE;
+    }
+
+    OM_uint32 minorStatus;
+    IovMessage iovMessage(message, GSS_IOV_BUFFER_TYPE_MIC_TOKEN);
+    OM_uint32 majorStatus = gss_get_mic_iov(
+        &minorStatus,
+        context->ctx,
+        qop,
+        iovMessage.Get(),
+        iovMessage.GetCount());
+    if (GSS_ERROR(majorStatus))
+    {
+        return MapGssStatus("gss_get_mic_iov", majorStatus, minorStatus);
+    }
+
+    iovMessage.CopyBack();
+    return SEC_E_OK;
+}
+
+SECURITY_STATUS GssapiSspiProvider::VerifySignature(
+    CtxtHandle* ctxtHandle,
+    SecBufferDesc* message,
+    unsigned long seqNo,
+    unsigned long* qop)
+{
+    Context* context = GetContext(ctxtHandle);
+    if (context == nullptr || context->ctx == GSS_C_NO_CONTEXT)
+    {
+        return SEC_E_INVALID_HANDLE;
+    }
+
+    OM_uint32 minorStatus;
+    gss_qop_t qopState = GSS_C_QOP_DEFAULT;
+    IovMessage iovMessage(message, GSS_IOV_BUFFER_TYPE_MIC_TOKEN);
+    OM_uint32 majorStatus = gss_verify_mic_iov(
+        &minorStatus,
+        context->ctx,
+        &qopState,
+        iovMessage.Get(),
+        iovMessage.GetCount());
+
+    // Supplementary sequence errors come with GSS_S_COMPLETE, see
+    // MapGssStatus.
+    *qop = qopState;
+    return MapGssStatus("gss_verify_mic_iov", majorStatus, minorStatus);
+}
+
+SECURITY_STATUS GssapiSspiProvider::EncryptMessage(
+    CtxtHandle* ctxtHandle,
+    unsigned long qop,
+    SecBufferDesc* message,
+    unsigned long seqNo)
+{
+    Context* context = GetContext(ctxtHandle);
+    if (context == nullptr || context->ctx == GSS_C_NO_CONTEXT)
+    {
+        return SEC_E_INVALID_HANDLE;
+    }
+
+    if (qop != 0 && qop != SECQOP_WRAP_NO_ENCRYPT)
+    {
+        return SEC_E_QOP_NOT_SUPPORTED;
+    }
+
+    // SECQOP_WRAP_NO_ENCRYPT asks for an integrity only wrap token.
+    int isConfRequested = (qop == SECQOP_WRAP_NO_ENCRYPT) ? 0 : 1;
+
+    OM_uint32 minorStatus;
+    int confState = 0;
+    IovMessage iovMessage(message, GSS_IOV_BUFFER_TYPE_HEADER);
+    OM_uint32 majorStatus = gss_wrap_iov(
+        &minorStatus,
+        context->ctx,
+        isConfRequested,
+        GSS_C_QOP_DEFAULT,
+        &confState,
+        iovMessage.Get(),
+        iovMessage.GetCount());
+    if (GSS_ERROR(majorStatus))
+    {
+        return MapGssStatus("gss_wrap_iov", majorStatus, minorStatus);
+    }
+
+    if (isConfRequested && !confState)
+    {
+        return SEC_E_UNSUPPORTED_FUNCTION;
+    }
+
+    iovMessage.CopyBack();
+    return SEC_E_OK;
+}
+
+SECURITY_STATUS GssapiSspiProvider::DecryptMessage(
+    CtxtHandle* ctxtHandle,
+    SecBufferDesc* message,
+    unsigned long seqNo,
+    unsigned long* qop)
+{
+    Context* context = GetContext(ctxtHandle);
+    if (context == nullptr || context->ctx == GSS_C_NO_CONTEXT)
+    {
+        return SEC_E_INVALID_HANDLE;
+    }
+
+    OM_uint32 minorStatus;
+    int confState = 0;
+    gss_qop_t qopState = GSS_C_QOP_DEFAULT;
+    IovMessage iovMessage(message, GSS_IOV_BUFFER_TYPE_HEADER);
+    OM_uint32 majorStatus = gss_unwrap_iov(
+        &minorStatus,
+        context->ctx,
+        &confState,
+        &qopState,
+        iovMessage.Get(),
+        iovMessage.GetCount());
+    if (GSS_ERROR(majorStatus))
+    {
+        return MapGssStatus("gss_unwrap_iov", majorStatus, minorStatus);
+    }
+
+    iovMessage.CopyBack();
+    *qop = confState ? 0 : SECQOP_WRAP_NO_ENCRYPT;
+    return MapGssStatus("gss_unwrap_iov", majorStatus, minorStatus);
+}
+
+// static
+void GssapiSspiProvider::DeleteContextState(Context* context)
+{
+    OM_uint32 minorStatus;
+    if (context->ctx != GSS_C_NO_CONTEXT)
+    {
+        gss_delete_sec_context(&minorStatus, &context->ctx, GSS_C_NO_BUFFER);
+    }
+
+    if (context->targetName != GSS_C_NO_NAME)
+    {
+        gss_release_name(&minorStatus, &context->targetName);
+    }
+
+    context->tag = 0;
+    delete context;
+}
+
+// static
+GssapiSspiProvider::Credential* GssapiSspiProvider::GetCredential(CredHandle* credHandle)
+{
+    if (credHandle == nullptr
+        || !SecIsValidHandle(credHandle)
+        || credHandle->dwUpper != c_credentialTag)
+    {
+        return nullptr;
+    }
+
+    Credential* credential = reinterpret_cast<Credential*>(credHandle->dwLower);
+    return credential->tag == c_credentialTag ? credential : nullptr;
+}
+
+// static
+GssapiSspiProvider::Context* GssapiSspiProvider::GetContext(CtxtHandle* ctxtHandle)
+{
+    if (ctxtHandle == nullptr
+        || !SecIsValidHandle(ctxtHandle)
+        || ctxtHandle->dwUpper != c_contextTag)
+    {
+        return nullptr;
+    }
+
+    Context* context = reinterpret_cast<Context*>(ctxtHandle->dwLower);
+    return context->tag == c_contextTag ? context : nullptr;
+}
+
+// static
+SECURITY_STATUS GssapiSspiProvider::DeliverPendingOutput(
+    Context* context,
+    SecBufferDesc* output)
+{
+    SecBuffer* outSecBuffer = FindTokenBuffer(output);
+    if (outSecBuffer == nullptr)
+    {
+        return SEC_E_INSUFFICIENT_MEMORY;
+    }
+
+    if (outSecBuffer->cbBuffer < context->pendingOutput.size())
+    {
+        return SEC_E_BUFFER_TOO_SMALL;
+    }
+
+    if (!context->pendingOutput.empty())
+    {
+        memcpy(outSecBuffer->pvBuffer, context->pendingOutput.data(), context->pendingOutput.size());
+    }
+
+    outSecBuffer->cbBuffer = static_cast<ULONG>(context->pendingOutput.size());
+
+    context->pendingOutput.clear();
+    context->hasPendingOutput = false;
+    return context->pendingStatus;
+}
+
+#endif  // IS_SUPPORTED_NODE_VERSION
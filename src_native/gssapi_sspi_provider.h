@@ -0,0 +1,105 @@
+#pragma once
+
+#include "sspi_provider.h"
+
+// Provider that maps SSPI calls onto GSSAPI (MIT krb5) for Linux. Negotiate
+// maps to the SPNEGO mechanism, Kerberos to krb5 and NTLM to gss-ntlmssp when
+// it's installed. Credentials come from the default ccache for the client
+// side and the default keytab for the server side, same as any other GSSAPI
+// application, so KRB5CCNAME, KRB5_KTNAME and KRB5_CONFIG apply.
+//
+// GSSAPI has no notion of a caller supplied output buffer. If the token does
+// not fit, the call fails with SEC_E_BUFFER_TOO_SMALL and the token is held in
+// the context until the caller retries with a bigger buffer, same as SSPI
+// semantics.
+//
+// Message protection goes through the gss_*_iov calls (MIT krb5 1.12 and
+// later), which work on the caller's buffers in place. Tokens use the Windows
+// layout, the wrap trailer is rotated into the header, so they interoperate
+// with SSPI peers.
+class GssapiSspiProvider : public SspiProvider
+{
+public:
+    static const char* c_name;
+
+    const char* GetName() const;
+
+    SECURITY_STATUS EnumeratePackages(std::vector<SspiPackageInfo>* packages);
+
+    SECURITY_STATUS AcquireCredentials(
+        const WCHAR* principal,
+        const WCHAR* securityPackage,
+        unsigned long credentialUse,
+        CredHandle* credHandle,
+        TimeStamp* timeExpiry);
+
+    SECURITY_STATUS FreeCredentials(CredHandle* credHandle);
+
+    SECURITY_STATUS InitializeContext(
+        CredHandle* credHandle,
+        CtxtHandle* ctxtHandle,
+        const WCHAR* targetName,
+        unsigned long contextReq,
+        SecBufferDesc* input,
+        CtxtHandle* newCtxtHandle,
+        SecBufferDesc* output,
+        unsigned long* contextAttr,
+        TimeStamp* timeExpiry);
+
+    SECURITY_STATUS AcceptContext(
+        CredHandle* credHandle,
+        CtxtHandle* ctxtHandle,
+        SecBufferDesc* input,
+        unsigned long contextReq,
+        CtxtHandle* newCtxtHandle,
+        SecBufferDesc* output,
+        unsigned long* contextAttr,
+        TimeStamp* timeExpiry);
+
+    SECURITY_STATUS CompleteToken(
+        CtxtHandle* ctxtHandle,
+        SecBufferDesc* token);
+
+    SECURITY_STATUS DeleteContext(CtxtHandle* ctxtHandle);
+
+    SECURITY_STATUS QueryContextSizes(
+        CtxtHandle* ctxtHandle,
+        SecPkgContext_Sizes* sizes);
+
+    SECURITY_STATUS MakeSignature(
+        CtxtHandle* ctxtHandle,
+        unsigned long qop,
+        SecBufferDesc* message,
+        unsigned long seqNo);
+
+    SECURITY_STATUS VerifySignature(
+        CtxtHandle* ctxtHandle,
+        SecBufferDesc* message,
+        unsigned long seqNo,
+        unsigned long* qop);
+
+    SECURITY_STATUS EncryptMessage(
+        CtxtHandle* ctxtHandle,
+        unsigned long qop,
+        SecBufferDesc* message,
+        unsigned long seqNo);
+
+    SECURITY_STATUS DecryptMessage(
+        CtxtHandle* ctxtHandle,
+        SecBufferDesc* message,
+        unsigned long seqNo,
+        unsigned long* qop);
+
+private:
+    struct Credential;
+    struct Context;
+
+    static Credential* GetCredential(CredHandle* credHandle);
+    static Context* GetContext(CtxtHandle* ctxtHandle);
+    static void DeleteContextState(Context* context);
+
+    // Hands the pending output token of the context to the caller's buffer.
+    static SECURITY_STATUS DeliverPendingOutput(
+        Context* context,
+        SecBufferDesc* output);
+};
@@ -0,0 +1,152 @@
+#include "node_version_support.h"
+#ifdef IS_SUPPORTED_NODE_VERSION
+
+#include "handshake_admission.h"
+
+#include "utils.h"
+
+QueuedCall::QueuedCall() :
+    m_state(c_stateQueued)
+{
+}
+
+bool QueuedCall::Cancel(bool timedOut)
+{
+    int state = m_state.load();
+    while (state == c_stateQueued || state == c_stateRunning)
+    {
+        if (m_state.compare_exchange_weak(state, timedOut ? c_stateTimedOut : c_stateCancelled))
+        {
+            HandshakeAdmission* admission = HandshakeAdmission::GetInstance();
+            (timedOut ? admission->m_timedOut : admission->m_cancelled).fetch_add(1, std::memory_order_relaxed);
+
+            // Only one of Cancel and Start moves a call out of the queued
+            // state, so only one of them takes it out of the queue depth.
+            if (state != c_stateQueued)
+            {
+                return false;
+            }
+
+            admission->m_queueDepth.fetch_sub(1, std::memory_order_relaxed);
+            return true;
+        }
+    }
+
+    return false;
+}
+
+SECURITY_STATUS QueuedCall::Start(std::string* errorString)
+{
+    HandshakeAdmission* admission = HandshakeAdmission::GetInstance();
+
+    int state = c_stateQueued;
+    if (m_state.compare_exchange_strong(state, c_stateRunning))
+    {
+        admission->m_queueDepth.fetch_sub(1, std::memory_order_relaxed);
+        return SEC_E_OK;
+    }
+
+    DebugLog("%d: Worker thread: QueuedCall::Start: skipped.\n", GetCurrentThreadId());
+
+    admission->m_skipped.fetch_add(1, std::memory_order_relaxed);
+    if (state == c_stateTimedOut)
+    {
+        errorString->assign("Call timed out waiting for a thread.");
+        return c_errorTimedOut;
+    }
+
+    errorString->assign("Call cancelled.");
+    return c_errorCancelled;
+}
+
+void QueuedCall::Complete()
+{
+    int state = c_stateRunning;
+    m_state.compare_exchange_strong(state, c_stateCompleted);
+}
+
+// static
+HandshakeAdmission* HandshakeAdmission::GetInstance()
+{
+    // Intentionally leaked, calls may still be completing on worker threads
+    // while static destructors run at process exit.
+    static HandshakeAdmission* s_handshakeAdmission = new HandshakeAdmission();
+    return s_handshakeAdmission;
+}
+
+HandshakeAdmission::HandshakeAdmission() :
+    m_maxQueueDepth(0),
+    m_queueDepth(0),
+    m_peakQueueDepth(0),
+    m_admitted(0),
+    m_rejected(0),
+    m_cancelled(0),
+    m_timedOut(0),
+    m_skipped(0)
+{
+}
+
+HandshakeAdmission::~HandshakeAdmission()
+{
+}
+
+void HandshakeAdmission::Configure(int maxQueueDepth)
+{
+    DebugLog("%d: Main event loop: HandshakeAdmission::Configure: maxQueueDepth=%d.\n",
+        GetCurrentThreadId(),
+        maxQueueDepth);
+
+    m_maxQueueDepth.store(maxQueueDepth > 0 ? maxQueueDepth : 0);
+}
+
+bool HandshakeAdmission::TryAdmit()
+{
+    int maxQueueDepth = m_maxQueueDepth.load(std::memory_order_relaxed);
+    int queueDepth = m_queueDepth.load(std::memory_order_relaxed);
+    do
+    {
+        if (maxQueueDepth > 0 && queueDepth >= maxQueueDepth)
+        {
+            m_rejected.fetch_add(1, std::memory_order_relaxed);
+            return false;
+        }
+    }
+    while (!m_queueDepth.compare_exchange_weak(queueDepth, queueDepth + 1, std::memory_order_relaxed));
+
+    m_admitted.fetch_add(1, std::memory_order_relaxed);
+
+    uint64_t newDepth = static_cast<uint64_t>(queueDepth + 1);
+    uint64_t peakQueueDepth = m_peakQueueDepth.load(std::memory_order_relaxed);
+    while (peakQueueDepth < newDepth
+        && !m_peakQueueDepth.compare_exchange_weak(peakQueueDepth, newDepth, std::memory_order_relaxed))
+    {
+    }
+
+    return true;
+}
+
+void HandshakeAdmission::GetStats(HandshakeAdmissionStats* stats)
+{
+    int queueDepth = m_queueDepth.load(std::memory_order_relaxed);
+
+    stats->maxQueueDepth = static_cast<uint64_t>(m_maxQueueDepth.load(std::memory_order_relaxed));
+    stats->queueDepth = queueDepth > 0 ? static_cast<uint64_t>(queueDepth) : 0;
+    stats->peakQueueDepth = m_peakQueueDepth.load(std::memory_order_relaxed);
+    stats->admitted = m_admitted.load(std::memory_order_relaxed);
+    stats->rejected = m_rejected.load(std::memory_order_relaxed);
+    stats->cancelled = m_cancelled.load(std::memory_order_relaxed);
+    stats->timedOut = m_timedOut.load(std::memory_order_relaxed);
+    stats->skipped = m_skipped.load(std::memory_order_relaxed);
+}
+
+void HandshakeAdmission::ResetStats()
+{
+    m_peakQueueDepth.store(0);
+    m_admitted.store(0);
+    m_rejected.store(0);
+    m_cancelled.store(0);
+    m_timedOut.store(0);
+    m_skipped.store(0);
+}
+
+#endif  // IS_SUPPORTED_NODE_VERSION
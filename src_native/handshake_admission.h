@@ -0,0 +1,109 @@
+#pragma once
+
+#include "sspi_platform.h"
+
+#include <atomic>
+#include <stdint.h>
+#include <string>
+
+// Error codes of getNextBlob calls the addon fails without calling the
+// provider. Customer HRESULTs, bit 29 set, so they never collide with SSPI or
+// GSSAPI codes.
+const SECURITY_STATUS c_errorQueueFull = static_cast<SECURITY_STATUS>(0xA0090001);
+const SECURITY_STATUS c_errorCancelled = static_cast<SECURITY_STATUS>(0xA0090002);
+const SECURITY_STATUS c_errorTimedOut = static_cast<SECURITY_STATUS>(0xA0090003);
+
+struct HandshakeAdmissionStats
+{
+    uint64_t maxQueueDepth;
+    uint64_t queueDepth;
+    uint64_t peakQueueDepth;
+    uint64_t admitted;
+    uint64_t rejected;
+    uint64_t cancelled;
+    uint64_t timedOut;
+
+    // Cancelled or timed out calls a thread dequeued and skipped, rather
+    // than running them for nobody.
+    uint64_t skipped;
+};
+
+// A getNextBlob call admitted by HandshakeAdmission, from the time it's
+// queued until it completes.
+// Cancelling a call that hasn't started takes it out of the queue depth at
+// once and makes the thread skip it; a call that has started runs to
+// completion, provider calls can't be interrupted.
+//
+// Cancel runs on the main event loop, Start on the worker thread.
+class QueuedCall
+{
+public:
+    QueuedCall();
+
+    // timedOut picks the error code the call fails with. No effect once the
+    // call has completed or been cancelled. Returns true if the call hadn't
+    // started, it then never touches the context.
+    bool Cancel(bool timedOut);
+
+    // Leaves the queue, unless Cancel already took the call out of it.
+    // Returns SEC_E_OK if the call should run, else the error it fails with,
+    // setting errorString.
+    SECURITY_STATUS Start(std::string* errorString);
+
+    // The call ran or was skipped, later cancellations aren't counted.
+    void Complete();
+
+private:
+    // Not implemented.
+    QueuedCall(const QueuedCall&);
+    QueuedCall& operator=(const QueuedCall&);
+
+    enum State
+    {
+        c_stateQueued,
+        c_stateRunning,
+        c_stateCompleted,
+        c_stateCancelled,
+        c_stateTimedOut
+    };
+
+    std::atomic<int> m_state;
+};
+
+// Process-wide bound on getNextBlob calls queued for a thread, so a stalled
+// KDC makes new calls fail fast instead of the queue growing without bound.
+// Counters are relaxed atomics, safe from any thread.
+class HandshakeAdmission
+{
+public:
+    static HandshakeAdmission* GetInstance();
+
+    // 0, the default, doesn't limit the queue.
+    void Configure(int maxQueueDepth);
+
+    // Counts a call into the queue. Returns false, counting a rejection, if
+    // the queue is full.
+    bool TryAdmit();
+
+    void GetStats(HandshakeAdmissionStats* stats);
+    void ResetStats();
+
+private:
+    friend class QueuedCall;
+
+    HandshakeAdmission();
+
+    // Not implemented. Never destroyed, see GetInstance.
+    HandshakeAdmission(const HandshakeAdmission&);
+    HandshakeAdmission& operator=(const HandshakeAdmission&);
+    ~HandshakeAdmission();
+
+    std::atomic<int> m_maxQueueDepth;
+    std::atomic<int> m_queueDepth;
+    std::atomic<uint64_t> m_peakQueueDepth;
+    std::atomic<uint64_t> m_admitted;
+    std::atomic<uint64_t> m_rejected;
+    std::atomic<uint64_t> m_cancelled;
+    std::atomic<uint64_t> m_timedOut;
+    std::atomic<uint64_t> m_skipped;
+};
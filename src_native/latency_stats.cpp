@@ -0,0 +1,197 @@
+#include "node_version_support.h"
+#ifdef IS_SUPPORTED_NODE_VERSION
+
+#include "latency_stats.h"
+
+namespace
+{
+    const char* c_phaseNames[c_latencyPhaseCount] = {
+        "queueWait",
+        "acquireCredentials",
+        "initializeContext",
+        "completeToken",
+        "callbackDelay",
+        "total"
+    };
+
+    const uint64_t c_noMinimum = ~static_cast<uint64_t>(0);
+}
+
+LatencyHistogram::LatencyHistogram() :
+    m_count(0),
+    m_sumUs(0),
+    m_minUs(c_noMinimum),
+    m_maxUs(0)
+{
+    for (int i = 0; i < c_bucketCount; i++)
+    {
+        m_buckets[i] = 0;
+    }
+}
+
+// static
+int LatencyHistogram::GetBucketIndex(uint64_t valueUs)
+{
+    if (valueUs < static_cast<uint64_t>(c_subBucketCount))
+    {
+        return static_cast<int>(valueUs);
+    }
+
+    int magnitude = 0;
+    for (uint64_t value = valueUs; value > 1; value >>= 1)
+    {
+        magnitude++;
+    }
+
+    if (magnitude > c_maxMagnitude)
+    {
+        return c_bucketCount - 1;
+    }
+
+    int shift = magnitude - c_subBucketBits;
+    int subBucket = static_cast<int>(valueUs >> shift) - c_subBucketCount;
+    return c_subBucketCount * (shift + 1) + subBucket;
+}
+
+// static
+uint64_t LatencyHistogram::GetBucketUpperBound(int bucketIndex)
+{
+    if (bucketIndex < c_subBucketCount)
+    {
+        return static_cast<uint64_t>(bucketIndex);
+    }
+
+    int shift = bucketIndex / c_subBucketCount - 1;
+    uint64_t subBucket = static_cast<uint64_t>(bucketIndex % c_subBucketCount + c_subBucketCount);
+    return ((subBucket + 1) << shift) - 1;
+}
+
+void LatencyHistogram::Record(uint64_t valueUs)
+{
+    m_buckets[GetBucketIndex(valueUs)].fetch_add(1, std::memory_order_relaxed);
+    m_count.fetch_add(1, std::memory_order_relaxed);
+    m_sumUs.fetch_add(valueUs, std::memory_order_relaxed);
+
+    uint64_t minUs = m_minUs.load(std::memory_order_relaxed);
+    while (valueUs < minUs && !m_minUs.compare_exchange_weak(minUs, valueUs, std::memory_order_relaxed))
+    {
+    }
+
+    uint64_t maxUs = m_maxUs.load(std::memory_order_relaxed);
+    while (valueUs > maxUs && !m_maxUs.compare_exchange_weak(maxUs, valueUs, std::memory_order_relaxed))
+    {
+    }
+}
+
+// Not an atomic snapshot, counts recorded meanwhile may be partly included.
+void LatencyHistogram::GetSnapshot(Snapshot* snapshot) const
+{
+    snapshot->count = m_count.load();
+    snapshot->sumUs = m_sumUs.load();
+    snapshot->minUs = snapshot->count > 0 ? m_minUs.load() : 0;
+    snapshot->maxUs = m_maxUs.load();
+    snapshot->buckets.resize(c_bucketCount);
+    for (int i = 0; i < c_bucketCount; i++)
+    {
+        snapshot->buckets[i] = m_buckets[i].load();
+    }
+}
+
+void LatencyHistogram::Reset()
+{
+    for (int i = 0; i < c_bucketCount; i++)
+    {
+        m_buckets[i] = 0;
+    }
+
+    m_count = 0;
+    m_sumUs = 0;
+    m_minUs = c_noMinimum;
+    m_maxUs = 0;
+}
+
+uint64_t LatencyHistogram::Snapshot::GetValueAtPercentile(double percentile) const
+{
+    uint64_t total = 0;
+    for (size_t i = 0; i < buckets.size(); i++)
+    {
+        total += buckets[i];
+    }
+
+    if (total == 0)
+    {
+        return 0;
+    }
+
+    // Rank of the value, 1 based, rounded up so p100 is the last value.
+    uint64_t rank = static_cast<uint64_t>(percentile / 100.0 * static_cast<double>(total) + 0.999999);
+    if (rank < 1)
+    {
+        rank = 1;
+    }
+
+    uint64_t seen = 0;
+    for (size_t i = 0; i < buckets.size(); i++)
+    {
+        seen += buckets[i];
+        if (seen >= rank)
+        {
+            uint64_t upperBound = GetBucketUpperBound(static_cast<int>(i));
+            return upperBound < maxUs ? upperBound : maxUs;
+        }
+    }
+
+    return maxUs;
+}
+
+// static
+LatencyStats* LatencyStats::GetInstance()
+{
+    // Intentionally leaked. Worker threads may record while static
+    // destructors run at process exit.
+    static LatencyStats* s_latencyStats = new LatencyStats();
+    return s_latencyStats;
+}
+
+LatencyStats::LatencyStats()
+{
+}
+
+LatencyStats::~LatencyStats()
+{
+}
+
+void LatencyStats::Record(LatencyPhase phase, int packageIndex, bool succeeded, uint64_t valueUs)
+{
+    if (packageIndex < 0 || packageIndex >= c_otherPackageIndex)
+    {
+        packageIndex = c_otherPackageIndex;
+    }
+
+    m_histograms[phase][packageIndex][succeeded ? 0 : 1].Record(valueUs);
+}
+
+const LatencyHistogram& LatencyStats::GetHistogram(int phase, int packageIndex, bool succeeded) const
+{
+    return m_histograms[phase][packageIndex][succeeded ? 0 : 1];
+}
+
+void LatencyStats::Reset()
+{
+    for (int phase = 0; phase < c_latencyPhaseCount; phase++)
+    {
+        for (int packageIndex = 0; packageIndex < c_packageCount; packageIndex++)
+        {
+            m_histograms[phase][packageIndex][0].Reset();
+            m_histograms[phase][packageIndex][1].Reset();
+        }
+    }
+}
+
+// static
+const char* LatencyStats::GetPhaseName(int phase)
+{
+    return phase >= 0 && phase < c_latencyPhaseCount ? c_phaseNames[phase] : "";
+}
+
+#endif  // IS_SUPPORTED_NODE_VERSION
@@ -0,0 +1,135 @@
+#pragma once
+
+#include <atomic>
+#include <chrono>
+#include <stdint.h>
+#include <vector>
+
+// Log-linear histogram of durations in microseconds, in the style of
+// HdrHistogram: each power of two range is split into c_subBucketCount
+// linear buckets, so values are kept to within 1/16 across 1us to over an
+// hour. Recording is a handful of relaxed atomic operations, safe from any
+// thread.
+class LatencyHistogram
+{
+public:
+    struct Snapshot
+    {
+        uint64_t count;
+        uint64_t sumUs;
+        uint64_t minUs;
+        uint64_t maxUs;
+        std::vector<uint64_t> buckets;
+
+        // Upper bound of the bucket holding the value at percentile, 0-100,
+        // capped at maxUs. 0 if empty.
+        uint64_t GetValueAtPercentile(double percentile) const;
+    };
+
+    LatencyHistogram();
+
+    void Record(uint64_t valueUs);
+
+    uint64_t GetCount() const
+    {
+        return m_count.load(std::memory_order_relaxed);
+    }
+
+    void GetSnapshot(Snapshot* snapshot) const;
+    void Reset();
+
+    static int GetBucketIndex(uint64_t valueUs);
+    static uint64_t GetBucketUpperBound(int bucketIndex);
+
+    static const int c_subBucketBits = 4;
+    static const int c_subBucketCount = 1 << c_subBucketBits;
+
+    // Values from 2^c_maxMagnitude on share the last bucket range.
+    static const int c_maxMagnitude = 35;
+    static const int c_bucketCount = c_subBucketCount * (c_maxMagnitude - c_subBucketBits + 2);
+
+private:
+    // Not implemented.
+    LatencyHistogram(const LatencyHistogram&);
+    LatencyHistogram& operator=(const LatencyHistogram&);
+
+    std::atomic<uint64_t> m_buckets[c_bucketCount];
+    std::atomic<uint64_t> m_count;
+    std::atomic<uint64_t> m_sumUs;
+    std::atomic<uint64_t> m_minUs;
+    std::atomic<uint64_t> m_maxUs;
+};
+
+// Phases of a getNextBlob call.
+enum LatencyPhase
+{
+    // Waiting for a worker thread.
+    c_latencyPhaseQueueWait,
+
+    // Getting the credential handle on the first leg, mostly cache hits.
+    c_latencyPhaseAcquireCredentials,
+    c_latencyPhaseInitializeContext,
+    c_latencyPhaseCompleteToken,
+
+    // Waiting for the main event loop after the worker thread is done.
+    c_latencyPhaseCallbackDelay,
+
+    // From the native call to the callback.
+    c_latencyPhaseTotal,
+
+    c_latencyPhaseCount
+};
+
+// Process-wide latency histograms per phase, security package and outcome.
+class LatencyStats
+{
+public:
+    static LatencyStats* GetInstance();
+
+    // packageIndex is an index into SspiImpl's supported packages, anything
+    // else is counted under c_otherPackageIndex.
+    void Record(LatencyPhase phase, int packageIndex, bool succeeded, uint64_t valueUs);
+
+    const LatencyHistogram& GetHistogram(int phase, int packageIndex, bool succeeded) const;
+
+    void Reset();
+
+    static const char* GetPhaseName(int phase);
+
+    static const int c_otherPackageIndex = 3;
+    static const int c_packageCount = c_otherPackageIndex + 1;
+
+private:
+    LatencyStats();
+
+    // Not implemented. Never destroyed, see GetInstance.
+    LatencyStats(const LatencyStats&);
+    LatencyStats& operator=(const LatencyStats&);
+    ~LatencyStats();
+
+    LatencyHistogram m_histograms[c_latencyPhaseCount][c_packageCount][2];
+};
+
+// Measures one phase on a monotonic clock.
+class LatencyTimer
+{
+public:
+    LatencyTimer()
+        : m_begin(std::chrono::steady_clock::now())
+    {
+    }
+
+    uint64_t GetElapsedUs() const
+    {
+        return static_cast<uint64_t>(std::chrono::duration_cast<std::chrono::microseconds>(
+            std::chrono::steady_clock::now() - m_begin).count());
+    }
+
+    void Restart()
+    {
+        m_begin = std::chrono::steady_clock::now();
+    }
+
+private:
+    std::chrono::steady_clock::time_point m_begin;
+};
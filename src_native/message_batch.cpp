@@ -0,0 +1,192 @@
+#include "node_version_support.h"
+#ifdef IS_SUPPORTED_NODE_VERSION
+
+#include "message_batch.h"
+
+#include "utils.h"
+
+#include <stdio.h>
+
+namespace
+{
+    const char* c_notEstablishedErrorString = "Security context is not established.";
+
+    // SSPI names of the calls, for error strings.
+    const char* c_operationNames[c_messageOperationCount] =
+    {
+        "MakeSignature",
+        "VerifySignature",
+        "EncryptMessage",
+        "DecryptMessage"
+    };
+
+    const TraceCall c_operationTraceCalls[c_messageOperationCount] =
+    {
+        c_traceCallMakeSignature,
+        c_traceCallVerifySignature,
+        c_traceCallEncryptMessage,
+        c_traceCallDecryptMessage
+    };
+}
+
+MessageBatch::MessageBatch() :
+    m_buffers(),
+    m_messages()
+{
+}
+
+void MessageBatch::Clear()
+{
+    m_buffers.clear();
+    m_messages.clear();
+}
+
+void MessageBatch::Reserve(int messageCount, int segmentCount)
+{
+    m_buffers.reserve(messageCount + segmentCount);
+    m_messages.reserve(messageCount);
+}
+
+void MessageBatch::AddMessage(char* token, unsigned long tokenLength)
+{
+    Message message;
+    message.firstBuffer = m_buffers.size();
+    message.bufferCount = 1;
+    m_messages.push_back(message);
+
+    SecBuffer tokenBuffer;
+    tokenBuffer.cbBuffer = tokenLength;
+    tokenBuffer.BufferType = SECBUFFER_TOKEN;
+    tokenBuffer.pvBuffer = token;
+    m_buffers.push_back(tokenBuffer);
+}
+
+void MessageBatch::AddSegment(char* data, unsigned long dataLength)
+{
+    SecBuffer dataBuffer;
+    dataBuffer.cbBuffer = dataLength;
+    dataBuffer.BufferType = SECBUFFER_DATA;
+    dataBuffer.pvBuffer = data;
+    m_buffers.push_back(dataBuffer);
+    m_messages.back().bufferCount++;
+}
+
+int MessageBatch::GetMessageCount() const
+{
+    return static_cast<int>(m_messages.size());
+}
+
+unsigned long MessageBatch::GetTokenLength(int index) const
+{
+    return m_buffers[m_messages[index].firstBuffer].cbBuffer;
+}
+
+SECURITY_STATUS MessageBatch::Process(
+    SspiProvider* provider,
+    CtxtHandle* ctxtHandle,
+    MessageOperation operation,
+    int* processedCount,
+    std::string* errorString)
+{
+    DebugLog("%d: Worker thread: MessageBatch::Process: %s, %d messages.\n",
+        GetCurrentThreadId(),
+        c_operationNames[operation],
+        GetMessageCount());
+
+    errorString->assign("");
+    *processedCount = 0;
+
+    if (ctxtHandle == nullptr)
+    {
+        errorString->assign(c_notEstablishedErrorString);
+        return SEC_E_INVALID_HANDLE;
+    }
+
+    for (size_t i = 0; i < m_messages.size(); i++)
+    {
+        SecBufferDesc message;
+        message.ulVersion = SECBUFFER_VERSION;
+        message.cBuffers = m_messages[i].bufferCount;
+        message.pBuffers = &m_buffers[m_messages[i].firstBuffer];
+
+        unsigned long qop = 0;
+        SECURITY_STATUS securityStatus;
+        TraceCallTimer traceTimer;
+        switch (operation)
+        {
+        case c_messageSign:
+            securityStatus = provider->MakeSignature(ctxtHandle, 0, &message, 0);
+            break;
+        case c_messageVerify:
+            securityStatus = provider->VerifySignature(ctxtHandle, &message, 0, &qop);
+            break;
+        case c_messageEncrypt:
+            securityStatus = provider->EncryptMessage(ctxtHandle, 0, &message, 0);
+            break;
+        default:
+            securityStatus = provider->DecryptMessage(ctxtHandle, &message, 0, &qop);
+
+            // Integrity only, the peer did not encrypt.
+            if (securityStatus == SEC_E_OK && qop == SECQOP_WRAP_NO_ENCRYPT)
+            {
+                securityStatus = SEC_E_QOP_NOT_SUPPORTED;
+            }
+
+            break;
+        }
+        traceTimer.Complete(c_operationTraceCalls[operation], securityStatus);
+
+        if (securityStatus != SEC_E_OK)
+        {
+            char errorStringLocal[c_errorStringBufferSize];
+            snprintf(
+                errorStringLocal,
+                c_errorStringBufferSize,
+                "%s failed with error code: 0x%X.",
+                c_operationNames[operation],
+                securityStatus);
+
+            errorString->assign(errorStringLocal);
+            return securityStatus;
+        }
+
+        (*processedCount)++;
+    }
+
+    return SEC_E_OK;
+}
+
+// static
+SECURITY_STATUS MessageBatch::QuerySizes(
+    SspiProvider* provider,
+    CtxtHandle* ctxtHandle,
+    SecPkgContext_Sizes* sizes,
+    std::string* errorString)
+{
+    errorString->assign("");
+
+    if (ctxtHandle == nullptr)
+    {
+        errorString->assign(c_notEstablishedErrorString);
+        return SEC_E_INVALID_HANDLE;
+    }
+
+    TraceCallTimer traceTimer;
+    SECURITY_STATUS securityStatus = provider->QueryContextSizes(ctxtHandle, sizes);
+    traceTimer.Complete(c_traceCallQueryContextSizes, securityStatus);
+    if (securityStatus != SEC_E_OK)
+    {
+        char errorStringLocal[c_errorStringBufferSize];
+        snprintf(
+            errorStringLocal,
+            c_errorStringBufferSize,
+            "QueryContextAttributesW failed with error code: 0x%X.",
+            securityStatus);
+
+        errorString->assign(errorStringLocal);
+    }
+
+    return securityStatus;
+}
+
+#endif  // IS_SUPPORTED_NODE_VERSION
@@ -0,0 +1,79 @@
+#pragma once
+
+#include "sspi_platform.h"
+#include "sspi_provider.h"
+
+#include <stddef.h>
+
+#include <string>
+#include <vector>
+
+// Values are shared with the JavaScript layer.
+enum MessageOperation
+{
+    c_messageSign = 0,
+    c_messageVerify,
+    c_messageEncrypt,
+    c_messageDecrypt,
+    c_messageOperationCount
+};
+
+// Messages protected in place with one established context in a single call,
+// e.g. everything a connection has queued to send. Each message is a token
+// buffer for the signature or security trailer followed by any number of data
+// segments, all in caller memory. The SecBuffers of every message share one
+// array, so a batch costs the same couple of allocations however many
+// messages it holds, and none once reused.
+//
+// Not thread-safe.
+class MessageBatch
+{
+public:
+    MessageBatch();
+
+    // Empties the batch, keeping its capacity.
+    void Clear();
+
+    void Reserve(int messageCount, int segmentCount);
+
+    // Segments added from here on belong to this message. For Sign and
+    // Encrypt token needs room for cbMaxSignature and cbSecurityTrailer bytes
+    // respectively, see QuerySizes.
+    void AddMessage(char* token, unsigned long tokenLength);
+    void AddSegment(char* data, unsigned long dataLength);
+
+    int GetMessageCount() const;
+
+    // Token length of the message at index once processed, the actual
+    // signature or trailer length for Sign and Encrypt.
+    unsigned long GetTokenLength(int index) const;
+
+    // Runs operation on each message in order. Stops at the first failure,
+    // processedCount has the number of messages that succeeded. ctxtHandle is
+    // nullptr if the context is not established yet.
+    SECURITY_STATUS Process(
+        SspiProvider* provider,
+        CtxtHandle* ctxtHandle,
+        MessageOperation operation,
+        int* processedCount,
+        std::string* errorString);
+
+    // Same rules for ctxtHandle as Process.
+    static SECURITY_STATUS QuerySizes(
+        SspiProvider* provider,
+        CtxtHandle* ctxtHandle,
+        SecPkgContext_Sizes* sizes,
+        std::string* errorString);
+
+private:
+    struct Message
+    {
+        size_t firstBuffer;
+        unsigned long bufferCount;
+    };
+
+    static const int c_errorStringBufferSize = 256;
+
+    std::vector<SecBuffer> m_buffers;
+    std::vector<Message> m_messages;
+};
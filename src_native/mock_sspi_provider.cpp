@@ -0,0 +1,921 @@
+#include "node_version_support.h"
+#ifdef IS_SUPPORTED_NODE_VERSION
+
+#include "mock_sspi_provider.h"
+
+#include "utils.h"
+
+#include <atomic>
+#include <chrono>
+#include <memory>
+#include <mutex>
+#include <map>
+#include <string>
+#include <thread>
+#include <string.h>
+
+namespace
+{
+    const int c_maxTokensPerExchange = 3;
+
+    struct MockPackage
+    {
+        const char* name;
+        const WCHAR* wideName;
+        unsigned long maxTokenSize;
+        int numTokens;
+        unsigned long tokenSizes[c_maxTokensPerExchange];
+    };
+
+    // Max token sizes match what Windows reports for these packages. Token
+    // sizes are in the range seen on the wire for each package.
+    const MockPackage c_packages[] =
+    {
+        { "Negotiate", WSTR("Negotiate"), 48256, 2, { 1620, 180, 0 } },
+        { "Kerberos", WSTR("Kerberos"), 48000, 2, { 1480, 160, 0 } },
+        { "NTLM", WSTR("NTLM"), 2888, 3, { 40, 230, 360 } }
+    };
+
+    const int c_numPackages = sizeof(c_packages) / sizeof(c_packages[0]);
+    const int c_negotiatePackageIndex = 0;
+    const int c_ntlmPackageIndex = 2;
+
+    // Token layout, little endian:
+    //  0: magic 'MSSP'
+    //  4: package index
+    //  5: token index within the exchange
+    //  6: reserved
+    //  8: exchange seed
+    // 12: payload length
+    // 16: payload checksum
+    // 20: payload
+    const unsigned long c_tokenHeaderSize = 20;
+    const unsigned char c_tokenMagic[4] = { 'M', 'S', 'S', 'P' };
+
+    const ULONG_PTR c_credentialTag = 0x4D435244;   // 'MCRD'
+    const ULONG_PTR c_contextTag = 0x4D435458;      // 'MCTX'
+
+    // Lifetime reported for credentials and contexts, same as the default
+    // Kerberos ticket lifetime.
+    const int64_t c_expiryMs = 10 * 60 * 60 * 1000;
+
+    // Credential lifetime, adjustable for tests.
+    std::atomic<int64_t> s_credentialLifetimeMs(c_expiryMs);
+
+    // Added to every context call, adjustable for tests.
+    std::atomic<int> s_latencyMs(0);
+
+    void SimulateLatency()
+    {
+        int latencyMs = s_latencyMs.load();
+        if (latencyMs > 0)
+        {
+            std::this_thread::sleep_for(std::chrono::milliseconds(latencyMs));
+        }
+    }
+
+    // Service tickets by target with their expiry, as in the Kerberos ticket
+    // cache. The first context for a target without a ticket, or with one
+    // expiring within c_ticketRenewWindowMs, pays s_ticketLatencyMs for the
+    // TGS request. Adjustable for tests, changing the latency purges the
+    // cache.
+    const int64_t c_ticketRenewWindowMs = 5 * 60 * 1000;
+    std::atomic<int> s_ticketLatencyMs(0);
+    std::atomic<int64_t> s_ticketLifetimeMs(c_expiryMs);
+    std::mutex s_ticketsMutex;
+    std::map<std::basic_string<WCHAR>, int64_t> s_tickets;
+
+    // Returns the expiry of the ticket for targetName.
+    int64_t SimulateTicketRequest(const WCHAR* targetName)
+    {
+        {
+            std::lock_guard<std::mutex> lock(s_ticketsMutex);
+            std::map<std::basic_string<WCHAR>, int64_t>::iterator it = s_tickets.find(targetName);
+            if (it != s_tickets.end() && GetUnixTimeMs() < it->second - c_ticketRenewWindowMs)
+            {
+                return it->second;
+            }
+        }
+
+        // Concurrent first contexts for a target each request a ticket, same
+        // as SSPI.
+        int latencyMs = s_ticketLatencyMs.load();
+        if (latencyMs > 0)
+        {
+            std::this_thread::sleep_for(std::chrono::milliseconds(latencyMs));
+        }
+
+        int64_t expiryUnixMs = GetUnixTimeMs() + s_ticketLifetimeMs.load();
+        std::lock_guard<std::mutex> lock(s_ticketsMutex);
+        s_tickets[targetName] = expiryUnixMs;
+        return expiryUnixMs;
+    }
+
+    void Put32(unsigned char* p, uint32_t value)
+    {
+        p[0] = static_cast<unsigned char>(value);
+        p[1] = static_cast<unsigned char>(value >> 8);
+        p[2] = static_cast<unsigned char>(value >> 16);
+        p[3] = static_cast<unsigned char>(value >> 24);
+    }
+
+    uint32_t Get32(const unsigned char* p)
+    {
+        return static_cast<uint32_t>(p[0])
+            | (static_cast<uint32_t>(p[1]) << 8)
+            | (static_cast<uint32_t>(p[2]) << 16)
+            | (static_cast<uint32_t>(p[3]) << 24);
+    }
+
+    uint32_t Fnv1a(const unsigned char* data, unsigned long length, uint32_t hash = 2166136261u)
+    {
+        for (unsigned long i = 0; i < length; i++)
+        {
+            hash ^= data[i];
+            hash *= 16777619u;
+        }
+
+        return hash;
+    }
+
+    void FillPayload(unsigned char* payload, unsigned long length, uint32_t seed, int tokenIndex)
+    {
+        uint32_t state = seed ^ (static_cast<uint32_t>(tokenIndex + 1) * 0x9E3779B9u);
+        if (state == 0)
+        {
+            state = 1;
+        }
+
+        for (unsigned long i = 0; i < length; i++)
+        {
+            // xorshift32.
+            state ^= state << 13;
+            state ^= state >> 17;
+            state ^= state << 5;
+            payload[i] = static_cast<unsigned char>(state);
+        }
+    }
+
+    // Message token layout for MakeSignature and EncryptMessage, little
+    // endian:
+    //  0: magic 'MSIG' for signatures, 'MSEA' for sealed messages
+    //  4: sequence number
+    //  8: keyed hash of the sequence number and the data buffers
+    const unsigned long c_messageTokenSize = 16;
+    const unsigned char c_signatureMagic[4] = { 'M', 'S', 'I', 'G' };
+    const unsigned char c_sealMagic[4] = { 'M', 'S', 'E', 'A' };
+
+    void Put64(unsigned char* p, uint64_t value)
+    {
+        Put32(p, static_cast<uint32_t>(value));
+        Put32(p + 4, static_cast<uint32_t>(value >> 32));
+    }
+
+    uint64_t Get64(const unsigned char* p)
+    {
+        return static_cast<uint64_t>(Get32(p)) | (static_cast<uint64_t>(Get32(p + 4)) << 32);
+    }
+
+    // splitmix64 finalizer.
+    uint64_t Mix64(uint64_t value)
+    {
+        value ^= value >> 30;
+        value *= 0xBF58476D1CE4E5B9ULL;
+        value ^= value >> 27;
+        value *= 0x94D049BB133111EBULL;
+        value ^= value >> 31;
+        return value;
+    }
+
+    // Per message key, different for each direction so a side can't accept
+    // its own messages.
+    uint64_t GetMessageKey(uint32_t seed, bool isClientToServer, uint32_t sequence)
+    {
+        uint64_t direction = isClientToServer ? 0x436C69656E74ULL : 0x536572766572ULL;
+        return Mix64(((static_cast<uint64_t>(seed) << 32) | sequence) ^ direction);
+    }
+
+    // Keyed 64 bit hash over the data buffers of a message, fed buffer by
+    // buffer. Detects tampering in tests, it's not a MAC in any real sense.
+    class MessageHash
+    {
+    public:
+        explicit MessageHash(uint64_t key)
+            : m_state(key),
+            m_word(0),
+            m_wordLength(0),
+            m_length(0)
+        {
+        }
+
+        void Update(const unsigned char* data, unsigned long length)
+        {
+            m_length += length;
+
+            unsigned long i = 0;
+            while (m_wordLength > 0 && i < length)
+            {
+                AddByte(data[i++]);
+            }
+
+            for (; i + 8 <= length; i += 8)
+            {
+                Mix(Get64(data + i));
+            }
+
+            for (; i < length; i++)
+            {
+                AddByte(data[i]);
+            }
+        }
+
+        uint64_t Final()
+        {
+            Mix(m_word ^ (m_length << 3));
+            return Mix64(m_state);
+        }
+
+    private:
+        void AddByte(unsigned char value)
+        {
+            m_word |= static_cast<uint64_t>(value) << (8 * m_wordLength);
+            if (++m_wordLength == 8)
+            {
+                Mix(m_word);
+                m_word = 0;
+                m_wordLength = 0;
+            }
+        }
+
+        void Mix(uint64_t word)
+        {
+            m_state ^= word * 0x87C37B91114253D5ULL;
+            m_state = ((m_state << 31) | (m_state >> 33)) * 0x4CF5AD432745937FULL;
+        }
+
+        uint64_t m_state;
+        uint64_t m_word;
+        int m_wordLength;
+        uint64_t m_length;
+    };
+
+    // xorshift64* keystream XORed over the data buffers of a sealed message,
+    // continuing from one buffer to the next.
+    class Keystream
+    {
+    public:
+        explicit Keystream(uint64_t key)
+            : m_state(Mix64(key ^ 0x5EA1ED5EA1ED5EA1ULL) | 1),
+            m_word(0),
+            m_available(0)
+        {
+        }
+
+        void Apply(unsigned char* data, unsigned long length)
+        {
+            unsigned long i = 0;
+            while (m_available > 0 && i < length)
+            {
+                data[i++] ^= static_cast<unsigned char>(m_word >> (8 * (8 - m_available--)));
+            }
+
+            for (; i + 8 <= length; i += 8)
+            {
+                Put64(data + i, Get64(data + i) ^ Next());
+            }
+
+            if (i < length)
+            {
+                m_word = Next();
+                m_available = 8;
+                while (i < length)
+                {
+                    data[i++] ^= static_cast<unsigned char>(m_word >> (8 * (8 - m_available--)));
+                }
+            }
+        }
+
+    private:
+        uint64_t Next()
+        {
+            m_state ^= m_state >> 12;
+            m_state ^= m_state << 25;
+            m_state ^= m_state >> 27;
+            return m_state * 0x2545F4914F6CDD1DULL;
+        }
+
+        uint64_t m_state;
+        uint64_t m_word;
+        int m_available;
+    };
+
+    // ASCII case-insensitive match, which is all package names need.
+    bool PackageNameEquals(const WCHAR* a, const WCHAR* b)
+    {
+        for (; *a && *b; a++, b++)
+        {
+            WCHAR lowerA = (*a >= 'A' && *a <= 'Z') ? static_cast<WCHAR>(*a - 'A' + 'a') : *a;
+            WCHAR lowerB = (*b >= 'A' && *b <= 'Z') ? static_cast<WCHAR>(*b - 'A' + 'a') : *b;
+            if (lowerA != lowerB)
+            {
+                return false;
+            }
+        }
+
+        return *a == *b;
+    }
+
+    SecBuffer* FindTokenBuffer(SecBufferDesc* desc)
+    {
+        if (desc == nullptr)
+        {
+            return nullptr;
+        }
+
+        for (unsigned long i = 0; i < desc->cBuffers; i++)
+        {
+            if ((desc->pBuffers[i].BufferType & 0x0FFFFFFF) == SECBUFFER_TOKEN)
+            {
+                return &desc->pBuffers[i];
+            }
+        }
+
+        return nullptr;
+    }
+}
+
+struct MockSspiProvider::Credential
+{
+    ULONG_PTR tag;
+    int packageIndex;
+    unsigned long credentialUse;
+};
+
+struct MockSspiProvider::Context
+{
+    ULONG_PTR tag;
+    int packageIndex;
+    bool isServer;
+    bool isEstablished;
+    int nextToken;
+    uint32_t seed;
+
+    // Message protection, next sequence number for each direction.
+    uint32_t sendSequence;
+    uint32_t receiveSequence;
+
+    // Reported as the context expiry, the ticket's for client contexts that
+    // have one.
+    int64_t expiryUnixMs;
+};
+
+const char* MockSspiProvider::c_name = "mock";
+
+const char* MockSspiProvider::GetName() const
+{
+    return c_name;
+}
+
+SECURITY_STATUS MockSspiProvider::EnumeratePackages(std::vector<SspiPackageInfo>* packages)
+{
+    for (int i = 0; i < c_numPackages; i++)
+    {
+        SspiPackageInfo packageInfo;
+        packageInfo.name.assign(c_packages[i].name);
+        packageInfo.maxTokenSize = c_packages[i].maxTokenSize;
+        packages->push_back(packageInfo);
+    }
+
+    return SEC_E_OK;
+}
+
+SECURITY_STATUS MockSspiProvider::AcquireCredentials(
+    const WCHAR* principal,
+    const WCHAR* securityPackage,
+    unsigned long credentialUse,
+    CredHandle* credHandle,
+    TimeStamp* timeExpiry)
+{
+    for (int i = 0; i < c_numPackages; i++)
+    {
+        if (PackageNameEquals(securityPackage, c_packages[i].wideName))
+        {
+            Credential* credential = new Credential();
+            credential->tag = c_credentialTag;
+            credential->packageIndex = i;
+            credential->credentialUse = credentialUse;
+
+            credHandle->dwLower = reinterpret_cast<ULONG_PTR>(credential);
+            credHandle->dwUpper = c_credentialTag;
+            UnixMsToTimeStamp(GetUnixTimeMs() + s_credentialLifetimeMs.load(), timeExpiry);
+            return SEC_E_OK;
+        }
+    }
+
+    return SEC_E_SECPKG_NOT_FOUND;
+}
+
+SECURITY_STATUS MockSspiProvider::FreeCredentials(CredHandle* credHandle)
+{
+    Credential* credential = GetCredential(credHandle);
+    if (credential == nullptr)
+    {
+        return SEC_E_INVALID_HANDLE;
+    }
+
+    credential->tag = 0;
+    delete credential;
+    return SEC_E_OK;
+}
+
+SECURITY_STATUS MockSspiProvider::InitializeContext(
+    CredHandle* credHandle,
+    CtxtHandle* ctxtHandle,
+    const WCHAR* targetName,
+    unsigned long contextReq,
+    SecBufferDesc* input,
+    CtxtHandle* newCtxtHandle,
+    SecBufferDesc* output,
+    unsigned long* contextAttr,
+    TimeStamp* timeExpiry)
+{
+    SimulateLatency();
+
+    Credential* credential = GetCredential(credHandle);
+    if (credential == nullptr || !(credential->credentialUse & SECPKG_CRED_OUTBOUND))
+    {
+        return SEC_E_INVALID_HANDLE;
+    }
+
+    Context* context;
+    std::unique_ptr<Context> newContext;
+    if (ctxtHandle == nullptr)
+    {
+        if (targetName == nullptr || *targetName == 0)
+        {
+            return SEC_E_TARGET_UNKNOWN;
+        }
+
+        unsigned long targetNameLength = 0;
+        while (targetName[targetNameLength])
+        {
+            targetNameLength++;
+        }
+
+        // NTLM has no tickets.
+        int64_t expiryUnixMs = credential->packageIndex != c_ntlmPackageIndex
+            ? SimulateTicketRequest(targetName)
+            : GetExpiryUnixMs();
+
+        newContext.reset(new Context());
+        newContext->tag = c_contextTag;
+        newContext->packageIndex = credential->packageIndex;
+        newContext->isServer = false;
+        newContext->isEstablished = false;
+        newContext->nextToken = 0;
+        newContext->sendSequence = 0;
+        newContext->receiveSequence = 0;
+        newContext->expiryUnixMs = expiryUnixMs;
+        newContext->seed = Fnv1a(
+            reinterpret_cast<const unsigned char*>(targetName),
+            targetNameLength * sizeof(WCHAR),
+            Fnv1a(reinterpret_cast<const unsigned char*>(c_packages[credential->packageIndex].name),
+                static_cast<unsigned long>(strlen(c_packages[credential->packageIndex].name))));
+        context = newContext.get();
+    }
+    else
+    {
+        context = GetContext(ctxtHandle);
+        if (context == nullptr || context->isServer)
+        {
+            return SEC_E_INVALID_HANDLE;
+        }
+    }
+
+    SECURITY_STATUS securityStatus = Step(context, input, output);
+    if (securityStatus != SEC_E_OK && securityStatus != SEC_I_CONTINUE_NEEDED)
+    {
+        return securityStatus;
+    }
+
+    if (newContext)
+    {
+        newCtxtHandle->dwLower = reinterpret_cast<ULONG_PTR>(newContext.release());
+        newCtxtHandle->dwUpper = c_contextTag;
+    }
+
+    *contextAttr = contextReq;
+    UnixMsToTimeStamp(context->expiryUnixMs, timeExpiry);
+    return securityStatus;
+}
+
+SECURITY_STATUS MockSspiProvider::AcceptContext(
+    CredHandle* credHandle,
+    CtxtHandle* ctxtHandle,
+    SecBufferDesc* input,
+    unsigned long contextReq,
+    CtxtHandle* newCtxtHandle,
+    SecBufferDesc* output,
+    unsigned long* contextAttr,
+    TimeStamp* timeExpiry)
+{
+    SimulateLatency();
+
+    Credential* credential = GetCredential(credHandle);
+    if (credential == nullptr || !(credential->credentialUse & SECPKG_CRED_INBOUND))
+    {
+        return SEC_E_INVALID_HANDLE;
+    }
+
+    Context* context;
+    std::unique_ptr<Context> newContext;
+    if (ctxtHandle == nullptr)
+    {
+        // Package and seed come from the client's first token. Step()
+        // validates the rest of the token.
+        SecBuffer* inToken = FindTokenBuffer(input);
+        if (inToken == nullptr || inToken->cbBuffer < c_tokenHeaderSize)
+        {
+            return SEC_E_INVALID_TOKEN;
+        }
+
+        const unsigned char* header = static_cast<const unsigned char*>(inToken->pvBuffer);
+        int packageIndex = header[4];
+        if (packageIndex >= c_numPackages
+            || (packageIndex != credential->packageIndex
+                && credential->packageIndex != c_negotiatePackageIndex))
+        {
+            return SEC_E_INVALID_TOKEN;
+        }
+
+        newContext.reset(new Context());
+        newContext->tag = c_contextTag;
+        newContext->packageIndex = packageIndex;
+        newContext->isServer = true;
+        newContext->isEstablished = false;
+        newContext->nextToken = 0;
+        newContext->sendSequence = 0;
+        newContext->receiveSequence = 0;
+        newContext->expiryUnixMs = GetExpiryUnixMs();
+        newContext->seed = Get32(header + 8);
+        context = newContext.get();
+    }
+    else
+    {
+        context = GetContext(ctxtHandle);
+        if (context == nullptr || !context->isServer)
+        {
+            return SEC_E_INVALID_HANDLE;
+        }
+    }
+
+    SECURITY_STATUS securityStatus = Step(context, input, output);
+    if (securityStatus != SEC_E_OK && securityStatus != SEC_I_CONTINUE_NEEDED)
+    {
+        return securityStatus;
+    }
+
+    if (newContext)
+    {
+        newCtxtHandle->dwLower = reinterpret_cast<ULONG_PTR>(newContext.release());
+        newCtxtHandle->dwUpper = c_contextTag;
+    }
+
+    *contextAttr = contextReq;
+    UnixMsToTimeStamp(context->expiryUnixMs, timeExpiry);
+    return securityStatus;
+}
+
+SECURITY_STATUS MockSspiProvider::CompleteToken(
+    CtxtHandle* ctxtHandle,
+    SecBufferDesc* token)
+{
+    return GetContext(ctxtHandle) != nullptr ? SEC_E_OK : SEC_E_INVALID_HANDLE;
+}
+
+SECURITY_STATUS MockSspiProvider::DeleteContext(CtxtHandle* ctxtHandle)
+{
+    Context* context = GetContext(ctxtHandle);
+    if (context == nullptr)
+    {
+        return SEC_E_INVALID_HANDLE;
+    }
+
+    context->tag = 0;
+    delete context;
+    return SEC_E_OK;
+}
+
+SECURITY_STATUS MockSspiProvider::QueryContextSizes(
+    CtxtHandle* ctxtHandle,
+    SecPkgContext_Sizes* sizes)
+{
+    Context* context = GetContext(ctxtHandle);
+    if (context == nullptr || !context->isEstablished)
+    {
+        return SEC_E_INVALID_HANDLE;
+    }
+
+    sizes->cbMaxToken = c_packages[context->packageIndex].maxTokenSize;
+    sizes->cbMaxSignature = c_messageTokenSize;
+    sizes->cbBlockSize = 1;
+    sizes->cbSecurityTrailer = c_messageTokenSize;
+    return SEC_E_OK;
+}
+
+SECURITY_STATUS MockSspiProvider::MakeSignature(
+    CtxtHandle* ctxtHandle,
+    unsigned long qop,
+    SecBufferDesc* message,
+    unsigned long seqNo)
+{
+    return qop == 0 ? ProtectMessage(ctxtHandle, message, false) : SEC_E_QOP_NOT_SUPPORTED;
+}
+
+SECURITY_STATUS MockSspiProvider::VerifySignature(
+    CtxtHandle* ctxtHandle,
+    SecBufferDesc* message,
+    unsigned long seqNo,
+    unsigned long* qop)
+{
+    *qop = 0;
+    return UnprotectMessage(ctxtHandle, message, false);
+}
+
+SECURITY_STATUS MockSspiProvider::EncryptMessage(
+    CtxtHandle* ctxtHandle,
+    unsigned long qop,
+    SecBufferDesc* message,
+    unsigned long seqNo)
+{
+    return qop == 0 ? ProtectMessage(ctxtHandle, message, true) : SEC_E_QOP_NOT_SUPPORTED;
+}
+
+SECURITY_STATUS MockSspiProvider::DecryptMessage(
+    CtxtHandle* ctxtHandle,
+    SecBufferDesc* message,
+    unsigned long seqNo,
+    unsigned long* qop)
+{
+    *qop = 0;
+    return UnprotectMessage(ctxtHandle, message, true);
+}
+
+// static
+MockSspiProvider::Credential* MockSspiProvider::GetCredential(CredHandle* credHandle)
+{
+    if (credHandle == nullptr
+        || !SecIsValidHandle(credHandle)
+        || credHandle->dwUpper != c_credentialTag)
+    {
+        return nullptr;
+    }
+
+    Credential* credential = reinterpret_cast<Credential*>(credHandle->dwLower);
+    return credential->tag == c_credentialTag ? credential : nullptr;
+}
+
+// static
+MockSspiProvider::Context* MockSspiProvider::GetContext(CtxtHandle* ctxtHandle)
+{
+    if (ctxtHandle == nullptr
+        || !SecIsValidHandle(ctxtHandle)
+        || ctxtHandle->dwUpper != c_contextTag)
+    {
+        return nullptr;
+    }
+
+    Context* context = reinterpret_cast<Context*>(ctxtHandle->dwLower);
+    return context->tag == c_contextTag ? context : nullptr;
+}
+
+// static
+SECURITY_STATUS MockSspiProvider::Step(
+    Context* context,
+    SecBufferDesc* input,
+    SecBufferDesc* output)
+{
+    if (context->isEstablished)
+    {
+        return SEC_E_OUT_OF_SEQUENCE;
+    }
+
+    const MockPackage& package = c_packages[context->packageIndex];
+    int nextToken = context->nextToken;
+
+    // The server always starts by consuming a token, the client on every
+    // call but the first.
+    if (context->isServer || nextToken > 0)
+    {
+        SecBuffer* inToken = FindTokenBuffer(input);
+        if (inToken == nullptr || inToken->cbBuffer < c_tokenHeaderSize)
+        {
+            return SEC_E_INVALID_TOKEN;
+        }
+
+        const unsigned char* header = static_cast<const unsigned char*>(inToken->pvBuffer);
+        const unsigned char* payload = header + c_tokenHeaderSize;
+        unsigned long payloadLength = Get32(header + 12);
+        if (memcmp(header, c_tokenMagic, sizeof(c_tokenMagic)) != 0
+            || header[4] != context->packageIndex
+            || header[5] != nextToken
+            || Get32(header + 8) != context->seed
+            || payloadLength != inToken->cbBuffer - c_tokenHeaderSize
+            || Get32(header + 16) != Fnv1a(payload, payloadLength))
+        {
+            return SEC_E_INVALID_TOKEN;
+        }
+
+        nextToken++;
+    }
+
+    SecBuffer* outToken = FindTokenBuffer(output);
+    if (nextToken < package.numTokens)
+    {
+        unsigned long tokenSize = package.tokenSizes[nextToken];
+        if (outToken == nullptr)
+        {
+            return SEC_E_INSUFFICIENT_MEMORY;
+        }
+
+        if (outToken->cbBuffer < tokenSize)
+        {
+            // Nothing consumed, caller may retry with a bigger buffer.
+            return SEC_E_BUFFER_TOO_SMALL;
+        }
+
+        unsigned char* header = static_cast<unsigned char*>(outToken->pvBuffer);
+        unsigned char* payload = header + c_tokenHeaderSize;
+        unsigned long payloadLength = tokenSize - c_tokenHeaderSize;
+        FillPayload(payload, payloadLength, context->seed, nextToken);
+
+        memcpy(header, c_tokenMagic, sizeof(c_tokenMagic));
+        header[4] = static_cast<unsigned char>(context->packageIndex);
+        header[5] = static_cast<unsigned char>(nextToken);
+        header[6] = 0;
+        header[7] = 0;
+        Put32(header + 8, context->seed);
+        Put32(header + 12, payloadLength);
+        Put32(header + 16, Fnv1a(payload, payloadLength));
+
+        outToken->cbBuffer = tokenSize;
+        nextToken++;
+    }
+    else if (outToken != nullptr)
+    {
+        outToken->cbBuffer = 0;
+    }
+
+    context->nextToken = nextToken;
+    if (nextToken < package.numTokens)
+    {
+        return SEC_I_CONTINUE_NEEDED;
+    }
+
+    context->isEstablished = true;
+    return SEC_E_OK;
+}
+
+// static
+SECURITY_STATUS MockSspiProvider::ProtectMessage(
+    CtxtHandle* ctxtHandle,
+    SecBufferDesc* message,
+    bool isSealing)
+{
+    Context* context = GetContext(ctxtHandle);
+    if (context == nullptr || !context->isEstablished)
+    {
+        return SEC_E_INVALID_HANDLE;
+    }
+
+    SecBuffer* token = FindTokenBuffer(message);
+    if (token == nullptr)
+    {
+        return SEC_E_INVALID_TOKEN;
+    }
+
+    if (token->cbBuffer < c_messageTokenSize)
+    {
+        return SEC_E_BUFFER_TOO_SMALL;
+    }
+
+    uint32_t sequence = context->sendSequence;
+    uint64_t key = GetMessageKey(context->seed, !context->isServer, sequence);
+    MessageHash hash(key);
+    Keystream keystream(key);
+    for (unsigned long i = 0; i < message->cBuffers; i++)
+    {
+        SecBuffer& buffer = message->pBuffers[i];
+        if ((buffer.BufferType & 0x0FFFFFFF) == SECBUFFER_DATA)
+        {
+            unsigned char* data = static_cast<unsigned char*>(buffer.pvBuffer);
+            hash.Update(data, buffer.cbBuffer);
+            if (isSealing)
+            {
+                keystream.Apply(data, buffer.cbBuffer);
+            }
+        }
+    }
+
+    unsigned char* header = static_cast<unsigned char*>(token->pvBuffer);
+    memcpy(header, isSealing ? c_sealMagic : c_signatureMagic, 4);
+    Put32(header + 4, sequence);
+    Put64(header + 8, hash.Final());
+    token->cbBuffer = c_messageTokenSize;
+
+    context->sendSequence++;
+    return SEC_E_OK;
+}
+
+// static
+SECURITY_STATUS MockSspiProvider::UnprotectMessage(
+    CtxtHandle* ctxtHandle,
+    SecBufferDesc* message,
+    bool isSealing)
+{
+    Context* context = GetContext(ctxtHandle);
+    if (context == nullptr || !context->isEstablished)
+    {
+        return SEC_E_INVALID_HANDLE;
+    }
+
+    SecBuffer* token = FindTokenBuffer(message);
+    if (token == nullptr || token->cbBuffer != c_messageTokenSize)
+    {
+        return SEC_E_INVALID_TOKEN;
+    }
+
+    const unsigned char* header = static_cast<const unsigned char*>(token->pvBuffer);
+    if (memcmp(header, isSealing ? c_sealMagic : c_signatureMagic, 4) != 0)
+    {
+        return SEC_E_INVALID_TOKEN;
+    }
+
+    // Replayed, dropped and reordered messages all fail here, data buffers
+    // are left untouched.
+    uint32_t sequence = Get32(header + 4);
+    if (sequence != context->receiveSequence)
+    {
+        return SEC_E_OUT_OF_SEQUENCE;
+    }
+
+    uint64_t key = GetMessageKey(context->seed, context->isServer, sequence);
+    MessageHash hash(key);
+    Keystream keystream(key);
+    for (unsigned long i = 0; i < message->cBuffers; i++)
+    {
+        SecBuffer& buffer = message->pBuffers[i];
+        if ((buffer.BufferType & 0x0FFFFFFF) == SECBUFFER_DATA)
+        {
+            unsigned char* data = static_cast<unsigned char*>(buffer.pvBuffer);
+            if (isSealing)
+            {
+                keystream.Apply(data, buffer.cbBuffer);
+            }
+
+            hash.Update(data, buffer.cbBuffer);
+        }
+    }
+
+    if (hash.Final() != Get64(header + 8))
+    {
+        return SEC_E_MESSAGE_ALTERED;
+    }
+
+    context->receiveSequence++;
+    return SEC_E_OK;
+}
+
+// static
+void MockSspiProvider::SetCredentialLifetimeMs(int64_t lifetimeMs)
+{
+    s_credentialLifetimeMs.store(lifetimeMs >= 0 ? lifetimeMs : c_expiryMs);
+}
+
+// static
+void MockSspiProvider::SetLatencyMs(int latencyMs)
+{
+    s_latencyMs.store(latencyMs > 0 ? latencyMs : 0);
+}
+
+// static
+void MockSspiProvider::SetTicketLatencyMs(int latencyMs)
+{
+    std::lock_guard<std::mutex> lock(s_ticketsMutex);
+    s_tickets.clear();
+    s_ticketLatencyMs.store(latencyMs > 0 ? latencyMs : 0);
+}
+
+// static
+void MockSspiProvider::SetTicketLifetimeMs(int64_t lifetimeMs)
+{
+    s_ticketLifetimeMs.store(lifetimeMs >= 0 ? lifetimeMs : c_expiryMs);
+}
+
+// static
+int64_t MockSspiProvider::GetExpiryUnixMs()
+{
+    return GetUnixTimeMs() + c_expiryMs;
+}
+
+#endif  // IS_SUPPORTED_NODE_VERSION
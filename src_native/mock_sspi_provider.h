@@ -0,0 +1,141 @@
+#pragma once
+
+#include "sspi_provider.h"
+
+// Deterministic in-process provider with both client and server sides. It
+// offers the same packages as Windows (Negotiate, Kerberos, NTLM) and runs
+// multi-leg exchanges with realistic token counts and sizes, so the whole
+// native layer can be exercised, benchmarked and profiled without a domain.
+//
+// Exchanges per package, tokens alternate starting with the client:
+//  - Negotiate, Kerberos: client token, server token (mutual auth).
+//  - NTLM: negotiate, challenge, authenticate.
+//
+// Token contents are a function of the SPN, package and leg only, so
+// identical exchanges produce identical bytes. Tokens carry a checksum and
+// are validated by the receiving side; a token from the wrong leg, package or
+// exchange fails with SEC_E_INVALID_TOKEN.
+//
+// Established contexts sign and seal messages with a per direction keyed hash
+// and keystream, 16 byte tokens, sequence numbered. Not secure in any way, but
+// tampered, replayed and reordered messages fail as they would with SSPI.
+class MockSspiProvider : public SspiProvider
+{
+public:
+    static const char* c_name;
+
+    const char* GetName() const;
+
+    SECURITY_STATUS EnumeratePackages(std::vector<SspiPackageInfo>* packages);
+
+    SECURITY_STATUS AcquireCredentials(
+        const WCHAR* principal,
+        const WCHAR* securityPackage,
+        unsigned long credentialUse,
+        CredHandle* credHandle,
+        TimeStamp* timeExpiry);
+
+    SECURITY_STATUS FreeCredentials(CredHandle* credHandle);
+
+    SECURITY_STATUS InitializeContext(
+        CredHandle* credHandle,
+        CtxtHandle* ctxtHandle,
+        const WCHAR* targetName,
+        unsigned long contextReq,
+        SecBufferDesc* input,
+        CtxtHandle* newCtxtHandle,
+        SecBufferDesc* output,
+        unsigned long* contextAttr,
+        TimeStamp* timeExpiry);
+
+    SECURITY_STATUS AcceptContext(
+        CredHandle* credHandle,
+        CtxtHandle* ctxtHandle,
+        SecBufferDesc* input,
+        unsigned long contextReq,
+        CtxtHandle* newCtxtHandle,
+        SecBufferDesc* output,
+        unsigned long* contextAttr,
+        TimeStamp* timeExpiry);
+
+    SECURITY_STATUS CompleteToken(
+        CtxtHandle* ctxtHandle,
+        SecBufferDesc* token);
+
+    SECURITY_STATUS DeleteContext(CtxtHandle* ctxtHandle);
+
+    SECURITY_STATUS QueryContextSizes(
+        CtxtHandle* ctxtHandle,
+        SecPkgContext_Sizes* sizes);
+
+    SECURITY_STATUS MakeSignature(
+        CtxtHandle* ctxtHandle,
+        unsigned long qop,
+        SecBufferDesc* message,
+        unsigned long seqNo);
+
+    SECURITY_STATUS VerifySignature(
+        CtxtHandle* ctxtHandle,
+        SecBufferDesc* message,
+        unsigned long seqNo,
+        unsigned long* qop);
+
+    SECURITY_STATUS EncryptMessage(
+        CtxtHandle* ctxtHandle,
+        unsigned long qop,
+        SecBufferDesc* message,
+        unsigned long seqNo);
+
+    SECURITY_STATUS DecryptMessage(
+        CtxtHandle* ctxtHandle,
+        SecBufferDesc* message,
+        unsigned long seqNo,
+        unsigned long* qop);
+
+    // Lifetime reported for credentials acquired from now on. Negative
+    // restores the default of 10 hours. For unit testing purposes only.
+    static void SetCredentialLifetimeMs(int64_t lifetimeMs);
+
+    // Delay added to every InitializeContext and AcceptContext call, like a
+    // slow KDC would. For unit testing and benchmarking purposes only.
+    static void SetLatencyMs(int latencyMs);
+
+    // Delay added to the first Kerberos or Negotiate context for each target,
+    // like a TGS request for a service ticket not yet cached would. Purges
+    // the simulated ticket cache. For unit testing and benchmarking purposes
+    // only.
+    static void SetTicketLatencyMs(int latencyMs);
+
+    // Lifetime of service tickets requested from now on. Negative restores
+    // the default of 10 hours. For unit testing purposes only.
+    static void SetTicketLifetimeMs(int64_t lifetimeMs);
+
+private:
+    struct Credential;
+    struct Context;
+
+    static Credential* GetCredential(CredHandle* credHandle);
+    static Context* GetContext(CtxtHandle* ctxtHandle);
+
+    // Consumes the peer token from input if one is expected and writes the
+    // next token for this side to output.
+    static SECURITY_STATUS Step(
+        Context* context,
+        SecBufferDesc* input,
+        SecBufferDesc* output);
+
+    // MakeSignature and EncryptMessage, DATA buffers are encrypted in place
+    // if isSealing.
+    static SECURITY_STATUS ProtectMessage(
+        CtxtHandle* ctxtHandle,
+        SecBufferDesc* message,
+        bool isSealing);
+
+    // VerifySignature and DecryptMessage.
+    static SECURITY_STATUS UnprotectMessage(
+        CtxtHandle* ctxtHandle,
+        SecBufferDesc* message,
+        bool isSealing);
+
+    static int64_t GetExpiryUnixMs();
+};
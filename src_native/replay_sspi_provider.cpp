@@ -0,0 +1,617 @@
+#include "node_version_support.h"
+#ifdef IS_SUPPORTED_NODE_VERSION
+
+#include "replay_sspi_provider.h"
+
+#include "transcript.h"
+#include "utils.h"
+
+#include <atomic>
+#include <chrono>
+#include <map>
+#include <memory>
+#include <mutex>
+#include <thread>
+#include <string.h>
+
+namespace
+{
+    struct ReplayPackage
+    {
+        const char* name;
+        const WCHAR* wideName;
+        unsigned long maxTokenSize;
+    };
+
+    // Same packages and max token sizes as Windows, as for the mock.
+    const ReplayPackage c_packages[] =
+    {
+        { "Negotiate", WSTR("Negotiate"), 48256 },
+        { "Kerberos", WSTR("Kerberos"), 48000 },
+        { "NTLM", WSTR("NTLM"), 2888 }
+    };
+
+    const int c_numPackages = sizeof(c_packages) / sizeof(c_packages[0]);
+
+    const ULONG_PTR c_credentialTag = 0x52435244;   // 'RCRD'
+    const ULONG_PTR c_contextTag = 0x52435458;      // 'RCTX'
+
+    // Lifetime reported for credentials and contexts, same as the default
+    // Kerberos ticket lifetime.
+    const int64_t c_expiryMs = 10 * 60 * 60 * 1000;
+
+    std::atomic<bool> s_realTime(false);
+    std::atomic<uint64_t> s_served(0);
+    std::atomic<uint64_t> s_mismatches(0);
+
+    // Handshakes to pick from in turn.
+    struct HandshakeList
+    {
+        std::vector<size_t> handshakes;
+        uint64_t next;
+    };
+
+    struct ReplayHandshake
+    {
+        std::vector<const TranscriptRecord*> legs;
+    };
+
+    // A loaded transcript file, never changed after Load but for the turns
+    // of the handshake lists.
+    struct ReplayTranscripts
+    {
+        TranscriptFile file;
+        std::vector<ReplayHandshake> handshakes;
+        uint64_t legs;
+
+        // By lower case package name, and by SPN within a package.
+        std::map<std::string, HandshakeList> packages;
+        std::map<std::string, std::map<std::string, HandshakeList>> packageSpns;
+
+        // Guards next in the lists.
+        std::mutex mutex;
+    };
+
+    std::mutex s_transcriptsMutex;
+    std::shared_ptr<ReplayTranscripts> s_transcripts;
+
+    std::shared_ptr<ReplayTranscripts> GetTranscripts()
+    {
+        std::lock_guard<std::mutex> lock(s_transcriptsMutex);
+        return s_transcripts;
+    }
+
+    std::string ToLower(const std::string& name)
+    {
+        std::string lower(name);
+        for (size_t i = 0; i < lower.size(); i++)
+        {
+            if (lower[i] >= 'A' && lower[i] <= 'Z')
+            {
+                lower[i] = static_cast<char>(lower[i] - 'A' + 'a');
+            }
+        }
+
+        return lower;
+    }
+
+    // ASCII case-insensitive match, which is all package names need.
+    bool PackageNameEquals(const WCHAR* a, const WCHAR* b)
+    {
+        for (; *a && *b; a++, b++)
+        {
+            WCHAR lowerA = (*a >= 'A' && *a <= 'Z') ? static_cast<WCHAR>(*a - 'A' + 'a') : *a;
+            WCHAR lowerB = (*b >= 'A' && *b <= 'Z') ? static_cast<WCHAR>(*b - 'A' + 'a') : *b;
+            if (lowerA != lowerB)
+            {
+                return false;
+            }
+        }
+
+        return *a == *b;
+    }
+
+    // Exact match of a UTF-16 target name with a recorded UTF-8 SPN. SPNs are
+    // ASCII in practice, others never match and replay any handshake for
+    // the package.
+    bool SpnEquals(const WCHAR* targetName, const std::string& spn)
+    {
+        size_t i = 0;
+        for (; targetName[i] && i < spn.size(); i++)
+        {
+            if (targetName[i] >= 0x80 || targetName[i] != static_cast<unsigned char>(spn[i]))
+            {
+                return false;
+            }
+        }
+
+        return targetName[i] == 0 && i == spn.size();
+    }
+
+    SecBuffer* FindTokenBuffer(SecBufferDesc* desc)
+    {
+        if (desc == nullptr)
+        {
+            return nullptr;
+        }
+
+        for (unsigned long i = 0; i < desc->cBuffers; i++)
+        {
+            if ((desc->pBuffers[i].BufferType & 0x0FFFFFFF) == SECBUFFER_TOKEN)
+            {
+                return &desc->pBuffers[i];
+            }
+        }
+
+        return nullptr;
+    }
+
+    bool TokenEquals(const SecBuffer* token, const char* recordedToken, uint32_t recordedTokenLength)
+    {
+        if (token == nullptr || token->cbBuffer == 0)
+        {
+            return recordedTokenLength == 0;
+        }
+
+        return token->cbBuffer == recordedTokenLength
+            && memcmp(token->pvBuffer, recordedToken, recordedTokenLength) == 0;
+    }
+
+    bool LegEquals(const TranscriptRecord& a, const TranscriptRecord& b)
+    {
+        return a.status == b.status
+            && a.isDone == b.isDone
+            && a.inTokenLength == b.inTokenLength
+            && a.outTokenLength == b.outTokenLength
+            && memcmp(a.inToken, b.inToken, a.inTokenLength) == 0
+            && memcmp(a.outToken, b.outToken, a.outTokenLength) == 0;
+    }
+
+    // Next handshake for securityPackage, one recorded for targetName if
+    // there's any, and all the package's handshakes. Returns false if there's
+    // none for the package.
+    bool TakeTurn(
+        ReplayTranscripts* transcripts,
+        const std::string& securityPackage,
+        const WCHAR* targetName,
+        size_t* handshake,
+        const HandshakeList** packageHandshakes)
+    {
+        std::map<std::string, HandshakeList>::iterator packageIt = transcripts->packages.find(securityPackage);
+        if (packageIt == transcripts->packages.end())
+        {
+            return false;
+        }
+
+        HandshakeList* list = &packageIt->second;
+        std::map<std::string, HandshakeList>& spns = transcripts->packageSpns.find(securityPackage)->second;
+        for (std::map<std::string, HandshakeList>::iterator it = spns.begin(); it != spns.end(); ++it)
+        {
+            if (SpnEquals(targetName, it->first))
+            {
+                list = &it->second;
+                break;
+            }
+        }
+
+        std::lock_guard<std::mutex> lock(transcripts->mutex);
+        *handshake = list->handshakes[list->next % list->handshakes.size()];
+        *packageHandshakes = &packageIt->second;
+        list->next++;
+        return true;
+    }
+}
+
+struct ReplaySspiProvider::Credential
+{
+    ULONG_PTR tag;
+    std::string securityPackage;
+    unsigned long credentialUse;
+};
+
+struct ReplaySspiProvider::Context
+{
+    ULONG_PTR tag;
+
+    // Kept loaded while the context uses them.
+    std::shared_ptr<ReplayTranscripts> transcripts;
+    const HandshakeList* packageHandshakes;
+
+    size_t handshake;
+    size_t nextLeg;
+    bool isEstablished;
+};
+
+const char* ReplaySspiProvider::c_name = "replay";
+
+const char* ReplaySspiProvider::GetName() const
+{
+    return c_name;
+}
+
+SECURITY_STATUS ReplaySspiProvider::EnumeratePackages(std::vector<SspiPackageInfo>* packages)
+{
+    for (int i = 0; i < c_numPackages; i++)
+    {
+        SspiPackageInfo packageInfo;
+        packageInfo.name.assign(c_packages[i].name);
+        packageInfo.maxTokenSize = c_packages[i].maxTokenSize;
+        packages->push_back(packageInfo);
+    }
+
+    return SEC_E_OK;
+}
+
+SECURITY_STATUS ReplaySspiProvider::AcquireCredentials(
+    const WCHAR* principal,
+    const WCHAR* securityPackage,
+    unsigned long credentialUse,
+    CredHandle* credHandle,
+    TimeStamp* timeExpiry)
+{
+    if (!(credentialUse & SECPKG_CRED_OUTBOUND))
+    {
+        return SEC_E_UNSUPPORTED_FUNCTION;
+    }
+
+    for (int i = 0; i < c_numPackages; i++)
+    {
+        if (PackageNameEquals(securityPackage, c_packages[i].wideName))
+        {
+            Credential* credential = new Credential();
+            credential->tag = c_credentialTag;
+            credential->securityPackage = ToLower(c_packages[i].name);
+            credential->credentialUse = credentialUse;
+
+            credHandle->dwLower = reinterpret_cast<ULONG_PTR>(credential);
+            credHandle->dwUpper = c_credentialTag;
+            UnixMsToTimeStamp(GetUnixTimeMs() + c_expiryMs, timeExpiry);
+            return SEC_E_OK;
+        }
+    }
+
+    return SEC_E_SECPKG_NOT_FOUND;
+}
+
+SECURITY_STATUS ReplaySspiProvider::FreeCredentials(CredHandle* credHandle)
+{
+    Credential* credential = GetCredential(credHandle);
+    if (credential == nullptr)
+    {
+        return SEC_E_INVALID_HANDLE;
+    }
+
+    credential->tag = 0;
+    delete credential;
+    return SEC_E_OK;
+}
+
+SECURITY_STATUS ReplaySspiProvider::InitializeContext(
+    CredHandle* credHandle,
+    CtxtHandle* ctxtHandle,
+    const WCHAR* targetName,
+    unsigned long contextReq,
+    SecBufferDesc* input,
+    CtxtHandle* newCtxtHandle,
+    SecBufferDesc* output,
+    unsigned long* contextAttr,
+    TimeStamp* timeExpiry)
+{
+    Credential* credential = GetCredential(credHandle);
+    if (credential == nullptr)
+    {
+        return SEC_E_INVALID_HANDLE;
+    }
+
+    Context* context;
+    std::unique_ptr<Context> newContext;
+    if (ctxtHandle == nullptr)
+    {
+        if (targetName == nullptr || *targetName == 0)
+        {
+            return SEC_E_TARGET_UNKNOWN;
+        }
+
+        // Nothing recorded for the package, as if there were no ticket or
+        // password to authenticate with.
+        std::shared_ptr<ReplayTranscripts> transcripts = GetTranscripts();
+        size_t handshake;
+        const HandshakeList* packageHandshakes;
+        if (!transcripts
+            || !TakeTurn(transcripts.get(), credential->securityPackage, targetName, &handshake, &packageHandshakes))
+        {
+            return SEC_E_NO_CREDENTIALS;
+        }
+
+        newContext.reset(new Context());
+        newContext->tag = c_contextTag;
+        newContext->transcripts = transcripts;
+        newContext->packageHandshakes = packageHandshakes;
+        newContext->handshake = handshake;
+        newContext->nextLeg = 0;
+        newContext->isEstablished = false;
+        context = newContext.get();
+    }
+    else
+    {
+        context = GetContext(ctxtHandle);
+        if (context == nullptr)
+        {
+            return SEC_E_INVALID_HANDLE;
+        }
+    }
+
+    if (context->isEstablished
+        || context->nextLeg >= context->transcripts->handshakes[context->handshake].legs.size())
+    {
+        return SEC_E_OUT_OF_SEQUENCE;
+    }
+
+    // The first leg has no input, later ones must be what was recorded.
+    if (context->nextLeg > 0)
+    {
+        SecBuffer* inToken = FindTokenBuffer(input);
+        const TranscriptRecord* record = context->transcripts->handshakes[context->handshake].legs[context->nextLeg];
+        if (!TokenEquals(inToken, record->inToken, record->inTokenLength)
+            && !FindMatchingHandshake(context, inToken))
+        {
+            s_mismatches++;
+            return SEC_E_INVALID_TOKEN;
+        }
+    }
+
+    const TranscriptRecord* record = context->transcripts->handshakes[context->handshake].legs[context->nextLeg];
+    SecBuffer* outToken = FindTokenBuffer(output);
+    if (record->status >= 0 && record->outTokenLength > 0)
+    {
+        if (outToken == nullptr)
+        {
+            return SEC_E_INSUFFICIENT_MEMORY;
+        }
+
+        if (outToken->cbBuffer < record->outTokenLength)
+        {
+            // Nothing consumed, caller may retry with a bigger buffer.
+            return SEC_E_BUFFER_TOO_SMALL;
+        }
+    }
+
+    if (s_realTime.load() && record->durationUs > 0)
+    {
+        std::this_thread::sleep_for(std::chrono::microseconds(record->durationUs));
+    }
+
+    context->nextLeg++;
+    s_served++;
+
+    // Failed as recorded, a new context isn't kept.
+    if (record->status < 0)
+    {
+        return record->status;
+    }
+
+    if (outToken != nullptr)
+    {
+        memcpy(outToken->pvBuffer, record->outToken, record->outTokenLength);
+        outToken->cbBuffer = record->outTokenLength;
+    }
+
+    context->isEstablished = record->isDone;
+
+    if (newContext)
+    {
+        newCtxtHandle->dwLower = reinterpret_cast<ULONG_PTR>(newContext.release());
+        newCtxtHandle->dwUpper = c_contextTag;
+    }
+
+    *contextAttr = contextReq;
+    UnixMsToTimeStamp(GetUnixTimeMs() + c_expiryMs, timeExpiry);
+    return record->isDone ? SEC_E_OK : SEC_I_CONTINUE_NEEDED;
+}
+
+SECURITY_STATUS ReplaySspiProvider::AcceptContext(
+    CredHandle* credHandle,
+    CtxtHandle* ctxtHandle,
+    SecBufferDesc* input,
+    unsigned long contextReq,
+    CtxtHandle* newCtxtHandle,
+    SecBufferDesc* output,
+    unsigned long* contextAttr,
+    TimeStamp* timeExpiry)
+{
+    return SEC_E_UNSUPPORTED_FUNCTION;
+}
+
+SECURITY_STATUS ReplaySspiProvider::CompleteToken(
+    CtxtHandle* ctxtHandle,
+    SecBufferDesc* token)
+{
+    return GetContext(ctxtHandle) != nullptr ? SEC_E_OK : SEC_E_INVALID_HANDLE;
+}
+
+SECURITY_STATUS ReplaySspiProvider::DeleteContext(CtxtHandle* ctxtHandle)
+{
+    Context* context = GetContext(ctxtHandle);
+    if (context == nullptr)
+    {
+        return SEC_E_INVALID_HANDLE;
+    }
+
+    context->tag = 0;
+    delete context;
+    return SEC_E_OK;
+}
+
+SECURITY_STATUS ReplaySspiProvider::QueryContextSizes(
+    CtxtHandle* ctxtHandle,
+    SecPkgContext_Sizes* sizes)
+{
+    return SEC_E_UNSUPPORTED_FUNCTION;
+}
+
+SECURITY_STATUS ReplaySspiProvider::MakeSignature(
+    CtxtHandle* ctxtHandle,
+    unsigned long qop,
+    SecBufferDesc* message,
+    unsigned long seqNo)
+{
+    return SEC_E_UNSUPPORTED_FUNCTION;
+}
+
+SECURITY_STATUS ReplaySspiProvider::VerifySignature(
+    CtxtHandle* ctxtHandle,
+    SecBufferDesc* message,
+    unsigned long seqNo,
+    unsigned long* qop)
+{
+    return SEC_E_UNSUPPORTED_FUNCTION;
+}
+
+SECURITY_STATUS ReplaySspiProvider::EncryptMessage(
+    CtxtHandle* ctxtHandle,
+    unsigned long qop,
+    SecBufferDesc* message,
+    unsigned long seqNo)
+{
+    return SEC_E_UNSUPPORTED_FUNCTION;
+}
+
+SECURITY_STATUS ReplaySspiProvider::DecryptMessage(
+    CtxtHandle* ctxtHandle,
+    SecBufferDesc* message,
+    unsigned long seqNo,
+    unsigned long* qop)
+{
+    return SEC_E_UNSUPPORTED_FUNCTION;
+}
+
+// static
+bool ReplaySspiProvider::Load(const std::string& path, std::string* errorString)
+{
+    DebugLog("%d: Main event loop: ReplaySspiProvider::Load: %s.\n", GetCurrentThreadId(), path.c_str());
+
+    std::shared_ptr<ReplayTranscripts> transcripts(new ReplayTranscripts());
+    if (!transcripts->file.Open(path, errorString))
+    {
+        return false;
+    }
+
+    // Legs of a handshake are in order in the file, though interleaved with
+    // other handshakes. Handshakes whose first leg wasn't recorded are left
+    // out, as are legs after one that's missing.
+    std::map<uint64_t, size_t> handshakesByContextId;
+    const std::vector<TranscriptRecord>& records = transcripts->file.GetRecords();
+    for (size_t i = 0; i < records.size(); i++)
+    {
+        const TranscriptRecord& record = records[i];
+        std::map<uint64_t, size_t>::iterator it = handshakesByContextId.find(record.contextId);
+        if (it == handshakesByContextId.end())
+        {
+            if (record.leg != 0)
+            {
+                continue;
+            }
+
+            it = handshakesByContextId.insert(std::make_pair(record.contextId, transcripts->handshakes.size())).first;
+            transcripts->handshakes.push_back(ReplayHandshake());
+        }
+
+        ReplayHandshake& handshake = transcripts->handshakes[it->second];
+        if (static_cast<size_t>(record.leg) == handshake.legs.size())
+        {
+            handshake.legs.push_back(&record);
+        }
+    }
+
+    transcripts->legs = 0;
+    for (size_t i = 0; i < transcripts->handshakes.size(); i++)
+    {
+        const TranscriptRecord* firstLeg = transcripts->handshakes[i].legs[0];
+        std::string securityPackage = ToLower(firstLeg->securityPackage);
+        transcripts->packages[securityPackage].handshakes.push_back(i);
+        transcripts->packageSpns[securityPackage][firstLeg->spn].handshakes.push_back(i);
+        transcripts->legs += transcripts->handshakes[i].legs.size();
+    }
+
+    std::lock_guard<std::mutex> lock(s_transcriptsMutex);
+    s_transcripts = transcripts;
+    return true;
+}
+
+// static
+void ReplaySspiProvider::SetRealTime(bool realTime)
+{
+    s_realTime = realTime;
+}
+
+// static
+void ReplaySspiProvider::GetStats(ReplayStats* stats)
+{
+    std::shared_ptr<ReplayTranscripts> transcripts = GetTranscripts();
+    stats->handshakes = transcripts ? transcripts->handshakes.size() : 0;
+    stats->legs = transcripts ? transcripts->legs : 0;
+    stats->served = s_served.load();
+    stats->mismatches = s_mismatches.load();
+}
+
+// static
+ReplaySspiProvider::Credential* ReplaySspiProvider::GetCredential(CredHandle* credHandle)
+{
+    if (credHandle == nullptr
+        || !SecIsValidHandle(credHandle)
+        || credHandle->dwUpper != c_credentialTag)
+    {
+        return nullptr;
+    }
+
+    Credential* credential = reinterpret_cast<Credential*>(credHandle->dwLower);
+    return credential->tag == c_credentialTag ? credential : nullptr;
+}
+
+// static
+ReplaySspiProvider::Context* ReplaySspiProvider::GetContext(CtxtHandle* ctxtHandle)
+{
+    if (ctxtHandle == nullptr
+        || !SecIsValidHandle(ctxtHandle)
+        || ctxtHandle->dwUpper != c_contextTag)
+    {
+        return nullptr;
+    }
+
+    Context* context = reinterpret_cast<Context*>(ctxtHandle->dwLower);
+    return context->tag == c_contextTag ? context : nullptr;
+}
+
+// static
+bool ReplaySspiProvider::FindMatchingHandshake(Context* context, const SecBuffer* input)
+{
+    const std::vector<ReplayHandshake>& handshakes = context->transcripts->handshakes;
+    const ReplayHandshake& current = handshakes[context->handshake];
+    const std::vector<size_t>& candidates = context->packageHandshakes->handshakes;
+    for (size_t i = 0; i < candidates.size(); i++)
+    {
+        const ReplayHandshake& candidate = handshakes[candidates[i]];
+        if (candidates[i] == context->handshake
+            || candidate.legs.size() <= context->nextLeg
+            || !TokenEquals(input, candidate.legs[context->nextLeg]->inToken, candidate.legs[context->nextLeg]->inTokenLength))
+        {
+            continue;
+        }
+
+        bool isMatch = true;
+        for (size_t leg = 0; leg < context->nextLeg && isMatch; leg++)
+        {
+            isMatch = LegEquals(*current.legs[leg], *candidate.legs[leg]);
+        }
+
+        if (isMatch)
+        {
+            context->handshake = candidates[i];
+            return true;
+        }
+    }
+
+    return false;
+}
+
+#endif  // IS_SUPPORTED_NODE_VERSION
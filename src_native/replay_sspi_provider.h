@@ -0,0 +1,130 @@
+#pragma once
+
+#include "sspi_provider.h"
+
+#include <stdint.h>
+#include <string>
+
+struct ReplayStats
+{
+    // Handshakes and legs in the transcripts loaded.
+    uint64_t handshakes;
+    uint64_t legs;
+
+    // Legs served, and inputs that matched no recorded handshake.
+    uint64_t served;
+    uint64_t mismatches;
+};
+
+// Client side provider that serves handshakes recorded by TranscriptRecorder,
+// so captured Kerberos, Negotiate or NTLM traffic can be replayed on any
+// platform with no KDC or Windows host. It offers the same packages as
+// Windows.
+//
+// A new context starts on the next recorded handshake for its package, round
+// robin, preferring ones recorded for the same SPN, and serves its first
+// output token. Each later leg checks the input token against the recording
+// and serves the recorded output token and status. If the input differs, the
+// context moves to another handshake that served the same tokens so far and
+// expected this input; if there's none, the call fails with
+// SEC_E_INVALID_TOKEN. Recorded failures are returned as they were.
+//
+// Calls return as fast as they can unless real time is on, then each takes
+// as long as it did when recorded. Server contexts and message protection are
+// not supported.
+class ReplaySspiProvider : public SspiProvider
+{
+public:
+    static const char* c_name;
+
+    const char* GetName() const;
+
+    SECURITY_STATUS EnumeratePackages(std::vector<SspiPackageInfo>* packages);
+
+    SECURITY_STATUS AcquireCredentials(
+        const WCHAR* principal,
+        const WCHAR* securityPackage,
+        unsigned long credentialUse,
+        CredHandle* credHandle,
+        TimeStamp* timeExpiry);
+
+    SECURITY_STATUS FreeCredentials(CredHandle* credHandle);
+
+    SECURITY_STATUS InitializeContext(
+        CredHandle* credHandle,
+        CtxtHandle* ctxtHandle,
+        const WCHAR* targetName,
+        unsigned long contextReq,
+        SecBufferDesc* input,
+        CtxtHandle* newCtxtHandle,
+        SecBufferDesc* output,
+        unsigned long* contextAttr,
+        TimeStamp* timeExpiry);
+
+    SECURITY_STATUS AcceptContext(
+        CredHandle* credHandle,
+        CtxtHandle* ctxtHandle,
+        SecBufferDesc* input,
+        unsigned long contextReq,
+        CtxtHandle* newCtxtHandle,
+        SecBufferDesc* output,
+        unsigned long* contextAttr,
+        TimeStamp* timeExpiry);
+
+    SECURITY_STATUS CompleteToken(
+        CtxtHandle* ctxtHandle,
+        SecBufferDesc* token);
+
+    SECURITY_STATUS DeleteContext(CtxtHandle* ctxtHandle);
+
+    SECURITY_STATUS QueryContextSizes(
+        CtxtHandle* ctxtHandle,
+        SecPkgContext_Sizes* sizes);
+
+    SECURITY_STATUS MakeSignature(
+        CtxtHandle* ctxtHandle,
+        unsigned long qop,
+        SecBufferDesc* message,
+        unsigned long seqNo);
+
+    SECURITY_STATUS VerifySignature(
+        CtxtHandle* ctxtHandle,
+        SecBufferDesc* message,
+        unsigned long seqNo,
+        unsigned long* qop);
+
+    SECURITY_STATUS EncryptMessage(
+        CtxtHandle* ctxtHandle,
+        unsigned long qop,
+        SecBufferDesc* message,
+        unsigned long seqNo);
+
+    SECURITY_STATUS DecryptMessage(
+        CtxtHandle* ctxtHandle,
+        SecBufferDesc* message,
+        unsigned long seqNo,
+        unsigned long* qop);
+
+    // Maps the transcript file at path and serves its handshakes to contexts
+    // started from now on. Contexts already started keep the handshakes
+    // they were on. Returns false, keeping the transcripts loaded before, if
+    // path can't be mapped or isn't a transcript file.
+    static bool Load(const std::string& path, std::string* errorString);
+
+    // Whether calls take as long as they did when recorded.
+    static void SetRealTime(bool realTime);
+
+    static void GetStats(ReplayStats* stats);
+
+private:
+    struct Credential;
+    struct Context;
+    struct Transcripts;
+
+    static Credential* GetCredential(CredHandle* credHandle);
+    static Context* GetContext(CtxtHandle* ctxtHandle);
+
+    // Moves context to a handshake that matches the one it's on up to its
+    // next leg and expects input there. Returns false if there's none.
+    static bool FindMatchingHandshake(Context* context, const SecBuffer* input);
+};
@@ -0,0 +1,529 @@
+#include "node_version_support.h"
+#ifdef IS_SUPPORTED_NODE_VERSION
+
+// Before anything pulls in Windows.h.
+#ifdef _WIN32
+#include <winsock2.h>
+#include <ws2tcpip.h>
+#pragma comment(lib, "ws2_32.lib")
+#else
+#include <arpa/inet.h>
+#include <netdb.h>
+#include <netinet/in.h>
+#include <sys/socket.h>
+#endif
+
+#include "spn_resolver.h"
+
+#include "utils.h"
+#include "worker_pool.h"
+
+#include <chrono>
+#include <condition_variable>
+#include <ctype.h>
+#include <sstream>
+#include <string.h>
+#include <thread>
+
+namespace
+{
+    // Host names are case insensitive.
+    std::string ToLower(const std::string& value)
+    {
+        std::string lowerCase(value);
+        for (size_t i = 0; i < lowerCase.size(); i++)
+        {
+            lowerCase[i] = static_cast<char>(tolower(static_cast<unsigned char>(lowerCase[i])));
+        }
+
+        return lowerCase;
+    }
+
+    std::string GetAddrInfoErrorCode(int error)
+    {
+        switch (error)
+        {
+        case EAI_NONAME:
+#if defined(EAI_NODATA) && EAI_NODATA != EAI_NONAME
+        case EAI_NODATA:
+#endif
+            return "ENOTFOUND";
+        case EAI_AGAIN:
+            return "EAI_AGAIN";
+        case EAI_MEMORY:
+            return "EAI_MEMORY";
+        default:
+            return "EAI_FAIL";
+        }
+    }
+
+    bool IsIpAddress(const std::string& host)
+    {
+        unsigned char address[sizeof(struct in6_addr)];
+        return inet_pton(AF_INET, host.c_str(), address) == 1
+            || inet_pton(AF_INET6, host.c_str(), address) == 1;
+    }
+
+    // Reverse lookups for one host racing each other. The first name found
+    // wins; the caller stops waiting then, lookups already started finish on
+    // their own and the addresses nobody has taken yet are dropped.
+    struct ReverseRace
+    {
+        std::mutex mutex;
+        std::condition_variable completed;
+        std::vector<std::string> addresses;
+        size_t next;
+        int pending;
+        std::string fqdn;
+        std::string errorCode;
+    };
+
+    // Takes addresses off race and looks them up one after the other until
+    // none are left or a name is found.
+    void RunReverses(const std::shared_ptr<HostResolver>& hostResolver, const std::shared_ptr<ReverseRace>& race)
+    {
+        std::unique_lock<std::mutex> lock(race->mutex);
+        while (race->fqdn.empty() && race->next < race->addresses.size())
+        {
+            std::string address = race->addresses[race->next++];
+            lock.unlock();
+
+            std::string name;
+            std::string errorCode = hostResolver->Reverse(address, &name);
+
+            lock.lock();
+            race->pending--;
+            if (errorCode.empty())
+            {
+                if (race->fqdn.empty())
+                {
+                    race->fqdn = name;
+                }
+            }
+            else if (race->errorCode.empty())
+            {
+                race->errorCode = errorCode;
+            }
+
+            race->completed.notify_all();
+        }
+    }
+}
+
+// Winsock is initialized by libuv before any add-on code runs.
+std::string SystemHostResolver::Lookup(const std::string& host, std::vector<std::string>* addresses)
+{
+    struct addrinfo hints;
+    memset(&hints, 0, sizeof(hints));
+    hints.ai_family = AF_UNSPEC;
+    hints.ai_socktype = SOCK_STREAM;
+
+    struct addrinfo* result = nullptr;
+    int error = getaddrinfo(host.c_str(), nullptr, &hints, &result);
+    if (error != 0)
+    {
+        return GetAddrInfoErrorCode(error);
+    }
+
+    for (struct addrinfo* info = result; info != nullptr; info = info->ai_next)
+    {
+        char address[NI_MAXHOST];
+        if (getnameinfo(info->ai_addr, static_cast<socklen_t>(info->ai_addrlen), address, sizeof(address),
+                nullptr, 0, NI_NUMERICHOST) == 0)
+        {
+            bool isDuplicate = false;
+            for (size_t i = 0; i < addresses->size() && !isDuplicate; i++)
+            {
+                isDuplicate = (*addresses)[i] == address;
+            }
+
+            if (!isDuplicate)
+            {
+                addresses->push_back(address);
+            }
+        }
+    }
+
+    freeaddrinfo(result);
+    return addresses->empty() ? "ENOTFOUND" : "";
+}
+
+std::string SystemHostResolver::Reverse(const std::string& address, std::string* name)
+{
+    struct addrinfo hints;
+    memset(&hints, 0, sizeof(hints));
+    hints.ai_family = AF_UNSPEC;
+    hints.ai_flags = AI_NUMERICHOST;
+
+    struct addrinfo* result = nullptr;
+    int error = getaddrinfo(address.c_str(), nullptr, &hints, &result);
+    if (error != 0)
+    {
+        return GetAddrInfoErrorCode(error);
+    }
+
+    char host[NI_MAXHOST];
+    error = getnameinfo(result->ai_addr, static_cast<socklen_t>(result->ai_addrlen), host, sizeof(host),
+        nullptr, 0, NI_NAMEREQD);
+    freeaddrinfo(result);
+
+    if (error != 0)
+    {
+        return GetAddrInfoErrorCode(error);
+    }
+
+    name->assign(host);
+    return "";
+}
+
+StubHostResolver::StubHostResolver(const std::string& hosts, int delayMs) :
+    m_lines(),
+    m_delayMs(delayMs)
+{
+    std::istringstream hostsStream(hosts);
+    std::string line;
+    while (std::getline(hostsStream, line))
+    {
+        size_t comment = line.find('#');
+        if (comment != std::string::npos)
+        {
+            line.erase(comment);
+        }
+
+        std::istringstream lineStream(line);
+        HostsLine hostsLine;
+        std::string name;
+        if (!(lineStream >> hostsLine.address))
+        {
+            continue;
+        }
+
+        while (lineStream >> name)
+        {
+            hostsLine.names.push_back(ToLower(name));
+        }
+
+        if (!hostsLine.names.empty())
+        {
+            m_lines.push_back(hostsLine);
+        }
+    }
+}
+
+void StubHostResolver::Delay() const
+{
+    if (m_delayMs > 0)
+    {
+        std::this_thread::sleep_for(std::chrono::milliseconds(m_delayMs));
+    }
+}
+
+std::string StubHostResolver::Lookup(const std::string& host, std::vector<std::string>* addresses)
+{
+    Delay();
+
+    std::string lowerCaseHost = ToLower(host);
+    for (size_t i = 0; i < m_lines.size(); i++)
+    {
+        for (size_t j = 0; j < m_lines[i].names.size(); j++)
+        {
+            if (m_lines[i].names[j] == lowerCaseHost)
+            {
+                addresses->push_back(m_lines[i].address);
+                break;
+            }
+        }
+    }
+
+    return addresses->empty() ? "ENOTFOUND" : "";
+}
+
+std::string StubHostResolver::Reverse(const std::string& address, std::string* name)
+{
+    Delay();
+
+    for (size_t i = 0; i < m_lines.size(); i++)
+    {
+        if (m_lines[i].address == address)
+        {
+            if (m_lines[i].names[0] == "-")
+            {
+                break;
+            }
+
+            name->assign(m_lines[i].names[0]);
+            return "";
+        }
+    }
+
+    return "ENOTFOUND";
+}
+
+// static
+SpnResolver* SpnResolver::GetInstance()
+{
+    // Intentionally leaked, reverse lookups that lost a race may still be
+    // running while static destructors run at process exit.
+    static SpnResolver* s_spnResolver = new SpnResolver();
+    return s_spnResolver;
+}
+
+SpnResolver::SpnResolver() :
+    m_mutex(),
+    m_entries(),
+    m_hostResolver(new SystemHostResolver()),
+    m_ttlMs(c_defaultTtlMs),
+    m_negativeTtlMs(c_defaultNegativeTtlMs),
+    m_sweepSize(c_minSweepSize),
+    m_stats()
+{
+}
+
+SpnResolver::~SpnResolver()
+{
+}
+
+// Called with m_mutex held.
+bool SpnResolver::IsFresh(const Entry& entry, int64_t nowMs)
+{
+    if (entry.isResolving || nowMs >= entry.expiryUnixMs)
+    {
+        return false;
+    }
+
+    if (entry.errorCode.empty())
+    {
+        m_stats.hits++;
+    }
+    else
+    {
+        m_stats.negativeHits++;
+    }
+
+    return true;
+}
+
+bool SpnResolver::TryGetCached(const std::string& host, std::string* fqdn, std::string* errorCode)
+{
+    std::lock_guard<std::mutex> lock(m_mutex);
+
+    std::map<std::string, std::shared_ptr<Entry>>::iterator it = m_entries.find(ToLower(host));
+    if (it == m_entries.end() || !IsFresh(*it->second, GetUnixTimeMs()))
+    {
+        return false;
+    }
+
+    *fqdn = it->second->fqdn;
+    *errorCode = it->second->errorCode;
+    return true;
+}
+
+void SpnResolver::Resolve(
+    const std::string& host,
+    const ResolveCallback& callback,
+    std::string* fqdn,
+    std::string* errorCode,
+    std::vector<ResolveCallback>* callbacks)
+{
+    std::string key = ToLower(host);
+
+    std::unique_lock<std::mutex> lock(m_mutex);
+
+    std::map<std::string, std::shared_ptr<Entry>>::iterator it = m_entries.find(key);
+    if (it != m_entries.end())
+    {
+        std::shared_ptr<Entry> entry = it->second;
+        if (entry->isResolving)
+        {
+            // Whoever is resolving calls back, no need to hold up this
+            // thread meanwhile.
+            m_stats.waits++;
+            entry->callbacks.push_back(callback);
+            return;
+        }
+
+        if (IsFresh(*entry, GetUnixTimeMs()))
+        {
+            *fqdn = entry->fqdn;
+            *errorCode = entry->errorCode;
+            callbacks->push_back(callback);
+            return;
+        }
+
+        m_entries.erase(it);
+    }
+
+    m_stats.misses++;
+
+    if (m_entries.size() >= m_sweepSize)
+    {
+        SweepExpired(GetUnixTimeMs());
+    }
+
+    std::shared_ptr<Entry> entry(new Entry());
+    entry->isResolving = true;
+    entry->callbacks.push_back(callback);
+    entry->expiryUnixMs = 0;
+    m_entries[key] = entry;
+
+    std::shared_ptr<HostResolver> hostResolver = m_hostResolver;
+
+    // Resolve without holding the lock, resolutions of other hosts must not
+    // wait for this one.
+    lock.unlock();
+
+    std::chrono::steady_clock::time_point begin = std::chrono::steady_clock::now();
+    ResolveUncached(hostResolver, host, fqdn, errorCode);
+    uint64_t lookupUs = static_cast<uint64_t>(std::chrono::duration_cast<std::chrono::microseconds>(
+        std::chrono::steady_clock::now() - begin).count());
+
+    DebugLog("%d: Worker thread: SpnResolver::Resolve: %s -> %s%s in %llu us.\n",
+        GetCurrentThreadId(),
+        host.c_str(),
+        fqdn->c_str(),
+        errorCode->c_str(),
+        static_cast<unsigned long long>(lookupUs));
+
+    lock.lock();
+
+    m_stats.lookups++;
+    m_stats.totalLookupUs += lookupUs;
+    if (m_stats.maxLookupUs < lookupUs)
+    {
+        m_stats.maxLookupUs = lookupUs;
+    }
+
+    if (!errorCode->empty())
+    {
+        m_stats.failures++;
+    }
+
+    entry->isResolving = false;
+    entry->fqdn = *fqdn;
+    entry->errorCode = *errorCode;
+    entry->expiryUnixMs = GetUnixTimeMs() + (errorCode->empty() ? m_ttlMs : m_negativeTtlMs);
+    callbacks->swap(entry->callbacks);
+}
+
+// Called with m_mutex held.
+void SpnResolver::SweepExpired(int64_t nowMs)
+{
+    for (std::map<std::string, std::shared_ptr<Entry>>::iterator it = m_entries.begin(); it != m_entries.end();)
+    {
+        if (!it->second->isResolving && nowMs >= it->second->expiryUnixMs)
+        {
+            it = m_entries.erase(it);
+        }
+        else
+        {
+            ++it;
+        }
+    }
+
+    // Next sweep once the cache has doubled, so sweeps stay cheap per miss
+    // however many entries are fresh.
+    m_sweepSize = m_entries.size() * 2 > c_minSweepSize ? m_entries.size() * 2 : c_minSweepSize;
+}
+
+// static
+void SpnResolver::ResolveUncached(
+    const std::shared_ptr<HostResolver>& hostResolver,
+    const std::string& host,
+    std::string* fqdn,
+    std::string* errorCode)
+{
+    std::vector<std::string> addresses;
+    if (IsIpAddress(host))
+    {
+        addresses.push_back(host);
+    }
+    else
+    {
+        *errorCode = hostResolver->Lookup(host, &addresses);
+        if (!errorCode->empty())
+        {
+            return;
+        }
+    }
+
+    if (addresses.size() == 1)
+    {
+        *errorCode = hostResolver->Reverse(addresses[0], fqdn);
+        return;
+    }
+
+    std::shared_ptr<ReverseRace> race(new ReverseRace());
+    race->addresses.swap(addresses);
+    race->next = 0;
+    race->pending = static_cast<int>(race->addresses.size());
+
+    // Helpers on the WorkerPool take addresses as threads come free. The
+    // caller, possibly a WorkerPool thread itself, takes its share too rather
+    // than wait on tasks queued behind it; with no thread free it does them
+    // all.
+    for (size_t i = 1; i < race->addresses.size(); i++)
+    {
+        WorkerPool::GetInstance()->Submit(host, 0, [hostResolver, race]()
+        {
+            RunReverses(hostResolver, race);
+        });
+    }
+
+    RunReverses(hostResolver, race);
+
+    std::unique_lock<std::mutex> lock(race->mutex);
+    race->completed.wait(lock, [&race]() { return !race->fqdn.empty() || race->pending == 0; });
+
+    *fqdn = race->fqdn;
+    *errorCode = race->fqdn.empty() ? race->errorCode : "";
+}
+
+void SpnResolver::Configure(int64_t ttlMs, int64_t negativeTtlMs)
+{
+    std::lock_guard<std::mutex> lock(m_mutex);
+    m_ttlMs = ttlMs >= 0 ? ttlMs : c_defaultTtlMs;
+    m_negativeTtlMs = negativeTtlMs >= 0 ? negativeTtlMs : c_defaultNegativeTtlMs;
+}
+
+void SpnResolver::SetHostResolver(const std::shared_ptr<HostResolver>& hostResolver)
+{
+    {
+        std::lock_guard<std::mutex> lock(m_mutex);
+        m_hostResolver = hostResolver ? hostResolver : std::make_shared<SystemHostResolver>();
+    }
+
+    Clear();
+}
+
+void SpnResolver::Clear()
+{
+    std::lock_guard<std::mutex> lock(m_mutex);
+
+    // Entries being resolved stay, their callbacks still need the result.
+    for (std::map<std::string, std::shared_ptr<Entry>>::iterator it = m_entries.begin(); it != m_entries.end();)
+    {
+        if (it->second->isResolving)
+        {
+            ++it;
+        }
+        else
+        {
+            it = m_entries.erase(it);
+        }
+    }
+}
+
+void SpnResolver::GetStats(SpnResolverStats* stats)
+{
+    std::lock_guard<std::mutex> lock(m_mutex);
+    *stats = m_stats;
+    stats->size = m_entries.size();
+}
+
+void SpnResolver::ResetStats()
+{
+    std::lock_guard<std::mutex> lock(m_mutex);
+    m_stats = SpnResolverStats();
+}
+
+#endif  // IS_SUPPORTED_NODE_VERSION
@@ -0,0 +1,165 @@
+#pragma once
+
+#include <functional>
+#include <map>
+#include <memory>
+#include <mutex>
+#include <stdint.h>
+#include <string>
+#include <vector>
+
+struct SpnResolverStats
+{
+    uint64_t hits;
+    uint64_t negativeHits;
+    uint64_t misses;
+    uint64_t waits;
+    uint64_t lookups;
+    uint64_t failures;
+    uint64_t totalLookupUs;
+    uint64_t maxLookupUs;
+    uint64_t size;
+};
+
+// Name lookups underneath the SpnResolver. Errors are returned as the codes
+// Node.js uses for DNS errors, e.g. "ENOTFOUND", empty on success.
+// Implementations must be safe to call from multiple threads at once.
+class HostResolver
+{
+public:
+    virtual ~HostResolver() {}
+
+    virtual std::string Lookup(const std::string& host, std::vector<std::string>* addresses) = 0;
+    virtual std::string Reverse(const std::string& address, std::string* name) = 0;
+};
+
+// getaddrinfo and getnameinfo, which go through the hosts file and DNS the
+// same way dns.lookup does.
+class SystemHostResolver : public HostResolver
+{
+public:
+    std::string Lookup(const std::string& host, std::vector<std::string>* addresses);
+    std::string Reverse(const std::string& address, std::string* name);
+};
+
+// Answers from hosts file text instead of the system, optionally slowed down
+// by delayMs per call. Each line is an address followed by names; Lookup
+// matches any of the names, Reverse returns the first. A first name of "-"
+// makes Reverse fail for that address, as for an address without a PTR
+// record. For unit testing purposes only.
+class StubHostResolver : public HostResolver
+{
+public:
+    StubHostResolver(const std::string& hosts, int delayMs);
+
+    std::string Lookup(const std::string& host, std::vector<std::string>* addresses);
+    std::string Reverse(const std::string& address, std::string* name);
+
+private:
+    struct HostsLine
+    {
+        std::string address;
+        std::vector<std::string> names;
+    };
+
+    void Delay() const;
+
+    std::vector<HostsLine> m_lines;
+    int m_delayMs;
+};
+
+// Process-wide, thread-safe cache of host name to FQDN resolutions, the
+// expensive part of building an SPN. Failures are cached too, for a shorter
+// time. Expired entries are swept out as the cache grows. Concurrent
+// resolutions of the same host are single-flighted: one caller resolves, the
+// others attach their callbacks to its resolution and return without
+// waiting, so a slow host ties up one worker thread however many resolve it.
+// The reverse lookups for a host with several addresses are spread over the
+// caller and free WorkerPool threads and the first name found wins.
+class SpnResolver
+{
+public:
+    // Takes the FQDN and the error code, one of them empty.
+    typedef std::function<void(const std::string& fqdn, const std::string& errorCode)> ResolveCallback;
+
+    static SpnResolver* GetInstance();
+
+    // Returns true if host has an unexpired cache entry, with either fqdn or
+    // errorCode set. Never blocks on a resolution in flight, cheap enough for
+    // the main event loop.
+    bool TryGetCached(const std::string& host, std::string* fqdn, std::string* errorCode);
+
+    // Resolves host, an IP address or a host name, to an FQDN through the
+    // cache. If host is being resolved already, attaches callback to that
+    // resolution and returns at once. Otherwise blocks on the lookups, worker
+    // threads only, and fills callbacks with callback and the callbacks
+    // attached meanwhile. Calling them, on whatever thread suits them, is up
+    // to the caller.
+    void Resolve(
+        const std::string& host,
+        const ResolveCallback& callback,
+        std::string* fqdn,
+        std::string* errorCode,
+        std::vector<ResolveCallback>* callbacks);
+
+    // 0 disables caching of successes or failures, resolutions in flight are
+    // still shared.
+    void Configure(int64_t ttlMs, int64_t negativeTtlMs);
+
+    // nullptr restores the SystemHostResolver. Clears the cache.
+    void SetHostResolver(const std::shared_ptr<HostResolver>& hostResolver);
+
+    void Clear();
+
+    void GetStats(SpnResolverStats* stats);
+    void ResetStats();
+
+    static const int64_t c_defaultTtlMs = 5 * 60 * 1000;
+    static const int64_t c_defaultNegativeTtlMs = 10 * 1000;
+    static const size_t c_minSweepSize = 1024;
+
+private:
+    SpnResolver();
+
+    // Not implemented. Never destroyed, see GetInstance.
+    SpnResolver(const SpnResolver&);
+    SpnResolver& operator=(const SpnResolver&);
+    ~SpnResolver();
+
+    struct Entry
+    {
+        bool isResolving;
+
+        // Attached while isResolving.
+        std::vector<ResolveCallback> callbacks;
+
+        std::string fqdn;
+        std::string errorCode;
+        int64_t expiryUnixMs;
+    };
+
+    // Called with m_mutex held. Counts hits.
+    bool IsFresh(const Entry& entry, int64_t nowMs);
+
+    // Called with m_mutex held. Drops the expired entries not being resolved.
+    void SweepExpired(int64_t nowMs);
+
+    // Does the lookups for host, without the cache.
+    static void ResolveUncached(
+        const std::shared_ptr<HostResolver>& hostResolver,
+        const std::string& host,
+        std::string* fqdn,
+        std::string* errorCode);
+
+    std::mutex m_mutex;
+    std::map<std::string, std::shared_ptr<Entry>> m_entries;
+    std::shared_ptr<HostResolver> m_hostResolver;
+
+    int64_t m_ttlMs;
+    int64_t m_negativeTtlMs;
+
+    // Cache size that triggers the next SweepExpired.
+    size_t m_sweepSize;
+
+    SpnResolverStats m_stats;
+};
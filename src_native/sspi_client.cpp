@@ -13,20 +13,233 @@
 // In short, native binding is meant to used by the package implementation. Application
 // should only use API surfaced in JavaScript.
 
+#include <atomic>
+#include <chrono>
+#include <map>
 #include <memory>
+#include <mutex>
 #include <nan.h>
 #include <string>
+#include <vector>
 
+#include "credential_cache.h"
+#include "expiry_refresher.h"
+#include "first_leg_pool.h"
+#include "handshake_admission.h"
+#include "latency_stats.h"
+#include "message_batch.h"
+#include "mock_sspi_provider.h"
+#include "replay_sspi_provider.h"
+#include "spn_resolver.h"
 #include "sspi_impl.h"
+#include "sspi_provider.h"
+#include "sspi_server_impl.h"
+#include "token_buffer_pool.h"
+#include "transcript.h"
+#include "worker_pool.h"
 
 #include "utils.h"
 
+// Runs workers on the addon's WorkerPool instead of the libuv thread pool and
+// completes them on the main event loop through a uv_async_t, the same way
+// Nan::AsyncQueueWorker would. Disabled, workers go to the libuv thread pool.
+// Queue and completion run on the main event loop thread.
+class WorkerPoolQueue
+{
+public:
+    static void Queue(Nan::AsyncWorker* worker)
+    {
+        Queue(worker, std::string(), 0);
+    }
+
+    // Schedules the work for tenant with a deadline deadlineMs from now, 0
+    // for the default or c_backgroundDeadlineMs, see WorkerPool::Submit. The
+    // libuv thread pool ignores both.
+    static void Queue(Nan::AsyncWorker* worker, const std::string& tenant, int deadlineMs)
+    {
+        if (!BeginQueue(worker))
+        {
+            return;
+        }
+
+        std::shared_ptr<std::atomic<int>> remaining = std::make_shared<std::atomic<int>>(1);
+        Submit(tenant, deadlineMs, [worker, remaining]()
+        {
+            worker->Execute();
+            EndTask(worker, remaining.get());
+        });
+    }
+
+    // For workers made of independent entries, e.g. one per client of a
+    // batch: runs worker->ExecuteEntry(i) as a task of its own for each
+    // entry, scheduled for worker->GetTenant(i) with a deadline of
+    // worker->GetDeadlineMs(i), so every entry gets the fair share and
+    // deadline of its tenant. The worker completes once after the last of
+    // them returns. On the libuv thread pool Execute runs once and has to go
+    // through all entries.
+    template <typename EntryWorker>
+    static void QueueEntries(EntryWorker* worker)
+    {
+        int entryCount = worker->GetEntryCount();
+        if (entryCount == 0)
+        {
+            Queue(worker);
+            return;
+        }
+
+        if (!BeginQueue(worker))
+        {
+            return;
+        }
+
+        std::shared_ptr<std::atomic<int>> remaining = std::make_shared<std::atomic<int>>(entryCount);
+        for (int i = 0; i < entryCount; i++)
+        {
+            Submit(worker->GetTenant(i), worker->GetDeadlineMs(i), [worker, remaining, i]()
+            {
+                worker->ExecuteEntry(i);
+                EndTask(worker, remaining.get());
+            });
+        }
+    }
+
+    static void SetEnabled(bool enable)
+    {
+        s_isEnabled = enable;
+    }
+
+    static bool IsEnabled()
+    {
+        return s_isEnabled;
+    }
+
+    // Deadline for work nobody waits on, see WorkerPool::SubmitBackground.
+    static const int c_backgroundDeadlineMs = -1;
+
+private:
+    // Returns false if the worker went to the libuv thread pool instead.
+    static bool BeginQueue(Nan::AsyncWorker* worker)
+    {
+        if (!s_isEnabled)
+        {
+            Nan::AsyncQueueWorker(worker);
+            return false;
+        }
+
+        if (!s_isInitialized)
+        {
+            uv_async_init(uv_default_loop(), &s_completedAsync, OnCompleted);
+            uv_unref(reinterpret_cast<uv_handle_t*>(&s_completedAsync));
+            s_isInitialized = true;
+        }
+
+        // Keep the event loop alive only while work is pending, same as
+        // requests on the libuv thread pool.
+        if (s_pending++ == 0)
+        {
+            uv_ref(reinterpret_cast<uv_handle_t*>(&s_completedAsync));
+        }
+
+        return true;
+    }
+
+    static void Submit(const std::string& tenant, int deadlineMs, const WorkerPool::Task& task)
+    {
+        if (deadlineMs == c_backgroundDeadlineMs)
+        {
+            WorkerPool::GetInstance()->SubmitBackground(tenant, task);
+        }
+        else
+        {
+            WorkerPool::GetInstance()->Submit(tenant, deadlineMs, task);
+        }
+    }
+
+    // Executes inside worker threads. The last task of worker to return
+    // hands it back to the main event loop.
+    static void EndTask(Nan::AsyncWorker* worker, std::atomic<int>* remaining)
+    {
+        if (--*remaining > 0)
+        {
+            return;
+        }
+
+        {
+            std::lock_guard<std::mutex> lock(s_completedMutex);
+            s_completed.push_back(worker);
+        }
+
+        uv_async_send(&s_completedAsync);
+    }
+
+    // uv_async_send coalesces, drain everything completed so far.
+    static void OnCompleted(uv_async_t* handle)
+    {
+        std::vector<Nan::AsyncWorker*> completed;
+
+        {
+            std::lock_guard<std::mutex> lock(s_completedMutex);
+            completed.swap(s_completed);
+        }
+
+        for (size_t i = 0; i < completed.size(); i++)
+        {
+            completed[i]->WorkComplete();
+            completed[i]->Destroy();
+        }
+
+        s_pending -= static_cast<int>(completed.size());
+        if (s_pending == 0)
+        {
+            uv_unref(reinterpret_cast<uv_handle_t*>(&s_completedAsync));
+        }
+    }
+
+    static bool s_isEnabled;
+    static bool s_isInitialized;
+    static int s_pending;
+    static uv_async_t s_completedAsync;
+
+    static std::mutex s_completedMutex;
+    static std::vector<Nan::AsyncWorker*> s_completed;
+};
+
+bool WorkerPoolQueue::s_isEnabled = true;
+bool WorkerPoolQueue::s_isInitialized = false;
+int WorkerPoolQueue::s_pending = 0;
+uv_async_t WorkerPoolQueue::s_completedAsync;
+
+std::mutex WorkerPoolQueue::s_completedMutex;
+std::vector<Nan::AsyncWorker*> WorkerPoolQueue::s_completed;
+
 // Worker class for executing SSPI initialization code asynchronously.
+// Initialization runs once per process. Callers that ask for it while it's in
+// flight are added to a waiter list and all of them are called back from the
+// single completion; callers after completion are called back right away with
+// the same results. All static state is only touched on the main event loop
+// thread.
 class SspiClientInitializeWorker : public Nan::AsyncWorker
 {
 public:
-    SspiClientInitializeWorker(Nan::Callback* callback) :
-        Nan::AsyncWorker(callback),
+    // Calls callback once initialization completes, starting it if needed.
+    static void AddWaiter(Nan::Callback* callback)
+    {
+        if (s_isCompleted)
+        {
+            InvokeWaiter(callback);
+            return;
+        }
+
+        s_waiters.push_back(callback);
+        if (!s_isStarted)
+        {
+            s_isStarted = true;
+            WorkerPoolQueue::Queue(new SspiClientInitializeWorker());
+        }
+    }
+
+    SspiClientInitializeWorker() :
+        Nan::AsyncWorker(nullptr),  // Waiters are called back instead.
         m_securityStatus(SEC_E_INTERNAL_ERROR),
         m_errorString(),
         m_availablePackages(),
@@ -52,28 +265,26 @@ public:
     }
 
     // Executed in main event loop thread after async work is completed. Invokes
-    // user callback with the results from initialization.
+    // all the waiters with the results from initialization.
     void HandleOKCallback()
     {
-        DebugLog("%ul: Main event loop: SspiClientInitializeWorker::HandleOKCallback.\n",
-            GetCurrentThreadId());
+        DebugLog("%ul: Main event loop: SspiClientInitializeWorker::HandleOKCallback: %d waiters.\n",
+            GetCurrentThreadId(),
+            static_cast<int>(s_waiters.size()));
 
-        v8::Local<v8::Array> availablePackages =
-            Nan::New<v8::Array>(static_cast<int>(m_availablePackages.size()));
-        for (unsigned int i = 0; i < m_availablePackages.size(); i++)
-        {
-            Nan::Set(availablePackages, i, Nan::New<v8::String>(m_availablePackages[i].c_str()).ToLocalChecked());
-        }
+        s_securityStatus = m_securityStatus;
+        s_errorString.swap(m_errorString);
+        s_availablePackages.swap(m_availablePackages);
+        s_defaultPackageIndex = m_defaultPackageIndex;
+        s_isCompleted = true;
 
-        v8::Local<v8::Value> argv[] =
+        // Waiters added from the callbacks below are invoked right away.
+        std::vector<Nan::Callback*> waiters;
+        waiters.swap(s_waiters);
+        for (size_t i = 0; i < waiters.size(); i++)
         {
-            availablePackages,
-            Nan::New<v8::Uint32>(m_defaultPackageIndex),
-            Nan::New<v8::Uint32>(m_securityStatus),
-            Nan::New<v8::String>(m_errorString.c_str()).ToLocalChecked()
-        };
-
-        callback->Call(4, argv);
+            InvokeWaiter(waiters[i]);
+        }
     }
 
     ~SspiClientInitializeWorker()
@@ -87,12 +298,73 @@ private:
     SspiClientInitializeWorker(const SspiClientInitializeWorker&);
     SspiClientInitializeWorker& operator=(const SspiClientInitializeWorker&);
 
+    static void InvokeWaiter(Nan::Callback* callback)
+    {
+        Nan::HandleScope scope;
+
+        v8::Local<v8::Array> availablePackages =
+            Nan::New<v8::Array>(static_cast<int>(s_availablePackages.size()));
+        for (unsigned int i = 0; i < s_availablePackages.size(); i++)
+        {
+            Nan::Set(availablePackages, i, Nan::New<v8::String>(s_availablePackages[i].c_str()).ToLocalChecked());
+        }
+
+        v8::Local<v8::Value> argv[] =
+        {
+            availablePackages,
+            Nan::New<v8::Uint32>(s_defaultPackageIndex),
+            Nan::New<v8::Uint32>(s_securityStatus),
+            Nan::New<v8::String>(s_errorString.c_str()).ToLocalChecked()
+        };
+
+        std::unique_ptr<Nan::Callback> waiter(callback);
+        waiter->Call(4, argv);
+    }
+
     SECURITY_STATUS m_securityStatus;
     std::string m_errorString;
     std::vector<std::string> m_availablePackages;
     int m_defaultPackageIndex;
+
+    static bool s_isStarted;
+    static bool s_isCompleted;
+    static std::vector<Nan::Callback*> s_waiters;
+
+    static SECURITY_STATUS s_securityStatus;
+    static std::string s_errorString;
+    static std::vector<std::string> s_availablePackages;
+    static int s_defaultPackageIndex;
 };
 
+bool SspiClientInitializeWorker::s_isStarted = false;
+bool SspiClientInitializeWorker::s_isCompleted = false;
+std::vector<Nan::Callback*> SspiClientInitializeWorker::s_waiters;
+
+SECURITY_STATUS SspiClientInitializeWorker::s_securityStatus = SEC_E_INTERNAL_ERROR;
+std::string SspiClientInitializeWorker::s_errorString;
+std::vector<std::string> SspiClientInitializeWorker::s_availablePackages;
+int SspiClientInitializeWorker::s_defaultPackageIndex = -1;
+
+// Accessing V8 data from worker threads is not allowed, but the memory behind
+// a Buffer does not move. Keeping the Buffer alive through the worker's
+// persistent handle lets the worker thread read the blob in place instead of
+// from a copy. Returns nullptr for empty blobs.
+static const char* PinInBlob(
+    Nan::AsyncWorker* worker,
+    v8::Local<v8::Value> inBlobBuffer,
+    int inBlobBeginOffset,
+    int inBlobLength)
+{
+    if (inBlobLength <= 0)
+    {
+        return nullptr;
+    }
+
+    v8::Local<v8::Object> buffer = inBlobBuffer->ToObject();
+    worker->SaveToPersistent("inBlob", buffer);
+    return node::Buffer::Data(buffer) + inBlobBeginOffset;
+}
+
 // Worker class to get the next client response asynchronously.
 class SspiClientGetNextBlobWorker : public Nan::AsyncWorker
 {
@@ -100,29 +372,27 @@ public:
     SspiClientGetNextBlobWorker(
         Nan::Callback* callback,
         const std::shared_ptr<SspiImpl>& sspiImpl,
-        const char* inBlob,
+        const std::shared_ptr<QueuedCall>& queuedCall,
+        v8::Local<v8::Value> inBlobBuffer,
         int inBlobBeginOffset,
         int inBlobLength)
         : Nan::AsyncWorker(callback),
         m_sspiImpl(sspiImpl),
+        m_queuedCall(queuedCall),
+        m_isSkipped(false),
         m_securityStatus(-1),
         m_errorString(),
-        m_inBlob(nullptr),
+        m_inBlob(PinInBlob(this, inBlobBuffer, inBlobBeginOffset, inBlobLength)),
         m_inBlobLength(inBlobLength),
         m_outBlob(nullptr),
         m_outBlobLength(0),
-        m_isDone(false)
+        m_isDone(false),
+        m_totalTimer(),
+        m_callbackTimer(),
+        m_queueWaitUs(0)
     {
         DebugLog("%ul: Main event loop: SspiClientGetNextBlobWorker::SspiClientInitializeWorker.\n",
             GetCurrentThreadId());
-
-        // Accessing V8 data from worker threads is not allowed. That's why
-        // we need to make a copy of the inBlob to hand off to worker thread.
-        if (m_inBlobLength)
-        {
-            m_inBlob.reset(new char[m_inBlobLength]);
-            memcpy(m_inBlob.get(), inBlob + inBlobBeginOffset, m_inBlobLength);
-        }
     }
 
     // This function executes inside the worker-thread. No V8 data-structures
@@ -134,13 +404,26 @@ public:
         DebugLog("%ul: Worker Thread: Initialize: SspiClientGetNextBlobWorker::Execute.\n",
             GetCurrentThreadId());
 
+        m_queueWaitUs = m_totalTimer.GetElapsedUs();
+
+        // Cancelled or timed out while queued, nobody waits for the result.
+        m_securityStatus = m_queuedCall->Start(&m_errorString);
+        if (m_securityStatus != SEC_E_OK)
+        {
+            m_isSkipped = true;
+            return;
+        }
+
         m_securityStatus = m_sspiImpl->GetNextBlob(
-            m_inBlob.get(),
+            m_inBlob,
             m_inBlobLength,
             &m_outBlob,
             &m_outBlobLength,
             &m_isDone,
             &m_errorString);
+        m_queuedCall->Complete();
+
+        m_callbackTimer.Restart();
     }
 
     // Executed in main event loop thread after async work is completed. Invokes
@@ -150,9 +433,21 @@ public:
         DebugLog("%ul: Main event loop: SspiClientGetNextBlobWorker::HandleOKCallback.\n",
             GetCurrentThreadId());
 
+        if (!m_isSkipped)
+        {
+            LatencyStats* latencyStats = LatencyStats::GetInstance();
+            int packageIndex = m_sspiImpl->GetPackageIndex();
+            bool succeeded = m_securityStatus >= 0;
+            latencyStats->Record(c_latencyPhaseQueueWait, packageIndex, succeeded, m_queueWaitUs);
+            latencyStats->Record(c_latencyPhaseCallbackDelay, packageIndex, succeeded, m_callbackTimer.GetElapsedUs());
+            latencyStats->Record(c_latencyPhaseTotal, packageIndex, succeeded, m_totalTimer.GetElapsedUs());
+        }
+
         v8::Local<v8::Value> argv[] =
         {
-            Nan::NewBuffer(m_outBlob, m_outBlobLength, FreeCallback, nullptr).ToLocalChecked(),
+            m_outBlob != nullptr
+                ? Nan::NewBuffer(m_outBlob, m_outBlobLength, FreeCallback, nullptr).ToLocalChecked()
+                : Nan::NewBuffer(0).ToLocalChecked(),
             Nan::New<v8::Boolean>(m_isDone),
             Nan::New<v8::Uint32>(m_securityStatus),
             Nan::New<v8::String>(m_errorString.c_str()).ToLocalChecked()
@@ -183,10 +478,16 @@ private:
     // Lifetime shared with SspiClientObject.
     std::shared_ptr<SspiImpl> m_sspiImpl;
 
+    // Shared with SspiClientObject, which cancels it.
+    std::shared_ptr<QueuedCall> m_queuedCall;
+    bool m_isSkipped;
+
     SECURITY_STATUS m_securityStatus;
     std::string m_errorString;
 
-    std::unique_ptr<char> m_inBlob;
+    // Points into the Buffer passed in from JavaScript, kept alive by the
+    // worker's persistent handle. See PinInBlob.
+    const char* m_inBlob;
     int m_inBlobLength;
 
     // This is allocated SspiImpl class. It's lifetime is managed
@@ -195,147 +496,1609 @@ private:
     char* m_outBlob;
     int m_outBlobLength;
     bool m_isDone;
+
+    // Running from the constructor on the main event loop and from the end
+    // of Execute.
+    LatencyTimer m_totalTimer;
+    LatencyTimer m_callbackTimer;
+    uint64_t m_queueWaitUs;
 };
 
-NAN_METHOD(InitializeAsync)
+// Worker class to get the next client response for many clients as a single
+// job, e.g. the first leg for every connection of a pool being filled. Saves
+// the per call callback and worker. Each entry is scheduled for its own
+// tenant and deadline, see WorkerPoolQueue::QueueEntries.
+class SspiClientGetNextBlobBatchWorker : public Nan::AsyncWorker
 {
-    DebugLog("%ul: Main event loop: InitializeAsync NAN_METHOD.\n", GetCurrentThreadId());
+public:
+    struct Entry
+    {
+        std::shared_ptr<SspiImpl> sspiImpl;
 
-    Nan::Callback* callback = new Nan::Callback(info[0].As<v8::Function>());
-    AsyncQueueWorker(new SspiClientInitializeWorker(callback));
-}
+        // Shared with SspiClientObject, which cancels it. Null if the entry
+        // wasn't admitted, it fails with c_errorQueueFull.
+        std::shared_ptr<QueuedCall> queuedCall;
 
-NAN_METHOD(EnableDebugLogging)
-{
-    DebugLog("%ul: Main event loop: EnableDebugLogging NAN_METHOD.\n", GetCurrentThreadId());
-    SetDebugLogging(info[0]->BooleanValue());
-}
+        std::string tenant;
+        int deadlineMs;
 
-// Native implementation of SspiClient surfaced to JavaScript.
-class SspiClientObject : public Nan::ObjectWrap
-{
-public:
-    static NAN_MODULE_INIT(Init)
-    {
-        DebugLog("%ul: Main event loop: SspiClientObject::Init.\n", GetCurrentThreadId());
-        v8::Local<v8::FunctionTemplate> tpl = Nan::New<v8::FunctionTemplate>(New);
-        tpl->SetClassName(Nan::New(c_className).ToLocalChecked());
-        tpl->InstanceTemplate()->SetInternalFieldCount(1);
+        const char* inBlob;
+        int inBlobLength;
 
-        Nan::SetPrototypeMethod(tpl, "getNextBlob", GetNextBlob);
-        Nan::SetPrototypeMethod(tpl, "utEnableCannedResponse", UtEnableCannedResponse);
-        Nan::SetPrototypeMethod(tpl, "utForceCompleteAuth", UtForceCompleteAuth);
+        SECURITY_STATUS securityStatus;
+        std::string errorString;
+        char* outBlob;
+        int outBlobLength;
+        bool isDone;
+    };
 
-        s_constructor.Reset(Nan::GetFunction(tpl).ToLocalChecked());
-        Nan::Set(
-            target,
-            Nan::New(c_className).ToLocalChecked(),
-            Nan::GetFunction(tpl).ToLocalChecked());
+    // inBlobBuffers is kept alive by the worker's persistent handle, entries
+    // point into the Buffers it holds. See PinInBlob.
+    SspiClientGetNextBlobBatchWorker(Nan::Callback* callback, v8::Local<v8::Object> inBlobBuffers)
+        : Nan::AsyncWorker(callback),
+        m_entries()
+    {
+        DebugLog("%ul: Main event loop: SspiClientGetNextBlobBatchWorker::SspiClientGetNextBlobBatchWorker.\n",
+            GetCurrentThreadId());
+        SaveToPersistent("inBlobs", inBlobBuffers);
     }
 
-private:
-    // Not implemented.
-    SspiClientObject(const SspiClientGetNextBlobWorker&);
-    SspiClientObject& operator=(const SspiClientGetNextBlobWorker&);
+    void AddEntry(
+        const std::shared_ptr<SspiImpl>& sspiImpl,
+        const std::shared_ptr<QueuedCall>& queuedCall,
+        const char* tenant,
+        int deadlineMs,
+        v8::Local<v8::Value> inBlobBuffer,
+        int inBlobBeginOffset,
+        int inBlobLength)
+    {
+        Entry entry;
+        entry.sspiImpl = sspiImpl;
+        entry.queuedCall = queuedCall;
+        entry.tenant.assign(tenant);
+        entry.deadlineMs = deadlineMs;
+        entry.inBlob = inBlobLength > 0 ? node::Buffer::Data(inBlobBuffer) + inBlobBeginOffset : nullptr;
+        entry.inBlobLength = inBlobLength;
+        entry.securityStatus = queuedCall ? -1 : c_errorQueueFull;
+        entry.errorString = queuedCall ? "" : "Too many calls queued.";
+        entry.outBlob = nullptr;
+        entry.outBlobLength = 0;
+        entry.isDone = false;
+        m_entries.push_back(entry);
+    }
 
-    SspiClientObject(const char* spn, const char* securityPackage)
-        : m_sspiImpl(new SspiImpl(spn, securityPackage))
+    int GetEntryCount() const
     {
-        DebugLog("%ul: Main event loop: SspiClientObject::SspiClientObject.\n", GetCurrentThreadId());
+        return static_cast<int>(m_entries.size());
     }
 
-    ~SspiClientObject()
+    const std::string& GetTenant(int index) const
     {
-        DebugLog("%ul: Garbage Collection Thread: SspiClientObject::~SspiClientObject.\n", GetCurrentThreadId());
+        return m_entries[index].tenant;
     }
 
-    static NAN_METHOD(New)
+    int GetDeadlineMs(int index) const
     {
-        if (info.IsConstructCall())
+        return m_entries[index].deadlineMs;
+    }
+
+    // Executes inside a libuv thread pool thread, only with the WorkerPool
+    // disabled. Otherwise WorkerPool threads run the entries one task each,
+    // see WorkerPoolQueue::QueueEntries.
+    void Execute()
+    {
+        for (int i = 0; i < GetEntryCount(); i++)
         {
-            // Constructor invoked with new SspiClient().
-            DebugLog("%ul: Main event loop: SspiClientObject::New IsConstructorCall.\n", GetCurrentThreadId());
-            Nan::Utf8String spn(info[0]);
+            ExecuteEntry(i);
+        }
+    }
 
-            const char* securityPackage = nullptr;
-            if (info.Length() == 2)
-            {
-                Nan::Utf8String securityPackageArg(info[1]);
-                securityPackage = *securityPackageArg;
-            }
+    // Executes inside worker threads, possibly several at once for different
+    // entries.
+    void ExecuteEntry(int index)
+    {
+        DebugLog("%ul: Worker Thread: SspiClientGetNextBlobBatchWorker::ExecuteEntry: %d.\n",
+            GetCurrentThreadId(),
+            index);
 
-            SspiClientObject* sspiClientObject = new SspiClientObject(*spn, securityPackage);
-            sspiClientObject->Wrap(info.This());
-            info.GetReturnValue().Set(info.This());
-        }
-        else
+        Entry& entry = m_entries[index];
+        if (!entry.queuedCall)
         {
-            // Constructor invoked with SspiClient().
-            DebugLog("%ul: Main event loop: SspiClientObject::New Not IsConstructorCall.\n", GetCurrentThreadId());
-            v8::Local<v8::Value> argv[1] = { info[0] };
-
-            v8::Local<v8::Function> constructor = Nan::New(s_constructor);
+            return;
+        }
 
-            // This will trigger the New method and that invocation will go through
-            // the IsConstructorCall() true code path.
-            info.GetReturnValue().Set(Nan::NewInstance(constructor, info.Length(), argv).ToLocalChecked());
+        // Cancelled or timed out while queued, nobody waits for the result.
+        entry.securityStatus = entry.queuedCall->Start(&entry.errorString);
+        if (entry.securityStatus != SEC_E_OK)
+        {
+            return;
         }
+
+        entry.securityStatus = entry.sspiImpl->GetNextBlob(
+            entry.inBlob,
+            entry.inBlobLength,
+            &entry.outBlob,
+            &entry.outBlobLength,
+            &entry.isDone,
+            &entry.errorString);
+        entry.queuedCall->Complete();
     }
 
-    static NAN_METHOD(GetNextBlob)
+    // Invokes the user callback once with an array of results in the order
+    // of the entries.
+    void HandleOKCallback()
     {
-        DebugLog("%ul: Main event loop: SspiClientObject::GetNextBlob.\n", GetCurrentThreadId());
+        DebugLog("%ul: Main event loop: SspiClientGetNextBlobBatchWorker::HandleOKCallback: %d entries.\n",
+            GetCurrentThreadId(),
+            GetEntryCount());
 
-        int inBlobBeginOffset = static_cast<int>(info[1]->IntegerValue());
-        int inBlobLength = static_cast<int>(info[2]->IntegerValue());
+        v8::Local<v8::String> clientResponseKey = Nan::New<v8::String>("clientResponse").ToLocalChecked();
+        v8::Local<v8::String> isDoneKey = Nan::New<v8::String>("isDone").ToLocalChecked();
+        v8::Local<v8::String> errorCodeKey = Nan::New<v8::String>("errorCode").ToLocalChecked();
+        v8::Local<v8::String> errorStringKey = Nan::New<v8::String>("errorString").ToLocalChecked();
 
-        char* inBlob = nullptr;
-        if (inBlobLength > 0)
+        v8::Local<v8::Array> results = Nan::New<v8::Array>(GetEntryCount());
+        for (size_t i = 0; i < m_entries.size(); i++)
         {
-            inBlob = node::Buffer::Data(info[0]->ToObject());
+            Entry& entry = m_entries[i];
+            v8::Local<v8::Object> result = Nan::New<v8::Object>();
+            Nan::Set(
+                result,
+                clientResponseKey,
+                entry.outBlob != nullptr
+                    ? Nan::NewBuffer(entry.outBlob, entry.outBlobLength, FreeCallback, nullptr).ToLocalChecked()
+                    : Nan::NewBuffer(0).ToLocalChecked());
+            Nan::Set(result, isDoneKey, Nan::New<v8::Boolean>(entry.isDone));
+            Nan::Set(result, errorCodeKey, Nan::New<v8::Uint32>(entry.securityStatus));
+            Nan::Set(result, errorStringKey, Nan::New<v8::String>(entry.errorString.c_str()).ToLocalChecked());
+            Nan::Set(results, static_cast<uint32_t>(i), result);
+
+            // Owned by the Buffer now.
+            entry.outBlob = nullptr;
         }
 
-        Nan::Callback* callback = new Nan::Callback(info[3].As<v8::Function>());
-        SspiClientObject* sspiClientObject = Nan::ObjectWrap::Unwrap<SspiClientObject>(info.Holder());
-        AsyncQueueWorker(new SspiClientGetNextBlobWorker(
-            callback,
-            sspiClientObject->m_sspiImpl,
-            inBlob,
-            inBlobBeginOffset,
-            inBlobLength));
+        v8::Local<v8::Value> argv[] = { results };
+        callback->Call(1, argv);
     }
 
-    static NAN_METHOD(UtEnableCannedResponse)
+    static void FreeCallback(char* data, void* hint)
     {
-        DebugLog("%ul: Main event loop: SspiClientObject::UtEnableCannedResponse.\n", GetCurrentThreadId());
-        SspiClientObject* sspiClientObject = Nan::ObjectWrap::Unwrap<SspiClientObject>(info.Holder());
-        sspiClientObject->m_sspiImpl->UtEnableCannedResponse(info[0]->BooleanValue());
+        SspiImpl::FreeBlob(data);
     }
 
-    static NAN_METHOD(UtForceCompleteAuth)
+    ~SspiClientGetNextBlobBatchWorker()
     {
-        DebugLog("%ul: Main event loop: SspiClientObject::UtForceCompleteAuth.\n", GetCurrentThreadId());
-        SspiClientObject* sspiClientObject = Nan::ObjectWrap::Unwrap<SspiClientObject>(info.Holder());
-        sspiClientObject->m_sspiImpl->UtForceCompleteAuth(info[0]->BooleanValue());
+        // Blobs never handed to JavaScript.
+        for (size_t i = 0; i < m_entries.size(); i++)
+        {
+            if (m_entries[i].outBlob != nullptr)
+            {
+                SspiImpl::FreeBlob(m_entries[i].outBlob);
+            }
+        }
     }
 
-    // This is a shared pointer because we pass this to
-    // SspiClientGetNextBlobWorker, whose life time is independently managed
-    // by AsynQueueWorker.
-    std::shared_ptr<SspiImpl> m_sspiImpl;
+private:
+    // Not implemented.
+    SspiClientGetNextBlobBatchWorker(const SspiClientGetNextBlobBatchWorker&);
+    SspiClientGetNextBlobBatchWorker& operator=(const SspiClientGetNextBlobBatchWorker&);
 
-    static Nan::Persistent<v8::Function> s_constructor;
-    static const char* c_className;
+    std::vector<Entry> m_entries;
 };
 
-Nan::Persistent<v8::Function> SspiClientObject::s_constructor;
-const char* SspiClientObject::c_className = "SspiClient";
+// Worker class to warm the ticket cache for a list of SPNs: runs the first
+// leg of a context for each SPN, so any service ticket request happens now
+// rather than on the first real connection, and throws the context away.
+// Each SPN is its own tenant, with the background deadline as nobody waits on
+// the connection yet, see WorkerPoolQueue::QueueEntries.
+class SspiClientPrefetchTicketsWorker : public Nan::AsyncWorker
+{
+public:
+    struct Entry
+    {
+        std::string spn;
+        SECURITY_STATUS securityStatus;
+        std::string errorString;
+        double elapsedMs;
+    };
 
-NAN_MODULE_INIT(Init) {
-    DebugLog("%ul: Main event loop: Init NAN_MODULE_INIT.\n", GetCurrentThreadId());
+    // securityPackage is empty for the default package.
+    SspiClientPrefetchTicketsWorker(Nan::Callback* callback, const std::string& securityPackage)
+        : Nan::AsyncWorker(callback),
+        m_securityPackage(securityPackage),
+        m_entries()
+    {
+        DebugLog("%ul: Main event loop: SspiClientPrefetchTicketsWorker::SspiClientPrefetchTicketsWorker.\n",
+            GetCurrentThreadId());
+    }
 
-    Nan::Set(
-        target,
+    void AddSpn(const char* spn)
+    {
+        Entry entry;
+        entry.spn.assign(spn);
+        entry.securityStatus = -1;
+        entry.elapsedMs = 0;
+        m_entries.push_back(entry);
+    }
+
+    int GetEntryCount() const
+    {
+        return static_cast<int>(m_entries.size());
+    }
+
+    const std::string& GetTenant(int index) const
+    {
+        return m_entries[index].spn;
+    }
+
+    int GetDeadlineMs(int index) const
+    {
+        return WorkerPoolQueue::c_backgroundDeadlineMs;
+    }
+
+    // Executes inside a libuv thread pool thread, only with the WorkerPool
+    // disabled. Otherwise WorkerPool threads run the entries one task each,
+    // see WorkerPoolQueue::QueueEntries.
+    void Execute()
+    {
+        for (int i = 0; i < GetEntryCount(); i++)
+        {
+            ExecuteEntry(i);
+        }
+    }
+
+    // Executes inside worker threads, possibly several at once for different
+    // SPNs.
+    void ExecuteEntry(int index)
+    {
+        DebugLog("%ul: Worker Thread: SspiClientPrefetchTicketsWorker::ExecuteEntry: %d.\n",
+            GetCurrentThreadId(),
+            index);
+
+        Entry& entry = m_entries[index];
+        std::chrono::steady_clock::time_point begin = std::chrono::steady_clock::now();
+
+        // The context is deleted with sspiImpl, the ticket stays cached.
+        SspiImpl sspiImpl(entry.spn.c_str(), m_securityPackage.empty() ? nullptr : m_securityPackage.c_str());
+        char* outBlob;
+        int outBlobLength;
+        bool isDone;
+        entry.securityStatus = sspiImpl.GetNextBlob(
+            nullptr,
+            0,
+            &outBlob,
+            &outBlobLength,
+            &isDone,
+            &entry.errorString);
+
+        if (entry.securityStatus == SEC_E_OK && outBlob != nullptr)
+        {
+            SspiImpl::FreeBlob(outBlob);
+        }
+
+        entry.elapsedMs = std::chrono::duration<double, std::milli>(
+            std::chrono::steady_clock::now() - begin).count();
+    }
+
+    // Invokes the user callback once with an array of results in the order
+    // of the SPNs.
+    void HandleOKCallback()
+    {
+        DebugLog("%ul: Main event loop: SspiClientPrefetchTicketsWorker::HandleOKCallback: %d SPNs.\n",
+            GetCurrentThreadId(),
+            GetEntryCount());
+
+        v8::Local<v8::Array> results = Nan::New<v8::Array>(GetEntryCount());
+        for (size_t i = 0; i < m_entries.size(); i++)
+        {
+            const Entry& entry = m_entries[i];
+            v8::Local<v8::Object> result = Nan::New<v8::Object>();
+            Nan::Set(
+                result,
+                Nan::New<v8::String>("spn").ToLocalChecked(),
+                Nan::New<v8::String>(entry.spn.c_str()).ToLocalChecked());
+            Nan::Set(
+                result,
+                Nan::New<v8::String>("elapsedMs").ToLocalChecked(),
+                Nan::New<v8::Number>(entry.elapsedMs));
+            Nan::Set(
+                result,
+                Nan::New<v8::String>("errorCode").ToLocalChecked(),
+                Nan::New<v8::Uint32>(entry.securityStatus));
+            Nan::Set(
+                result,
+                Nan::New<v8::String>("errorString").ToLocalChecked(),
+                Nan::New<v8::String>(entry.errorString.c_str()).ToLocalChecked());
+            Nan::Set(results, static_cast<uint32_t>(i), result);
+        }
+
+        v8::Local<v8::Value> argv[] = { results };
+        callback->Call(1, argv);
+    }
+
+private:
+    // Not implemented.
+    SspiClientPrefetchTicketsWorker(const SspiClientPrefetchTicketsWorker&);
+    SspiClientPrefetchTicketsWorker& operator=(const SspiClientPrefetchTicketsWorker&);
+
+    std::string m_securityPackage;
+    std::vector<Entry> m_entries;
+};
+
+// Arguments are an array of SPNs, the security package, empty for the
+// default, and the callback.
+NAN_METHOD(PrefetchTickets)
+{
+    v8::Local<v8::Array> spns = info[0].As<v8::Array>();
+    Nan::Utf8String securityPackage(info[1]);
+
+    DebugLog("%ul: Main event loop: PrefetchTickets NAN_METHOD: %u SPNs.\n", GetCurrentThreadId(), spns->Length());
+
+    Nan::Callback* callback = new Nan::Callback(info[2].As<v8::Function>());
+    SspiClientPrefetchTicketsWorker* worker = new SspiClientPrefetchTicketsWorker(callback, *securityPackage);
+    for (uint32_t i = 0; i < spns->Length(); i++)
+    {
+        Nan::Utf8String spn(Nan::Get(spns, i).ToLocalChecked());
+        worker->AddSpn(*spn);
+    }
+
+    WorkerPoolQueue::QueueEntries(worker);
+}
+
+// Worker class to resolve a host name to an FQDN through the SpnResolver.
+// Workers for a host already being resolved return at once, the worker that
+// resolves it calls their callbacks along with its own.
+class SpnResolveWorker : public Nan::AsyncWorker
+{
+public:
+    SpnResolveWorker(Nan::Callback* callback, const char* host)
+        : Nan::AsyncWorker(nullptr),
+        m_host(host),
+        m_callback(callback)
+    {
+        DebugLog("%ul: Main event loop: SpnResolveWorker::SpnResolveWorker.\n", GetCurrentThreadId());
+    }
+
+    void Execute()
+    {
+        DebugLog("%ul: Worker Thread: SpnResolveWorker::Execute: %s.\n", GetCurrentThreadId(), m_host.c_str());
+
+        // Shared, the worker that calls back may outlive this one. Only
+        // released on the main event loop, by the workers holding it.
+        std::shared_ptr<Nan::Callback> callback = m_callback;
+        SpnResolver::GetInstance()->Resolve(
+            m_host,
+            [callback](const std::string& fqdn, const std::string& errorCode)
+            {
+                v8::Local<v8::Value> argv[] = {
+                    Nan::New<v8::String>(errorCode.c_str()).ToLocalChecked(),
+                    Nan::New<v8::String>(fqdn.c_str()).ToLocalChecked()
+                };
+                callback->Call(2, argv);
+            },
+            &m_fqdn,
+            &m_errorCode,
+            &m_callbacks);
+    }
+
+    // Invokes the user callbacks with the error code, empty on success, and
+    // the FQDN. None if another worker is resolving the host.
+    void HandleOKCallback()
+    {
+        DebugLog("%ul: Main event loop: SpnResolveWorker::HandleOKCallback: %d callbacks.\n",
+            GetCurrentThreadId(), static_cast<int>(m_callbacks.size()));
+
+        for (size_t i = 0; i < m_callbacks.size(); i++)
+        {
+            m_callbacks[i](m_fqdn, m_errorCode);
+        }
+    }
+
+private:
+    // Not implemented.
+    SpnResolveWorker(const SpnResolveWorker&);
+    SpnResolveWorker& operator=(const SpnResolveWorker&);
+
+    std::string m_host;
+    std::shared_ptr<Nan::Callback> m_callback;
+    std::string m_fqdn;
+    std::string m_errorCode;
+    std::vector<SpnResolver::ResolveCallback> m_callbacks;
+};
+
+// Arguments are the host, the tenant and deadline to schedule the lookup
+// with, see WorkerPoolQueue::Queue, and the callback.
+NAN_METHOD(ResolveFqdn)
+{
+    Nan::Utf8String host(info[0]);
+    Nan::Utf8String tenant(info[1]);
+    int deadlineMs = static_cast<int>(info[2]->IntegerValue());
+
+    DebugLog("%ul: Main event loop: ResolveFqdn NAN_METHOD: %s.\n", GetCurrentThreadId(), *host);
+
+    Nan::Callback* callback = new Nan::Callback(info[3].As<v8::Function>());
+    WorkerPoolQueue::Queue(new SpnResolveWorker(callback, *host), *tenant, deadlineMs);
+}
+
+// Returns an object with fqdn and errorCode if host is in the SpnResolver
+// cache, undefined otherwise. Never blocks.
+NAN_METHOD(GetCachedFqdn)
+{
+    Nan::Utf8String host(info[0]);
+    std::string fqdn;
+    std::string errorCode;
+    if (!SpnResolver::GetInstance()->TryGetCached(*host, &fqdn, &errorCode))
+    {
+        return;
+    }
+
+    v8::Local<v8::Object> result = Nan::New<v8::Object>();
+    Nan::Set(
+        result,
+        Nan::New<v8::String>("fqdn").ToLocalChecked(),
+        Nan::New<v8::String>(fqdn.c_str()).ToLocalChecked());
+    Nan::Set(
+        result,
+        Nan::New<v8::String>("errorCode").ToLocalChecked(),
+        Nan::New<v8::String>(errorCode.c_str()).ToLocalChecked());
+    info.GetReturnValue().Set(result);
+}
+
+NAN_METHOD(InitializeAsync)
+{
+    DebugLog("%ul: Main event loop: InitializeAsync NAN_METHOD.\n", GetCurrentThreadId());
+
+    SspiClientInitializeWorker::AddWaiter(new Nan::Callback(info[0].As<v8::Function>()));
+}
+
+// Worker class to accept the next client blob on the server side
+// asynchronously.
+class SspiServerAcceptNextBlobWorker : public Nan::AsyncWorker
+{
+public:
+    SspiServerAcceptNextBlobWorker(
+        Nan::Callback* callback,
+        const std::shared_ptr<SspiServerImpl>& sspiServerImpl,
+        v8::Local<v8::Value> inBlobBuffer,
+        int inBlobBeginOffset,
+        int inBlobLength)
+        : Nan::AsyncWorker(callback),
+        m_sspiServerImpl(sspiServerImpl),
+        m_securityStatus(-1),
+        m_errorString(),
+        m_inBlob(PinInBlob(this, inBlobBuffer, inBlobBeginOffset, inBlobLength)),
+        m_inBlobLength(inBlobLength),
+        m_outBlob(nullptr),
+        m_outBlobLength(0),
+        m_isDone(false)
+    {
+        DebugLog("%ul: Main event loop: SspiServerAcceptNextBlobWorker::SspiServerAcceptNextBlobWorker.\n",
+            GetCurrentThreadId());
+    }
+
+    void Execute()
+    {
+        DebugLog("%ul: Worker Thread: SspiServerAcceptNextBlobWorker::Execute.\n",
+            GetCurrentThreadId());
+
+        m_securityStatus = m_sspiServerImpl->AcceptNextBlob(
+            m_inBlob,
+            m_inBlobLength,
+            &m_outBlob,
+            &m_outBlobLength,
+            &m_isDone,
+            &m_errorString);
+    }
+
+    void HandleOKCallback()
+    {
+        DebugLog("%ul: Main event loop: SspiServerAcceptNextBlobWorker::HandleOKCallback.\n",
+            GetCurrentThreadId());
+
+        v8::Local<v8::Value> argv[] =
+        {
+            m_outBlob != nullptr
+                ? Nan::NewBuffer(m_outBlob, m_outBlobLength, FreeCallback, nullptr).ToLocalChecked()
+                : Nan::NewBuffer(0).ToLocalChecked(),
+            Nan::New<v8::Boolean>(m_isDone),
+            Nan::New<v8::Uint32>(m_securityStatus),
+            Nan::New<v8::String>(m_errorString.c_str()).ToLocalChecked()
+        };
+
+        callback->Call(4, argv);
+    }
+
+    static void FreeCallback(char* data, void* hint)
+    {
+        SspiImpl::FreeBlob(data);
+    }
+
+private:
+    // Not implemented.
+    SspiServerAcceptNextBlobWorker(const SspiServerAcceptNextBlobWorker&);
+    SspiServerAcceptNextBlobWorker& operator=(const SspiServerAcceptNextBlobWorker&);
+
+    // Lifetime shared with SspiServerObject.
+    std::shared_ptr<SspiServerImpl> m_sspiServerImpl;
+
+    SECURITY_STATUS m_securityStatus;
+    std::string m_errorString;
+
+    // Same as SspiClientGetNextBlobWorker.
+    const char* m_inBlob;
+    int m_inBlobLength;
+
+    // Lifetime managed by the V8 garbage collector, same as
+    // SspiClientGetNextBlobWorker.
+    char* m_outBlob;
+    int m_outBlobLength;
+    bool m_isDone;
+};
+
+// Worker class to sign, verify, encrypt or decrypt a batch of messages in
+// place with an established context, for SspiClientObject with SspiImpl and
+// SspiServerObject with SspiServerImpl. Messages are processed in order on a
+// single thread, as sequence numbers require.
+template <typename Impl>
+class MessageBatchWorker : public Nan::AsyncWorker
+{
+public:
+    // tokens has a Buffer per message, segments the data Buffers of all the
+    // messages in order and segmentCounts how many of them each message has.
+    // The arrays keep the Buffers alive through the worker's persistent
+    // handle, the worker thread reads and writes them in place. See
+    // PinInBlob.
+    MessageBatchWorker(
+        Nan::Callback* callback,
+        const std::shared_ptr<Impl>& impl,
+        MessageOperation operation,
+        v8::Local<v8::Array> tokens,
+        v8::Local<v8::Array> segments,
+        v8::Local<v8::Array> segmentCounts)
+        : Nan::AsyncWorker(callback),
+        m_impl(impl),
+        m_operation(operation),
+        m_batch(),
+        m_securityStatus(-1),
+        m_errorString(),
+        m_processedCount(0)
+    {
+        DebugLog("%ul: Main event loop: MessageBatchWorker::MessageBatchWorker: %u messages.\n",
+            GetCurrentThreadId(),
+            tokens->Length());
+
+        SaveToPersistent("tokens", tokens);
+        SaveToPersistent("segments", segments);
+
+        m_batch.Reserve(static_cast<int>(tokens->Length()), static_cast<int>(segments->Length()));
+        uint32_t segmentIndex = 0;
+        for (uint32_t i = 0; i < tokens->Length(); i++)
+        {
+            v8::Local<v8::Value> token = Nan::Get(tokens, i).ToLocalChecked();
+            m_batch.AddMessage(node::Buffer::Data(token), static_cast<unsigned long>(node::Buffer::Length(token)));
+
+            uint32_t segmentCount = static_cast<uint32_t>(Nan::Get(segmentCounts, i).ToLocalChecked()->IntegerValue());
+            for (uint32_t j = 0; j < segmentCount; j++, segmentIndex++)
+            {
+                v8::Local<v8::Value> segment = Nan::Get(segments, segmentIndex).ToLocalChecked();
+                m_batch.AddSegment(node::Buffer::Data(segment), static_cast<unsigned long>(node::Buffer::Length(segment)));
+            }
+        }
+    }
+
+    void Execute()
+    {
+        DebugLog("%ul: Worker Thread: MessageBatchWorker::Execute.\n", GetCurrentThreadId());
+        m_securityStatus = m_impl->ProcessMessages(m_operation, &m_batch, &m_processedCount, &m_errorString);
+    }
+
+    // Calls back with the token length of each message processed, all of
+    // them unless one failed.
+    void HandleOKCallback()
+    {
+        DebugLog("%ul: Main event loop: MessageBatchWorker::HandleOKCallback.\n", GetCurrentThreadId());
+
+        v8::Local<v8::Array> tokenLengths = Nan::New<v8::Array>(m_processedCount);
+        for (int i = 0; i < m_processedCount; i++)
+        {
+            Nan::Set(
+                tokenLengths,
+                static_cast<uint32_t>(i),
+                Nan::New<v8::Uint32>(static_cast<uint32_t>(m_batch.GetTokenLength(i))));
+        }
+
+        v8::Local<v8::Value> argv[] =
+        {
+            tokenLengths,
+            Nan::New<v8::Uint32>(m_securityStatus),
+            Nan::New<v8::String>(m_errorString.c_str()).ToLocalChecked()
+        };
+
+        callback->Call(3, argv);
+    }
+
+private:
+    // Not implemented.
+    MessageBatchWorker(const MessageBatchWorker&);
+    MessageBatchWorker& operator=(const MessageBatchWorker&);
+
+    // Lifetime shared with the object that queued the worker.
+    std::shared_ptr<Impl> m_impl;
+
+    MessageOperation m_operation;
+    MessageBatch m_batch;
+
+    SECURITY_STATUS m_securityStatus;
+    std::string m_errorString;
+    int m_processedCount;
+};
+
+// Arguments are the operation, tokens, segments, segmentCounts, the tenant
+// and deadline to schedule the batch with, see WorkerPoolQueue::Queue, and the
+// callback, see MessageBatchWorker. The JavaScript layer validates them and
+// makes sure only one batch or handshake call per instance is in flight.
+template <typename Impl>
+static void QueueMessageBatch(const Nan::FunctionCallbackInfo<v8::Value>& info, const std::shared_ptr<Impl>& impl)
+{
+    MessageOperation operation = static_cast<MessageOperation>(info[0]->IntegerValue());
+    Nan::Utf8String tenant(info[4]);
+    int deadlineMs = static_cast<int>(info[5]->IntegerValue());
+    Nan::Callback* callback = new Nan::Callback(info[6].As<v8::Function>());
+    WorkerPoolQueue::Queue(
+        new MessageBatchWorker<Impl>(
+            callback,
+            impl,
+            operation,
+            info[1].As<v8::Array>(),
+            info[2].As<v8::Array>(),
+            info[3].As<v8::Array>()),
+        *tenant,
+        deadlineMs);
+}
+
+// Returns the message protection sizes of an established context with
+// errorCode and errorString. Runs synchronously, same rules as
+// QueueMessageBatch.
+template <typename Impl>
+static void ReturnMessageSizes(const Nan::FunctionCallbackInfo<v8::Value>& info, Impl* impl)
+{
+    SecPkgContext_Sizes sizes = {};
+    std::string errorString;
+    SECURITY_STATUS securityStatus = impl->GetMessageSizes(&sizes, &errorString);
+
+    v8::Local<v8::Object> result = Nan::New<v8::Object>();
+    Nan::Set(
+        result,
+        Nan::New<v8::String>("maxSignature").ToLocalChecked(),
+        Nan::New<v8::Uint32>(static_cast<uint32_t>(sizes.cbMaxSignature)));
+    Nan::Set(
+        result,
+        Nan::New<v8::String>("securityTrailer").ToLocalChecked(),
+        Nan::New<v8::Uint32>(static_cast<uint32_t>(sizes.cbSecurityTrailer)));
+    Nan::Set(
+        result,
+        Nan::New<v8::String>("blockSize").ToLocalChecked(),
+        Nan::New<v8::Uint32>(static_cast<uint32_t>(sizes.cbBlockSize)));
+    Nan::Set(
+        result,
+        Nan::New<v8::String>("errorCode").ToLocalChecked(),
+        Nan::New<v8::Uint32>(securityStatus));
+    Nan::Set(
+        result,
+        Nan::New<v8::String>("errorString").ToLocalChecked(),
+        Nan::New<v8::String>(errorString.c_str()).ToLocalChecked());
+
+    info.GetReturnValue().Set(result);
+}
+
+NAN_METHOD(SetProvider)
+{
+    Nan::Utf8String name(info[0]);
+    DebugLog("%ul: Main event loop: SetProvider NAN_METHOD: %s.\n", GetCurrentThreadId(), *name);
+    info.GetReturnValue().Set(Nan::New<v8::Boolean>(SspiProvider::SetDefault(*name)));
+}
+
+NAN_METHOD(GetProviderName)
+{
+    info.GetReturnValue().Set(Nan::New<v8::String>(SspiProvider::GetDefault()->GetName()).ToLocalChecked());
+}
+
+static void SetStat(v8::Local<v8::Object> stats, const char* name, uint64_t value)
+{
+    Nan::Set(
+        stats,
+        Nan::New<v8::String>(name).ToLocalChecked(),
+        Nan::New<v8::Number>(static_cast<double>(value)));
+}
+
+NAN_METHOD(GetCredentialCacheStats)
+{
+    CredentialCacheStats cacheStats;
+    CredentialCache::GetInstance()->GetStats(&cacheStats);
+
+    v8::Local<v8::Object> stats = Nan::New<v8::Object>();
+    SetStat(stats, "hits", cacheStats.hits);
+    SetStat(stats, "misses", cacheStats.misses);
+    SetStat(stats, "waits", cacheStats.waits);
+    SetStat(stats, "acquisitions", cacheStats.acquisitions);
+    SetStat(stats, "failures", cacheStats.failures);
+    SetStat(stats, "evictions", cacheStats.evictions);
+    SetStat(stats, "refreshes", cacheStats.refreshes);
+    SetStat(stats, "refreshFailures", cacheStats.refreshFailures);
+    SetStat(stats, "size", cacheStats.size);
+    info.GetReturnValue().Set(stats);
+}
+
+NAN_METHOD(ClearCredentialCache)
+{
+    DebugLog("%ul: Main event loop: ClearCredentialCache NAN_METHOD.\n", GetCurrentThreadId());
+    CredentialCache::GetInstance()->Clear();
+}
+
+NAN_METHOD(GetBufferPoolStats)
+{
+    TokenBufferPoolStats poolStats;
+    TokenBufferPool::GetInstance()->GetStats(&poolStats);
+
+    v8::Local<v8::Object> stats = Nan::New<v8::Object>();
+    SetStat(stats, "allocations", poolStats.allocations);
+    SetStat(stats, "threadCacheHits", poolStats.threadCacheHits);
+    SetStat(stats, "globalHits", poolStats.globalHits);
+    SetStat(stats, "heapAllocations", poolStats.heapAllocations);
+    SetStat(stats, "oversizeAllocations", poolStats.oversizeAllocations);
+    SetStat(stats, "frees", poolStats.frees);
+    SetStat(stats, "heapFrees", poolStats.heapFrees);
+    SetStat(stats, "bytesInUse", poolStats.bytesInUse);
+    SetStat(stats, "bytesRetained", poolStats.bytesRetained);
+    info.GetReturnValue().Set(stats);
+}
+
+NAN_METHOD(GetBlobStats)
+{
+    SspiBlobStats blobStats;
+    SspiImpl::GetBlobStats(&blobStats);
+
+    v8::Local<v8::Object> stats = Nan::New<v8::Object>();
+    SetStat(stats, "inBlobs", blobStats.inBlobs);
+    SetStat(stats, "inBytes", blobStats.inBytes);
+    SetStat(stats, "outBlobs", blobStats.outBlobs);
+    SetStat(stats, "outBytes", blobStats.outBytes);
+    SetStat(stats, "bytesCopied", blobStats.bytesCopied);
+    info.GetReturnValue().Set(stats);
+}
+
+// For unit testing and benchmarking purposes only.
+NAN_METHOD(UtResetBlobStats)
+{
+    SspiImpl::ResetBlobStats();
+}
+
+// For unit testing and benchmarking purposes only.
+NAN_METHOD(UtResetBufferPoolStats)
+{
+    TokenBufferPool::GetInstance()->ResetStats();
+}
+
+// For unit testing and benchmarking purposes only.
+NAN_METHOD(UtSetBufferPoolEnabled)
+{
+    TokenBufferPool::GetInstance()->SetEnabled(info[0]->BooleanValue());
+}
+
+// For unit testing purposes only.
+NAN_METHOD(UtSetMockCredentialLifetime)
+{
+    MockSspiProvider::SetCredentialLifetimeMs(static_cast<int64_t>(info[0]->NumberValue()));
+}
+
+// For unit testing and benchmarking purposes only.
+NAN_METHOD(UtSetMockTicketLatency)
+{
+    MockSspiProvider::SetTicketLatencyMs(static_cast<int>(info[0]->IntegerValue()));
+}
+
+// For unit testing purposes only.
+NAN_METHOD(UtSetMockTicketLifetime)
+{
+    MockSspiProvider::SetTicketLifetimeMs(static_cast<int64_t>(info[0]->NumberValue()));
+}
+
+// For unit testing purposes only.
+NAN_METHOD(UtSetClockOffset)
+{
+    UtSetClockOffsetMs(static_cast<int64_t>(info[0]->NumberValue()));
+}
+
+// For unit testing and benchmarking purposes only.
+NAN_METHOD(UtSetMockLatency)
+{
+    MockSspiProvider::SetLatencyMs(static_cast<int>(info[0]->IntegerValue()));
+}
+
+// Size 0 sends SSPI calls to the libuv thread pool.
+NAN_METHOD(ConfigureWorkerPool)
+{
+    int size = static_cast<int>(info[0]->IntegerValue());
+    int maxSize = static_cast<int>(info[1]->IntegerValue());
+    int idleTimeoutMs = static_cast<int>(info[2]->IntegerValue());
+
+    DebugLog("%ul: Main event loop: ConfigureWorkerPool NAN_METHOD: size=%d.\n", GetCurrentThreadId(), size);
+
+    WorkerPoolQueue::SetEnabled(size > 0);
+    if (size > 0)
+    {
+        WorkerPool::GetInstance()->Configure(size, maxSize, idleTimeoutMs);
+    }
+}
+
+// Arguments are the policy, deadlineMs and backgroundDeadlineMs, 0 for the
+// defaults, and arrays of tenants and their weights.
+NAN_METHOD(ConfigureScheduling)
+{
+    int policy = static_cast<int>(info[0]->IntegerValue());
+    v8::Local<v8::Array> tenants = info[3].As<v8::Array>();
+    v8::Local<v8::Array> weights = info[4].As<v8::Array>();
+
+    std::map<std::string, int> tenantWeights;
+    for (uint32_t i = 0; i < tenants->Length(); i++)
+    {
+        Nan::Utf8String tenant(Nan::Get(tenants, i).ToLocalChecked());
+        tenantWeights[*tenant] = static_cast<int>(Nan::Get(weights, i).ToLocalChecked()->IntegerValue());
+    }
+
+    WorkerPool::GetInstance()->ConfigureScheduling(
+        policy == c_schedulingFifo ? c_schedulingFifo : c_schedulingFair,
+        static_cast<int>(info[1]->IntegerValue()),
+        static_cast<int>(info[2]->IntegerValue()),
+        tenantWeights);
+}
+
+NAN_METHOD(GetWorkerPoolStats)
+{
+    WorkerPoolStats poolStats;
+    WorkerPool::GetInstance()->GetStats(&poolStats);
+
+    v8::Local<v8::Object> stats = Nan::New<v8::Object>();
+    Nan::Set(
+        stats,
+        Nan::New<v8::String>("enabled").ToLocalChecked(),
+        Nan::New<v8::Boolean>(WorkerPoolQueue::IsEnabled()));
+    SetStat(stats, "size", poolStats.size);
+    SetStat(stats, "maxSize", poolStats.maxSize);
+    SetStat(stats, "threads", poolStats.threads);
+    SetStat(stats, "idleThreads", poolStats.idleThreads);
+    SetStat(stats, "peakThreads", poolStats.peakThreads);
+    SetStat(stats, "queueDepth", poolStats.queueDepth);
+    SetStat(stats, "peakQueueDepth", poolStats.peakQueueDepth);
+    SetStat(stats, "submitted", poolStats.submitted);
+    SetStat(stats, "completed", poolStats.completed);
+    SetStat(stats, "totalWaitUs", poolStats.totalWaitUs);
+    SetStat(stats, "maxWaitUs", poolStats.maxWaitUs);
+    SetStat(stats, "tenants", poolStats.tenants);
+    SetStat(stats, "deadlineMisses", poolStats.deadlineMisses);
+    info.GetReturnValue().Set(stats);
+}
+
+// For unit testing and benchmarking purposes only.
+NAN_METHOD(UtResetWorkerPoolStats)
+{
+    WorkerPool::GetInstance()->ResetStats();
+}
+
+// Arguments are spn, securityPackage, empty for the default, size and
+// maxAgeMs. Size 0 removes the pool.
+NAN_METHOD(ConfigureFirstLegPool)
+{
+    Nan::Utf8String spn(info[0]);
+    Nan::Utf8String securityPackage(info[1]);
+    FirstLegPool::GetInstance()->Configure(
+        *spn,
+        *securityPackage,
+        static_cast<int>(info[2]->IntegerValue()),
+        info[3]->IntegerValue());
+}
+
+NAN_METHOD(GetFirstLegPoolStats)
+{
+    FirstLegPoolStats poolStats;
+    FirstLegPool::GetInstance()->GetStats(&poolStats);
+
+    v8::Local<v8::Object> stats = Nan::New<v8::Object>();
+    SetStat(stats, "hits", poolStats.hits);
+    SetStat(stats, "misses", poolStats.misses);
+    SetStat(stats, "stale", poolStats.stale);
+    SetStat(stats, "generated", poolStats.generated);
+    SetStat(stats, "failures", poolStats.failures);
+    SetStat(stats, "ready", poolStats.ready);
+    SetStat(stats, "generating", poolStats.generating);
+    info.GetReturnValue().Set(stats);
+}
+
+// For unit testing and benchmarking purposes only.
+NAN_METHOD(UtResetFirstLegPoolStats)
+{
+    FirstLegPool::GetInstance()->ResetStats();
+}
+
+// 0 doesn't limit the queue.
+NAN_METHOD(ConfigureHandshakeAdmission)
+{
+    HandshakeAdmission::GetInstance()->Configure(static_cast<int>(info[0]->IntegerValue()));
+}
+
+NAN_METHOD(GetHandshakeAdmissionStats)
+{
+    HandshakeAdmissionStats admissionStats;
+    HandshakeAdmission::GetInstance()->GetStats(&admissionStats);
+
+    v8::Local<v8::Object> stats = Nan::New<v8::Object>();
+    SetStat(stats, "maxQueueDepth", admissionStats.maxQueueDepth);
+    SetStat(stats, "queueDepth", admissionStats.queueDepth);
+    SetStat(stats, "peakQueueDepth", admissionStats.peakQueueDepth);
+    SetStat(stats, "admitted", admissionStats.admitted);
+    SetStat(stats, "rejected", admissionStats.rejected);
+    SetStat(stats, "cancelled", admissionStats.cancelled);
+    SetStat(stats, "timedOut", admissionStats.timedOut);
+    SetStat(stats, "skipped", admissionStats.skipped);
+    info.GetReturnValue().Set(stats);
+}
+
+// For unit testing and benchmarking purposes only.
+NAN_METHOD(UtResetHandshakeAdmissionStats)
+{
+    HandshakeAdmission::GetInstance()->ResetStats();
+}
+
+// Arguments are enabled, refreshAheadMs and jitterMs.
+NAN_METHOD(ConfigureExpiryRefresh)
+{
+    ExpiryRefresher::GetInstance()->Configure(
+        info[0]->BooleanValue(),
+        static_cast<int64_t>(info[1]->NumberValue()),
+        static_cast<int64_t>(info[2]->NumberValue()));
+}
+
+// Called on a timer by the JavaScript layer, only starts the refreshes.
+NAN_METHOD(RefreshExpiring)
+{
+    ExpiryRefresher::GetInstance()->RefreshDue();
+}
+
+NAN_METHOD(GetExpiryRefreshStats)
+{
+    ExpiryRefresherStats refresherStats;
+    ExpiryRefresher::GetInstance()->GetStats(&refresherStats);
+
+    v8::Local<v8::Object> stats = Nan::New<v8::Object>();
+    SetStat(stats, "passes", refresherStats.passes);
+    SetStat(stats, "credentialRefreshes", refresherStats.credentialRefreshes);
+    SetStat(stats, "credentialRefreshFailures", refresherStats.credentialRefreshFailures);
+    SetStat(stats, "ticketRefreshes", refresherStats.ticketRefreshes);
+    SetStat(stats, "ticketRefreshFailures", refresherStats.ticketRefreshFailures);
+    SetStat(stats, "ticketsDropped", refresherStats.ticketsDropped);
+    SetStat(stats, "tickets", refresherStats.tickets);
+    info.GetReturnValue().Set(stats);
+}
+
+// For unit testing purposes only.
+NAN_METHOD(UtResetExpiryRefreshStats)
+{
+    ExpiryRefresher::GetInstance()->ResetStats();
+}
+
+// Arguments are ttlMs and negativeTtlMs, negative for the defaults.
+NAN_METHOD(ConfigureSpnResolver)
+{
+    SpnResolver::GetInstance()->Configure(info[0]->IntegerValue(), info[1]->IntegerValue());
+}
+
+NAN_METHOD(GetSpnResolverStats)
+{
+    SpnResolverStats resolverStats;
+    SpnResolver::GetInstance()->GetStats(&resolverStats);
+
+    v8::Local<v8::Object> stats = Nan::New<v8::Object>();
+    SetStat(stats, "hits", resolverStats.hits);
+    SetStat(stats, "negativeHits", resolverStats.negativeHits);
+    SetStat(stats, "misses", resolverStats.misses);
+    SetStat(stats, "waits", resolverStats.waits);
+    SetStat(stats, "lookups", resolverStats.lookups);
+    SetStat(stats, "failures", resolverStats.failures);
+    SetStat(stats, "totalLookupUs", resolverStats.totalLookupUs);
+    SetStat(stats, "maxLookupUs", resolverStats.maxLookupUs);
+    SetStat(stats, "size", resolverStats.size);
+    info.GetReturnValue().Set(stats);
+}
+
+NAN_METHOD(ClearSpnResolverCache)
+{
+    DebugLog("%ul: Main event loop: ClearSpnResolverCache NAN_METHOD.\n", GetCurrentThreadId());
+    SpnResolver::GetInstance()->Clear();
+}
+
+// For unit testing and benchmarking purposes only.
+NAN_METHOD(UtResetSpnResolverStats)
+{
+    SpnResolver::GetInstance()->ResetStats();
+}
+
+// Arguments are hosts file text and a per lookup delay in milliseconds.
+// Empty text restores the system resolver. For unit testing purposes only.
+NAN_METHOD(UtSetStubResolver)
+{
+    Nan::Utf8String hosts(info[0]);
+    std::shared_ptr<HostResolver> hostResolver;
+    if (hosts.length() > 0)
+    {
+        hostResolver = std::make_shared<StubHostResolver>(*hosts, static_cast<int>(info[1]->IntegerValue()));
+    }
+
+    SpnResolver::GetInstance()->SetHostResolver(hostResolver);
+}
+
+static void SetHistogramStats(v8::Local<v8::Object> stats, const char* name, const LatencyHistogram& histogram)
+{
+    LatencyHistogram::Snapshot snapshot;
+    histogram.GetSnapshot(&snapshot);
+    if (snapshot.count == 0)
+    {
+        return;
+    }
+
+    v8::Local<v8::Object> histogramStats = Nan::New<v8::Object>();
+    SetStat(histogramStats, "count", snapshot.count);
+    SetStat(histogramStats, "minUs", snapshot.minUs);
+    SetStat(histogramStats, "meanUs", snapshot.sumUs / snapshot.count);
+    SetStat(histogramStats, "p50Us", snapshot.GetValueAtPercentile(50));
+    SetStat(histogramStats, "p90Us", snapshot.GetValueAtPercentile(90));
+    SetStat(histogramStats, "p99Us", snapshot.GetValueAtPercentile(99));
+    SetStat(histogramStats, "p999Us", snapshot.GetValueAtPercentile(99.9));
+    SetStat(histogramStats, "maxUs", snapshot.maxUs);
+    Nan::Set(stats, Nan::New<v8::String>(name).ToLocalChecked(), histogramStats);
+}
+
+// Returns latency histograms summaries by phase, then package, then outcome.
+// Only combinations with samples are included.
+NAN_METHOD(GetStats)
+{
+    LatencyStats* latencyStats = LatencyStats::GetInstance();
+
+    v8::Local<v8::Object> stats = Nan::New<v8::Object>();
+    for (int phase = 0; phase < c_latencyPhaseCount; phase++)
+    {
+        v8::Local<v8::Object> phaseStats = Nan::New<v8::Object>();
+        bool hasPhaseStats = false;
+        for (int packageIndex = 0; packageIndex < LatencyStats::c_packageCount; packageIndex++)
+        {
+            const LatencyHistogram& succeeded = latencyStats->GetHistogram(phase, packageIndex, true);
+            const LatencyHistogram& failed = latencyStats->GetHistogram(phase, packageIndex, false);
+            if (succeeded.GetCount() == 0 && failed.GetCount() == 0)
+            {
+                continue;
+            }
+
+            v8::Local<v8::Object> packageStats = Nan::New<v8::Object>();
+            SetHistogramStats(packageStats, "success", succeeded);
+            SetHistogramStats(packageStats, "failure", failed);
+
+            const char* packageName = SspiImpl::GetSupportedPackageName(packageIndex);
+            Nan::Set(
+                phaseStats,
+                Nan::New<v8::String>(packageName != nullptr ? packageName : "Other").ToLocalChecked(),
+                packageStats);
+            hasPhaseStats = true;
+        }
+
+        if (hasPhaseStats)
+        {
+            Nan::Set(stats, Nan::New<v8::String>(LatencyStats::GetPhaseName(phase)).ToLocalChecked(), phaseStats);
+        }
+    }
+
+    info.GetReturnValue().Set(stats);
+}
+
+NAN_METHOD(ResetStats)
+{
+    DebugLog("%ul: Main event loop: ResetStats NAN_METHOD.\n", GetCurrentThreadId());
+    LatencyStats::GetInstance()->Reset();
+}
+
+// DebugLog messages go to stdout, drained in the background.
+NAN_METHOD(EnableDebugLogging)
+{
+    DebugLog("%ul: Main event loop: EnableDebugLogging NAN_METHOD.\n", GetCurrentThreadId());
+    if (info[0]->BooleanValue())
+    {
+        Tracer::SetLevel(Tracer::c_levelDebug);
+        Tracer::StartFileSink("", Tracer::c_defaultFlushIntervalMs);
+    }
+    else
+    {
+        Tracer::SetLevel(Tracer::c_levelOff);
+        Tracer::StopFileSink();
+    }
+}
+
+// Arguments are the level, whether to drain to a file, the file path, empty
+// for stdout, and the flush interval. Returns false if the file can't be
+// opened.
+NAN_METHOD(ConfigureTracing)
+{
+    int level = static_cast<int>(info[0]->IntegerValue());
+    bool useFileSink = info[1]->BooleanValue();
+    Nan::Utf8String path(info[2]);
+
+    bool succeeded = true;
+    if (useFileSink)
+    {
+        succeeded = Tracer::StartFileSink(*path, static_cast<int>(info[3]->IntegerValue()));
+    }
+    else
+    {
+        Tracer::StopFileSink();
+    }
+
+    Tracer::SetLevel(succeeded ? level : Tracer::c_levelOff);
+    info.GetReturnValue().Set(succeeded);
+}
+
+// Returns the records not drained yet, oldest first.
+NAN_METHOD(DrainTrace)
+{
+    std::vector<TraceRecord> records;
+    Tracer::Drain(&records);
+
+    v8::Local<v8::String> timestampUsKey = Nan::New<v8::String>("timestampUs").ToLocalChecked();
+    v8::Local<v8::String> threadIdKey = Nan::New<v8::String>("threadId").ToLocalChecked();
+    v8::Local<v8::String> workerIdKey = Nan::New<v8::String>("workerId").ToLocalChecked();
+    v8::Local<v8::String> callKey = Nan::New<v8::String>("call").ToLocalChecked();
+    v8::Local<v8::String> statusKey = Nan::New<v8::String>("status").ToLocalChecked();
+    v8::Local<v8::String> durationUsKey = Nan::New<v8::String>("durationUs").ToLocalChecked();
+    v8::Local<v8::String> messageKey = Nan::New<v8::String>("message").ToLocalChecked();
+
+    v8::Local<v8::Array> results = Nan::New<v8::Array>(static_cast<int>(records.size()));
+    for (size_t i = 0; i < records.size(); i++)
+    {
+        const TraceRecord& record = records[i];
+        v8::Local<v8::Object> result = Nan::New<v8::Object>();
+        Nan::Set(result, timestampUsKey, Nan::New<v8::Number>(static_cast<double>(record.timestampUs)));
+        Nan::Set(result, threadIdKey, Nan::New<v8::Uint32>(record.threadId));
+        Nan::Set(result, workerIdKey, Nan::New<v8::Uint32>(record.workerId));
+        if (record.type == Tracer::c_typeCall)
+        {
+            Nan::Set(result, callKey, Nan::New<v8::String>(Tracer::GetCallName(record.call)).ToLocalChecked());
+            Nan::Set(result, statusKey, Nan::New<v8::Uint32>(static_cast<uint32_t>(record.status)));
+            Nan::Set(result, durationUsKey, Nan::New<v8::Uint32>(record.durationUs));
+        }
+        else
+        {
+            Nan::Set(result, messageKey, Nan::New<v8::String>(record.message).ToLocalChecked());
+        }
+
+        Nan::Set(results, static_cast<uint32_t>(i), result);
+    }
+
+    info.GetReturnValue().Set(results);
+}
+
+NAN_METHOD(GetTraceStats)
+{
+    TraceStats traceStats;
+    Tracer::GetStats(&traceStats);
+
+    v8::Local<v8::Object> stats = Nan::New<v8::Object>();
+    SetStat(stats, "recorded", traceStats.recorded);
+    SetStat(stats, "dropped", traceStats.dropped);
+    SetStat(stats, "drained", traceStats.drained);
+    SetStat(stats, "rings", traceStats.rings);
+    info.GetReturnValue().Set(stats);
+}
+
+// Argument is the path to append to. Returns the error string, empty if
+// recording started.
+NAN_METHOD(StartTranscriptRecording)
+{
+    Nan::Utf8String path(info[0]);
+    std::string errorString;
+    TranscriptRecorder::GetInstance()->Start(*path, &errorString);
+    info.GetReturnValue().Set(Nan::New<v8::String>(errorString.c_str()).ToLocalChecked());
+}
+
+NAN_METHOD(StopTranscriptRecording)
+{
+    TranscriptRecorder::GetInstance()->Stop();
+}
+
+// Arguments are the path of the transcript file and whether to replay in
+// real time. Returns the error string, empty if the file was loaded.
+NAN_METHOD(LoadReplayTranscripts)
+{
+    Nan::Utf8String path(info[0]);
+    std::string errorString;
+    if (ReplaySspiProvider::Load(*path, &errorString))
+    {
+        ReplaySspiProvider::SetRealTime(info[1]->BooleanValue());
+    }
+
+    info.GetReturnValue().Set(Nan::New<v8::String>(errorString.c_str()).ToLocalChecked());
+}
+
+NAN_METHOD(GetTranscriptStats)
+{
+    TranscriptStats transcriptStats;
+    TranscriptRecorder::GetInstance()->GetStats(&transcriptStats);
+    ReplayStats replayStats;
+    ReplaySspiProvider::GetStats(&replayStats);
+
+    v8::Local<v8::Object> stats = Nan::New<v8::Object>();
+    SetStat(stats, "recorded", transcriptStats.recorded);
+    SetStat(stats, "bytes", transcriptStats.bytes);
+    SetStat(stats, "failures", transcriptStats.failures);
+    SetStat(stats, "handshakes", replayStats.handshakes);
+    SetStat(stats, "legs", replayStats.legs);
+    SetStat(stats, "served", replayStats.served);
+    SetStat(stats, "mismatches", replayStats.mismatches);
+    info.GetReturnValue().Set(stats);
+}
+
+// Native implementation of SspiClient surfaced to JavaScript.
+class SspiClientObject : public Nan::ObjectWrap
+{
+public:
+    static NAN_MODULE_INIT(Init)
+    {
+        DebugLog("%ul: Main event loop: SspiClientObject::Init.\n", GetCurrentThreadId());
+        v8::Local<v8::FunctionTemplate> tpl = Nan::New<v8::FunctionTemplate>(New);
+        tpl->SetClassName(Nan::New(c_className).ToLocalChecked());
+        tpl->InstanceTemplate()->SetInternalFieldCount(1);
+
+        Nan::SetPrototypeMethod(tpl, "getNextBlob", GetNextBlob);
+        Nan::SetPrototypeMethod(tpl, "cancel", Cancel);
+        Nan::SetPrototypeMethod(tpl, "takePooledFirstLeg", TakePooledFirstLeg);
+        Nan::SetPrototypeMethod(tpl, "reset", Reset);
+        Nan::SetPrototypeMethod(tpl, "getExpiry", GetExpiry);
+        Nan::SetPrototypeMethod(tpl, "processMessages", ProcessMessages);
+        Nan::SetPrototypeMethod(tpl, "getMessageSizes", GetMessageSizes);
+        Nan::SetPrototypeMethod(tpl, "utEnableCannedResponse", UtEnableCannedResponse);
+        Nan::SetPrototypeMethod(tpl, "utForceCompleteAuth", UtForceCompleteAuth);
+
+        s_constructor.Reset(Nan::GetFunction(tpl).ToLocalChecked());
+        Nan::Set(
+            target,
+            Nan::New(c_className).ToLocalChecked(),
+            Nan::GetFunction(tpl).ToLocalChecked());
+
+        Nan::Set(
+            target,
+            Nan::New<v8::String>("getNextBlobBatch").ToLocalChecked(),
+            Nan::GetFunction(Nan::New<v8::FunctionTemplate>(GetNextBlobBatch)).ToLocalChecked());
+    }
+
+private:
+    // Not implemented.
+    SspiClientObject(const SspiClientGetNextBlobWorker&);
+    SspiClientObject& operator=(const SspiClientGetNextBlobWorker&);
+
+    SspiClientObject(const char* spn, const char* securityPackage)
+        : m_sspiImpl(new SspiImpl(spn, securityPackage)),
+        m_queuedCall()
+    {
+        DebugLog("%ul: Main event loop: SspiClientObject::SspiClientObject.\n", GetCurrentThreadId());
+    }
+
+    ~SspiClientObject()
+    {
+        DebugLog("%ul: Garbage Collection Thread: SspiClientObject::~SspiClientObject.\n", GetCurrentThreadId());
+    }
+
+    static NAN_METHOD(New)
+    {
+        if (info.IsConstructCall())
+        {
+            // Constructor invoked with new SspiClient().
+            DebugLog("%ul: Main event loop: SspiClientObject::New IsConstructorCall.\n", GetCurrentThreadId());
+            Nan::Utf8String spn(info[0]);
+
+            const char* securityPackage = nullptr;
+            if (info.Length() == 2)
+            {
+                Nan::Utf8String securityPackageArg(info[1]);
+                securityPackage = *securityPackageArg;
+            }
+
+            SspiClientObject* sspiClientObject = new SspiClientObject(*spn, securityPackage);
+            sspiClientObject->Wrap(info.This());
+            info.GetReturnValue().Set(info.This());
+        }
+        else
+        {
+            // Constructor invoked with SspiClient().
+            DebugLog("%ul: Main event loop: SspiClientObject::New Not IsConstructorCall.\n", GetCurrentThreadId());
+            v8::Local<v8::Value> argv[1] = { info[0] };
+
+            v8::Local<v8::Function> constructor = Nan::New(s_constructor);
+
+            // This will trigger the New method and that invocation will go through
+            // the IsConstructorCall() true code path.
+            info.GetReturnValue().Set(Nan::NewInstance(constructor, info.Length(), argv).ToLocalChecked());
+        }
+    }
+
+    // Arguments are the server response, its offset and length, the tenant
+    // and deadlineMs to schedule the call with, see WorkerPool::Submit, and
+    // the callback. Returns false without queueing anything, and without
+    // calling back, if the HandshakeAdmission queue is full.
+    static NAN_METHOD(GetNextBlob)
+    {
+        DebugLog("%ul: Main event loop: SspiClientObject::GetNextBlob.\n", GetCurrentThreadId());
+
+        if (!HandshakeAdmission::GetInstance()->TryAdmit())
+        {
+            info.GetReturnValue().Set(Nan::False());
+            return;
+        }
+
+        int inBlobBeginOffset = static_cast<int>(info[1]->IntegerValue());
+        int inBlobLength = static_cast<int>(info[2]->IntegerValue());
+        Nan::Utf8String tenant(info[3]);
+        int deadlineMs = static_cast<int>(info[4]->IntegerValue());
+
+        Nan::Callback* callback = new Nan::Callback(info[5].As<v8::Function>());
+        SspiClientObject* sspiClientObject = Nan::ObjectWrap::Unwrap<SspiClientObject>(info.Holder());
+        sspiClientObject->m_queuedCall.reset(new QueuedCall());
+        WorkerPoolQueue::Queue(
+            new SspiClientGetNextBlobWorker(
+                callback,
+                sspiClientObject->m_sspiImpl,
+                sspiClientObject->m_queuedCall,
+                info[0],
+                inBlobBeginOffset,
+                inBlobLength),
+            *tenant,
+            deadlineMs);
+        info.GetReturnValue().Set(Nan::True());
+    }
+
+    // Cancels the last getNextBlob call, argument is whether it timed out.
+    // The call still calls back, with c_errorCancelled or c_errorTimedOut if
+    // it hadn't started. Returns true in that case, the client may then be
+    // used again right away.
+    static NAN_METHOD(Cancel)
+    {
+        DebugLog("%ul: Main event loop: SspiClientObject::Cancel.\n", GetCurrentThreadId());
+        SspiClientObject* sspiClientObject = Nan::ObjectWrap::Unwrap<SspiClientObject>(info.Holder());
+        bool wasQueued = sspiClientObject->m_queuedCall
+            && sspiClientObject->m_queuedCall->Cancel(info[0]->BooleanValue());
+        info.GetReturnValue().Set(Nan::New<v8::Boolean>(wasQueued));
+    }
+
+    // Arguments are arrays of native clients, server responses, offsets,
+    // lengths, tenants and deadlines, one element per client, and the
+    // callback. The JavaScript layer validates them. Each client is admitted
+    // by HandshakeAdmission like a getNextBlob call and can be cancelled the
+    // same way. Returns an array of booleans, false for the clients past the
+    // queue limit, which fail fast; their results in the callback are
+    // c_errorQueueFull.
+    static NAN_METHOD(GetNextBlobBatch)
+    {
+        v8::Local<v8::Array> clients = info[0].As<v8::Array>();
+        v8::Local<v8::Array> inBlobBuffers = info[1].As<v8::Array>();
+        v8::Local<v8::Array> inBlobBeginOffsets = info[2].As<v8::Array>();
+        v8::Local<v8::Array> inBlobLengths = info[3].As<v8::Array>();
+        v8::Local<v8::Array> tenants = info[4].As<v8::Array>();
+        v8::Local<v8::Array> deadlines = info[5].As<v8::Array>();
+
+        DebugLog("%ul: Main event loop: SspiClientObject::GetNextBlobBatch: %u clients.\n",
+            GetCurrentThreadId(),
+            clients->Length());
+
+        Nan::Callback* callback = new Nan::Callback(info[6].As<v8::Function>());
+        SspiClientGetNextBlobBatchWorker* worker = new SspiClientGetNextBlobBatchWorker(callback, inBlobBuffers);
+        v8::Local<v8::Array> admitted = Nan::New<v8::Array>(static_cast<int>(clients->Length()));
+        for (uint32_t i = 0; i < clients->Length(); i++)
+        {
+            SspiClientObject* sspiClientObject = Nan::ObjectWrap::Unwrap<SspiClientObject>(
+                Nan::Get(clients, i).ToLocalChecked()->ToObject());
+
+            std::shared_ptr<QueuedCall> queuedCall;
+            if (HandshakeAdmission::GetInstance()->TryAdmit())
+            {
+                queuedCall.reset(new QueuedCall());
+            }
+
+            sspiClientObject->m_queuedCall = queuedCall;
+            Nan::Set(admitted, i, Nan::New<v8::Boolean>(queuedCall != nullptr));
+            Nan::Utf8String tenant(Nan::Get(tenants, i).ToLocalChecked());
+            worker->AddEntry(
+                sspiClientObject->m_sspiImpl,
+                queuedCall,
+                *tenant,
+                static_cast<int>(Nan::Get(deadlines, i).ToLocalChecked()->IntegerValue()),
+                Nan::Get(inBlobBuffers, i).ToLocalChecked(),
+                static_cast<int>(Nan::Get(inBlobBeginOffsets, i).ToLocalChecked()->IntegerValue()),
+                static_cast<int>(Nan::Get(inBlobLengths, i).ToLocalChecked()->IntegerValue()));
+        }
+
+        WorkerPoolQueue::QueueEntries(worker);
+        info.GetReturnValue().Set(admitted);
+    }
+
+    // Returns the first leg's client response as a Buffer if the FirstLegPool
+    // had one ready, undefined otherwise. Runs synchronously, the JavaScript
+    // layer makes sure no getNextBlob is in flight.
+    static NAN_METHOD(TakePooledFirstLeg)
+    {
+        SspiClientObject* sspiClientObject = Nan::ObjectWrap::Unwrap<SspiClientObject>(info.Holder());
+
+        char* outBlob;
+        int outBlobLength;
+        if (sspiClientObject->m_sspiImpl->TakePooledFirstLeg(&outBlob, &outBlobLength))
+        {
+            info.GetReturnValue().Set(Nan::NewBuffer(
+                outBlob,
+                outBlobLength,
+                SspiClientGetNextBlobWorker::FreeCallback,
+                nullptr).ToLocalChecked());
+        }
+    }
+
+    // Runs synchronously, the JavaScript layer makes sure nothing is in
+    // flight.
+    static NAN_METHOD(Reset)
+    {
+        DebugLog("%ul: Main event loop: SspiClientObject::Reset.\n", GetCurrentThreadId());
+        SspiClientObject* sspiClientObject = Nan::ObjectWrap::Unwrap<SspiClientObject>(info.Holder());
+        sspiClientObject->m_sspiImpl->Reset();
+    }
+
+    // Returns contextExpiryMs and credentialExpiryMs, 0 for whichever the
+    // client doesn't hold.
+    static NAN_METHOD(GetExpiry)
+    {
+        SspiClientObject* sspiClientObject = Nan::ObjectWrap::Unwrap<SspiClientObject>(info.Holder());
+        int64_t contextExpiryUnixMs;
+        int64_t credentialExpiryUnixMs;
+        sspiClientObject->m_sspiImpl->GetExpiry(&contextExpiryUnixMs, &credentialExpiryUnixMs);
+
+        v8::Local<v8::Object> result = Nan::New<v8::Object>();
+        SetStat(result, "contextExpiryMs", contextExpiryUnixMs);
+        SetStat(result, "credentialExpiryMs", credentialExpiryUnixMs);
+        info.GetReturnValue().Set(result);
+    }
+
+    static NAN_METHOD(ProcessMessages)
+    {
+        DebugLog("%ul: Main event loop: SspiClientObject::ProcessMessages.\n", GetCurrentThreadId());
+        SspiClientObject* sspiClientObject = Nan::ObjectWrap::Unwrap<SspiClientObject>(info.Holder());
+        QueueMessageBatch(info, sspiClientObject->m_sspiImpl);
+    }
+
+    static NAN_METHOD(GetMessageSizes)
+    {
+        SspiClientObject* sspiClientObject = Nan::ObjectWrap::Unwrap<SspiClientObject>(info.Holder());
+        ReturnMessageSizes(info, sspiClientObject->m_sspiImpl.get());
+    }
+
+    static NAN_METHOD(UtEnableCannedResponse)
+    {
+        DebugLog("%ul: Main event loop: SspiClientObject::UtEnableCannedResponse.\n", GetCurrentThreadId());
+        SspiClientObject* sspiClientObject = Nan::ObjectWrap::Unwrap<SspiClientObject>(info.Holder());
+        sspiClientObject->m_sspiImpl->UtEnableCannedResponse(info[0]->BooleanValue());
+    }
+
+    static NAN_METHOD(UtForceCompleteAuth)
+    {
+        DebugLog("%ul: Main event loop: SspiClientObject::UtForceCompleteAuth.\n", GetCurrentThreadId());
+        SspiClientObject* sspiClientObject = Nan::ObjectWrap::Unwrap<SspiClientObject>(info.Holder());
+        sspiClientObject->m_sspiImpl->UtForceCompleteAuth(info[0]->BooleanValue());
+    }
+
+    // This is a shared pointer because we pass this to
+    // SspiClientGetNextBlobWorker, whose life time is independently managed
+    // by AsynQueueWorker.
+    std::shared_ptr<SspiImpl> m_sspiImpl;
+
+    // Last getNextBlob call, shared with its worker.
+    std::shared_ptr<QueuedCall> m_queuedCall;
+
+    static Nan::Persistent<v8::Function> s_constructor;
+    static const char* c_className;
+};
+
+Nan::Persistent<v8::Function> SspiClientObject::s_constructor;
+const char* SspiClientObject::c_className = "SspiClient";
+
+// Native implementation of SspiServer surfaced to JavaScript. Server side of
+// the handshake, used for loopback testing.
+class SspiServerObject : public Nan::ObjectWrap
+{
+public:
+    static NAN_MODULE_INIT(Init)
+    {
+        DebugLog("%ul: Main event loop: SspiServerObject::Init.\n", GetCurrentThreadId());
+        v8::Local<v8::FunctionTemplate> tpl = Nan::New<v8::FunctionTemplate>(New);
+        tpl->SetClassName(Nan::New(c_className).ToLocalChecked());
+        tpl->InstanceTemplate()->SetInternalFieldCount(1);
+
+        Nan::SetPrototypeMethod(tpl, "acceptNextBlob", AcceptNextBlob);
+        Nan::SetPrototypeMethod(tpl, "processMessages", ProcessMessages);
+        Nan::SetPrototypeMethod(tpl, "getMessageSizes", GetMessageSizes);
+
+        Nan::Set(
+            target,
+            Nan::New(c_className).ToLocalChecked(),
+            Nan::GetFunction(tpl).ToLocalChecked());
+    }
+
+private:
+    // Not implemented.
+    SspiServerObject(const SspiServerObject&);
+    SspiServerObject& operator=(const SspiServerObject&);
+
+    explicit SspiServerObject(const char* securityPackage)
+        : m_sspiServerImpl(new SspiServerImpl(securityPackage))
+    {
+        DebugLog("%ul: Main event loop: SspiServerObject::SspiServerObject.\n", GetCurrentThreadId());
+    }
+
+    // Only invoked as a constructor call from the JavaScript layer.
+    static NAN_METHOD(New)
+    {
+        DebugLog("%ul: Main event loop: SspiServerObject::New.\n", GetCurrentThreadId());
+        Nan::Utf8String securityPackage(info[0]);
+        SspiServerObject* sspiServerObject = new SspiServerObject(*securityPackage);
+        sspiServerObject->Wrap(info.This());
+        info.GetReturnValue().Set(info.This());
+    }
+
+    static NAN_METHOD(AcceptNextBlob)
+    {
+        DebugLog("%ul: Main event loop: SspiServerObject::AcceptNextBlob.\n", GetCurrentThreadId());
+
+        int inBlobBeginOffset = static_cast<int>(info[1]->IntegerValue());
+        int inBlobLength = static_cast<int>(info[2]->IntegerValue());
+        Nan::Utf8String tenant(info[3]);
+        int deadlineMs = static_cast<int>(info[4]->IntegerValue());
+
+        Nan::Callback* callback = new Nan::Callback(info[5].As<v8::Function>());
+        SspiServerObject* sspiServerObject = Nan::ObjectWrap::Unwrap<SspiServerObject>(info.Holder());
+        WorkerPoolQueue::Queue(
+            new SspiServerAcceptNextBlobWorker(
+                callback,
+                sspiServerObject->m_sspiServerImpl,
+                info[0],
+                inBlobBeginOffset,
+                inBlobLength),
+            *tenant,
+            deadlineMs);
+    }
+
+    static NAN_METHOD(ProcessMessages)
+    {
+        DebugLog("%ul: Main event loop: SspiServerObject::ProcessMessages.\n", GetCurrentThreadId());
+        SspiServerObject* sspiServerObject = Nan::ObjectWrap::Unwrap<SspiServerObject>(info.Holder());
+        QueueMessageBatch(info, sspiServerObject->m_sspiServerImpl);
+    }
+
+    static NAN_METHOD(GetMessageSizes)
+    {
+        SspiServerObject* sspiServerObject = Nan::ObjectWrap::Unwrap<SspiServerObject>(info.Holder());
+        ReturnMessageSizes(info, sspiServerObject->m_sspiServerImpl.get());
+    }
+
+    std::shared_ptr<SspiServerImpl> m_sspiServerImpl;
+
+    static const char* c_className;
+};
+
+const char* SspiServerObject::c_className = "SspiServer";
+
+NAN_MODULE_INIT(Init) {
+    DebugLog("%ul: Main event loop: Init NAN_MODULE_INIT.\n", GetCurrentThreadId());
+
+    Nan::Set(
+        target,
         Nan::New<v8::String>("initialize").ToLocalChecked(),
         Nan::GetFunction(Nan::New<v8::FunctionTemplate>(InitializeAsync)).ToLocalChecked());
 
@@ -344,7 +2107,233 @@ NAN_MODULE_INIT(Init) {
         Nan::New<v8::String>("enableDebugLogging").ToLocalChecked(),
         Nan::GetFunction(Nan::New<v8::FunctionTemplate>(EnableDebugLogging)).ToLocalChecked());
 
+    Nan::Set(
+        target,
+        Nan::New<v8::String>("setProvider").ToLocalChecked(),
+        Nan::GetFunction(Nan::New<v8::FunctionTemplate>(SetProvider)).ToLocalChecked());
+
+    Nan::Set(
+        target,
+        Nan::New<v8::String>("getProviderName").ToLocalChecked(),
+        Nan::GetFunction(Nan::New<v8::FunctionTemplate>(GetProviderName)).ToLocalChecked());
+
+    Nan::Set(
+        target,
+        Nan::New<v8::String>("getCredentialCacheStats").ToLocalChecked(),
+        Nan::GetFunction(Nan::New<v8::FunctionTemplate>(GetCredentialCacheStats)).ToLocalChecked());
+
+    Nan::Set(
+        target,
+        Nan::New<v8::String>("clearCredentialCache").ToLocalChecked(),
+        Nan::GetFunction(Nan::New<v8::FunctionTemplate>(ClearCredentialCache)).ToLocalChecked());
+
+    Nan::Set(
+        target,
+        Nan::New<v8::String>("getBufferPoolStats").ToLocalChecked(),
+        Nan::GetFunction(Nan::New<v8::FunctionTemplate>(GetBufferPoolStats)).ToLocalChecked());
+
+    Nan::Set(
+        target,
+        Nan::New<v8::String>("getBlobStats").ToLocalChecked(),
+        Nan::GetFunction(Nan::New<v8::FunctionTemplate>(GetBlobStats)).ToLocalChecked());
+
+    Nan::Set(
+        target,
+        Nan::New<v8::String>("utResetBlobStats").ToLocalChecked(),
+        Nan::GetFunction(Nan::New<v8::FunctionTemplate>(UtResetBlobStats)).ToLocalChecked());
+
+    Nan::Set(
+        target,
+        Nan::New<v8::String>("utResetBufferPoolStats").ToLocalChecked(),
+        Nan::GetFunction(Nan::New<v8::FunctionTemplate>(UtResetBufferPoolStats)).ToLocalChecked());
+
+    Nan::Set(
+        target,
+        Nan::New<v8::String>("utSetBufferPoolEnabled").ToLocalChecked(),
+        Nan::GetFunction(Nan::New<v8::FunctionTemplate>(UtSetBufferPoolEnabled)).ToLocalChecked());
+
+    Nan::Set(
+        target,
+        Nan::New<v8::String>("utSetMockCredentialLifetime").ToLocalChecked(),
+        Nan::GetFunction(Nan::New<v8::FunctionTemplate>(UtSetMockCredentialLifetime)).ToLocalChecked());
+
+    Nan::Set(
+        target,
+        Nan::New<v8::String>("utSetMockLatency").ToLocalChecked(),
+        Nan::GetFunction(Nan::New<v8::FunctionTemplate>(UtSetMockLatency)).ToLocalChecked());
+
+    Nan::Set(
+        target,
+        Nan::New<v8::String>("configureWorkerPool").ToLocalChecked(),
+        Nan::GetFunction(Nan::New<v8::FunctionTemplate>(ConfigureWorkerPool)).ToLocalChecked());
+
+    Nan::Set(
+        target,
+        Nan::New<v8::String>("configureScheduling").ToLocalChecked(),
+        Nan::GetFunction(Nan::New<v8::FunctionTemplate>(ConfigureScheduling)).ToLocalChecked());
+
+    Nan::Set(
+        target,
+        Nan::New<v8::String>("getWorkerPoolStats").ToLocalChecked(),
+        Nan::GetFunction(Nan::New<v8::FunctionTemplate>(GetWorkerPoolStats)).ToLocalChecked());
+
+    Nan::Set(
+        target,
+        Nan::New<v8::String>("utResetWorkerPoolStats").ToLocalChecked(),
+        Nan::GetFunction(Nan::New<v8::FunctionTemplate>(UtResetWorkerPoolStats)).ToLocalChecked());
+
+    Nan::Set(
+        target,
+        Nan::New<v8::String>("prefetchTickets").ToLocalChecked(),
+        Nan::GetFunction(Nan::New<v8::FunctionTemplate>(PrefetchTickets)).ToLocalChecked());
+
+    Nan::Set(
+        target,
+        Nan::New<v8::String>("utSetMockTicketLatency").ToLocalChecked(),
+        Nan::GetFunction(Nan::New<v8::FunctionTemplate>(UtSetMockTicketLatency)).ToLocalChecked());
+
+    Nan::Set(
+        target,
+        Nan::New<v8::String>("utSetMockTicketLifetime").ToLocalChecked(),
+        Nan::GetFunction(Nan::New<v8::FunctionTemplate>(UtSetMockTicketLifetime)).ToLocalChecked());
+
+    Nan::Set(
+        target,
+        Nan::New<v8::String>("utSetClockOffset").ToLocalChecked(),
+        Nan::GetFunction(Nan::New<v8::FunctionTemplate>(UtSetClockOffset)).ToLocalChecked());
+
+    Nan::Set(
+        target,
+        Nan::New<v8::String>("configureFirstLegPool").ToLocalChecked(),
+        Nan::GetFunction(Nan::New<v8::FunctionTemplate>(ConfigureFirstLegPool)).ToLocalChecked());
+
+    Nan::Set(
+        target,
+        Nan::New<v8::String>("getFirstLegPoolStats").ToLocalChecked(),
+        Nan::GetFunction(Nan::New<v8::FunctionTemplate>(GetFirstLegPoolStats)).ToLocalChecked());
+
+    Nan::Set(
+        target,
+        Nan::New<v8::String>("utResetFirstLegPoolStats").ToLocalChecked(),
+        Nan::GetFunction(Nan::New<v8::FunctionTemplate>(UtResetFirstLegPoolStats)).ToLocalChecked());
+
+    Nan::Set(
+        target,
+        Nan::New<v8::String>("configureHandshakeAdmission").ToLocalChecked(),
+        Nan::GetFunction(Nan::New<v8::FunctionTemplate>(ConfigureHandshakeAdmission)).ToLocalChecked());
+
+    Nan::Set(
+        target,
+        Nan::New<v8::String>("getHandshakeAdmissionStats").ToLocalChecked(),
+        Nan::GetFunction(Nan::New<v8::FunctionTemplate>(GetHandshakeAdmissionStats)).ToLocalChecked());
+
+    Nan::Set(
+        target,
+        Nan::New<v8::String>("utResetHandshakeAdmissionStats").ToLocalChecked(),
+        Nan::GetFunction(Nan::New<v8::FunctionTemplate>(UtResetHandshakeAdmissionStats)).ToLocalChecked());
+
+    Nan::Set(
+        target,
+        Nan::New<v8::String>("configureExpiryRefresh").ToLocalChecked(),
+        Nan::GetFunction(Nan::New<v8::FunctionTemplate>(ConfigureExpiryRefresh)).ToLocalChecked());
+
+    Nan::Set(
+        target,
+        Nan::New<v8::String>("refreshExpiring").ToLocalChecked(),
+        Nan::GetFunction(Nan::New<v8::FunctionTemplate>(RefreshExpiring)).ToLocalChecked());
+
+    Nan::Set(
+        target,
+        Nan::New<v8::String>("getExpiryRefreshStats").ToLocalChecked(),
+        Nan::GetFunction(Nan::New<v8::FunctionTemplate>(GetExpiryRefreshStats)).ToLocalChecked());
+
+    Nan::Set(
+        target,
+        Nan::New<v8::String>("utResetExpiryRefreshStats").ToLocalChecked(),
+        Nan::GetFunction(Nan::New<v8::FunctionTemplate>(UtResetExpiryRefreshStats)).ToLocalChecked());
+
+    Nan::Set(
+        target,
+        Nan::New<v8::String>("resolveFqdn").ToLocalChecked(),
+        Nan::GetFunction(Nan::New<v8::FunctionTemplate>(ResolveFqdn)).ToLocalChecked());
+
+    Nan::Set(
+        target,
+        Nan::New<v8::String>("getCachedFqdn").ToLocalChecked(),
+        Nan::GetFunction(Nan::New<v8::FunctionTemplate>(GetCachedFqdn)).ToLocalChecked());
+
+    Nan::Set(
+        target,
+        Nan::New<v8::String>("configureSpnResolver").ToLocalChecked(),
+        Nan::GetFunction(Nan::New<v8::FunctionTemplate>(ConfigureSpnResolver)).ToLocalChecked());
+
+    Nan::Set(
+        target,
+        Nan::New<v8::String>("getSpnResolverStats").ToLocalChecked(),
+        Nan::GetFunction(Nan::New<v8::FunctionTemplate>(GetSpnResolverStats)).ToLocalChecked());
+
+    Nan::Set(
+        target,
+        Nan::New<v8::String>("clearSpnResolverCache").ToLocalChecked(),
+        Nan::GetFunction(Nan::New<v8::FunctionTemplate>(ClearSpnResolverCache)).ToLocalChecked());
+
+    Nan::Set(
+        target,
+        Nan::New<v8::String>("utResetSpnResolverStats").ToLocalChecked(),
+        Nan::GetFunction(Nan::New<v8::FunctionTemplate>(UtResetSpnResolverStats)).ToLocalChecked());
+
+    Nan::Set(
+        target,
+        Nan::New<v8::String>("utSetStubResolver").ToLocalChecked(),
+        Nan::GetFunction(Nan::New<v8::FunctionTemplate>(UtSetStubResolver)).ToLocalChecked());
+
+    Nan::Set(
+        target,
+        Nan::New<v8::String>("configureTracing").ToLocalChecked(),
+        Nan::GetFunction(Nan::New<v8::FunctionTemplate>(ConfigureTracing)).ToLocalChecked());
+
+    Nan::Set(
+        target,
+        Nan::New<v8::String>("drainTrace").ToLocalChecked(),
+        Nan::GetFunction(Nan::New<v8::FunctionTemplate>(DrainTrace)).ToLocalChecked());
+
+    Nan::Set(
+        target,
+        Nan::New<v8::String>("getTraceStats").ToLocalChecked(),
+        Nan::GetFunction(Nan::New<v8::FunctionTemplate>(GetTraceStats)).ToLocalChecked());
+
+    Nan::Set(
+        target,
+        Nan::New<v8::String>("startTranscriptRecording").ToLocalChecked(),
+        Nan::GetFunction(Nan::New<v8::FunctionTemplate>(StartTranscriptRecording)).ToLocalChecked());
+
+    Nan::Set(
+        target,
+        Nan::New<v8::String>("stopTranscriptRecording").ToLocalChecked(),
+        Nan::GetFunction(Nan::New<v8::FunctionTemplate>(StopTranscriptRecording)).ToLocalChecked());
+
+    Nan::Set(
+        target,
+        Nan::New<v8::String>("loadReplayTranscripts").ToLocalChecked(),
+        Nan::GetFunction(Nan::New<v8::FunctionTemplate>(LoadReplayTranscripts)).ToLocalChecked());
+
+    Nan::Set(
+        target,
+        Nan::New<v8::String>("getTranscriptStats").ToLocalChecked(),
+        Nan::GetFunction(Nan::New<v8::FunctionTemplate>(GetTranscriptStats)).ToLocalChecked());
+
+    Nan::Set(
+        target,
+        Nan::New<v8::String>("getStats").ToLocalChecked(),
+        Nan::GetFunction(Nan::New<v8::FunctionTemplate>(GetStats)).ToLocalChecked());
+
+    Nan::Set(
+        target,
+        Nan::New<v8::String>("resetStats").ToLocalChecked(),
+        Nan::GetFunction(Nan::New<v8::FunctionTemplate>(ResetStats)).ToLocalChecked());
+
     SspiClientObject::Init(target);
+    SspiServerObject::Init(target);
 }
 
 NODE_MODULE(SspiClientNative, Init)
@@ -3,20 +3,30 @@
 
 #include "sspi_impl.h"
 
+#include "expiry_refresher.h"
+#include "latency_stats.h"
+#include "token_buffer_pool.h"
+#include "transcript.h"
 #include "utils.h"
 
+#include <atomic>
 #include <stdio.h>
+#include <string.h>
 
-#pragma comment(lib, "secur32.lib")
+static std::atomic<uint64_t> s_inBlobs(0);
+static std::atomic<uint64_t> s_inBytes(0);
+static std::atomic<uint64_t> s_outBlobs(0);
+static std::atomic<uint64_t> s_outBytes(0);
+static std::atomic<uint64_t> s_bytesCopied(0);
 
 // This is in the prioritized order in terms of which package to use. The
 // first package from this list that's supported by the client OS will be
 // used to connect to the server.
 WCHAR SspiImpl::s_supportedPackages[s_numSupportedPackages][SspiImpl::c_maxPackageNameLength] =
 {
-    L"Negotiate",
-    L"Kerberos",
-    L"NTLM"
+    WSTR("Negotiate"),
+    WSTR("Kerberos"),
+    WSTR("NTLM")
 };
 
 // This should have 1-1 correspondence with s_supportedPackages above. This is to simplify
@@ -28,22 +38,48 @@ char SspiImpl::s_supportedPackagesUtf8[s_numSupportedPackages][SspiImpl::c_maxPa
     "NTLM"
 };
 
-// This is the default security package to use if none specified by the app.
-const WCHAR* SspiImpl::s_defaultPackage = nullptr;
+struct SspiImpl::PackageTable
+{
+    // Result of enumerating, the packages are empty if it failed.
+    SECURITY_STATUS securityStatus;
+    std::string errorString;
+    std::vector<SspiPackageInfo> packages;
+
+    // Supported packages the provider has, in priority order, and the index
+    // of the default package among them.
+    std::vector<std::string> availablePackages;
+    int availableDefaultIndex;
+
+    // Default security package to use if none specified by the app, nullptr
+    // if none is available, and its index in s_supportedPackages.
+    const WCHAR* defaultPackage;
+    int defaultPackageIndex;
+
+    // cbMaxToken of each supported package, -1 if not available, and the
+    // maximum across them.
+    int packageMaxTokenSizes[s_numSupportedPackages];
+    int packageMaxTokenSize;
+};
 
-// Maximum token size across all packages.
-int SspiImpl::s_packageMaxTokenSize = -1;
+std::once_flag SspiImpl::s_packageTableOnce;
+std::atomic<const SspiImpl::PackageTable*> SspiImpl::s_packageTable(nullptr);
 
 SspiImpl::SspiImpl(const char* spn, const char* securityPackage) :
+    m_provider(SspiProvider::GetDefault()),
+    m_credential(),
     m_spn(spn),
     m_spnMultiByte(),
     m_securityPackage(),
     m_securityPackageMultiByte(),
+    m_blobBufferSize(-1),
+    m_expiryUnixMs(0),
+    m_isEstablished(false),
+    m_transcriptContextId(0),
+    m_transcriptLeg(0),
     m_utEnableCannedResponse(false),
     m_utForceCompleteAuth(false)
 {
     DebugLog("%d: Main event loop: SspiImpl::SspiImpl: spn=%s", GetCurrentThreadId(), spn);
-    SecInvalidateHandle(&m_credHandle);
     SecInvalidateHandle(&m_ctxtHandle);
 
     if (securityPackage != nullptr)
@@ -60,13 +96,52 @@ SECURITY_STATUS SspiImpl::Initialize(
 {
     DebugLog("%d: Worker thread: SspiImpl::Initialize.\n", GetCurrentThreadId());
 
-    errorString->assign("");
-    char errorStringLocal[c_errorStringBufferSize];
+    const PackageTable* packageTable = GetPackageTable();
+    *availablePackages = packageTable->availablePackages;
+    *defaultPackageIndex = packageTable->availableDefaultIndex;
+    errorString->assign(packageTable->errorString);
+    return packageTable->securityStatus;
+}
+
+// static
+const SspiImpl::PackageTable* SspiImpl::GetPackageTable()
+{
+    const PackageTable* packageTable = s_packageTable.load(std::memory_order_acquire);
+    if (packageTable == nullptr)
+    {
+        std::call_once(s_packageTableOnce, []()
+        {
+            s_packageTable.store(BuildPackageTable(), std::memory_order_release);
+        });
+
+        packageTable = s_packageTable.load(std::memory_order_acquire);
+    }
+
+    return packageTable;
+}
 
-    unsigned long numPackages;
-    PSecPkgInfoW psecPkgInfo;
+// static
+const SspiImpl::PackageTable* SspiImpl::BuildPackageTable()
+{
+    DebugLog("%d: Worker thread: SspiImpl::BuildPackageTable.\n", GetCurrentThreadId());
+
+    // Intentionally leaked, readers hold on to it without a reference.
+    PackageTable* packageTable = new PackageTable();
+    packageTable->availableDefaultIndex = -1;
+    packageTable->defaultPackage = nullptr;
+    packageTable->defaultPackageIndex = -1;
+    packageTable->packageMaxTokenSize = -1;
+    for (int i = 0; i < s_numSupportedPackages; i++)
+    {
+        packageTable->packageMaxTokenSizes[i] = -1;
+    }
 
-    SECURITY_STATUS securityStatus = EnumerateSecurityPackagesW(&numPackages, &psecPkgInfo);
+    char errorStringLocal[c_errorStringBufferSize];
+
+    TraceCallTimer traceTimer;
+    SECURITY_STATUS securityStatus = SspiProvider::GetDefault()->EnumeratePackages(&packageTable->packages);
+    traceTimer.Complete(c_traceCallEnumeratePackages, securityStatus);
+    packageTable->securityStatus = securityStatus;
     if (securityStatus != SEC_E_OK)
     {
         snprintf(
@@ -75,45 +150,36 @@ SECURITY_STATUS SspiImpl::Initialize(
             "EnumerateSecurityPackagesW failed with error code: 0x%X.",
             securityStatus);
 
-        errorString->assign(errorStringLocal);
-        return securityStatus;
+        packageTable->errorString.assign(errorStringLocal);
+        packageTable->packages.clear();
+        return packageTable;
     }
 
-    for (unsigned long supportedPackagesIndex = 0; supportedPackagesIndex < s_numSupportedPackages; supportedPackagesIndex++)
+    const std::vector<SspiPackageInfo>& packages = packageTable->packages;
+    for (int supportedPackagesIndex = 0; supportedPackagesIndex < s_numSupportedPackages; supportedPackagesIndex++)
     {
-        for (unsigned long packagesIndex = 0; packagesIndex < numPackages; packagesIndex++)
+        for (size_t packagesIndex = 0; packagesIndex < packages.size(); packagesIndex++)
         {
-            if (_wcsicmp(s_supportedPackages[supportedPackagesIndex], psecPkgInfo[packagesIndex].Name) == 0)
+            if (PackageNameEquals(s_supportedPackagesUtf8[supportedPackagesIndex], packages[packagesIndex].name.c_str()))
             {
-                availablePackages->push_back(s_supportedPackagesUtf8[supportedPackagesIndex]);
-                if (s_packageMaxTokenSize < static_cast<int>(psecPkgInfo[packagesIndex].cbMaxToken))
+                packageTable->availablePackages.push_back(s_supportedPackagesUtf8[supportedPackagesIndex]);
+                packageTable->packageMaxTokenSizes[supportedPackagesIndex] = packages[packagesIndex].maxTokenSize;
+                if (packageTable->packageMaxTokenSize < static_cast<int>(packages[packagesIndex].maxTokenSize))
                 {
-                    s_packageMaxTokenSize = psecPkgInfo[packagesIndex].cbMaxToken;
+                    packageTable->packageMaxTokenSize = packages[packagesIndex].maxTokenSize;
                 }
 
-                if (s_defaultPackage == nullptr)
+                if (packageTable->defaultPackage == nullptr)
                 {
-                    s_defaultPackage = s_supportedPackages[supportedPackagesIndex];
-                    *defaultPackageIndex = static_cast<int>(availablePackages->size() - 1);
+                    packageTable->defaultPackage = s_supportedPackages[supportedPackagesIndex];
+                    packageTable->defaultPackageIndex = supportedPackagesIndex;
+                    packageTable->availableDefaultIndex = static_cast<int>(packageTable->availablePackages.size() - 1);
                 }
             }
         }
     }
 
-    securityStatus = FreeContextBuffer(psecPkgInfo);
-    if (securityStatus != SEC_E_OK)
-    {
-        snprintf(
-            errorStringLocal,
-            c_errorStringBufferSize,
-            "FreeContextBuffer call failed with error code: 0x%X.",
-            securityStatus);
-
-        errorString->assign(errorStringLocal);
-        return securityStatus;
-    }
-
-    if (s_defaultPackage == nullptr)
+    if (packageTable->defaultPackage == nullptr)
     {
         snprintf(
             errorStringLocal,
@@ -123,11 +189,75 @@ SECURITY_STATUS SspiImpl::Initialize(
             s_supportedPackagesUtf8[1],
             s_supportedPackagesUtf8[2]);
 
-        errorString->assign(errorStringLocal);
-        return securityStatus;
+        packageTable->errorString.assign(errorStringLocal);
     }
 
-    return securityStatus;
+    return packageTable;
+}
+
+// static
+int SspiImpl::FindEnumeratedMaxTokenSize(const std::string& securityPackage)
+{
+    const std::vector<SspiPackageInfo>& packages = GetPackageTable()->packages;
+    for (size_t i = 0; i < packages.size(); i++)
+    {
+        if (PackageNameEquals(packages[i].name.c_str(), securityPackage.c_str()))
+        {
+            return packages[i].maxTokenSize;
+        }
+    }
+
+    return -1;
+}
+
+// static
+int SspiImpl::FindPackageIndex(const std::string& securityPackage)
+{
+    if (securityPackage.empty())
+    {
+        // Not built yet, nothing has used the default package.
+        const PackageTable* packageTable = s_packageTable.load(std::memory_order_acquire);
+        return packageTable != nullptr ? packageTable->defaultPackageIndex : -1;
+    }
+
+    for (int i = 0; i < s_numSupportedPackages; i++)
+    {
+        if (PackageNameEquals(s_supportedPackagesUtf8[i], securityPackage.c_str()))
+        {
+            return i;
+        }
+    }
+
+    return -1;
+}
+
+// static
+const char* SspiImpl::GetSupportedPackageName(int packageIndex)
+{
+    return packageIndex >= 0 && packageIndex < s_numSupportedPackages
+        ? s_supportedPackagesUtf8[packageIndex]
+        : nullptr;
+}
+
+int SspiImpl::GetPackageIndex() const
+{
+    return FindPackageIndex(m_securityPackage);
+}
+
+// static
+int SspiImpl::GetPackageMaxTokenSize(const std::string& securityPackage)
+{
+    const PackageTable* packageTable = GetPackageTable();
+    int packageIndex = FindPackageIndex(securityPackage);
+
+    // Unknown packages fail in AcquireCredentials; this only needs to be a
+    // sane size until then.
+    if (packageIndex < 0 || packageTable->packageMaxTokenSizes[packageIndex] <= 0)
+    {
+        return packageTable->packageMaxTokenSize;
+    }
+
+    return packageTable->packageMaxTokenSizes[packageIndex];
 }
 
 SECURITY_STATUS SspiImpl::GetNextBlob(
@@ -140,6 +270,8 @@ SECURITY_STATUS SspiImpl::GetNextBlob(
 {
     DebugLog("%d: Worker thread: SspiImpl::GetNextBlob.\n", GetCurrentThreadId());
 
+    CountInBlob(inBlobLength);
+
     if (m_utEnableCannedResponse)
     {
         return UtSetCannedResponse(
@@ -151,16 +283,58 @@ SECURITY_STATUS SspiImpl::GetNextBlob(
             errorString);
     }
 
+    TranscriptRecorder* transcriptRecorder = TranscriptRecorder::GetInstance();
+    if (!transcriptRecorder->IsRecording())
+    {
+        return InitializeNextBlob(inBlob, inBlobLength, outBlob, outBlobLength, isDone, errorString);
+    }
+
+    // Handshakes are recorded from their first leg on.
+    if (!SecIsValidHandle(&m_ctxtHandle))
+    {
+        m_transcriptContextId = transcriptRecorder->NextContextId();
+        m_transcriptLeg = 0;
+    }
+
+    *isDone = false;
+    LatencyTimer transcriptTimer;
+    SECURITY_STATUS securityStatus = InitializeNextBlob(
+        inBlob,
+        inBlobLength,
+        outBlob,
+        outBlobLength,
+        isDone,
+        errorString);
+    RecordTranscriptLeg(
+        inBlob,
+        inBlobLength,
+        *outBlob,
+        *outBlobLength,
+        securityStatus,
+        securityStatus == SEC_E_OK && *isDone,
+        transcriptTimer.GetElapsedUs());
+    return securityStatus;
+}
+
+SECURITY_STATUS SspiImpl::InitializeNextBlob(
+    const char* inBlob,
+    int inBlobLength,
+    char** outBlob,
+    int* outBlobLength,
+    bool* isDone,
+    std::string* errorString)
+{
     errorString->assign("");
+    *outBlob = nullptr;
+    *outBlobLength = 0;
 
     char errorStringLocal[c_errorStringBufferSize];
 
-    // Lifetime owned by caller. See comments in the header file for details.
-    *outBlob = new char[s_packageMaxTokenSize];
     TimeStamp timeExpiry;
     SECURITY_STATUS securityStatus;
 
-    if (!SecIsValidHandle(&m_credHandle))
+    // Converted once per instance, Reset keeps them.
+    if (!m_spnMultiByte)
     {
         securityStatus = ConvertUtf8ToMultiByte(
             "spn",
@@ -174,40 +348,42 @@ SECURITY_STATUS SspiImpl::GetNextBlob(
             errorString->assign(errorStringLocal);
             return securityStatus;
         }
+    }
+
+    if (!m_securityPackage.empty() && !m_securityPackageMultiByte)
+    {
+        securityStatus = ConvertUtf8ToMultiByte(
+            "securityPackage",
+            m_securityPackage.c_str(),
+            &m_securityPackageMultiByte,
+            errorStringLocal,
+            c_errorStringBufferSize);
 
-        const WCHAR* securityPackage;
-        if (m_securityPackage.empty())
+        if (securityStatus != S_OK)
         {
-            securityPackage = s_defaultPackage;
+            errorString->assign(errorStringLocal);
+            return securityStatus;
         }
-        else
-        {
-            securityStatus = ConvertUtf8ToMultiByte(
-                "securityPackage",
-                m_securityPackage.c_str(),
-                &m_securityPackageMultiByte,
-                errorStringLocal,
-                c_errorStringBufferSize);
-
-            if (securityStatus != S_OK)
-            {
-                errorString->assign(errorStringLocal);
-                return securityStatus;
-            }
+    }
 
-            securityPackage = m_securityPackageMultiByte.get();
-        }
+    if (!m_credential)
+    {
+        const WCHAR* securityPackage = m_securityPackage.empty()
+            ? GetPackageTable()->defaultPackage
+            : m_securityPackageMultiByte.get();
 
-        securityStatus = AcquireCredentialsHandleW(
+        LatencyTimer acquireTimer;
+        securityStatus = CredentialCache::GetInstance()->Acquire(
+            m_provider,
             nullptr,    // Principal - logged in user.
-            const_cast<WCHAR*>(securityPackage),     // Security package to use.
+            securityPackage,     // Security package to use.
             SECPKG_CRED_OUTBOUND,   // Client credential token sent to server.
-            nullptr,    // Locally unique user identifier.
-            nullptr,    // Auth data - use default credentials.
-            nullptr,    // pGetKeyFn - unused.
-            nullptr,    // pGetKeyArgument - unused.
-            &m_credHandle,    // Credential handle.
-            &timeExpiry);
+            &m_credential);     // Shared credential handle.
+        LatencyStats::GetInstance()->Record(
+            c_latencyPhaseAcquireCredentials,
+            GetPackageIndex(),
+            securityStatus == SEC_E_OK,
+            acquireTimer.GetElapsedUs());
 
         if (securityStatus != SEC_E_OK)
         {
@@ -220,6 +396,8 @@ SECURITY_STATUS SspiImpl::GetNextBlob(
             errorString->assign(errorStringLocal);
             return securityStatus;
         }
+
+        m_blobBufferSize = GetPackageMaxTokenSize(m_securityPackage);
     }
 
     SecBuffer inSecBuffer;
@@ -234,30 +412,60 @@ SECURITY_STATUS SspiImpl::GetNextBlob(
 
     SecBuffer outSecBuffer;
     outSecBuffer.BufferType = SECBUFFER_TOKEN;
-    outSecBuffer.pvBuffer = *outBlob;
-    outSecBuffer.cbBuffer = s_packageMaxTokenSize;
 
     SecBufferDesc outSecBufferDesc;
     outSecBufferDesc.ulVersion = SECBUFFER_VERSION;
     outSecBufferDesc.cBuffers = 1;
     outSecBufferDesc.pBuffers = &outSecBuffer;
 
-    ULONG contextAttr;
-
-    securityStatus = InitializeSecurityContextW(
-        &m_credHandle,      // Credential handle.
-        SecIsValidHandle(&m_ctxtHandle) ? &m_ctxtHandle : nullptr,      // Context handle - input.
-        const_cast<WCHAR*>(m_spnMultiByte.get()),    // Service Principal name (SPN).
-        ISC_REQ_DELEGATE | ISC_REQ_MUTUAL_AUTH | ISC_REQ_INTEGRITY | ISC_REQ_EXTENDED_ERROR,
-                    // Context bit flags.
-        0,          // Reserved - unused.
-        SECURITY_NATIVE_DREP,       // Target data representation.
-        SecIsValidHandle(&m_ctxtHandle) ? &inSecBufferDesc : nullptr,   // Input buffer, has data from server.
-        0,          // Reserved - unused.
-        &m_ctxtHandle,      // Context handle - output.
-        &outSecBufferDesc,  // Output buffer, data to send to server.
-        &contextAttr,       // Context attributes - unused.
-        &timeExpiry);
+    unsigned long contextAttr;
+
+    // Lifetime owned by caller. See comments in the header file for details.
+    *outBlob = AllocateBlob(m_blobBufferSize);
+
+    while (true)
+    {
+        outSecBuffer.pvBuffer = *outBlob;
+        outSecBuffer.cbBuffer = m_blobBufferSize;
+
+        bool hasContext = SecIsValidHandle(&m_ctxtHandle);
+        LatencyTimer initializeTimer;
+        TraceCallTimer traceTimer;
+        securityStatus = m_provider->InitializeContext(
+            m_credential->GetHandle(),      // Credential handle.
+            hasContext ? &m_ctxtHandle : nullptr,   // Context handle - input.
+            m_spnMultiByte.get(),    // Service Principal name (SPN).
+            ISC_REQ_DELEGATE | ISC_REQ_MUTUAL_AUTH | ISC_REQ_INTEGRITY | ISC_REQ_CONFIDENTIALITY
+                | ISC_REQ_REPLAY_DETECT | ISC_REQ_SEQUENCE_DETECT | ISC_REQ_EXTENDED_ERROR,
+                        // Context bit flags.
+            hasContext ? &inSecBufferDesc : nullptr,    // Input buffer, has data from server.
+            &m_ctxtHandle,      // Context handle - output.
+            &outSecBufferDesc,  // Output buffer, data to send to server.
+            &contextAttr,       // Context attributes - unused.
+            &timeExpiry);
+        traceTimer.Complete(c_traceCallInitializeContext, securityStatus);
+        LatencyStats::GetInstance()->Record(
+            c_latencyPhaseInitializeContext,
+            GetPackageIndex(),
+            securityStatus >= 0,
+            initializeTimer.GetElapsedUs());
+
+        // cbMaxToken is a hint for some providers, tokens carrying large
+        // authorization data may exceed it. Retry with a bigger buffer, the
+        // providers leave the context untouched when the buffer is too small.
+        if (securityStatus != SEC_E_BUFFER_TOO_SMALL || m_blobBufferSize >= c_maxBlobBufferSize)
+        {
+            break;
+        }
+
+        DebugLog("%d: Worker thread: SspiImpl::GetNextBlob: buffer of %d bytes too small.\n",
+            GetCurrentThreadId(),
+            m_blobBufferSize);
+
+        FreeBlob(*outBlob);
+        m_blobBufferSize = GrowBlobBufferSize(m_blobBufferSize);
+        *outBlob = AllocateBlob(m_blobBufferSize);
+    }
 
     if (securityStatus != SEC_E_OK
         && securityStatus != SEC_I_CONTINUE_NEEDED
@@ -270,18 +478,30 @@ SECURITY_STATUS SspiImpl::GetNextBlob(
             "InitializeSecurityContextW failed with error code: 0x%X.",
             securityStatus);
 
+        FreeBlob(*outBlob);
+        *outBlob = nullptr;
+
         errorString->assign(errorStringLocal);
         return securityStatus;
     }
 
     *isDone = securityStatus != SEC_I_CONTINUE_NEEDED
         && securityStatus != SEC_I_COMPLETE_AND_CONTINUE;
+    m_expiryUnixMs = TimeStampToUnixMs(timeExpiry);
 
     if (m_utForceCompleteAuth
         || securityStatus == SEC_I_COMPLETE_NEEDED
         || securityStatus == SEC_I_COMPLETE_AND_CONTINUE)
     {
-        securityStatus = CompleteAuthToken(&m_ctxtHandle, &outSecBufferDesc);
+        LatencyTimer completeTimer;
+        TraceCallTimer traceTimer;
+        securityStatus = m_provider->CompleteToken(&m_ctxtHandle, &outSecBufferDesc);
+        traceTimer.Complete(c_traceCallCompleteToken, securityStatus);
+        LatencyStats::GetInstance()->Record(
+            c_latencyPhaseCompleteToken,
+            GetPackageIndex(),
+            securityStatus == SEC_E_OK,
+            completeTimer.GetElapsedUs());
         if (securityStatus != SEC_E_OK)
         {
             snprintf(
@@ -290,99 +510,274 @@ SECURITY_STATUS SspiImpl::GetNextBlob(
                 "CompleteAuthToken failed with error code: 0x%X.",
                 securityStatus);
 
+            FreeBlob(*outBlob);
+            *outBlob = nullptr;
+
             errorString->assign(errorStringLocal);
             return securityStatus;
         }
     }
 
     *outBlobLength = outSecBuffer.cbBuffer;
+    *outBlob = ShrinkBlob(*outBlob, *outBlobLength, m_blobBufferSize);
+    CountOutBlob(*outBlobLength);
+    m_isEstablished = *isDone;
+
+    if (*isDone)
+    {
+        ExpiryRefresher::GetInstance()->TrackContext(m_spn, m_securityPackage, m_expiryUnixMs);
+    }
 
     return 0;
 }
 
-// static
-void SspiImpl::FreeBlob(char* blob)
+bool SspiImpl::TakePooledFirstLeg(char** outBlob, int* outBlobLength)
 {
-    DebugLog("%d: Garbage Collection Thread: SspiImpl::FreeBlob.\n", GetCurrentThreadId());
-    delete[] blob;
-}
+    if (m_utEnableCannedResponse || SecIsValidHandle(&m_ctxtHandle))
+    {
+        return false;
+    }
 
-// static
-HRESULT SspiImpl::ConvertUtf8ToMultiByte(
-    const char* paramName,
-    const char* utf8Str,
-    std::unique_ptr<WCHAR[]>* multiByteStr,
-    char* errorString,
-    int errorStringBufferSize)
-{
-    int retval = MultiByteToWideChar(
-        CP_UTF8,                    // Code page UTF8.
-        MB_ERR_INVALID_CHARS,       // Fail on invalid characters.
-        utf8Str,                    // UTF8 string.
-        -1,                         // Indicates null-termination.
-        nullptr,                    // Output buffer, ignored when getting required buffer size.
-        0);                         // Output buffer size, in characters set to 0 to get required buffer size.
-
-    if (!retval) {
-        HRESULT hr = HRESULT_FROM_WIN32(GetLastError());
-        snprintf(
-            errorString,
-            errorStringBufferSize,
-            "MultiByteToWideChar failed to get required buffer size for '%s'. Error code: 0x%X.",
-            paramName,
-            hr);
+    FirstLeg firstLeg;
+    if (!FirstLegPool::GetInstance()->Take(m_spn, m_securityPackage, m_provider, &firstLeg))
+    {
+        return false;
+    }
 
-        return hr;
+    // Later legs need the SPN in the provider's encoding. It converted fine
+    // when the leg was generated.
+    char errorStringLocal[c_errorStringBufferSize];
+    if (!m_spnMultiByte
+        && ConvertUtf8ToMultiByte(
+            "spn",
+            m_spn.c_str(),
+            &m_spnMultiByte,
+            errorStringLocal,
+            c_errorStringBufferSize) != S_OK)
+    {
+        FirstLegPool::Discard(&firstLeg);
+        return false;
     }
 
-    // retval includes null space for terminating null character.
-    multiByteStr->reset(new WCHAR[retval]);
+    DebugLog("%d: Main event loop: SspiImpl::TakePooledFirstLeg: spn=%s.\n", GetCurrentThreadId(), m_spn.c_str());
 
-    retval = MultiByteToWideChar(
-        CP_UTF8,                    // Code page UTF8.
-        MB_ERR_INVALID_CHARS,       // Fail on invalid characters.
-        utf8Str,                    // UTF8 string.
-        -1,                         // Indicates null-termination.
-        multiByteStr->get(),        // Output buffer.
-        retval);                    // Output buffer size, in characters set to 0 to get required buffer size.
+    m_credential = firstLeg.credential;
+    m_ctxtHandle = firstLeg.ctxtHandle;
+    m_blobBufferSize = firstLeg.blobBufferSize;
+    m_expiryUnixMs = firstLeg.expiryUnixMs;
 
-    if (!retval) {
-        HRESULT hr = HRESULT_FROM_WIN32(GetLastError());
-        snprintf(
-            errorString,
-            errorStringBufferSize,
-            "MultiByteToWideChar failed to convert UTF8 to WideChar for '%s'. Error code: 0x%X.",
-            paramName,
-            hr);
+    *outBlob = firstLeg.outBlob;
+    *outBlobLength = firstLeg.outBlobLength;
 
-        return hr;
+    // Recorded as taking no time, it was generated ahead of the handshake.
+    m_transcriptContextId = 0;
+    TranscriptRecorder* transcriptRecorder = TranscriptRecorder::GetInstance();
+    if (transcriptRecorder->IsRecording())
+    {
+        m_transcriptContextId = transcriptRecorder->NextContextId();
+        m_transcriptLeg = 0;
+        RecordTranscriptLeg(nullptr, 0, *outBlob, *outBlobLength, SEC_E_OK, false, 0);
     }
 
-    return S_OK;
+    return true;
 }
 
-void SspiImpl::DeleteCredHandle()
+void SspiImpl::Reset()
 {
-    if (SecIsValidHandle(&m_credHandle))
+    DebugLog("%d: Main event loop: SspiImpl::Reset: spn=%s.\n", GetCurrentThreadId(), m_spn.c_str());
+
+    DeleteCtxtHandle();
+    m_expiryUnixMs = 0;
+    m_isEstablished = false;
+    m_transcriptContextId = 0;
+
+    // An expired credential would fail the next handshake, the cache has a
+    // fresh one.
+    if (m_credential && m_credential->GetExpiryUnixMs() <= GetUnixTimeMs())
     {
-        SECURITY_STATUS securityStatus = FreeCredentialHandle(&m_credHandle);
-        if (securityStatus != SEC_E_OK)
+        DeleteCredHandle();
+    }
+}
+
+void SspiImpl::GetExpiry(int64_t* contextExpiryUnixMs, int64_t* credentialExpiryUnixMs) const
+{
+    *contextExpiryUnixMs = m_isEstablished ? m_expiryUnixMs : 0;
+    *credentialExpiryUnixMs = m_credential ? m_credential->GetExpiryUnixMs() : 0;
+}
+
+SECURITY_STATUS SspiImpl::GetMessageSizes(SecPkgContext_Sizes* sizes, std::string* errorString)
+{
+    return MessageBatch::QuerySizes(m_provider, m_isEstablished ? &m_ctxtHandle : nullptr, sizes, errorString);
+}
+
+SECURITY_STATUS SspiImpl::ProcessMessages(
+    MessageOperation operation,
+    MessageBatch* batch,
+    int* processedCount,
+    std::string* errorString)
+{
+    return batch->Process(
+        m_provider,
+        m_isEstablished ? &m_ctxtHandle : nullptr,
+        operation,
+        processedCount,
+        errorString);
+}
+
+// static
+SECURITY_STATUS SspiImpl::GenerateFirstLeg(
+    const std::string& spn,
+    const std::string& securityPackage,
+    FirstLeg* firstLeg,
+    std::string* errorString)
+{
+    SspiImpl sspiImpl(spn.c_str(), securityPackage.empty() ? nullptr : securityPackage.c_str());
+
+    char* outBlob;
+    int outBlobLength;
+    bool isDone;
+
+    // Recorded when taken from the pool, if ever.
+    SECURITY_STATUS securityStatus = sspiImpl.InitializeNextBlob(
+        nullptr,
+        0,
+        &outBlob,
+        &outBlobLength,
+        &isDone,
+        errorString);
+
+    if (securityStatus != SEC_E_OK)
+    {
+        return securityStatus;
+    }
+
+    // A context done in one leg has nothing left for a client to do with it.
+    if (isDone || outBlob == nullptr)
+    {
+        if (outBlob != nullptr)
         {
-            DebugLog(
-                "%d: FreeCredentialHandle failed with error code: %ld.\n",
-                GetCurrentThreadId(),
-                securityStatus);
+            FreeBlob(outBlob);
         }
 
-        SecInvalidateHandle(&m_credHandle);
+        errorString->assign("First leg completed the context, nothing to pool.");
+        return SEC_E_UNSUPPORTED_FUNCTION;
+    }
+
+    firstLeg->provider = sspiImpl.m_provider;
+    firstLeg->credential = sspiImpl.m_credential;
+    firstLeg->ctxtHandle = sspiImpl.m_ctxtHandle;
+    firstLeg->outBlob = outBlob;
+    firstLeg->outBlobLength = outBlobLength;
+    firstLeg->blobBufferSize = sspiImpl.m_blobBufferSize;
+    firstLeg->createdUnixMs = GetUnixTimeMs();
+    firstLeg->expiryUnixMs = sspiImpl.m_expiryUnixMs;
+
+    // Owned by firstLeg now.
+    SecInvalidateHandle(&sspiImpl.m_ctxtHandle);
+    return SEC_E_OK;
+}
+
+// static
+char* SspiImpl::AllocateBlob(int blobLength)
+{
+    return TokenBufferPool::GetInstance()->Allocate(blobLength);
+}
+
+// static
+int SspiImpl::GrowBlobBufferSize(int blobBufferSize)
+{
+    const int c_minBlobBufferSize = 4096;
+
+    if (blobBufferSize < c_minBlobBufferSize / 2)
+    {
+        return c_minBlobBufferSize;
+    }
+
+    return blobBufferSize < c_maxBlobBufferSize / 2 ? blobBufferSize * 2 : c_maxBlobBufferSize;
+}
+
+// static
+char* SspiImpl::ShrinkBlob(char* blob, int blobLength, int blobBufferSize)
+{
+    if (blobLength == 0)
+    {
+        FreeBlob(blob);
+        return nullptr;
+    }
+
+    // Within a factor of two is what the pool's size classes give anyway.
+    if (blobLength > blobBufferSize / 2)
+    {
+        return blob;
     }
+
+    char* shrunkBlob = AllocateBlob(blobLength);
+    memcpy(shrunkBlob, blob, blobLength);
+    s_bytesCopied += blobLength;
+    FreeBlob(blob);
+    return shrunkBlob;
+}
+
+// static
+void SspiImpl::CountInBlob(int inBlobLength)
+{
+    if (inBlobLength > 0)
+    {
+        s_inBlobs++;
+        s_inBytes += inBlobLength;
+    }
+}
+
+// static
+void SspiImpl::CountOutBlob(int outBlobLength)
+{
+    if (outBlobLength > 0)
+    {
+        s_outBlobs++;
+        s_outBytes += outBlobLength;
+    }
+}
+
+// static
+void SspiImpl::GetBlobStats(SspiBlobStats* stats)
+{
+    stats->inBlobs = s_inBlobs.load();
+    stats->inBytes = s_inBytes.load();
+    stats->outBlobs = s_outBlobs.load();
+    stats->outBytes = s_outBytes.load();
+    stats->bytesCopied = s_bytesCopied.load();
+}
+
+// static
+void SspiImpl::ResetBlobStats()
+{
+    s_inBlobs = 0;
+    s_inBytes = 0;
+    s_outBlobs = 0;
+    s_outBytes = 0;
+    s_bytesCopied = 0;
+}
+
+// static
+void SspiImpl::FreeBlob(char* blob)
+{
+    DebugLog("%d: Garbage Collection Thread: SspiImpl::FreeBlob.\n", GetCurrentThreadId());
+    TokenBufferPool::GetInstance()->Free(blob);
+}
+
+void SspiImpl::DeleteCredHandle()
+{
+    // Freed by the CredentialCache once no one else uses it.
+    m_credential.reset();
 }
 
 void SspiImpl::DeleteCtxtHandle()
 {
     if (SecIsValidHandle(&m_ctxtHandle))
     {
-        SECURITY_STATUS securityStatus = DeleteSecurityContext(&m_ctxtHandle);
+        TraceCallTimer traceTimer;
+        SECURITY_STATUS securityStatus = m_provider->DeleteContext(&m_ctxtHandle);
+        traceTimer.Complete(c_traceCallDeleteContext, securityStatus);
         if (securityStatus != SEC_E_OK)
         {
             DebugLog(
@@ -395,6 +790,37 @@ void SspiImpl::DeleteCtxtHandle()
     }
 }
 
+void SspiImpl::RecordTranscriptLeg(
+    const char* inBlob,
+    int inBlobLength,
+    const char* outBlob,
+    int outBlobLength,
+    SECURITY_STATUS securityStatus,
+    bool isDone,
+    uint64_t durationUs)
+{
+    if (m_transcriptContextId == 0)
+    {
+        return;
+    }
+
+    // Packages not supported are recorded by the name asked for.
+    const char* securityPackage = GetSupportedPackageName(GetPackageIndex());
+    TranscriptRecorder::GetInstance()->Record(
+        m_transcriptContextId,
+        m_transcriptLeg,
+        securityPackage != nullptr ? securityPackage : m_securityPackage.c_str(),
+        m_spn,
+        inBlob,
+        inBlobLength,
+        outBlob,
+        outBlobLength,
+        securityStatus,
+        isDone,
+        durationUs);
+    m_transcriptLeg++;
+}
+
 SspiImpl::~SspiImpl()
 {
     DebugLog("%d: Garbage Collection Thread: SspiImpl::~SspiImpl.\n", GetCurrentThreadId());
@@ -423,8 +849,9 @@ SECURITY_STATUS SspiImpl::UtSetCannedResponse(
     if (!inBlobLength)
     {
         const int c_outBlobLength = 25;
-        *outBlob = new char[c_outBlobLength];
+        *outBlob = AllocateBlob(c_outBlobLength);
         *outBlobLength = c_outBlobLength;
+        CountOutBlob(*outBlobLength);
         for (int i = 0; i < c_outBlobLength; i++)
         {
             (*outBlob)[i] = i;
@@ -437,8 +864,9 @@ SECURITY_STATUS SspiImpl::UtSetCannedResponse(
     }
     else
     {
-        *outBlob = new char[inBlobLength];
+        *outBlob = AllocateBlob(inBlobLength);
         *outBlobLength = inBlobLength;
+        CountOutBlob(*outBlobLength);
         for (int i = 0; i < inBlobLength; i++)
         {
             (*outBlob)[i] = inBlob[i];
@@ -1,27 +1,54 @@
 #pragma once
 
-#define SECURITY_WIN32
+#include "credential_cache.h"
+#include "first_leg_pool.h"
+#include "message_batch.h"
+#include "sspi_platform.h"
+#include "sspi_provider.h"
 
+#include <atomic>
 #include <memory>
-#include <Windows.h>
-#include <Sspi.h>
+#include <mutex>
+#include <stdint.h>
 #include <string>
 #include <vector>
 
+// Token traffic through SspiImpl and SspiServerImpl. Input tokens are read in
+// place from the JavaScript Buffers; bytesCopied counts the bytes copied to
+// right-size output tokens.
+struct SspiBlobStats
+{
+    uint64_t inBlobs;
+    uint64_t inBytes;
+    uint64_t outBlobs;
+    uint64_t outBytes;
+    uint64_t bytesCopied;
+};
+
 // This class has the core SSPI client implementation. This has no dependencies on
 // V8 or libuv. All code in this class runs in the worker threads. It's upto the
-// caller to ensure thread-safety.
+// caller to ensure thread-safety. Security calls go through the SspiProvider
+// that was the default when the instance was created.
 class SspiImpl
 {
 public:
     SspiImpl(const char* spn, const char* securityPackage);
 
+    // Enumerates the default provider's packages once per process. Later
+    // calls, from any thread, return the same results without calling the
+    // provider. Other members enumerate on first use if this wasn't called,
+    // so the provider must be selected before anything else runs.
     static SECURITY_STATUS Initialize(
         std::vector<std::string>* availablePackages,
         int* defaultPackageIndex,
         std::string* errorString);
 
-    // Callee creates the outBlob.
+    // cbMaxToken the provider enumerated for securityPackage, -1 if it has
+    // no such package. Same enumeration as Initialize.
+    static int FindEnumeratedMaxTokenSize(const std::string& securityPackage);
+
+    // Callee creates the outBlob, sized to the token. outBlob is nullptr if
+    // there's no token to send.
     // Caller owns the lifetime of outBlob.
     // Caller deletes outBlob by invoking FreeBlob().
     //  - Caller invoking FreeBlob() vs invoking delete directly decouples
@@ -35,6 +62,68 @@ public:
         bool* isDone,
         std::string* errorString);
 
+    // Takes a ready first leg from the FirstLegPool for this instance's SPN
+    // and package, in place of the first GetNextBlob call. Returns false if
+    // there's a context already or the pool has none. Cheap enough
+    // for the main event loop, must not race with GetNextBlob.
+    bool TakePooledFirstLeg(char** outBlob, int* outBlobLength);
+
+    // Deletes the context so the instance can run a new handshake with
+    // GetNextBlob. The converted SPN and package and the credential are kept,
+    // the credential only until it expires. Same threading rules as
+    // TakePooledFirstLeg.
+    void Reset();
+
+    // Expiry of the established context and of the credential the instance
+    // holds, 0 for whichever there's none of. Same threading rules as
+    // TakePooledFirstLeg.
+    void GetExpiry(int64_t* contextExpiryUnixMs, int64_t* credentialExpiryUnixMs) const;
+
+    // Message protection with the context once GetNextBlob has reported
+    // isDone, see MessageBatch. Same threading rules as GetNextBlob.
+    SECURITY_STATUS GetMessageSizes(SecPkgContext_Sizes* sizes, std::string* errorString);
+    SECURITY_STATUS ProcessMessages(
+        MessageOperation operation,
+        MessageBatch* batch,
+        int* processedCount,
+        std::string* errorString);
+
+    // Runs the first GetNextBlob for spn and securityPackage, empty for the
+    // default package, and moves the resulting context into firstLeg.
+    static SECURITY_STATUS GenerateFirstLeg(
+        const std::string& spn,
+        const std::string& securityPackage,
+        FirstLeg* firstLeg,
+        std::string* errorString);
+
+    // Index of this instance's package in the supported packages, -1 if it's
+    // not one of them.
+    int GetPackageIndex() const;
+
+    // Name of the supported package at packageIndex, nullptr if out of range.
+    static const char* GetSupportedPackageName(int packageIndex);
+
+    // Allocates blobs returned by GetNextBlob and SspiServerImpl from the
+    // TokenBufferPool.
+    static char* AllocateBlob(int blobLength);
+
+    // Returns blob, or a right-sized copy of it if the token is much smaller
+    // than the buffer it was written to, so the caller doesn't hold on to
+    // cbMaxToken bytes per token. nullptr for empty tokens. blob is freed if
+    // not returned.
+    static char* ShrinkBlob(char* blob, int blobLength, int blobBufferSize);
+
+    // Next output buffer size to try after SEC_E_BUFFER_TOO_SMALL, up to
+    // c_maxBlobBufferSize.
+    static int GrowBlobBufferSize(int blobBufferSize);
+
+    static const int c_maxBlobBufferSize = 1024 * 1024;
+
+    static void CountInBlob(int inBlobLength);
+    static void CountOutBlob(int outBlobLength);
+    static void GetBlobStats(SspiBlobStats* stats);
+    static void ResetBlobStats();
+
     // Call triggered by JavaScript garbage collector.
     static void FreeBlob(char* blob);
 
@@ -48,27 +137,56 @@ private:
     SspiImpl(const SspiImpl&);
     SspiImpl& operator=(const SspiImpl&);
 
-    static HRESULT ConvertUtf8ToMultiByte(
-        const char* paramName,
-        const char* utf8Str,
-        std::unique_ptr<WCHAR[]>* multiByteStr,
-        char* errorString,
-        int errorStringBufferSize);
-
     void DeleteCredHandle();
     void DeleteCtxtHandle();
 
+    // GetNextBlob with the provider, not recorded.
+    SECURITY_STATUS InitializeNextBlob(
+        const char* inBlob,
+        int inBlobLength,
+        char** outBlob,
+        int* outBlobLength,
+        bool* isDone,
+        std::string* errorString);
+
+    // Appends a leg to the TranscriptRecorder's file, if the handshake's
+    // first leg was recorded.
+    void RecordTranscriptLeg(
+        const char* inBlob,
+        int inBlobLength,
+        const char* outBlob,
+        int outBlobLength,
+        SECURITY_STATUS securityStatus,
+        bool isDone,
+        uint64_t durationUs);
+
     static const int c_maxPackageNameLength = 32;
     static const int s_numSupportedPackages = 3;
     static WCHAR s_supportedPackages[s_numSupportedPackages][c_maxPackageNameLength];
     static char s_supportedPackagesUtf8[s_numSupportedPackages][c_maxPackageNameLength];
 
-    static const WCHAR* s_defaultPackage;
-    static int s_packageMaxTokenSize;
+    // What the provider's packages enumerated to. Built once per process and
+    // never changed or freed after, so it's read without locking.
+    struct PackageTable;
+    static std::once_flag s_packageTableOnce;
+    static std::atomic<const PackageTable*> s_packageTable;
+
+    // Enumerates on the first call, concurrent callers wait for it. Never
+    // returns nullptr.
+    static const PackageTable* GetPackageTable();
+    static const PackageTable* BuildPackageTable();
+
+    // Empty securityPackage is the default package, -1 until the package
+    // table is built.
+    static int FindPackageIndex(const std::string& securityPackage);
+    static int GetPackageMaxTokenSize(const std::string& securityPackage);
 
     static const int c_errorStringBufferSize = 256;
 
-    CredHandle m_credHandle;
+    SspiProvider* m_provider;
+
+    // Shared with other instances through the CredentialCache.
+    std::shared_ptr<CachedCredential> m_credential;
     CtxtHandle m_ctxtHandle;
 
     std::string m_spn;
@@ -77,6 +195,21 @@ private:
     std::string m_securityPackage;
     std::unique_ptr<WCHAR[]> m_securityPackageMultiByte;
 
+    // Output buffer size for the package in use. Starts at its cbMaxToken and
+    // grows on SEC_E_BUFFER_TOO_SMALL.
+    int m_blobBufferSize;
+
+    // Context expiry reported by the last InitializeContext call.
+    int64_t m_expiryUnixMs;
+
+    // GetNextBlob reported isDone, the context may protect messages.
+    bool m_isEstablished;
+
+    // Handshake being recorded by the TranscriptRecorder, 0 for none, and
+    // the number of its legs recorded.
+    uint64_t m_transcriptContextId;
+    int m_transcriptLeg;
+
     // Everything below is for unit testing purposes only.
     SECURITY_STATUS UtSetCannedResponse(
         const char* inBlob,
@@ -0,0 +1,160 @@
+#pragma once
+
+// SSPI types, constants and the handful of Win32 helpers used by the native
+// layer. On Windows these come straight from the platform headers. Elsewhere
+// we define the subset the providers need, with the same names and values, so
+// the code above the provider interface builds unchanged on Linux.
+
+#ifdef _WIN32
+
+#define SECURITY_WIN32
+
+#include <Windows.h>
+#include <Sspi.h>
+
+// Wide string literal in the platform WCHAR type.
+#define WSTR(s) L##s
+
+#else   // _WIN32
+
+#include <stdint.h>
+#include <sys/syscall.h>
+#include <unistd.h>
+
+typedef int32_t SECURITY_STATUS;
+typedef int32_t HRESULT;
+typedef uint32_t DWORD;
+typedef unsigned long ULONG;
+typedef uintptr_t ULONG_PTR;
+typedef intptr_t INT_PTR;
+typedef char16_t WCHAR;
+
+#define WSTR(s) u##s
+
+struct SecHandle
+{
+    ULONG_PTR dwLower;
+    ULONG_PTR dwUpper;
+};
+
+typedef SecHandle CredHandle;
+typedef SecHandle CtxtHandle;
+
+#define SecInvalidateHandle(x) \
+    ((x)->dwLower = (x)->dwUpper = static_cast<ULONG_PTR>(static_cast<INT_PTR>(-1)))
+
+#define SecIsValidHandle(x) \
+    (((x)->dwLower != static_cast<ULONG_PTR>(static_cast<INT_PTR>(-1))) \
+    && ((x)->dwUpper != static_cast<ULONG_PTR>(static_cast<INT_PTR>(-1))))
+
+// Same layout as SECURITY_INTEGER: 100ns intervals since January 1, 1601.
+struct TimeStamp
+{
+    uint32_t LowPart;
+    int32_t HighPart;
+};
+
+struct SecBuffer
+{
+    ULONG cbBuffer;
+    ULONG BufferType;
+    void* pvBuffer;
+};
+
+struct SecBufferDesc
+{
+    ULONG ulVersion;
+    ULONG cBuffers;
+    SecBuffer* pBuffers;
+};
+
+struct SecPkgContext_Sizes
+{
+    ULONG cbMaxToken;
+    ULONG cbMaxSignature;
+    ULONG cbBlockSize;
+    ULONG cbSecurityTrailer;
+};
+
+#define S_OK                                ((HRESULT)0x00000000L)
+#define HRESULT_FROM_WIN32(x)               ((HRESULT)(((x) & 0x0000FFFF) | 0x80070000))
+#define ERROR_NO_UNICODE_TRANSLATION        1113L
+
+#define SEC_E_OK                            ((SECURITY_STATUS)0x00000000L)
+#define SEC_I_CONTINUE_NEEDED               ((SECURITY_STATUS)0x00090312L)
+#define SEC_I_COMPLETE_NEEDED               ((SECURITY_STATUS)0x00090313L)
+#define SEC_I_COMPLETE_AND_CONTINUE         ((SECURITY_STATUS)0x00090314L)
+#define SEC_E_INSUFFICIENT_MEMORY           ((SECURITY_STATUS)0x80090300L)
+#define SEC_E_INVALID_HANDLE                ((SECURITY_STATUS)0x80090301L)
+#define SEC_E_UNSUPPORTED_FUNCTION          ((SECURITY_STATUS)0x80090302L)
+#define SEC_E_TARGET_UNKNOWN                ((SECURITY_STATUS)0x80090303L)
+#define SEC_E_INTERNAL_ERROR                ((SECURITY_STATUS)0x80090304L)
+#define SEC_E_SECPKG_NOT_FOUND              ((SECURITY_STATUS)0x80090305L)
+#define SEC_E_INVALID_TOKEN                 ((SECURITY_STATUS)0x80090308L)
+#define SEC_E_QOP_NOT_SUPPORTED             ((SECURITY_STATUS)0x8009030AL)
+#define SEC_E_LOGON_DENIED                  ((SECURITY_STATUS)0x8009030CL)
+#define SEC_E_UNKNOWN_CREDENTIALS           ((SECURITY_STATUS)0x8009030DL)
+#define SEC_E_NO_CREDENTIALS                ((SECURITY_STATUS)0x8009030EL)
+#define SEC_E_MESSAGE_ALTERED               ((SECURITY_STATUS)0x8009030FL)
+#define SEC_E_OUT_OF_SEQUENCE               ((SECURITY_STATUS)0x80090310L)
+#define SEC_E_CONTEXT_EXPIRED               ((SECURITY_STATUS)0x80090317L)
+#define SEC_E_INCOMPLETE_MESSAGE            ((SECURITY_STATUS)0x80090318L)
+#define SEC_E_BUFFER_TOO_SMALL              ((SECURITY_STATUS)0x80090321L)
+#define SEC_E_WRONG_PRINCIPAL               ((SECURITY_STATUS)0x80090322L)
+#define SEC_E_DECRYPT_FAILURE               ((SECURITY_STATUS)0x80090330L)
+
+#define SECBUFFER_VERSION                   0
+#define SECBUFFER_EMPTY                     0
+#define SECBUFFER_DATA                      1
+#define SECBUFFER_TOKEN                     2
+#define SECBUFFER_PADDING                   9
+#define SECBUFFER_STREAM                    10
+
+#define SECPKG_CRED_INBOUND                 0x00000001
+#define SECPKG_CRED_OUTBOUND                0x00000002
+
+#define SECURITY_NATIVE_DREP                0x00000010
+
+#define SECQOP_WRAP_NO_ENCRYPT              0x80000001
+
+#define ISC_REQ_DELEGATE                    0x00000001
+#define ISC_REQ_MUTUAL_AUTH                 0x00000002
+#define ISC_REQ_REPLAY_DETECT               0x00000004
+#define ISC_REQ_SEQUENCE_DETECT             0x00000008
+#define ISC_REQ_CONFIDENTIALITY             0x00000010
+#define ISC_REQ_EXTENDED_ERROR              0x00004000
+#define ISC_REQ_INTEGRITY                   0x00010000
+
+#define ASC_REQ_MUTUAL_AUTH                 0x00000002
+#define ASC_REQ_REPLAY_DETECT               0x00000004
+#define ASC_REQ_SEQUENCE_DETECT             0x00000008
+#define ASC_REQ_CONFIDENTIALITY             0x00000010
+#define ASC_REQ_EXTENDED_ERROR              0x00008000
+#define ASC_REQ_INTEGRITY                   0x00020000
+
+inline DWORD GetCurrentThreadId()
+{
+    return static_cast<DWORD>(syscall(SYS_gettid));
+}
+
+#endif  // _WIN32
+
+#include <stdint.h>
+
+// Offset between the Windows epoch (1601) and the Unix epoch (1970) in
+// milliseconds.
+const int64_t c_windowsEpochOffsetMs = 11644473600000LL;
+
+inline int64_t TimeStampToUnixMs(const TimeStamp& timeStamp)
+{
+    uint64_t ticks = (static_cast<uint64_t>(static_cast<uint32_t>(timeStamp.HighPart)) << 32)
+        | static_cast<uint32_t>(timeStamp.LowPart);
+    return static_cast<int64_t>(ticks / 10000) - c_windowsEpochOffsetMs;
+}
+
+inline void UnixMsToTimeStamp(int64_t unixMs, TimeStamp* timeStamp)
+{
+    uint64_t ticks = static_cast<uint64_t>(unixMs + c_windowsEpochOffsetMs) * 10000;
+    timeStamp->LowPart = static_cast<uint32_t>(ticks & 0xFFFFFFFF);
+    timeStamp->HighPart = static_cast<int32_t>(ticks >> 32);
+}
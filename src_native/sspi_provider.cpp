@@ -0,0 +1,100 @@
+#include "node_version_support.h"
+#ifdef IS_SUPPORTED_NODE_VERSION
+
+#include "sspi_provider.h"
+
+#include "mock_sspi_provider.h"
+#include "replay_sspi_provider.h"
+#ifdef _WIN32
+#include "windows_sspi_provider.h"
+#endif
+#ifdef SSPI_CLIENT_HAVE_GSSAPI
+#include "gssapi_sspi_provider.h"
+#endif
+
+#include "utils.h"
+
+#include <atomic>
+#include <string.h>
+
+static SspiProvider* GetPlatformProvider()
+{
+#if defined(_WIN32)
+    return SspiProvider::GetByName(WindowsSspiProvider::c_name);
+#elif defined(SSPI_CLIENT_HAVE_GSSAPI)
+    return SspiProvider::GetByName(GssapiSspiProvider::c_name);
+#else
+    return SspiProvider::GetByName(MockSspiProvider::c_name);
+#endif
+}
+
+static std::atomic<SspiProvider*> s_defaultProvider(nullptr);
+
+// static
+SspiProvider* SspiProvider::GetDefault()
+{
+    SspiProvider* provider = s_defaultProvider.load();
+    if (provider == nullptr)
+    {
+        provider = GetPlatformProvider();
+        SspiProvider* expected = nullptr;
+        if (!s_defaultProvider.compare_exchange_strong(expected, provider))
+        {
+            provider = expected;
+        }
+    }
+
+    return provider;
+}
+
+// static
+bool SspiProvider::SetDefault(const char* name)
+{
+    SspiProvider* provider = GetByName(name);
+    if (provider == nullptr)
+    {
+        return false;
+    }
+
+    DebugLog("%d: Main event loop: SspiProvider::SetDefault: %s.\n", GetCurrentThreadId(), name);
+    s_defaultProvider.store(provider);
+    return true;
+}
+
+// static
+SspiProvider* SspiProvider::GetByName(const char* name)
+{
+    // Providers live for the lifetime of the process. Function local statics
+    // so they are only constructed if used.
+#ifdef _WIN32
+    if (strcmp(name, WindowsSspiProvider::c_name) == 0)
+    {
+        static WindowsSspiProvider s_windowsProvider;
+        return &s_windowsProvider;
+    }
+#endif
+
+#ifdef SSPI_CLIENT_HAVE_GSSAPI
+    if (strcmp(name, GssapiSspiProvider::c_name) == 0)
+    {
+        static GssapiSspiProvider s_gssapiProvider;
+        return &s_gssapiProvider;
+    }
+#endif
+
+    if (strcmp(name, MockSspiProvider::c_name) == 0)
+    {
+        static MockSspiProvider s_mockProvider;
+        return &s_mockProvider;
+    }
+
+    if (strcmp(name, ReplaySspiProvider::c_name) == 0)
+    {
+        static ReplaySspiProvider s_replayProvider;
+        return &s_replayProvider;
+    }
+
+    return nullptr;
+}
+
+#endif  // IS_SUPPORTED_NODE_VERSION
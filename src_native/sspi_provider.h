@@ -0,0 +1,116 @@
+#pragma once
+
+#include "sspi_platform.h"
+
+#include <string>
+#include <vector>
+
+// Security package as reported by a provider.
+struct SspiPackageInfo
+{
+    std::string name;
+    unsigned long maxTokenSize;
+};
+
+// Interface to the security system underneath SspiImpl. Methods mirror the
+// SSPI calls of the same name, take the same handles and buffers and return
+// the same status codes, so the Windows provider is a thin pass-through and
+// other providers only need to emulate SSPI semantics. Method names differ
+// slightly from the SSPI names as those are A/W macros on Windows.
+//
+// Providers are process-wide singletons and must be safe to call from
+// multiple worker threads at once. Individual handles are never used
+// concurrently; that's upto the caller.
+class SspiProvider
+{
+public:
+    virtual ~SspiProvider() {}
+
+    virtual const char* GetName() const = 0;
+
+    virtual SECURITY_STATUS EnumeratePackages(std::vector<SspiPackageInfo>* packages) = 0;
+
+    // principal may be nullptr to use the credentials of the logged in user.
+    virtual SECURITY_STATUS AcquireCredentials(
+        const WCHAR* principal,
+        const WCHAR* securityPackage,
+        unsigned long credentialUse,
+        CredHandle* credHandle,
+        TimeStamp* timeExpiry) = 0;
+
+    virtual SECURITY_STATUS FreeCredentials(CredHandle* credHandle) = 0;
+
+    // ctxtHandle and input are nullptr on the first call for a context.
+    virtual SECURITY_STATUS InitializeContext(
+        CredHandle* credHandle,
+        CtxtHandle* ctxtHandle,
+        const WCHAR* targetName,
+        unsigned long contextReq,
+        SecBufferDesc* input,
+        CtxtHandle* newCtxtHandle,
+        SecBufferDesc* output,
+        unsigned long* contextAttr,
+        TimeStamp* timeExpiry) = 0;
+
+    // Server side of InitializeSecurityContext. ctxtHandle is nullptr on the
+    // first call for a context.
+    virtual SECURITY_STATUS AcceptContext(
+        CredHandle* credHandle,
+        CtxtHandle* ctxtHandle,
+        SecBufferDesc* input,
+        unsigned long contextReq,
+        CtxtHandle* newCtxtHandle,
+        SecBufferDesc* output,
+        unsigned long* contextAttr,
+        TimeStamp* timeExpiry) = 0;
+
+    virtual SECURITY_STATUS CompleteToken(
+        CtxtHandle* ctxtHandle,
+        SecBufferDesc* token) = 0;
+
+    virtual SECURITY_STATUS DeleteContext(CtxtHandle* ctxtHandle) = 0;
+
+    // Message protection with an established context. QueryContextSizes is
+    // QueryContextAttributes for SECPKG_ATTR_SIZES. Messages are protected in
+    // place: data buffers are transformed where they are and the token buffer
+    // receives the signature or security trailer. seqNo is unused by the
+    // connection oriented packages we support.
+    virtual SECURITY_STATUS QueryContextSizes(
+        CtxtHandle* ctxtHandle,
+        SecPkgContext_Sizes* sizes) = 0;
+
+    virtual SECURITY_STATUS MakeSignature(
+        CtxtHandle* ctxtHandle,
+        unsigned long qop,
+        SecBufferDesc* message,
+        unsigned long seqNo) = 0;
+
+    virtual SECURITY_STATUS VerifySignature(
+        CtxtHandle* ctxtHandle,
+        SecBufferDesc* message,
+        unsigned long seqNo,
+        unsigned long* qop) = 0;
+
+    virtual SECURITY_STATUS EncryptMessage(
+        CtxtHandle* ctxtHandle,
+        unsigned long qop,
+        SecBufferDesc* message,
+        unsigned long seqNo) = 0;
+
+    virtual SECURITY_STATUS DecryptMessage(
+        CtxtHandle* ctxtHandle,
+        SecBufferDesc* message,
+        unsigned long seqNo,
+        unsigned long* qop) = 0;
+
+    // Provider used by SspiImpl instances created from here on. Each
+    // SspiImpl holds on to the provider it was created with.
+    static SspiProvider* GetDefault();
+
+    // Selects the default provider by name. Returns false if there's no
+    // provider with that name in this build.
+    static bool SetDefault(const char* name);
+
+    // Returns nullptr if there's no provider with that name in this build.
+    static SspiProvider* GetByName(const char* name);
+};
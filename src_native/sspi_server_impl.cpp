@@ -0,0 +1,240 @@
+#include "node_version_support.h"
+#ifdef IS_SUPPORTED_NODE_VERSION
+
+#include "sspi_server_impl.h"
+
+#include "sspi_impl.h"
+#include "utils.h"
+
+#include <stdio.h>
+
+SspiServerImpl::SspiServerImpl(const char* securityPackage) :
+    m_provider(SspiProvider::GetDefault()),
+    m_credential(),
+    m_securityPackage(securityPackage),
+    m_securityPackageMultiByte(),
+    m_blobBufferSize(-1),
+    m_isEstablished(false)
+{
+    DebugLog("%d: Main event loop: SspiServerImpl::SspiServerImpl: securityPackage=%s.\n",
+        GetCurrentThreadId(),
+        securityPackage);
+    SecInvalidateHandle(&m_ctxtHandle);
+}
+
+SECURITY_STATUS SspiServerImpl::AcceptNextBlob(
+    const char* inBlob,
+    int inBlobLength,
+    char** outBlob,
+    int* outBlobLength,
+    bool* isDone,
+    std::string* errorString)
+{
+    DebugLog("%d: Worker thread: SspiServerImpl::AcceptNextBlob.\n", GetCurrentThreadId());
+
+    SspiImpl::CountInBlob(inBlobLength);
+
+    errorString->assign("");
+    *outBlob = nullptr;
+    *outBlobLength = 0;
+    *isDone = false;
+
+    char errorStringLocal[c_errorStringBufferSize];
+    TimeStamp timeExpiry;
+    SECURITY_STATUS securityStatus;
+
+    if (!m_credential)
+    {
+        // Unknown packages fail in AcquireCredentials below. Enumerated once
+        // per process, not per server.
+        m_blobBufferSize = SspiImpl::FindEnumeratedMaxTokenSize(m_securityPackage);
+
+        securityStatus = ConvertUtf8ToMultiByte(
+            "securityPackage",
+            m_securityPackage.c_str(),
+            &m_securityPackageMultiByte,
+            errorStringLocal,
+            c_errorStringBufferSize);
+
+        if (securityStatus != S_OK)
+        {
+            errorString->assign(errorStringLocal);
+            return securityStatus;
+        }
+
+        securityStatus = CredentialCache::GetInstance()->Acquire(
+            m_provider,
+            nullptr,    // Principal - logged in user.
+            m_securityPackageMultiByte.get(),   // Security package to use.
+            SECPKG_CRED_INBOUND,    // Server credential, validates client tokens.
+            &m_credential);     // Shared credential handle.
+
+        if (securityStatus != SEC_E_OK)
+        {
+            snprintf(
+                errorStringLocal,
+                c_errorStringBufferSize,
+                "AcquireCredentialsHandleW failed with error code: 0x%X.",
+                securityStatus);
+
+            errorString->assign(errorStringLocal);
+            return securityStatus;
+        }
+    }
+
+    SecBuffer inSecBuffer;
+    inSecBuffer.BufferType = SECBUFFER_TOKEN;
+    inSecBuffer.cbBuffer = inBlobLength;
+    inSecBuffer.pvBuffer = const_cast<char*>(inBlob);
+
+    SecBufferDesc inSecBufferDesc;
+    inSecBufferDesc.ulVersion = SECBUFFER_VERSION;
+    inSecBufferDesc.pBuffers = &inSecBuffer;
+    inSecBufferDesc.cBuffers = 1;
+
+    SecBuffer outSecBuffer;
+    outSecBuffer.BufferType = SECBUFFER_TOKEN;
+
+    SecBufferDesc outSecBufferDesc;
+    outSecBufferDesc.ulVersion = SECBUFFER_VERSION;
+    outSecBufferDesc.cBuffers = 1;
+    outSecBufferDesc.pBuffers = &outSecBuffer;
+
+    unsigned long contextAttr;
+
+    // Lifetime owned by caller. See comments in the header file for details.
+    *outBlob = SspiImpl::AllocateBlob(m_blobBufferSize);
+
+    while (true)
+    {
+        outSecBuffer.pvBuffer = *outBlob;
+        outSecBuffer.cbBuffer = m_blobBufferSize;
+
+        TraceCallTimer traceTimer;
+        securityStatus = m_provider->AcceptContext(
+            m_credential->GetHandle(),      // Credential handle.
+            SecIsValidHandle(&m_ctxtHandle) ? &m_ctxtHandle : nullptr,      // Context handle - input.
+            &inSecBufferDesc,   // Input buffer, has data from client.
+            ASC_REQ_MUTUAL_AUTH | ASC_REQ_INTEGRITY | ASC_REQ_CONFIDENTIALITY
+                | ASC_REQ_REPLAY_DETECT | ASC_REQ_SEQUENCE_DETECT | ASC_REQ_EXTENDED_ERROR,
+                        // Context bit flags.
+            &m_ctxtHandle,      // Context handle - output.
+            &outSecBufferDesc,  // Output buffer, data to send to client.
+            &contextAttr,       // Context attributes - unused.
+            &timeExpiry);
+        traceTimer.Complete(c_traceCallAcceptContext, securityStatus);
+
+        // Same as SspiImpl::GetNextBlob, grow if cbMaxToken was too small.
+        if (securityStatus != SEC_E_BUFFER_TOO_SMALL || m_blobBufferSize >= SspiImpl::c_maxBlobBufferSize)
+        {
+            break;
+        }
+
+        SspiImpl::FreeBlob(*outBlob);
+        m_blobBufferSize = SspiImpl::GrowBlobBufferSize(m_blobBufferSize);
+        *outBlob = SspiImpl::AllocateBlob(m_blobBufferSize);
+    }
+
+    if (securityStatus != SEC_E_OK
+        && securityStatus != SEC_I_CONTINUE_NEEDED
+        && securityStatus != SEC_I_COMPLETE_AND_CONTINUE
+        && securityStatus != SEC_I_COMPLETE_NEEDED)
+    {
+        snprintf(
+            errorStringLocal,
+            c_errorStringBufferSize,
+            "AcceptSecurityContext failed with error code: 0x%X.",
+            securityStatus);
+
+        SspiImpl::FreeBlob(*outBlob);
+        *outBlob = nullptr;
+
+        errorString->assign(errorStringLocal);
+        return securityStatus;
+    }
+
+    *isDone = securityStatus != SEC_I_CONTINUE_NEEDED
+        && securityStatus != SEC_I_COMPLETE_AND_CONTINUE;
+
+    if (securityStatus == SEC_I_COMPLETE_NEEDED
+        || securityStatus == SEC_I_COMPLETE_AND_CONTINUE)
+    {
+        TraceCallTimer traceTimer;
+        securityStatus = m_provider->CompleteToken(&m_ctxtHandle, &outSecBufferDesc);
+        traceTimer.Complete(c_traceCallCompleteToken, securityStatus);
+        if (securityStatus != SEC_E_OK)
+        {
+            snprintf(
+                errorStringLocal,
+                c_errorStringBufferSize,
+                "CompleteAuthToken failed with error code: 0x%X.",
+                securityStatus);
+
+            SspiImpl::FreeBlob(*outBlob);
+            *outBlob = nullptr;
+
+            errorString->assign(errorStringLocal);
+            return securityStatus;
+        }
+    }
+
+    *outBlobLength = outSecBuffer.cbBuffer;
+    *outBlob = SspiImpl::ShrinkBlob(*outBlob, *outBlobLength, m_blobBufferSize);
+    SspiImpl::CountOutBlob(*outBlobLength);
+    m_isEstablished = *isDone;
+
+    return 0;
+}
+
+SECURITY_STATUS SspiServerImpl::GetMessageSizes(SecPkgContext_Sizes* sizes, std::string* errorString)
+{
+    return MessageBatch::QuerySizes(m_provider, m_isEstablished ? &m_ctxtHandle : nullptr, sizes, errorString);
+}
+
+SECURITY_STATUS SspiServerImpl::ProcessMessages(
+    MessageOperation operation,
+    MessageBatch* batch,
+    int* processedCount,
+    std::string* errorString)
+{
+    return batch->Process(
+        m_provider,
+        m_isEstablished ? &m_ctxtHandle : nullptr,
+        operation,
+        processedCount,
+        errorString);
+}
+
+void SspiServerImpl::DeleteCredHandle()
+{
+    // Freed by the CredentialCache once no one else uses it.
+    m_credential.reset();
+}
+
+void SspiServerImpl::DeleteCtxtHandle()
+{
+    if (SecIsValidHandle(&m_ctxtHandle))
+    {
+        TraceCallTimer traceTimer;
+        SECURITY_STATUS securityStatus = m_provider->DeleteContext(&m_ctxtHandle);
+        traceTimer.Complete(c_traceCallDeleteContext, securityStatus);
+        if (securityStatus != SEC_E_OK)
+        {
+            DebugLog(
+                "%d: DeleteSecurityContext failed with error code: %ld.\n",
+                GetCurrentThreadId(),
+                securityStatus);
+        }
+
+        SecInvalidateHandle(&m_ctxtHandle);
+    }
+}
+
+SspiServerImpl::~SspiServerImpl()
+{
+    DebugLog("%d: Garbage Collection Thread: SspiServerImpl::~SspiServerImpl.\n", GetCurrentThreadId());
+    DeleteCtxtHandle();
+    DeleteCredHandle();
+}
+
+#endif  // IS_SUPPORTED_NODE_VERSION
@@ -0,0 +1,65 @@
+#pragma once
+
+#include "credential_cache.h"
+#include "message_batch.h"
+#include "sspi_platform.h"
+#include "sspi_provider.h"
+
+#include <memory>
+#include <string>
+
+// Server side counterpart of SspiImpl, accepts the blobs generated by
+// SspiImpl::GetNextBlob. Used for loopback testing and load generation
+// against the default provider. Same threading rules as SspiImpl: no V8 or
+// libuv dependencies, runs in worker threads, caller ensures thread-safety.
+class SspiServerImpl
+{
+public:
+    explicit SspiServerImpl(const char* securityPackage);
+
+    // Callee creates the outBlob. Caller deletes it by invoking
+    // SspiImpl::FreeBlob(). outBlob is empty when the final client blob is
+    // accepted without anything to send back.
+    SECURITY_STATUS AcceptNextBlob(
+        const char* inBlob,
+        int inBlobLength,
+        char** outBlob,
+        int* outBlobLength,
+        bool* isDone,
+        std::string* errorString);
+
+    // Same as SspiImpl, once AcceptNextBlob has reported isDone.
+    SECURITY_STATUS GetMessageSizes(SecPkgContext_Sizes* sizes, std::string* errorString);
+    SECURITY_STATUS ProcessMessages(
+        MessageOperation operation,
+        MessageBatch* batch,
+        int* processedCount,
+        std::string* errorString);
+
+    ~SspiServerImpl();
+
+private:
+    // Not implemented.
+    SspiServerImpl(const SspiServerImpl&);
+    SspiServerImpl& operator=(const SspiServerImpl&);
+
+    void DeleteCredHandle();
+    void DeleteCtxtHandle();
+
+    static const int c_errorStringBufferSize = 256;
+
+    SspiProvider* m_provider;
+
+    // Shared with other instances through the CredentialCache.
+    std::shared_ptr<CachedCredential> m_credential;
+    CtxtHandle m_ctxtHandle;
+
+    std::string m_securityPackage;
+    std::unique_ptr<WCHAR[]> m_securityPackageMultiByte;
+
+    // Output buffer size, starts at cbMaxToken of the package.
+    int m_blobBufferSize;
+
+    // AcceptNextBlob reported isDone.
+    bool m_isEstablished;
+};
@@ -0,0 +1,182 @@
+#include "node_version_support.h"
+#ifdef IS_SUPPORTED_NODE_VERSION
+
+#include "task_scheduler.h"
+
+#include <algorithm>
+
+namespace
+{
+    // Weight of a tenant's last completed task in its average running time.
+    const double c_averageRunWeight = 0.125;
+}
+
+TaskScheduler::TaskScheduler() :
+    m_policy(c_schedulingFair),
+    m_tenantWeights(),
+    m_tenants(),
+    m_virtualTimeUs(0),
+    m_size(0),
+    m_sequence(0),
+    m_deadlineMisses(0)
+{
+}
+
+void TaskScheduler::Configure(SchedulingPolicy policy, const std::map<std::string, int>& tenantWeights)
+{
+    m_policy = policy;
+    m_tenantWeights = tenantWeights;
+    for (auto it = m_tenants.begin(); it != m_tenants.end(); ++it)
+    {
+        it->second.weight = GetWeight(it->first);
+    }
+}
+
+void TaskScheduler::Push(
+    const std::function<void()>& task,
+    const std::string& tenant,
+    TimePoint queuedAt,
+    TimePoint deadline)
+{
+    // FIFO is a single tenant whose tasks all share a deadline, so they run
+    // in queue order.
+    bool isFifo = m_policy == c_schedulingFifo;
+    std::string key = isFifo ? std::string() : tenant;
+
+    auto it = m_tenants.find(key);
+    if (it == m_tenants.end())
+    {
+        Tenant newTenant;
+        newTenant.weight = GetWeight(key);
+        newTenant.running = 0;
+        newTenant.virtualServiceUs = m_virtualTimeUs;
+        newTenant.averageRunUs = c_initialRunUs;
+        it = m_tenants.insert(std::make_pair(key, newTenant)).first;
+    }
+    else if (it->second.queue.empty())
+    {
+        // Idle time isn't banked.
+        it->second.virtualServiceUs = std::max(it->second.virtualServiceUs, m_virtualTimeUs);
+    }
+
+    Entry entry;
+    entry.task = task;
+    entry.queuedAt = queuedAt;
+    entry.deadline = deadline;
+    entry.orderBy = isFifo ? TimePoint() : deadline;
+    entry.sequence = m_sequence++;
+
+    std::vector<Entry>& queue = it->second.queue;
+    queue.push_back(entry);
+    std::push_heap(queue.begin(), queue.end(), IsLater);
+    m_size++;
+}
+
+void TaskScheduler::Pop(TimePoint now, ScheduledTask* scheduledTask)
+{
+    auto chosen = m_tenants.end();
+    for (auto it = m_tenants.begin(); it != m_tenants.end(); ++it)
+    {
+        if (it->second.queue.empty())
+        {
+            continue;
+        }
+
+        if (chosen == m_tenants.end()
+            || it->second.virtualServiceUs < chosen->second.virtualServiceUs
+            || (it->second.virtualServiceUs == chosen->second.virtualServiceUs
+                && IsLater(chosen->second.queue.front(), it->second.queue.front())))
+        {
+            chosen = it;
+        }
+    }
+
+    Tenant& tenant = chosen->second;
+    m_virtualTimeUs = std::max(m_virtualTimeUs, tenant.virtualServiceUs);
+
+    std::pop_heap(tenant.queue.begin(), tenant.queue.end(), IsLater);
+    Entry& entry = tenant.queue.back();
+    scheduledTask->task.swap(entry.task);
+    scheduledTask->tenant = chosen->first;
+    scheduledTask->queuedAt = entry.queuedAt;
+    scheduledTask->deadline = entry.deadline;
+    tenant.queue.pop_back();
+    m_size--;
+
+    if (now > scheduledTask->deadline)
+    {
+        m_deadlineMisses++;
+    }
+
+    scheduledTask->chargedUs = tenant.averageRunUs / tenant.weight;
+    tenant.virtualServiceUs += scheduledTask->chargedUs;
+    tenant.running++;
+}
+
+void TaskScheduler::Complete(const ScheduledTask& scheduledTask, uint64_t runUs)
+{
+    auto it = m_tenants.find(scheduledTask.tenant);
+    if (it == m_tenants.end())
+    {
+        return;
+    }
+
+    Tenant& tenant = it->second;
+    tenant.running--;
+    tenant.virtualServiceUs += static_cast<double>(runUs) / tenant.weight - scheduledTask.chargedUs;
+    tenant.averageRunUs += c_averageRunWeight * (static_cast<double>(runUs) - tenant.averageRunUs);
+    ForgetIfIdle(it);
+}
+
+bool TaskScheduler::IsEmpty() const
+{
+    return m_size == 0;
+}
+
+size_t TaskScheduler::GetSize() const
+{
+    return m_size;
+}
+
+size_t TaskScheduler::GetTenantCount() const
+{
+    return m_tenants.size();
+}
+
+uint64_t TaskScheduler::GetDeadlineMisses() const
+{
+    return m_deadlineMisses;
+}
+
+void TaskScheduler::ResetDeadlineMisses()
+{
+    m_deadlineMisses = 0;
+}
+
+// static
+// Heap comparison, the top is the earliest deadline.
+bool TaskScheduler::IsLater(const Entry& left, const Entry& right)
+{
+    if (left.orderBy != right.orderBy)
+    {
+        return left.orderBy > right.orderBy;
+    }
+
+    return left.sequence > right.sequence;
+}
+
+int TaskScheduler::GetWeight(const std::string& tenant) const
+{
+    auto it = m_tenantWeights.find(tenant);
+    return it != m_tenantWeights.end() && it->second > 0 ? it->second : 1;
+}
+
+void TaskScheduler::ForgetIfIdle(std::map<std::string, Tenant>::iterator it)
+{
+    if (it->second.queue.empty() && it->second.running == 0)
+    {
+        m_tenants.erase(it);
+    }
+}
+
+#endif  // IS_SUPPORTED_NODE_VERSION
@@ -0,0 +1,124 @@
+#pragma once
+
+#include <stdint.h>
+
+#include <chrono>
+#include <functional>
+#include <map>
+#include <string>
+#include <vector>
+
+enum SchedulingPolicy
+{
+    // Tasks run in the order they were queued.
+    c_schedulingFifo = 0,
+
+    // Threads are shared between tenants in proportion to their weights,
+    // and each tenant's tasks run earliest deadline first.
+    c_schedulingFair = 1
+};
+
+// A task taken from TaskScheduler, to be run and then handed back to
+// Complete.
+struct ScheduledTask
+{
+    std::function<void()> task;
+    std::string tenant;
+    std::chrono::steady_clock::time_point queuedAt;
+    std::chrono::steady_clock::time_point deadline;
+
+    // Service charged to the tenant ahead of running the task, settled by
+    // Complete.
+    double chargedUs;
+};
+
+// Order in which WorkerPool runs queued tasks.
+//
+// Under c_schedulingFair every tenant accrues virtual service, the time its
+// tasks ran divided by its weight, and the next task comes from the tenant
+// with the least. A tenant starting to queue work again starts at the least
+// of the others, so idle time isn't banked. Running time isn't known until a
+// task completes, so a tenant is charged its average on dispatch and the
+// difference on completion; a tenant can't grab every thread with a burst.
+// Within a tenant, tasks run earliest deadline first, ties in queue order.
+//
+// Tenants are SPNs or caller keys, a handful per process, so choosing one is
+// a scan. Tenants with nothing queued or running are forgotten.
+//
+// Not thread-safe, WorkerPool calls it with its mutex held. No clock of its
+// own, so simulations can drive it with made up times.
+class TaskScheduler
+{
+public:
+    typedef std::chrono::steady_clock::time_point TimePoint;
+
+    TaskScheduler();
+
+    // Takes effect for tasks queued afterwards. Tenants missing from
+    // tenantWeights have weight 1.
+    void Configure(SchedulingPolicy policy, const std::map<std::string, int>& tenantWeights);
+
+    void Push(
+        const std::function<void()>& task,
+        const std::string& tenant,
+        TimePoint queuedAt,
+        TimePoint deadline);
+
+    // Must not be empty. Counts a deadline miss if now is past the deadline
+    // of the task taken.
+    void Pop(TimePoint now, ScheduledTask* scheduledTask);
+
+    // Settles the charge for a task taken with Pop that ran for runUs.
+    void Complete(const ScheduledTask& scheduledTask, uint64_t runUs);
+
+    bool IsEmpty() const;
+    size_t GetSize() const;
+
+    // Tenants with tasks queued or running.
+    size_t GetTenantCount() const;
+
+    uint64_t GetDeadlineMisses() const;
+    void ResetDeadlineMisses();
+
+    // Average service charged on dispatch until a tenant's first task
+    // completes.
+    static const int c_initialRunUs = 1000;
+
+private:
+    struct Entry
+    {
+        std::function<void()> task;
+        TimePoint queuedAt;
+        TimePoint deadline;
+
+        // The deadline, or the same for all tasks under c_schedulingFifo.
+        TimePoint orderBy;
+        uint64_t sequence;
+    };
+
+    struct Tenant
+    {
+        // Heap ordered by deadline, then sequence.
+        std::vector<Entry> queue;
+        int weight;
+        int running;
+        double virtualServiceUs;
+        double averageRunUs;
+    };
+
+    static bool IsLater(const Entry& left, const Entry& right);
+
+    int GetWeight(const std::string& tenant) const;
+    void ForgetIfIdle(std::map<std::string, Tenant>::iterator it);
+
+    SchedulingPolicy m_policy;
+    std::map<std::string, int> m_tenantWeights;
+    std::map<std::string, Tenant> m_tenants;
+
+    // Virtual service of the last tenant chosen, never decreases.
+    double m_virtualTimeUs;
+
+    size_t m_size;
+    uint64_t m_sequence;
+    uint64_t m_deadlineMisses;
+};
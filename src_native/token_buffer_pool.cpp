@@ -0,0 +1,292 @@
+#include "node_version_support.h"
+#ifdef IS_SUPPORTED_NODE_VERSION
+
+#include "token_buffer_pool.h"
+
+#include "utils.h"
+
+namespace
+{
+    // Precedes every buffer, keeps the buffer 16 byte aligned.
+    struct BlockHeader
+    {
+        uint64_t capacity;
+        int32_t sizeClass;
+        uint32_t tag;
+
+        // Thread cache of the thread that allocated the buffer. Only compared,
+        // never dereferenced, the thread may be gone by the time it's freed.
+        uint64_t owner;
+        uint64_t reserved;
+    };
+
+    const uint32_t c_blockTag = 0x4D544250;    // 'MTBP'
+
+    BlockHeader* GetHeader(char* buffer)
+    {
+        return reinterpret_cast<BlockHeader*>(buffer - sizeof(BlockHeader));
+    }
+
+    char* GetBuffer(char* block)
+    {
+        return block + sizeof(BlockHeader);
+    }
+}
+
+// Buffers cached by one thread, handed back to the global freelist when the
+// thread exits. Only buffers the thread allocated itself are cached, those
+// freed by other threads go to the global freelist where any thread can reuse
+// them.
+struct TokenBufferPool::ThreadCache
+{
+    std::vector<char*> freeLists[TokenBufferPool::c_numSizeClasses];
+
+    ~ThreadCache()
+    {
+        TokenBufferPool* pool = TokenBufferPool::GetInstance();
+        for (int sizeClass = 0; sizeClass < TokenBufferPool::c_numSizeClasses; sizeClass++)
+        {
+            for (size_t i = 0; i < freeLists[sizeClass].size(); i++)
+            {
+                pool->ReleaseToGlobal(sizeClass, freeLists[sizeClass][i]);
+            }
+        }
+    }
+};
+
+// static
+TokenBufferPool* TokenBufferPool::GetInstance()
+{
+    // Intentionally leaked. Thread caches and V8 free callbacks may return
+    // buffers while static destructors run at process exit.
+    static TokenBufferPool* s_tokenBufferPool = new TokenBufferPool();
+    return s_tokenBufferPool;
+}
+
+TokenBufferPool::TokenBufferPool() :
+    m_enabled(true),
+    m_mutex(),
+    m_globalRetainedBytes(0),
+    m_allocations(0),
+    m_threadCacheHits(0),
+    m_globalHits(0),
+    m_heapAllocations(0),
+    m_oversizeAllocations(0),
+    m_frees(0),
+    m_heapFrees(0),
+    m_bytesInUse(0),
+    m_bytesRetained(0)
+{
+}
+
+TokenBufferPool::~TokenBufferPool()
+{
+}
+
+// static
+TokenBufferPool::ThreadCache* TokenBufferPool::GetThreadCache()
+{
+    static thread_local ThreadCache t_threadCache;
+    return &t_threadCache;
+}
+
+// static
+uint64_t TokenBufferPool::GetOwner()
+{
+    return static_cast<uint64_t>(reinterpret_cast<uintptr_t>(GetThreadCache()));
+}
+
+// static
+int TokenBufferPool::GetSizeClass(size_t size)
+{
+    for (int sizeClass = 0; sizeClass < c_numSizeClasses; sizeClass++)
+    {
+        if (size <= GetSizeClassCapacity(sizeClass))
+        {
+            return sizeClass;
+        }
+    }
+
+    return c_oversizeClass;
+}
+
+// static
+size_t TokenBufferPool::GetSizeClassCapacity(int sizeClass)
+{
+    return static_cast<size_t>(1) << (c_minSizeClassShift + sizeClass);
+}
+
+char* TokenBufferPool::Allocate(size_t size)
+{
+    m_allocations++;
+
+    int sizeClass = GetSizeClass(size);
+    if (sizeClass != c_oversizeClass && m_enabled.load())
+    {
+        size_t capacity = GetSizeClassCapacity(sizeClass);
+        std::vector<char*>& threadFreeList = GetThreadCache()->freeLists[sizeClass];
+        char* block = nullptr;
+
+        if (!threadFreeList.empty())
+        {
+            block = threadFreeList.back();
+            threadFreeList.pop_back();
+            m_threadCacheHits++;
+        }
+        else
+        {
+            std::lock_guard<std::mutex> lock(m_mutex);
+            std::vector<char*>& freeList = m_freeLists[sizeClass];
+            if (!freeList.empty())
+            {
+                block = freeList.back();
+                freeList.pop_back();
+                m_globalRetainedBytes -= capacity;
+                m_globalHits++;
+            }
+        }
+
+        if (block != nullptr)
+        {
+            m_bytesRetained -= capacity;
+            m_bytesInUse += capacity;
+            reinterpret_cast<BlockHeader*>(block)->owner = GetOwner();
+            return GetBuffer(block);
+        }
+    }
+
+    size_t capacity = sizeClass != c_oversizeClass ? GetSizeClassCapacity(sizeClass) : size;
+    if (sizeClass == c_oversizeClass)
+    {
+        m_oversizeAllocations++;
+    }
+
+    m_heapAllocations++;
+    m_bytesInUse += capacity;
+
+    char* block = new char[sizeof(BlockHeader) + capacity];
+    BlockHeader* header = reinterpret_cast<BlockHeader*>(block);
+    header->capacity = capacity;
+    header->sizeClass = sizeClass;
+    header->tag = c_blockTag;
+    header->owner = GetOwner();
+    header->reserved = 0;
+    return GetBuffer(block);
+}
+
+void TokenBufferPool::Free(char* buffer)
+{
+    if (buffer == nullptr)
+    {
+        return;
+    }
+
+    m_frees++;
+
+    BlockHeader* header = GetHeader(buffer);
+    char* block = reinterpret_cast<char*>(header);
+    m_bytesInUse -= header->capacity;
+
+    if (header->sizeClass == c_oversizeClass || !m_enabled.load())
+    {
+        DeleteBlock(block);
+        return;
+    }
+
+    m_bytesRetained += header->capacity;
+
+    // Buffers handed to JavaScript are allocated on a worker thread and freed
+    // on the main thread. Caching those here would strand them where they're
+    // never allocated from.
+    std::vector<char*>& threadFreeList = GetThreadCache()->freeLists[header->sizeClass];
+    if (header->owner == GetOwner() && threadFreeList.size() < c_threadCacheBlocksPerClass)
+    {
+        threadFreeList.push_back(block);
+        return;
+    }
+
+    ReleaseToGlobal(header->sizeClass, block);
+}
+
+void TokenBufferPool::ReleaseToGlobal(int sizeClass, char* block)
+{
+    size_t capacity = GetSizeClassCapacity(sizeClass);
+
+    {
+        std::lock_guard<std::mutex> lock(m_mutex);
+        if (m_globalRetainedBytes + capacity <= c_maxGlobalRetainedBytes)
+        {
+            m_freeLists[sizeClass].push_back(block);
+            m_globalRetainedBytes += capacity;
+            return;
+        }
+    }
+
+    m_bytesRetained -= capacity;
+    DeleteBlock(block);
+}
+
+void TokenBufferPool::DeleteBlock(char* block)
+{
+    m_heapFrees++;
+    delete[] block;
+}
+
+void TokenBufferPool::SetEnabled(bool enable)
+{
+    DebugLog("%d: TokenBufferPool::SetEnabled: %d.\n", GetCurrentThreadId(), enable);
+    m_enabled.store(enable);
+    if (!enable)
+    {
+        Trim();
+    }
+}
+
+void TokenBufferPool::Trim()
+{
+    std::vector<char*> blocks;
+
+    {
+        std::lock_guard<std::mutex> lock(m_mutex);
+        for (int sizeClass = 0; sizeClass < c_numSizeClasses; sizeClass++)
+        {
+            blocks.insert(blocks.end(), m_freeLists[sizeClass].begin(), m_freeLists[sizeClass].end());
+            m_freeLists[sizeClass].clear();
+        }
+
+        m_bytesRetained -= m_globalRetainedBytes;
+        m_globalRetainedBytes = 0;
+    }
+
+    for (size_t i = 0; i < blocks.size(); i++)
+    {
+        DeleteBlock(blocks[i]);
+    }
+}
+
+void TokenBufferPool::GetStats(TokenBufferPoolStats* stats)
+{
+    stats->allocations = m_allocations.load();
+    stats->threadCacheHits = m_threadCacheHits.load();
+    stats->globalHits = m_globalHits.load();
+    stats->heapAllocations = m_heapAllocations.load();
+    stats->oversizeAllocations = m_oversizeAllocations.load();
+    stats->frees = m_frees.load();
+    stats->heapFrees = m_heapFrees.load();
+    stats->bytesInUse = static_cast<uint64_t>(m_bytesInUse.load());
+    stats->bytesRetained = static_cast<uint64_t>(m_bytesRetained.load());
+}
+
+// Gauges, bytes in use and retained, are not reset.
+void TokenBufferPool::ResetStats()
+{
+    m_allocations = 0;
+    m_threadCacheHits = 0;
+    m_globalHits = 0;
+    m_heapAllocations = 0;
+    m_oversizeAllocations = 0;
+    m_frees = 0;
+    m_heapFrees = 0;
+}
+
+#endif  // IS_SUPPORTED_NODE_VERSION
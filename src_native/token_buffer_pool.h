@@ -0,0 +1,93 @@
+#pragma once
+
+#include <stddef.h>
+#include <stdint.h>
+
+#include <atomic>
+#include <mutex>
+#include <vector>
+
+struct TokenBufferPoolStats
+{
+    uint64_t allocations;
+    uint64_t threadCacheHits;
+    uint64_t globalHits;
+    uint64_t heapAllocations;
+    uint64_t oversizeAllocations;
+    uint64_t frees;
+    uint64_t heapFrees;
+    uint64_t bytesInUse;
+    uint64_t bytesRetained;
+};
+
+// Size-classed pool for the token buffers handed to JavaScript. Buffers are
+// allocated on worker threads and freed on the main thread when V8 collects
+// them, so they go back to a global freelist bounded by bytes retained. Each
+// thread also keeps a small cache per size class for buffers it allocates and
+// frees itself, such as the ones freed on failures, overflowing into the
+// global freelist. Anything past the bound, and any request larger than the
+// largest size class, goes straight to the heap.
+//
+// Thread-safe. Buffers may be freed on any thread.
+class TokenBufferPool
+{
+public:
+    static TokenBufferPool* GetInstance();
+
+    char* Allocate(size_t size);
+    void Free(char* buffer);
+
+    // When disabled every allocation goes to the heap, for comparison in
+    // benchmarks. Buffers allocated either way may be freed either way.
+    void SetEnabled(bool enable);
+
+    // Releases the buffers in the global freelist to the heap.
+    void Trim();
+
+    void GetStats(TokenBufferPoolStats* stats);
+    void ResetStats();
+
+private:
+    TokenBufferPool();
+
+    // Not implemented. Never destroyed, see GetInstance.
+    TokenBufferPool(const TokenBufferPool&);
+    TokenBufferPool& operator=(const TokenBufferPool&);
+    ~TokenBufferPool();
+
+    struct ThreadCache;
+    friend struct ThreadCache;
+
+    static ThreadCache* GetThreadCache();
+    static uint64_t GetOwner();
+    static int GetSizeClass(size_t size);
+    static size_t GetSizeClassCapacity(int sizeClass);
+
+    void ReleaseToGlobal(int sizeClass, char* block);
+    void DeleteBlock(char* block);
+
+    // Size classes are powers of two from 256 bytes to 64KB, which covers
+    // cbMaxToken of all the supported packages.
+    static const int c_minSizeClassShift = 8;
+    static const int c_numSizeClasses = 9;
+    static const int c_oversizeClass = -1;
+
+    static const size_t c_threadCacheBlocksPerClass = 8;
+    static const size_t c_maxGlobalRetainedBytes = 8 * 1024 * 1024;
+
+    std::atomic<bool> m_enabled;
+
+    std::mutex m_mutex;
+    std::vector<char*> m_freeLists[c_numSizeClasses];
+    size_t m_globalRetainedBytes;
+
+    std::atomic<uint64_t> m_allocations;
+    std::atomic<uint64_t> m_threadCacheHits;
+    std::atomic<uint64_t> m_globalHits;
+    std::atomic<uint64_t> m_heapAllocations;
+    std::atomic<uint64_t> m_oversizeAllocations;
+    std::atomic<uint64_t> m_frees;
+    std::atomic<uint64_t> m_heapFrees;
+    std::atomic<int64_t> m_bytesInUse;
+    std::atomic<int64_t> m_bytesRetained;
+};
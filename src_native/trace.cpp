@@ -0,0 +1,408 @@
+#include "node_version_support.h"
+#ifdef IS_SUPPORTED_NODE_VERSION
+
+#include "trace.h"
+
+#include <algorithm>
+#include <condition_variable>
+#include <mutex>
+#include <stdarg.h>
+#include <stdio.h>
+#include <string.h>
+#include <thread>
+
+// Single producer, the owning thread, and single consumer, whoever holds the
+// drain mutex. head and tail only ever grow; the record for a position is at
+// position % c_ringSize.
+struct TraceRing
+{
+    TraceRecord records[Tracer::c_ringSize];
+    std::atomic<uint64_t> head;
+    std::atomic<uint64_t> tail;
+    std::atomic<uint64_t> dropped;
+
+    uint16_t id;
+
+    // Guarded by the registry mutex. Rings of threads that exited are handed
+    // to new threads, worker pool threads come and go.
+    bool isOwned;
+};
+
+struct TraceFileSink
+{
+    FILE* file;
+    int flushIntervalMs;
+
+    std::mutex mutex;
+    std::condition_variable stateChanged;
+    bool isStopRequested;
+    bool isStopped;
+};
+
+namespace
+{
+    struct Registry
+    {
+        Registry()
+            : drained(0),
+            fileSink(nullptr)
+        {
+        }
+
+        std::mutex mutex;
+        std::vector<TraceRing*> rings;
+
+        std::mutex drainMutex;
+        uint64_t drained;
+
+        std::mutex fileSinkMutex;
+        TraceFileSink* fileSink;
+    };
+
+    Registry* GetRegistry()
+    {
+        // Intentionally leaked, along with the rings. Detached threads may
+        // record while static destructors run at process exit.
+        static Registry* s_registry = new Registry();
+        return s_registry;
+    }
+
+    const char* c_callNames[c_traceCallCount] = {
+        "",
+        "EnumeratePackages",
+        "AcquireCredentials",
+        "FreeCredentials",
+        "InitializeContext",
+        "AcceptContext",
+        "CompleteToken",
+        "DeleteContext",
+        "QueryContextSizes",
+        "MakeSignature",
+        "VerifySignature",
+        "EncryptMessage",
+        "DecryptMessage"
+    };
+
+    uint64_t GetUnixTimeUs()
+    {
+        return static_cast<uint64_t>(std::chrono::duration_cast<std::chrono::microseconds>(
+            std::chrono::system_clock::now().time_since_epoch()).count());
+    }
+
+    bool CompareTimestamps(const TraceRecord& a, const TraceRecord& b)
+    {
+        return a.timestampUs < b.timestampUs;
+    }
+
+    // Releases the thread's ring for reuse when the thread exits.
+    struct RingOwner
+    {
+        RingOwner()
+            : ring(nullptr)
+        {
+        }
+
+        ~RingOwner()
+        {
+            if (ring != nullptr)
+            {
+                std::lock_guard<std::mutex> lock(GetRegistry()->mutex);
+                ring->isOwned = false;
+            }
+        }
+
+        TraceRing* ring;
+    };
+}
+
+std::atomic<int> Tracer::s_level(Tracer::c_levelOff);
+
+// static
+void Tracer::SetLevel(int level)
+{
+    s_level.store(level);
+}
+
+// static
+TraceRing* Tracer::GetThreadRing()
+{
+    static thread_local RingOwner t_ringOwner;
+    if (t_ringOwner.ring != nullptr)
+    {
+        return t_ringOwner.ring;
+    }
+
+    Registry* registry = GetRegistry();
+    std::lock_guard<std::mutex> lock(registry->mutex);
+    for (size_t i = 0; i < registry->rings.size(); i++)
+    {
+        if (!registry->rings[i]->isOwned)
+        {
+            t_ringOwner.ring = registry->rings[i];
+            break;
+        }
+    }
+
+    if (t_ringOwner.ring == nullptr)
+    {
+        TraceRing* ring = new TraceRing();
+        ring->head = 0;
+        ring->tail = 0;
+        ring->dropped = 0;
+        ring->id = static_cast<uint16_t>(registry->rings.size());
+        registry->rings.push_back(ring);
+        t_ringOwner.ring = ring;
+    }
+
+    t_ringOwner.ring->isOwned = true;
+    return t_ringOwner.ring;
+}
+
+// static
+void Tracer::Record(const TraceRecord& record)
+{
+    TraceRing* ring = GetThreadRing();
+
+    uint64_t head = ring->head.load(std::memory_order_relaxed);
+    if (head - ring->tail.load(std::memory_order_acquire) >= static_cast<uint64_t>(c_ringSize))
+    {
+        ring->dropped.fetch_add(1, std::memory_order_relaxed);
+        return;
+    }
+
+    TraceRecord& slot = ring->records[head % c_ringSize];
+    slot = record;
+    slot.workerId = ring->id;
+    ring->head.store(head + 1, std::memory_order_release);
+}
+
+// static
+void Tracer::Message(const char* format, ...)
+{
+    TraceRecord record;
+    record.timestampUs = GetUnixTimeUs();
+    record.threadId = GetCurrentThreadId();
+    record.type = c_typeMessage;
+    record.call = c_traceCallNone;
+    record.status = 0;
+    record.durationUs = 0;
+
+    va_list args;
+    va_start(args, format);
+    int length = vsnprintf(record.message, sizeof(record.message), format, args);
+    va_end(args);
+
+    // DebugLog messages end with a newline, records are lines already.
+    if (length > static_cast<int>(sizeof(record.message)) - 1)
+    {
+        length = static_cast<int>(sizeof(record.message)) - 1;
+    }
+
+    while (length > 0 && record.message[length - 1] == '\n')
+    {
+        record.message[--length] = '\0';
+    }
+
+    Record(record);
+}
+
+// static
+void Tracer::Call(TraceCall call, SECURITY_STATUS status, uint32_t durationUs)
+{
+    TraceRecord record;
+    record.timestampUs = GetUnixTimeUs();
+    record.threadId = GetCurrentThreadId();
+    record.type = c_typeCall;
+    record.call = static_cast<uint8_t>(call);
+    record.status = status;
+    record.durationUs = durationUs;
+    record.message[0] = '\0';
+
+    Record(record);
+}
+
+// static
+const char* Tracer::GetCallName(uint8_t call)
+{
+    return call < c_traceCallCount ? c_callNames[call] : "";
+}
+
+// static
+void Tracer::Drain(std::vector<TraceRecord>* records)
+{
+    Registry* registry = GetRegistry();
+    std::lock_guard<std::mutex> drainLock(registry->drainMutex);
+
+    std::vector<TraceRing*> rings;
+    {
+        std::lock_guard<std::mutex> lock(registry->mutex);
+        rings = registry->rings;
+    }
+
+    size_t begin = records->size();
+    for (size_t i = 0; i < rings.size(); i++)
+    {
+        TraceRing* ring = rings[i];
+        uint64_t tail = ring->tail.load(std::memory_order_relaxed);
+        uint64_t head = ring->head.load(std::memory_order_acquire);
+        for (uint64_t position = tail; position != head; position++)
+        {
+            records->push_back(ring->records[position % c_ringSize]);
+        }
+
+        ring->tail.store(head, std::memory_order_release);
+    }
+
+    // Each ring is in order already, merge them.
+    std::stable_sort(records->begin() + begin, records->end(), CompareTimestamps);
+    registry->drained += records->size() - begin;
+}
+
+// static
+void Tracer::FormatRecord(const TraceRecord& record, std::string* line)
+{
+    char buffer[256];
+    if (record.type == c_typeCall)
+    {
+        snprintf(buffer, sizeof(buffer), "%llu.%06llu %u/%u %s status=0x%08X durationUs=%u\n",
+            static_cast<unsigned long long>(record.timestampUs / 1000000),
+            static_cast<unsigned long long>(record.timestampUs % 1000000),
+            static_cast<unsigned int>(record.workerId),
+            static_cast<unsigned int>(record.threadId),
+            GetCallName(record.call),
+            static_cast<unsigned int>(record.status),
+            static_cast<unsigned int>(record.durationUs));
+    }
+    else
+    {
+        snprintf(buffer, sizeof(buffer), "%llu.%06llu %u/%u %s\n",
+            static_cast<unsigned long long>(record.timestampUs / 1000000),
+            static_cast<unsigned long long>(record.timestampUs % 1000000),
+            static_cast<unsigned int>(record.workerId),
+            static_cast<unsigned int>(record.threadId),
+            record.message);
+    }
+
+    line->assign(buffer);
+}
+
+// static
+bool Tracer::StartFileSink(const std::string& path, int flushIntervalMs)
+{
+    StopFileSink();
+
+    FILE* file = stdout;
+    if (!path.empty())
+    {
+        file = fopen(path.c_str(), "a");
+        if (file == nullptr)
+        {
+            return false;
+        }
+    }
+
+    TraceFileSink* fileSink = new TraceFileSink();
+    fileSink->file = file;
+    fileSink->flushIntervalMs = flushIntervalMs > 0 ? flushIntervalMs : c_defaultFlushIntervalMs;
+    fileSink->isStopRequested = false;
+    fileSink->isStopped = false;
+
+    Registry* registry = GetRegistry();
+    {
+        std::lock_guard<std::mutex> lock(registry->fileSinkMutex);
+        registry->fileSink = fileSink;
+    }
+
+    std::thread(&Tracer::FileSinkMain, fileSink).detach();
+    return true;
+}
+
+// static
+void Tracer::StopFileSink()
+{
+    Registry* registry = GetRegistry();
+    TraceFileSink* fileSink;
+    {
+        std::lock_guard<std::mutex> lock(registry->fileSinkMutex);
+        fileSink = registry->fileSink;
+        registry->fileSink = nullptr;
+    }
+
+    if (fileSink == nullptr)
+    {
+        return;
+    }
+
+    {
+        std::unique_lock<std::mutex> lock(fileSink->mutex);
+        fileSink->isStopRequested = true;
+        fileSink->stateChanged.notify_all();
+        fileSink->stateChanged.wait(lock, [fileSink]() { return fileSink->isStopped; });
+    }
+
+    delete fileSink;
+}
+
+// static
+void Tracer::FileSinkMain(TraceFileSink* fileSink)
+{
+    std::vector<TraceRecord> records;
+    std::string line;
+    bool isStopRequested = false;
+
+    while (!isStopRequested)
+    {
+        {
+            std::unique_lock<std::mutex> lock(fileSink->mutex);
+            fileSink->stateChanged.wait_for(
+                lock,
+                std::chrono::milliseconds(fileSink->flushIntervalMs),
+                [fileSink]() { return fileSink->isStopRequested; });
+            isStopRequested = fileSink->isStopRequested;
+        }
+
+        records.clear();
+        Drain(&records);
+        for (size_t i = 0; i < records.size(); i++)
+        {
+            FormatRecord(records[i], &line);
+            fputs(line.c_str(), fileSink->file);
+        }
+
+        fflush(fileSink->file);
+    }
+
+    if (fileSink->file != stdout)
+    {
+        fclose(fileSink->file);
+    }
+
+    std::lock_guard<std::mutex> lock(fileSink->mutex);
+    fileSink->isStopped = true;
+    fileSink->stateChanged.notify_all();
+}
+
+// static
+void Tracer::GetStats(TraceStats* stats)
+{
+    Registry* registry = GetRegistry();
+    std::vector<TraceRing*> rings;
+    {
+        std::lock_guard<std::mutex> lock(registry->mutex);
+        rings = registry->rings;
+    }
+
+    stats->recorded = 0;
+    stats->dropped = 0;
+    stats->rings = rings.size();
+    for (size_t i = 0; i < rings.size(); i++)
+    {
+        stats->recorded += rings[i]->head.load();
+        stats->dropped += rings[i]->dropped.load();
+    }
+
+    std::lock_guard<std::mutex> drainLock(registry->drainMutex);
+    stats->drained = registry->drained;
+}
+
+#endif  // IS_SUPPORTED_NODE_VERSION
@@ -0,0 +1,166 @@
+#pragma once
+
+#include "sspi_platform.h"
+
+#include <atomic>
+#include <chrono>
+#include <stdint.h>
+#include <string>
+#include <vector>
+
+// Levels compiled in, anything above SSPI_CLIENT_TRACE_LEVEL costs nothing at
+// run time either. 0 compiles tracing out, 1 keeps SSPI call events, 2 also
+// keeps the DebugLog messages.
+#ifndef SSPI_CLIENT_TRACE_LEVEL
+#define SSPI_CLIENT_TRACE_LEVEL 2
+#endif
+
+// SSPI and provider calls recorded as structured events.
+enum TraceCall
+{
+    c_traceCallNone = 0,
+    c_traceCallEnumeratePackages,
+    c_traceCallAcquireCredentials,
+    c_traceCallFreeCredentials,
+    c_traceCallInitializeContext,
+    c_traceCallAcceptContext,
+    c_traceCallCompleteToken,
+    c_traceCallDeleteContext,
+    c_traceCallQueryContextSizes,
+    c_traceCallMakeSignature,
+    c_traceCallVerifySignature,
+    c_traceCallEncryptMessage,
+    c_traceCallDecryptMessage,
+    c_traceCallCount
+};
+
+// One trace entry, either a DebugLog message or an SSPI call. Fixed size so
+// the rings need no allocation while recording.
+struct TraceRecord
+{
+    // Wall clock time in microseconds since the Unix epoch.
+    uint64_t timestampUs;
+    uint32_t threadId;
+
+    // Small sequential id of the ring the record was written to, stable for
+    // the life of the thread that wrote it.
+    uint16_t workerId;
+    uint8_t type;
+    uint8_t call;
+    int32_t status;
+    uint32_t durationUs;
+
+    static const int c_maxMessageLength = 104;
+    char message[c_maxMessageLength];
+};
+
+struct TraceRing;
+struct TraceFileSink;
+
+struct TraceStats
+{
+    uint64_t recorded;
+    uint64_t dropped;
+    uint64_t drained;
+    uint64_t rings;
+};
+
+// Per-thread binary trace rings. Recording threads write to their own ring
+// without locks or system calls; records are drained in the background to a
+// file or on demand to JavaScript. A full ring drops new records and counts
+// them rather than block the thread recording.
+//
+// Everything is off until SetLevel. Checking the level is a relaxed atomic
+// load, DebugLog and TraceCallTimer do nothing else when it's off.
+class Tracer
+{
+public:
+    static const int c_levelOff = 0;
+    static const int c_levelEvents = 1;
+    static const int c_levelDebug = 2;
+
+    static const uint8_t c_typeMessage = 1;
+    static const uint8_t c_typeCall = 2;
+
+    static bool IsEnabled(int level)
+    {
+        return level <= SSPI_CLIENT_TRACE_LEVEL && s_level.load(std::memory_order_relaxed) >= level;
+    }
+
+    static void SetLevel(int level);
+
+    static void Message(const char* format, ...);
+    static void Call(TraceCall call, SECURITY_STATUS status, uint32_t durationUs);
+
+    static const char* GetCallName(uint8_t call);
+
+    // Moves the records not drained yet to records, oldest first across all
+    // threads.
+    static void Drain(std::vector<TraceRecord>* records);
+
+    // Starts a thread that drains to path every flushIntervalMs, or stdout if
+    // path is empty. Replaces the file sink already running, if any.
+    static bool StartFileSink(const std::string& path, int flushIntervalMs);
+
+    // Flushes and closes the file sink, if any.
+    static void StopFileSink();
+
+    // Writes record as one line of text.
+    static void FormatRecord(const TraceRecord& record, std::string* line);
+
+    static void GetStats(TraceStats* stats);
+
+    static const int c_ringSize = 1024;
+    static const int c_defaultFlushIntervalMs = 100;
+
+private:
+    static TraceRing* GetThreadRing();
+    static void Record(const TraceRecord& record);
+    static void FileSinkMain(TraceFileSink* fileSink);
+
+    static std::atomic<int> s_level;
+};
+
+// Times an SSPI call when call events are on. Reads the clock only if so.
+class TraceCallTimer
+{
+public:
+    TraceCallTimer()
+        : m_isEnabled(Tracer::IsEnabled(Tracer::c_levelEvents))
+    {
+        if (m_isEnabled)
+        {
+            m_begin = std::chrono::steady_clock::now();
+        }
+    }
+
+    void Complete(TraceCall call, SECURITY_STATUS status)
+    {
+        if (m_isEnabled)
+        {
+            Tracer::Call(
+                call,
+                status,
+                static_cast<uint32_t>(std::chrono::duration_cast<std::chrono::microseconds>(
+                    std::chrono::steady_clock::now() - m_begin).count()));
+        }
+    }
+
+private:
+    bool m_isEnabled;
+    std::chrono::steady_clock::time_point m_begin;
+};
+
+// Arguments are not evaluated unless debug tracing is on.
+#if SSPI_CLIENT_TRACE_LEVEL >= 2
+#define DebugLog(...) \
+    do \
+    { \
+        if (Tracer::IsEnabled(Tracer::c_levelDebug)) \
+        { \
+            Tracer::Message(__VA_ARGS__); \
+        } \
+    } while (0)
+#else
+#define DebugLog(...) do { } while (0)
+#endif
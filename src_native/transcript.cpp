@@ -0,0 +1,493 @@
+#include "node_version_support.h"
+#ifdef IS_SUPPORTED_NODE_VERSION
+
+#include "transcript.h"
+
+#include "utils.h"
+
+#include <chrono>
+#include <memory>
+#include <random>
+#include <string.h>
+
+#ifdef _WIN32
+#include <fcntl.h>
+#include <io.h>
+#include <share.h>
+#include <sys/stat.h>
+#else
+#include <fcntl.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
+#endif
+
+namespace
+{
+    const char c_transcriptMagic[8] = { 'S', 'S', 'P', 'I', 'T', 'R', 'N', '1' };
+
+    const int c_errorStringBufferSize = 256;
+
+    uint64_t GetUnixTimeUs()
+    {
+        return static_cast<uint64_t>(std::chrono::duration_cast<std::chrono::microseconds>(
+            std::chrono::system_clock::now().time_since_epoch()).count());
+    }
+
+    // Opens path for reading and appending, creating it readable and writable
+    // by the current user only: transcripts hold authentication tokens.
+    FILE* OpenTranscriptFile(const std::string& path)
+    {
+#ifdef _WIN32
+        int fd;
+        if (_sopen_s(&fd, path.c_str(), _O_CREAT | _O_APPEND | _O_RDWR | _O_BINARY, _SH_DENYNO,
+                _S_IREAD | _S_IWRITE) != 0)
+        {
+            return nullptr;
+        }
+
+        FILE* file = _fdopen(fd, "a+b");
+        if (file == nullptr)
+        {
+            _close(fd);
+        }
+#else
+        int fd = open(path.c_str(), O_CREAT | O_APPEND | O_RDWR, 0600);
+        if (fd == -1)
+        {
+            return nullptr;
+        }
+
+        FILE* file = fdopen(fd, "a+b");
+        if (file == nullptr)
+        {
+            close(fd);
+        }
+#endif
+
+        return file;
+    }
+
+    uint32_t PadRecordSize(uint32_t size)
+    {
+        return (size + 7) & ~static_cast<uint32_t>(7);
+    }
+
+    void Put16(char* p, uint16_t value)
+    {
+        p[0] = static_cast<char>(value);
+        p[1] = static_cast<char>(value >> 8);
+    }
+
+    void Put32(char* p, uint32_t value)
+    {
+        Put16(p, static_cast<uint16_t>(value));
+        Put16(p + 2, static_cast<uint16_t>(value >> 16));
+    }
+
+    void Put64(char* p, uint64_t value)
+    {
+        Put32(p, static_cast<uint32_t>(value));
+        Put32(p + 4, static_cast<uint32_t>(value >> 32));
+    }
+
+    uint16_t Get16(const char* p)
+    {
+        const unsigned char* u = reinterpret_cast<const unsigned char*>(p);
+        return static_cast<uint16_t>(u[0] | (u[1] << 8));
+    }
+
+    uint32_t Get32(const char* p)
+    {
+        return Get16(p) | (static_cast<uint32_t>(Get16(p + 2)) << 16);
+    }
+
+    uint64_t Get64(const char* p)
+    {
+        return Get32(p) | (static_cast<uint64_t>(Get32(p + 4)) << 32);
+    }
+
+    void WriteFileHeader(char* header)
+    {
+        memcpy(header, c_transcriptMagic, sizeof(c_transcriptMagic));
+        Put32(header + 8, c_transcriptVersion);
+        Put32(header + 12, c_transcriptHeaderSize);
+    }
+
+    bool IsFileHeader(const char* header, size_t size)
+    {
+        return size >= c_transcriptHeaderSize
+            && memcmp(header, c_transcriptMagic, sizeof(c_transcriptMagic)) == 0
+            && Get32(header + 8) == c_transcriptVersion
+            && Get32(header + 12) >= c_transcriptHeaderSize
+            && Get32(header + 12) <= size;
+    }
+}
+
+// static
+TranscriptRecorder* TranscriptRecorder::GetInstance()
+{
+    // Intentionally leaked, worker threads may still be recording while
+    // static destructors run at process exit.
+    static TranscriptRecorder* s_transcriptRecorder = new TranscriptRecorder();
+    return s_transcriptRecorder;
+}
+
+TranscriptRecorder::TranscriptRecorder() :
+    m_isRecording(false),
+    m_nextContextId(0),
+    m_mutex(),
+    m_file(nullptr),
+    m_recorded(0),
+    m_bytes(0),
+    m_failures(0)
+{
+    std::random_device randomDevice;
+    std::mt19937_64 random((static_cast<uint64_t>(randomDevice()) << 32) ^ randomDevice() ^ GetUnixTimeUs());
+
+    // 0 is never an id, SspiImpl uses it for no handshake.
+    m_nextContextId = random() | 1;
+}
+
+bool TranscriptRecorder::Start(const std::string& path, std::string* errorString)
+{
+    DebugLog("%d: Main event loop: TranscriptRecorder::Start: %s.\n", GetCurrentThreadId(), path.c_str());
+
+    Stop();
+
+    char errorStringLocal[c_errorStringBufferSize];
+    FILE* file = OpenTranscriptFile(path);
+    if (file == nullptr)
+    {
+        snprintf(errorStringLocal, c_errorStringBufferSize, "Failed to open '%s' for recording.", path.c_str());
+        errorString->assign(errorStringLocal);
+        return false;
+    }
+
+    // Appending to an existing transcript is fine, to anything else isn't.
+    char header[c_transcriptHeaderSize];
+    size_t headerSize = fread(header, 1, sizeof(header), file);
+    bool succeeded;
+    if (headerSize == 0)
+    {
+        WriteFileHeader(header);
+        succeeded = fseek(file, 0, SEEK_END) == 0
+            && fwrite(header, 1, sizeof(header), file) == sizeof(header)
+            && fflush(file) == 0;
+    }
+    else
+    {
+        succeeded = IsFileHeader(header, headerSize) && fseek(file, 0, SEEK_END) == 0;
+    }
+
+    if (!succeeded)
+    {
+        fclose(file);
+        snprintf(errorStringLocal, c_errorStringBufferSize, "'%s' is not a transcript file.", path.c_str());
+        errorString->assign(errorStringLocal);
+        return false;
+    }
+
+    std::lock_guard<std::mutex> lock(m_mutex);
+    m_file = file;
+    m_isRecording = true;
+    return true;
+}
+
+void TranscriptRecorder::Stop()
+{
+    std::lock_guard<std::mutex> lock(m_mutex);
+    m_isRecording = false;
+    if (m_file != nullptr)
+    {
+        DebugLog("%d: Main event loop: TranscriptRecorder::Stop.\n", GetCurrentThreadId());
+        fclose(m_file);
+        m_file = nullptr;
+    }
+}
+
+uint64_t TranscriptRecorder::NextContextId()
+{
+    uint64_t contextId = m_nextContextId.fetch_add(1, std::memory_order_relaxed);
+    return contextId != 0 ? contextId : m_nextContextId.fetch_add(1, std::memory_order_relaxed);
+}
+
+void TranscriptRecorder::Record(
+    uint64_t contextId,
+    int leg,
+    const char* securityPackage,
+    const std::string& spn,
+    const char* inToken,
+    int inTokenLength,
+    const char* outToken,
+    int outTokenLength,
+    SECURITY_STATUS status,
+    bool isDone,
+    uint64_t durationUs)
+{
+    size_t securityPackageLength = strlen(securityPackage);
+    if (securityPackageLength > UINT16_MAX || spn.size() > UINT16_MAX || leg > UINT16_MAX)
+    {
+        m_failures++;
+        return;
+    }
+
+    uint32_t inLength = inToken != nullptr && inTokenLength > 0 ? static_cast<uint32_t>(inTokenLength) : 0;
+    uint32_t outLength = outToken != nullptr && outTokenLength > 0 ? static_cast<uint32_t>(outTokenLength) : 0;
+    uint32_t recordSize = PadRecordSize(
+        c_transcriptRecordHeaderSize
+        + static_cast<uint32_t>(securityPackageLength + spn.size())
+        + inLength
+        + outLength);
+
+    // Built whole so it goes out in one write.
+    std::vector<char> record(recordSize, 0);
+    char* p = record.data();
+    Put32(p, recordSize);
+    Put32(p + 4, isDone ? c_transcriptFlagIsDone : 0);
+    Put64(p + 8, contextId);
+    Put64(p + 16, GetUnixTimeUs() - durationUs);
+    Put32(p + 24, durationUs < UINT32_MAX ? static_cast<uint32_t>(durationUs) : UINT32_MAX);
+    Put32(p + 28, static_cast<uint32_t>(status));
+    Put16(p + 32, static_cast<uint16_t>(leg));
+    Put16(p + 34, static_cast<uint16_t>(securityPackageLength));
+    Put16(p + 36, static_cast<uint16_t>(spn.size()));
+    Put32(p + 40, inLength);
+    Put32(p + 44, outLength);
+
+    p += c_transcriptRecordHeaderSize;
+    memcpy(p, securityPackage, securityPackageLength);
+    p += securityPackageLength;
+    memcpy(p, spn.data(), spn.size());
+    p += spn.size();
+    if (inLength > 0)
+    {
+        memcpy(p, inToken, inLength);
+        p += inLength;
+    }
+
+    if (outLength > 0)
+    {
+        memcpy(p, outToken, outLength);
+    }
+
+    std::lock_guard<std::mutex> lock(m_mutex);
+    if (m_file == nullptr)
+    {
+        return;
+    }
+
+    // Flushed per record so a reader, or a crash, never sees more than the
+    // last record cut short.
+    if (fwrite(record.data(), 1, recordSize, m_file) != recordSize || fflush(m_file) != 0)
+    {
+        m_failures++;
+        return;
+    }
+
+    m_recorded++;
+    m_bytes += recordSize;
+}
+
+void TranscriptRecorder::GetStats(TranscriptStats* stats) const
+{
+    stats->recorded = m_recorded.load();
+    stats->bytes = m_bytes.load();
+    stats->failures = m_failures.load();
+}
+
+TranscriptRecorder::~TranscriptRecorder()
+{
+}
+
+TranscriptFile::TranscriptFile() :
+    m_data(nullptr),
+    m_size(0),
+#ifdef _WIN32
+    m_mapping(nullptr),
+#endif
+    m_records()
+{
+}
+
+TranscriptFile::~TranscriptFile()
+{
+    Close();
+}
+
+bool TranscriptFile::Open(const std::string& path, std::string* errorString)
+{
+    Close();
+
+    char errorStringLocal[c_errorStringBufferSize];
+    snprintf(errorStringLocal, c_errorStringBufferSize, "Failed to map '%s'.", path.c_str());
+
+#ifdef _WIN32
+    std::unique_ptr<WCHAR[]> widePath;
+    if (ConvertUtf8ToMultiByte("path", path.c_str(), &widePath, errorStringLocal, c_errorStringBufferSize) != S_OK)
+    {
+        errorString->assign(errorStringLocal);
+        return false;
+    }
+
+    HANDLE file = CreateFileW(
+        widePath.get(),
+        GENERIC_READ,
+        FILE_SHARE_READ | FILE_SHARE_WRITE,
+        nullptr,
+        OPEN_EXISTING,
+        FILE_ATTRIBUTE_NORMAL,
+        nullptr);
+    if (file == INVALID_HANDLE_VALUE)
+    {
+        errorString->assign(errorStringLocal);
+        return false;
+    }
+
+    LARGE_INTEGER fileSize;
+    if (!GetFileSizeEx(file, &fileSize) || fileSize.QuadPart < c_transcriptHeaderSize)
+    {
+        CloseHandle(file);
+        snprintf(errorStringLocal, c_errorStringBufferSize, "'%s' is not a transcript file.", path.c_str());
+        errorString->assign(errorStringLocal);
+        return false;
+    }
+
+    m_mapping = CreateFileMappingW(file, nullptr, PAGE_READONLY, 0, 0, nullptr);
+    CloseHandle(file);
+    if (m_mapping == nullptr)
+    {
+        errorString->assign(errorStringLocal);
+        return false;
+    }
+
+    m_data = static_cast<const char*>(MapViewOfFile(m_mapping, FILE_MAP_READ, 0, 0, 0));
+    if (m_data == nullptr)
+    {
+        Close();
+        errorString->assign(errorStringLocal);
+        return false;
+    }
+
+    m_size = static_cast<size_t>(fileSize.QuadPart);
+#else
+    int fd = open(path.c_str(), O_RDONLY);
+    if (fd < 0)
+    {
+        errorString->assign(errorStringLocal);
+        return false;
+    }
+
+    struct stat fileStat;
+    if (fstat(fd, &fileStat) != 0 || fileStat.st_size < static_cast<off_t>(c_transcriptHeaderSize))
+    {
+        close(fd);
+        snprintf(errorStringLocal, c_errorStringBufferSize, "'%s' is not a transcript file.", path.c_str());
+        errorString->assign(errorStringLocal);
+        return false;
+    }
+
+    // The mapping stays valid after the descriptor is closed.
+    void* data = mmap(nullptr, static_cast<size_t>(fileStat.st_size), PROT_READ, MAP_PRIVATE, fd, 0);
+    close(fd);
+    if (data == MAP_FAILED)
+    {
+        errorString->assign(errorStringLocal);
+        return false;
+    }
+
+    m_data = static_cast<const char*>(data);
+    m_size = static_cast<size_t>(fileStat.st_size);
+#endif
+
+    if (!Parse(path, errorString))
+    {
+        Close();
+        return false;
+    }
+
+    return true;
+}
+
+bool TranscriptFile::Parse(const std::string& path, std::string* errorString)
+{
+    if (!IsFileHeader(m_data, m_size))
+    {
+        char errorStringLocal[c_errorStringBufferSize];
+        snprintf(errorStringLocal, c_errorStringBufferSize, "'%s' is not a transcript file.", path.c_str());
+        errorString->assign(errorStringLocal);
+        return false;
+    }
+
+    size_t offset = Get32(m_data + 12);
+    while (m_size - offset >= c_transcriptRecordHeaderSize)
+    {
+        const char* p = m_data + offset;
+        uint32_t recordSize = Get32(p);
+        uint32_t securityPackageLength = Get16(p + 34);
+        uint32_t spnLength = Get16(p + 36);
+        uint32_t inTokenLength = Get32(p + 40);
+        uint32_t outTokenLength = Get32(p + 44);
+
+        // 64 bit sums, the lengths come from the file.
+        uint64_t contentSize = static_cast<uint64_t>(c_transcriptRecordHeaderSize)
+            + securityPackageLength + spnLength + inTokenLength + outTokenLength;
+        if (recordSize < contentSize || recordSize > m_size - offset)
+        {
+            // Cut short, still being written or the recording process died.
+            break;
+        }
+
+        TranscriptRecord record;
+        record.contextId = Get64(p + 8);
+        record.timestampUs = Get64(p + 16);
+        record.durationUs = Get32(p + 24);
+        record.status = static_cast<SECURITY_STATUS>(Get32(p + 28));
+        record.isDone = (Get32(p + 4) & c_transcriptFlagIsDone) != 0;
+        record.leg = Get16(p + 32);
+
+        p += c_transcriptRecordHeaderSize;
+        record.securityPackage.assign(p, securityPackageLength);
+        p += securityPackageLength;
+        record.spn.assign(p, spnLength);
+        p += spnLength;
+        record.inToken = p;
+        record.inTokenLength = inTokenLength;
+        p += inTokenLength;
+        record.outToken = p;
+        record.outTokenLength = outTokenLength;
+
+        m_records.push_back(record);
+        offset += recordSize;
+    }
+
+    return true;
+}
+
+void TranscriptFile::Close()
+{
+    m_records.clear();
+
+#ifdef _WIN32
+    if (m_data != nullptr)
+    {
+        UnmapViewOfFile(m_data);
+    }
+
+    if (m_mapping != nullptr)
+    {
+        CloseHandle(m_mapping);
+        m_mapping = nullptr;
+    }
+#else
+    if (m_data != nullptr)
+    {
+        munmap(const_cast<char*>(m_data), m_size);
+    }
+#endif
+
+    m_data = nullptr;
+    m_size = 0;
+}
+
+#endif  // IS_SUPPORTED_NODE_VERSION
@@ -0,0 +1,161 @@
+#pragma once
+
+#include "sspi_platform.h"
+
+#include <atomic>
+#include <mutex>
+#include <stdint.h>
+#include <stdio.h>
+#include <string>
+#include <vector>
+
+// Handshake transcript files. Each SspiImpl::GetNextBlob call is appended as
+// one record, so a file holds the exact token traffic of the handshakes run
+// while recording, to be served back by ReplaySspiProvider.
+//
+// Layout, little endian:
+//  File header, c_transcriptHeaderSize bytes:
+//   0: magic 'SSPITRN1'
+//   8: version
+//  12: header size
+//  Records, each padded to a multiple of 8 bytes:
+//   0: record size, including the header and padding
+//   4: flags, c_transcriptFlagIsDone
+//   8: context id, the same for every leg of a handshake
+//  16: start of the call, microseconds since the Unix epoch
+//  24: duration of the call in microseconds
+//  28: status GetNextBlob returned
+//  32: leg, 0 for the first
+//  34: security package name length
+//  36: SPN length
+//  38: reserved
+//  40: input token length
+//  44: output token length
+//  48: security package name, SPN, input token, output token
+//
+// Records are only ever appended and each is written whole, so a file can be
+// read while it's being recorded; a record cut short at the end is ignored.
+const uint32_t c_transcriptVersion = 1;
+const uint32_t c_transcriptHeaderSize = 16;
+const uint32_t c_transcriptRecordHeaderSize = 48;
+const uint32_t c_transcriptFlagIsDone = 0x1;
+
+// One record of a mapped TranscriptFile. Tokens point into the mapping.
+struct TranscriptRecord
+{
+    uint64_t contextId;
+    uint64_t timestampUs;
+    uint32_t durationUs;
+    SECURITY_STATUS status;
+    bool isDone;
+    int leg;
+    std::string securityPackage;
+    std::string spn;
+    const char* inToken;
+    uint32_t inTokenLength;
+    const char* outToken;
+    uint32_t outTokenLength;
+};
+
+struct TranscriptStats
+{
+    uint64_t recorded;
+    uint64_t bytes;
+    uint64_t failures;
+};
+
+// Appends GetNextBlob calls to a transcript file. Off until Start; checking
+// is a relaxed atomic load, SspiImpl does nothing else when it's off.
+// Recording writes and flushes each record under a mutex, it's meant for
+// capturing traffic, not for leaving on.
+class TranscriptRecorder
+{
+public:
+    static TranscriptRecorder* GetInstance();
+
+    // Appends to path, creating it if needed. Replaces the file being
+    // recorded to, if any. Returns false if path can't be opened or isn't a
+    // transcript file.
+    bool Start(const std::string& path, std::string* errorString);
+
+    // Closes the file, if any.
+    void Stop();
+
+    bool IsRecording() const
+    {
+        return m_isRecording.load(std::memory_order_relaxed);
+    }
+
+    // Id for the legs of a new handshake. Starts at a random value, so
+    // handshakes appended to the same file by other processes don't share
+    // ids.
+    uint64_t NextContextId();
+
+    // Appends a call that started durationUs ago. Tokens may be null if
+    // empty.
+    void Record(
+        uint64_t contextId,
+        int leg,
+        const char* securityPackage,
+        const std::string& spn,
+        const char* inToken,
+        int inTokenLength,
+        const char* outToken,
+        int outTokenLength,
+        SECURITY_STATUS status,
+        bool isDone,
+        uint64_t durationUs);
+
+    void GetStats(TranscriptStats* stats) const;
+
+private:
+    TranscriptRecorder();
+
+    // Not implemented. Never destroyed, see GetInstance.
+    TranscriptRecorder(const TranscriptRecorder&);
+    TranscriptRecorder& operator=(const TranscriptRecorder&);
+    ~TranscriptRecorder();
+
+    std::atomic<bool> m_isRecording;
+    std::atomic<uint64_t> m_nextContextId;
+
+    // Guards the file.
+    std::mutex m_mutex;
+    FILE* m_file;
+
+    std::atomic<uint64_t> m_recorded;
+    std::atomic<uint64_t> m_bytes;
+    std::atomic<uint64_t> m_failures;
+};
+
+// A transcript file mapped read-only, with its records parsed in file order.
+class TranscriptFile
+{
+public:
+    TranscriptFile();
+    ~TranscriptFile();
+
+    // Returns false if path can't be mapped or isn't a transcript file.
+    bool Open(const std::string& path, std::string* errorString);
+
+    const std::vector<TranscriptRecord>& GetRecords() const
+    {
+        return m_records;
+    }
+
+private:
+    // Not implemented.
+    TranscriptFile(const TranscriptFile&);
+    TranscriptFile& operator=(const TranscriptFile&);
+
+    bool Parse(const std::string& path, std::string* errorString);
+    void Close();
+
+    const char* m_data;
+    size_t m_size;
+#ifdef _WIN32
+    HANDLE m_mapping;
+#endif
+
+    std::vector<TranscriptRecord> m_records;
+};
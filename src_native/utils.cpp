@@ -3,25 +3,221 @@
 
 #include "utils.h"
 
+#include <atomic>
+#include <chrono>
+#include <ctype.h>
 #include <stdio.h>
-#include <stdarg.h>
 
-static bool s_debug = false;
+static std::atomic<int64_t> s_clockOffsetMs(0);
 
-void SetDebugLogging(bool enable)
+int64_t GetUnixTimeMs()
 {
-    s_debug = enable;
+    return std::chrono::duration_cast<std::chrono::milliseconds>(
+        std::chrono::system_clock::now().time_since_epoch()).count() + s_clockOffsetMs.load();
 }
 
-void DebugLog(const char* format, ...)
+void UtSetClockOffsetMs(int64_t offsetMs)
 {
-    if (s_debug)
+    s_clockOffsetMs.store(offsetMs);
+}
+
+bool PackageNameEquals(const char* a, const char* b)
+{
+    for (; *a && *b; a++, b++)
+    {
+        if (tolower(static_cast<unsigned char>(*a)) != tolower(static_cast<unsigned char>(*b)))
+        {
+            return false;
+        }
+    }
+
+    return *a == *b;
+}
+
+std::string MakeSpnPackageKey(const std::string& spn, const std::string& securityPackage)
+{
+    std::string key(securityPackage);
+    for (size_t i = 0; i < key.size(); i++)
+    {
+        key[i] = static_cast<char>(tolower(static_cast<unsigned char>(key[i])));
+    }
+
+    key.append(1, '\n');
+    key.append(spn);
+    return key;
+}
+
+#ifdef _WIN32
+
+HRESULT ConvertUtf8ToMultiByte(
+    const char* paramName,
+    const char* utf8Str,
+    std::unique_ptr<WCHAR[]>* multiByteStr,
+    char* errorString,
+    int errorStringBufferSize)
+{
+    int retval = MultiByteToWideChar(
+        CP_UTF8,                    // Code page UTF8.
+        MB_ERR_INVALID_CHARS,       // Fail on invalid characters.
+        utf8Str,                    // UTF8 string.
+        -1,                         // Indicates null-termination.
+        nullptr,                    // Output buffer, ignored when getting required buffer size.
+        0);                         // Output buffer size, in characters set to 0 to get required buffer size.
+
+    if (!retval) {
+        HRESULT hr = HRESULT_FROM_WIN32(GetLastError());
+        snprintf(
+            errorString,
+            errorStringBufferSize,
+            "MultiByteToWideChar failed to get required buffer size for '%s'. Error code: 0x%X.",
+            paramName,
+            hr);
+
+        return hr;
+    }
+
+    // retval includes null space for terminating null character.
+    multiByteStr->reset(new WCHAR[retval]);
+
+    retval = MultiByteToWideChar(
+        CP_UTF8,                    // Code page UTF8.
+        MB_ERR_INVALID_CHARS,       // Fail on invalid characters.
+        utf8Str,                    // UTF8 string.
+        -1,                         // Indicates null-termination.
+        multiByteStr->get(),        // Output buffer.
+        retval);                    // Output buffer size, in characters set to 0 to get required buffer size.
+
+    if (!retval) {
+        HRESULT hr = HRESULT_FROM_WIN32(GetLastError());
+        snprintf(
+            errorString,
+            errorStringBufferSize,
+            "MultiByteToWideChar failed to convert UTF8 to WideChar for '%s'. Error code: 0x%X.",
+            paramName,
+            hr);
+
+        return hr;
+    }
+
+    return S_OK;
+}
+
+#else   // _WIN32
+
+// Decodes the UTF-8 sequence at utf8Str into a code point. Returns the number
+// of bytes consumed or 0 for invalid sequences, same rules as
+// MB_ERR_INVALID_CHARS: no overlong forms, surrogates or values past U+10FFFF.
+static int DecodeUtf8(const unsigned char* utf8Str, uint32_t* codePoint)
+{
+    unsigned char lead = utf8Str[0];
+    int length;
+    uint32_t value;
+    uint32_t minValue;
+
+    if (lead < 0x80)
     {
-        va_list args;
-        va_start(args, format);
-        vprintf(format, args);
-        va_end(args);
+        *codePoint = lead;
+        return 1;
     }
+    else if ((lead & 0xE0) == 0xC0)
+    {
+        length = 2;
+        value = lead & 0x1F;
+        minValue = 0x80;
+    }
+    else if ((lead & 0xF0) == 0xE0)
+    {
+        length = 3;
+        value = lead & 0x0F;
+        minValue = 0x800;
+    }
+    else if ((lead & 0xF8) == 0xF0)
+    {
+        length = 4;
+        value = lead & 0x07;
+        minValue = 0x10000;
+    }
+    else
+    {
+        return 0;
+    }
+
+    for (int i = 1; i < length; i++)
+    {
+        // Also stops at the terminating null.
+        if ((utf8Str[i] & 0xC0) != 0x80)
+        {
+            return 0;
+        }
+
+        value = (value << 6) | (utf8Str[i] & 0x3F);
+    }
+
+    if (value < minValue || value > 0x10FFFF || (value >= 0xD800 && value <= 0xDFFF))
+    {
+        return 0;
+    }
+
+    *codePoint = value;
+    return length;
 }
 
+HRESULT ConvertUtf8ToMultiByte(
+    const char* paramName,
+    const char* utf8Str,
+    std::unique_ptr<WCHAR[]>* multiByteStr,
+    char* errorString,
+    int errorStringBufferSize)
+{
+    const unsigned char* input = reinterpret_cast<const unsigned char*>(utf8Str);
+
+    // First pass validates and gets the required buffer size, including the
+    // terminating null character.
+    size_t requiredLength = 1;
+    for (const unsigned char* p = input; *p;)
+    {
+        uint32_t codePoint;
+        int consumed = DecodeUtf8(p, &codePoint);
+        if (!consumed)
+        {
+            HRESULT hr = HRESULT_FROM_WIN32(ERROR_NO_UNICODE_TRANSLATION);
+            snprintf(
+                errorString,
+                errorStringBufferSize,
+                "Failed to convert UTF8 to WideChar for '%s'. Error code: 0x%X.",
+                paramName,
+                hr);
+
+            return hr;
+        }
+
+        requiredLength += codePoint >= 0x10000 ? 2 : 1;
+        p += consumed;
+    }
+
+    multiByteStr->reset(new WCHAR[requiredLength]);
+
+    WCHAR* output = multiByteStr->get();
+    for (const unsigned char* p = input; *p;)
+    {
+        uint32_t codePoint;
+        p += DecodeUtf8(p, &codePoint);
+        if (codePoint >= 0x10000)
+        {
+            codePoint -= 0x10000;
+            *output++ = static_cast<WCHAR>(0xD800 + (codePoint >> 10));
+            *output++ = static_cast<WCHAR>(0xDC00 + (codePoint & 0x3FF));
+        }
+        else
+        {
+            *output++ = static_cast<WCHAR>(codePoint);
+        }
+    }
+
+    *output = 0;
+    return S_OK;
+}
+
+#endif  // _WIN32
+
 #endif  // IS_SUPPORTED_NODE_VERSION
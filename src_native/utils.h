@@ -1,4 +1,32 @@
 #pragma once
 
-void SetDebugLogging(bool enable);
-void DebugLog(const char* format, ...);
+#include "sspi_platform.h"
+#include "trace.h"
+
+#include <memory>
+#include <string>
+
+// Wall clock time in milliseconds since the Unix epoch, moved by the
+// UtSetClockOffsetMs offset. Expiry decisions and the mock provider's expiry
+// times all go through this.
+int64_t GetUnixTimeMs();
+
+// Moves the clock GetUnixTimeMs reads by offsetMs, so expiry handling can be
+// tested without waiting. For unit testing purposes only.
+void UtSetClockOffsetMs(int64_t offsetMs);
+
+// ASCII case-insensitive match, which is all package names need.
+bool PackageNameEquals(const char* a, const char* b);
+
+// Map key for per SPN and package state. Package names are case insensitive,
+// SPNs are matched as given.
+std::string MakeSpnPackageKey(const std::string& spn, const std::string& securityPackage);
+
+// Converts a null terminated UTF-8 string to UTF-16. On failure, returns the
+// error code and writes details to errorString.
+HRESULT ConvertUtf8ToMultiByte(
+    const char* paramName,
+    const char* utf8Str,
+    std::unique_ptr<WCHAR[]>* multiByteStr,
+    char* errorString,
+    int errorStringBufferSize);
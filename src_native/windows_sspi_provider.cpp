@@ -0,0 +1,179 @@
+#include "node_version_support.h"
+#ifdef IS_SUPPORTED_NODE_VERSION
+
+#include "windows_sspi_provider.h"
+
+#pragma comment(lib, "secur32.lib")
+
+const char* WindowsSspiProvider::c_name = "windows";
+
+const char* WindowsSspiProvider::GetName() const
+{
+    return c_name;
+}
+
+SECURITY_STATUS WindowsSspiProvider::EnumeratePackages(std::vector<SspiPackageInfo>* packages)
+{
+    unsigned long numPackages;
+    PSecPkgInfoW psecPkgInfo;
+
+    SECURITY_STATUS securityStatus = ::EnumerateSecurityPackagesW(&numPackages, &psecPkgInfo);
+    if (securityStatus != SEC_E_OK)
+    {
+        return securityStatus;
+    }
+
+    for (unsigned long packagesIndex = 0; packagesIndex < numPackages; packagesIndex++)
+    {
+        // Package names are plain ASCII, convert failures just skip the package.
+        char name[256];
+        int retval = WideCharToMultiByte(
+            CP_UTF8,
+            0,
+            psecPkgInfo[packagesIndex].Name,
+            -1,
+            name,
+            sizeof(name),
+            nullptr,
+            nullptr);
+
+        if (retval)
+        {
+            SspiPackageInfo packageInfo;
+            packageInfo.name.assign(name);
+            packageInfo.maxTokenSize = psecPkgInfo[packagesIndex].cbMaxToken;
+            packages->push_back(packageInfo);
+        }
+    }
+
+    return ::FreeContextBuffer(psecPkgInfo);
+}
+
+SECURITY_STATUS WindowsSspiProvider::AcquireCredentials(
+    const WCHAR* principal,
+    const WCHAR* securityPackage,
+    unsigned long credentialUse,
+    CredHandle* credHandle,
+    TimeStamp* timeExpiry)
+{
+    return ::AcquireCredentialsHandleW(
+        const_cast<WCHAR*>(principal),          // Principal - nullptr for logged in user.
+        const_cast<WCHAR*>(securityPackage),    // Security package to use.
+        credentialUse,  // Inbound or outbound.
+        nullptr,    // Locally unique user identifier.
+        nullptr,    // Auth data - use default credentials.
+        nullptr,    // pGetKeyFn - unused.
+        nullptr,    // pGetKeyArgument - unused.
+        credHandle,     // Credential handle.
+        timeExpiry);
+}
+
+SECURITY_STATUS WindowsSspiProvider::FreeCredentials(CredHandle* credHandle)
+{
+    return ::FreeCredentialHandle(credHandle);
+}
+
+SECURITY_STATUS WindowsSspiProvider::InitializeContext(
+    CredHandle* credHandle,
+    CtxtHandle* ctxtHandle,
+    const WCHAR* targetName,
+    unsigned long contextReq,
+    SecBufferDesc* input,
+    CtxtHandle* newCtxtHandle,
+    SecBufferDesc* output,
+    unsigned long* contextAttr,
+    TimeStamp* timeExpiry)
+{
+    return ::InitializeSecurityContextW(
+        credHandle,     // Credential handle.
+        ctxtHandle,     // Context handle - input.
+        const_cast<WCHAR*>(targetName),     // Service Principal name (SPN).
+        contextReq,     // Context bit flags.
+        0,          // Reserved - unused.
+        SECURITY_NATIVE_DREP,       // Target data representation.
+        input,      // Input buffer, has data from server.
+        0,          // Reserved - unused.
+        newCtxtHandle,  // Context handle - output.
+        output,     // Output buffer, data to send to server.
+        contextAttr,    // Context attributes.
+        timeExpiry);
+}
+
+SECURITY_STATUS WindowsSspiProvider::AcceptContext(
+    CredHandle* credHandle,
+    CtxtHandle* ctxtHandle,
+    SecBufferDesc* input,
+    unsigned long contextReq,
+    CtxtHandle* newCtxtHandle,
+    SecBufferDesc* output,
+    unsigned long* contextAttr,
+    TimeStamp* timeExpiry)
+{
+    return ::AcceptSecurityContext(
+        credHandle,
+        ctxtHandle,
+        input,
+        contextReq,
+        SECURITY_NATIVE_DREP,
+        newCtxtHandle,
+        output,
+        contextAttr,
+        timeExpiry);
+}
+
+SECURITY_STATUS WindowsSspiProvider::CompleteToken(
+    CtxtHandle* ctxtHandle,
+    SecBufferDesc* token)
+{
+    return ::CompleteAuthToken(ctxtHandle, token);
+}
+
+SECURITY_STATUS WindowsSspiProvider::DeleteContext(CtxtHandle* ctxtHandle)
+{
+    return ::DeleteSecurityContext(ctxtHandle);
+}
+
+SECURITY_STATUS WindowsSspiProvider::QueryContextSizes(
+    CtxtHandle* ctxtHandle,
+    SecPkgContext_Sizes* sizes)
+{
+    return ::QueryContextAttributesW(ctxtHandle, SECPKG_ATTR_SIZES, sizes);
+}
+
+SECURITY_STATUS WindowsSspiProvider::MakeSignature(
+    CtxtHandle* ctxtHandle,
+    unsigned long qop,
+    SecBufferDesc* message,
+    unsigned long seqNo)
+{
+    return ::MakeSignature(ctxtHandle, qop, message, seqNo);
+}
+
+SECURITY_STATUS WindowsSspiProvider::VerifySignature(
+    CtxtHandle* ctxtHandle,
+    SecBufferDesc* message,
+    unsigned long seqNo,
+    unsigned long* qop)
+{
+    return ::VerifySignature(ctxtHandle, message, seqNo, qop);
+}
+
+SECURITY_STATUS WindowsSspiProvider::EncryptMessage(
+    CtxtHandle* ctxtHandle,
+    unsigned long qop,
+    SecBufferDesc* message,
+    unsigned long seqNo)
+{
+    return ::EncryptMessage(ctxtHandle, qop, message, seqNo);
+}
+
+SECURITY_STATUS WindowsSspiProvider::DecryptMessage(
+    CtxtHandle* ctxtHandle,
+    SecBufferDesc* message,
+    unsigned long seqNo,
+    unsigned long* qop)
+{
+    return ::DecryptMessage(ctxtHandle, message, seqNo, qop);
+}
+
+#endif  // IS_SUPPORTED_NODE_VERSION
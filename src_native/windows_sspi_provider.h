@@ -0,0 +1,79 @@
+#pragma once
+
+#include "sspi_provider.h"
+
+// Provider that passes calls straight through to the Windows SSPI
+// implementation in secur32.dll.
+class WindowsSspiProvider : public SspiProvider
+{
+public:
+    static const char* c_name;
+
+    const char* GetName() const;
+
+    SECURITY_STATUS EnumeratePackages(std::vector<SspiPackageInfo>* packages);
+
+    SECURITY_STATUS AcquireCredentials(
+        const WCHAR* principal,
+        const WCHAR* securityPackage,
+        unsigned long credentialUse,
+        CredHandle* credHandle,
+        TimeStamp* timeExpiry);
+
+    SECURITY_STATUS FreeCredentials(CredHandle* credHandle);
+
+    SECURITY_STATUS InitializeContext(
+        CredHandle* credHandle,
+        CtxtHandle* ctxtHandle,
+        const WCHAR* targetName,
+        unsigned long contextReq,
+        SecBufferDesc* input,
+        CtxtHandle* newCtxtHandle,
+        SecBufferDesc* output,
+        unsigned long* contextAttr,
+        TimeStamp* timeExpiry);
+
+    SECURITY_STATUS AcceptContext(
+        CredHandle* credHandle,
+        CtxtHandle* ctxtHandle,
+        SecBufferDesc* input,
+        unsigned long contextReq,
+        CtxtHandle* newCtxtHandle,
+        SecBufferDesc* output,
+        unsigned long* contextAttr,
+        TimeStamp* timeExpiry);
+
+    SECURITY_STATUS CompleteToken(
+        CtxtHandle* ctxtHandle,
+        SecBufferDesc* token);
+
+    SECURITY_STATUS DeleteContext(CtxtHandle* ctxtHandle);
+
+    SECURITY_STATUS QueryContextSizes(
+        CtxtHandle* ctxtHandle,
+        SecPkgContext_Sizes* sizes);
+
+    SECURITY_STATUS MakeSignature(
+        CtxtHandle* ctxtHandle,
+        unsigned long qop,
+        SecBufferDesc* message,
+        unsigned long seqNo);
+
+    SECURITY_STATUS VerifySignature(
+        CtxtHandle* ctxtHandle,
+        SecBufferDesc* message,
+        unsigned long seqNo,
+        unsigned long* qop);
+
+    SECURITY_STATUS EncryptMessage(
+        CtxtHandle* ctxtHandle,
+        unsigned long qop,
+        SecBufferDesc* message,
+        unsigned long seqNo);
+
+    SECURITY_STATUS DecryptMessage(
+        CtxtHandle* ctxtHandle,
+        SecBufferDesc* message,
+        unsigned long seqNo,
+        unsigned long* qop);
+};
@@ -0,0 +1,223 @@
+#include "node_version_support.h"
+#ifdef IS_SUPPORTED_NODE_VERSION
+
+#include "worker_pool.h"
+
+#include "utils.h"
+
+#include <thread>
+
+// static
+WorkerPool* WorkerPool::GetInstance()
+{
+    // Intentionally leaked. Threads are detached and may still be waiting for
+    // work while static destructors run at process exit.
+    static WorkerPool* s_workerPool = new WorkerPool();
+    return s_workerPool;
+}
+
+WorkerPool::WorkerPool() :
+    m_mutex(),
+    m_workAvailable(),
+    m_scheduler(),
+    m_size(c_defaultSize),
+    m_maxSize(c_defaultSize),
+    m_idleTimeoutMs(c_defaultIdleTimeoutMs),
+    m_deadlineMs(c_defaultDeadlineMs),
+    m_backgroundDeadlineMs(c_defaultBackgroundDeadlineMs),
+    m_threads(0),
+    m_idleThreads(0),
+    m_peakThreads(0),
+    m_peakQueueDepth(0),
+    m_submitted(0),
+    m_completed(0),
+    m_totalWaitUs(0),
+    m_maxWaitUs(0)
+{
+}
+
+WorkerPool::~WorkerPool()
+{
+}
+
+void WorkerPool::Configure(int size, int maxSize, int idleTimeoutMs)
+{
+    DebugLog("%d: WorkerPool::Configure: size=%d, maxSize=%d, idleTimeoutMs=%d.\n",
+        GetCurrentThreadId(),
+        size,
+        maxSize,
+        idleTimeoutMs);
+
+    std::lock_guard<std::mutex> lock(m_mutex);
+    m_size = size > 0 ? size : 1;
+    m_maxSize = maxSize > m_size ? maxSize : m_size;
+    m_idleTimeoutMs = idleTimeoutMs >= 0 ? idleTimeoutMs : c_defaultIdleTimeoutMs;
+
+    // Wake idle threads to re-evaluate against the new limits.
+    m_workAvailable.notify_all();
+}
+
+void WorkerPool::ConfigureScheduling(
+    SchedulingPolicy policy,
+    int deadlineMs,
+    int backgroundDeadlineMs,
+    const std::map<std::string, int>& tenantWeights)
+{
+    DebugLog("%d: WorkerPool::ConfigureScheduling: policy=%d, deadlineMs=%d, backgroundDeadlineMs=%d.\n",
+        GetCurrentThreadId(),
+        policy,
+        deadlineMs,
+        backgroundDeadlineMs);
+
+    std::lock_guard<std::mutex> lock(m_mutex);
+    m_scheduler.Configure(policy, tenantWeights);
+    m_deadlineMs = deadlineMs > 0 ? deadlineMs : c_defaultDeadlineMs;
+    m_backgroundDeadlineMs = backgroundDeadlineMs > 0 ? backgroundDeadlineMs : c_defaultBackgroundDeadlineMs;
+}
+
+void WorkerPool::Submit(const Task& task)
+{
+    Submit(std::string(), 0, task);
+}
+
+void WorkerPool::Submit(const std::string& tenant, int deadlineMs, const Task& task)
+{
+    std::lock_guard<std::mutex> lock(m_mutex);
+    SubmitWithDeadline(tenant, deadlineMs > 0 ? deadlineMs : m_deadlineMs, task);
+}
+
+void WorkerPool::SubmitBackground(const std::string& tenant, const Task& task)
+{
+    std::lock_guard<std::mutex> lock(m_mutex);
+    SubmitWithDeadline(tenant, m_backgroundDeadlineMs, task);
+}
+
+// Called with m_mutex held.
+void WorkerPool::SubmitWithDeadline(const std::string& tenant, int deadlineMs, const Task& task)
+{
+    std::chrono::steady_clock::time_point now = std::chrono::steady_clock::now();
+    m_scheduler.Push(task, tenant, now, now + std::chrono::milliseconds(deadlineMs));
+
+    m_submitted++;
+    if (m_peakQueueDepth < m_scheduler.GetSize())
+    {
+        m_peakQueueDepth = m_scheduler.GetSize();
+    }
+
+    // Core threads start on demand, elastic ones only when tasks would wait.
+    if (m_threads < m_size
+        || (m_threads < m_maxSize && static_cast<int>(m_scheduler.GetSize()) > m_idleThreads))
+    {
+        StartThread();
+    }
+    else
+    {
+        m_workAvailable.notify_one();
+    }
+}
+
+// Called with m_mutex held.
+void WorkerPool::StartThread()
+{
+    m_threads++;
+    if (m_peakThreads < static_cast<uint64_t>(m_threads))
+    {
+        m_peakThreads = m_threads;
+    }
+
+    std::thread(&WorkerPool::ThreadMain, this).detach();
+}
+
+void WorkerPool::ThreadMain()
+{
+    DebugLog("%d: Worker pool thread: WorkerPool::ThreadMain: started.\n", GetCurrentThreadId());
+
+    std::unique_lock<std::mutex> lock(m_mutex);
+    while (true)
+    {
+        while (m_scheduler.IsEmpty())
+        {
+            if (m_threads > m_maxSize)
+            {
+                m_threads--;
+                return;
+            }
+
+            bool isElastic = m_threads > m_size;
+            bool timedOut = false;
+
+            m_idleThreads++;
+            if (isElastic)
+            {
+                timedOut = m_workAvailable.wait_for(lock, std::chrono::milliseconds(m_idleTimeoutMs))
+                    == std::cv_status::timeout;
+            }
+            else
+            {
+                m_workAvailable.wait(lock);
+            }
+            m_idleThreads--;
+
+            if (timedOut && m_scheduler.IsEmpty() && m_threads > m_size)
+            {
+                DebugLog("%d: Worker pool thread: WorkerPool::ThreadMain: idle, exiting.\n",
+                    GetCurrentThreadId());
+                m_threads--;
+                return;
+            }
+        }
+
+        std::chrono::steady_clock::time_point startedAt = std::chrono::steady_clock::now();
+        ScheduledTask scheduledTask;
+        m_scheduler.Pop(startedAt, &scheduledTask);
+
+        uint64_t waitUs = static_cast<uint64_t>(std::chrono::duration_cast<std::chrono::microseconds>(
+            startedAt - scheduledTask.queuedAt).count());
+        m_totalWaitUs += waitUs;
+        if (m_maxWaitUs < waitUs)
+        {
+            m_maxWaitUs = waitUs;
+        }
+
+        lock.unlock();
+        scheduledTask.task();
+        uint64_t runUs = static_cast<uint64_t>(std::chrono::duration_cast<std::chrono::microseconds>(
+            std::chrono::steady_clock::now() - startedAt).count());
+        lock.lock();
+
+        m_scheduler.Complete(scheduledTask, runUs);
+        m_completed++;
+    }
+}
+
+void WorkerPool::GetStats(WorkerPoolStats* stats)
+{
+    std::lock_guard<std::mutex> lock(m_mutex);
+    stats->size = m_size;
+    stats->maxSize = m_maxSize;
+    stats->threads = m_threads;
+    stats->idleThreads = m_idleThreads;
+    stats->peakThreads = m_peakThreads;
+    stats->queueDepth = m_scheduler.GetSize();
+    stats->peakQueueDepth = m_peakQueueDepth;
+    stats->submitted = m_submitted;
+    stats->completed = m_completed;
+    stats->totalWaitUs = m_totalWaitUs;
+    stats->maxWaitUs = m_maxWaitUs;
+    stats->tenants = m_scheduler.GetTenantCount();
+    stats->deadlineMisses = m_scheduler.GetDeadlineMisses();
+}
+
+void WorkerPool::ResetStats()
+{
+    std::lock_guard<std::mutex> lock(m_mutex);
+    m_peakThreads = m_threads;
+    m_peakQueueDepth = m_scheduler.GetSize();
+    m_submitted = 0;
+    m_completed = 0;
+    m_totalWaitUs = 0;
+    m_maxWaitUs = 0;
+    m_scheduler.ResetDeadlineMisses();
+}
+
+#endif  // IS_SUPPORTED_NODE_VERSION
@@ -0,0 +1,117 @@
+#pragma once
+
+#include "task_scheduler.h"
+
+#include <stdint.h>
+
+#include <chrono>
+#include <condition_variable>
+#include <functional>
+#include <map>
+#include <mutex>
+#include <string>
+
+struct WorkerPoolStats
+{
+    uint64_t size;
+    uint64_t maxSize;
+    uint64_t threads;
+    uint64_t idleThreads;
+    uint64_t peakThreads;
+    uint64_t queueDepth;
+    uint64_t peakQueueDepth;
+    uint64_t submitted;
+    uint64_t completed;
+    uint64_t totalWaitUs;
+    uint64_t maxWaitUs;
+    uint64_t tenants;
+
+    // Tasks that started after their deadline.
+    uint64_t deadlineMisses;
+};
+
+// Threads owned by the addon for SSPI calls, so a call blocked on a slow KDC
+// only holds up other SSPI calls and not the libuv thread pool everyone else
+// shares. Threads are started on demand up to size. When maxSize is larger,
+// threads past size are started while tasks are waiting and exit after
+// idleTimeoutMs without work.
+//
+// Queued tasks are ordered by TaskScheduler: threads are shared fairly
+// between tenants, e.g. SPNs, and each tenant's tasks run earliest deadline
+// first. Background work, like refilling pools ahead of need, gets a longer
+// deadline than calls someone is waiting for, so a burst of it doesn't hold
+// up logins but still runs under sustained load.
+//
+// Thread-safe. No V8 or libuv dependencies, completion back on the main event
+// loop is up to the caller.
+class WorkerPool
+{
+public:
+    typedef std::function<void()> Task;
+
+    static WorkerPool* GetInstance();
+
+    // size must be at least 1. maxSize below size is taken as size. Takes
+    // effect for running threads as they go idle.
+    void Configure(int size, int maxSize, int idleTimeoutMs);
+
+    // Interactive task of no particular tenant.
+    void Submit(const Task& task);
+
+    // deadlineMs from now, 0 for the configured deadline of interactive
+    // tasks.
+    void Submit(const std::string& tenant, int deadlineMs, const Task& task);
+
+    // Task nobody is waiting for, with the configured background deadline.
+    void SubmitBackground(const std::string& tenant, const Task& task);
+
+    // Deadlines are in milliseconds from submission, values not above 0 keep
+    // the defaults. Tenants missing from tenantWeights have weight 1.
+    void ConfigureScheduling(
+        SchedulingPolicy policy,
+        int deadlineMs,
+        int backgroundDeadlineMs,
+        const std::map<std::string, int>& tenantWeights);
+
+    void GetStats(WorkerPoolStats* stats);
+
+    // Resets the cumulative counters and peaks.
+    void ResetStats();
+
+    static const int c_defaultSize = 4;
+    static const int c_defaultIdleTimeoutMs = 10000;
+    static const int c_defaultDeadlineMs = 1000;
+    static const int c_defaultBackgroundDeadlineMs = 30000;
+
+private:
+    WorkerPool();
+
+    // Not implemented. Never destroyed, see GetInstance.
+    WorkerPool(const WorkerPool&);
+    WorkerPool& operator=(const WorkerPool&);
+    ~WorkerPool();
+
+    void SubmitWithDeadline(const std::string& tenant, int deadlineMs, const Task& task);
+    void StartThread();
+    void ThreadMain();
+
+    std::mutex m_mutex;
+    std::condition_variable m_workAvailable;
+    TaskScheduler m_scheduler;
+
+    int m_size;
+    int m_maxSize;
+    int m_idleTimeoutMs;
+    int m_deadlineMs;
+    int m_backgroundDeadlineMs;
+
+    int m_threads;
+    int m_idleThreads;
+
+    uint64_t m_peakThreads;
+    uint64_t m_peakQueueDepth;
+    uint64_t m_submitted;
+    uint64_t m_completed;
+    uint64_t m_totalWaitUs;
+    uint64_t m_maxWaitUs;
+};
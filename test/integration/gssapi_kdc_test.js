@@ -0,0 +1,110 @@
+'use strict';
+
+// This test:
+//    - starts a throwaway MIT Kerberos KDC on loopback
+//    - runs Negotiate and Kerberos handshakes between SspiClient and
+//      SspiServer through the gssapi provider, server using a keytab
+//    - benchmarks handshake latency and throughput against the canned path
+//
+// Needs krb5kdc, kdb5_util, kadmin.local and kinit on the path. Linux only.
+
+const childProcess = require('child_process');
+const os = require('os');
+const path = require('path');
+
+const kdcDir = path.join(os.tmpdir(), 'sspi-client-kdc-' + process.pid);
+const scriptDir = path.join(__dirname, 'krb5kdc');
+
+const envLines = childProcess.execFileSync(
+  'bash', [path.join(scriptDir, 'start_kdc.sh'), kdcDir], { encoding: 'utf8' }).split('\n');
+
+// GSSAPI reads these on every call, so setting them before the first handshake
+// is enough.
+envLines.forEach((line) => {
+  const separator = line.indexOf('=');
+  if (separator > 0) {
+    process.env[line.slice(0, separator)] = line.slice(separator + 1);
+  }
+});
+
+const stopKdc = () => {
+  childProcess.execFileSync('bash', [path.join(scriptDir, 'stop_kdc.sh'), kdcDir]);
+};
+
+process.env.SSPI_CLIENT_PROVIDER = 'gssapi';
+
+const SspiClientApi = require('../../src_js/index.js').SspiClientApi;
+const Loopback = require('../utils/loopback.js');
+const HandshakeBench = require('../../bench/handshake_bench.js');
+
+const spn = 'MSSQLSvc/localhost:1433';
+const securityPackages = ['negotiate', 'kerberos'];
+
+const runHandshakes = (index, cb) => {
+  if (index === securityPackages.length) {
+    cb(null);
+    return;
+  }
+
+  Loopback.runHandshake(spn, securityPackages[index], (err, result) => {
+    if (err) {
+      cb(err);
+      return;
+    }
+
+    console.log('Authentication succeeded. Security package = ', securityPackages[index]);
+    result.legs.forEach((leg) => {
+      console.log('  ', leg.from, 'token (', leg.length, 'bytes): isDone=', leg.isDone);
+    });
+
+    runHandshakes(index + 1, cb);
+  });
+};
+
+const runBenchmarks = (index, cb) => {
+  if (index === securityPackages.length) {
+    cb(null);
+    return;
+  }
+
+  const options = { iterations: 500, concurrency: 8, securityPackage: securityPackages[index], spn: spn };
+  HandshakeBench.runBenchmark(options, (err, results) => {
+    if (err) {
+      cb(err);
+      return;
+    }
+
+    results.forEach((result) => console.log(JSON.stringify(result)));
+    runBenchmarks(index + 1, cb);
+  });
+};
+
+SspiClientApi.ensureInitialization((errorCode, errorString) => {
+  if (errorCode !== 0) {
+    console.log('Initialization failed: ', errorString);
+    stopKdc();
+    process.exitCode = 1;
+    return;
+  }
+
+  console.log('Provider = ', SspiClientApi.getProviderName(),
+    ', available packages = ', SspiClientApi.getAvailableSspiPackageNames());
+
+  runHandshakes(0, (err) => {
+    if (err) {
+      console.log('Error: ', err.message);
+      stopKdc();
+      process.exitCode = 1;
+      return;
+    }
+
+    runBenchmarks(0, (err) => {
+      if (err) {
+        console.log('Error: ', err.message);
+        process.exitCode = 1;
+      }
+
+      stopKdc();
+    });
+  });
+});
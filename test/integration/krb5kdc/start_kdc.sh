@@ -0,0 +1,76 @@
+#!/bin/bash
+#
+# Starts a throwaway MIT Kerberos KDC on loopback for GSSAPI integration
+# tests. Everything lives under the directory passed in, nothing is written
+# to system locations.
+#
+# Usage: start_kdc.sh <dir> [port]
+#
+# Prints environment assignments (KRB5_CONFIG, KRB5_KDC_PROFILE, KRB5_KTNAME,
+# KRB5CCNAME) to stdout for the test process to use. The client principal
+# 'user' has a TGT in the ccache and the service principal
+# MSSQLSvc/localhost:1433 has its key in the keytab.
+
+set -e
+
+dir="$1"
+port="${2:-18888}"
+realm="SSPI.TEST"
+
+if [ -z "$dir" ]; then
+  echo "Usage: $0 <dir> [port]" >&2
+  exit 1
+fi
+
+mkdir -p "$dir"
+dir="$(cd "$dir" && pwd)"
+
+cat > "$dir/krb5.conf" <<CONF
+[libdefaults]
+    default_realm = $realm
+    dns_lookup_kdc = false
+    dns_lookup_realm = false
+    rdns = false
+
+[realms]
+    $realm = {
+        kdc = 127.0.0.1:$port
+    }
+CONF
+
+cat > "$dir/kdc.conf" <<CONF
+[kdcdefaults]
+    kdc_listen = 127.0.0.1:$port
+    kdc_tcp_listen = 127.0.0.1:$port
+
+[realms]
+    $realm = {
+        database_name = $dir/principal
+        key_stash_file = $dir/stash
+        acl_file = $dir/kadm5.acl
+    }
+
+[logging]
+    kdc = FILE:$dir/kdc.log
+CONF
+
+touch "$dir/kadm5.acl"
+
+export KRB5_CONFIG="$dir/krb5.conf"
+export KRB5_KDC_PROFILE="$dir/kdc.conf"
+export KRB5_KTNAME="FILE:$dir/server.keytab"
+export KRB5CCNAME="FILE:$dir/ccache"
+
+kdb5_util create -s -r "$realm" -P masterpassword > /dev/null
+kadmin.local -r "$realm" -q "addprinc -pw userpassword user" > /dev/null
+kadmin.local -r "$realm" -q "addprinc -randkey MSSQLSvc/localhost:1433" > /dev/null
+kadmin.local -r "$realm" -q "ktadd -k $dir/server.keytab MSSQLSvc/localhost:1433" > /dev/null
+
+krb5kdc -P "$dir/kdc.pid"
+
+echo userpassword | kinit user > /dev/null
+
+echo "KRB5_CONFIG=$KRB5_CONFIG"
+echo "KRB5_KDC_PROFILE=$KRB5_KDC_PROFILE"
+echo "KRB5_KTNAME=$KRB5_KTNAME"
+echo "KRB5CCNAME=$KRB5CCNAME"
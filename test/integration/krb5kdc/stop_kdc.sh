@@ -0,0 +1,18 @@
+#!/bin/bash
+#
+# Stops the KDC started by start_kdc.sh and removes its directory.
+#
+# Usage: stop_kdc.sh <dir>
+
+dir="$1"
+
+if [ -z "$dir" ]; then
+  echo "Usage: $0 <dir>" >&2
+  exit 1
+fi
+
+if [ -f "$dir/kdc.pid" ]; then
+  kill "$(cat "$dir/kdc.pid")" 2> /dev/null
+fi
+
+rm -rf "$dir"
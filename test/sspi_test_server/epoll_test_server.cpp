@@ -0,0 +1,663 @@
+// Concurrent test authentication server for Linux, see epoll_test_server.h.
+//
+// Usage: sspi-test-server [port] [acceptorThreads] [securityPackage] [provider]
+//
+// Defaults to port 2000, 4 acceptor threads, negotiate and the platform
+// provider. Prints a JSON line of counters every second while there's
+// traffic and once more on SIGINT or SIGTERM. Each connection holds a file
+// descriptor, raise ulimit -n for thousands of them.
+
+#include "node_version_support.h"
+
+#include <stdio.h>
+
+#ifdef IS_SUPPORTED_NODE_VERSION
+
+#include "epoll_test_server.h"
+
+#include "sspi_impl.h"
+#include "sspi_provider.h"
+#include "sspi_server_impl.h"
+#include "utils.h"
+#include "worker_pool.h"
+
+#include <arpa/inet.h>
+#include <errno.h>
+#include <netinet/in.h>
+#include <netinet/tcp.h>
+#include <signal.h>
+#include <stdlib.h>
+#include <string.h>
+#include <sys/epoll.h>
+#include <sys/eventfd.h>
+#include <sys/socket.h>
+#include <unistd.h>
+
+#include <chrono>
+#include <thread>
+
+namespace
+{
+    const int c_defaultPort = 2000;
+    const int c_maxEvents = 256;
+    const int c_readChunkSize = 64 * 1024;
+    const int c_statsIntervalMs = 1000;
+
+    // Frame header, the blob length in host byte order as SendMsg sends it.
+    const size_t c_headerLength = sizeof(uint32_t);
+
+    void UpdatePeak(std::atomic<uint64_t>* peak, uint64_t value)
+    {
+        uint64_t current = peak->load();
+        while (value > current && !peak->compare_exchange_weak(current, value))
+        {
+        }
+    }
+
+    // Authenticates with SspiServerImpl over the default provider.
+    class SspiServerAcceptorContext : public AcceptorContext
+    {
+    public:
+        explicit SspiServerAcceptorContext(const std::string& securityPackage)
+            : m_sspiServerImpl(securityPackage.c_str())
+        {
+        }
+
+        virtual SECURITY_STATUS AcceptNextBlob(
+            const char* inBlob,
+            int inBlobLength,
+            std::vector<char>* outBlob,
+            bool* isDone,
+            std::string* errorString)
+        {
+            char* blob = nullptr;
+            int blobLength = 0;
+            SECURITY_STATUS securityStatus = m_sspiServerImpl.AcceptNextBlob(
+                inBlob, inBlobLength, &blob, &blobLength, isDone, errorString);
+            if (blob != nullptr)
+            {
+                outBlob->assign(blob, blob + blobLength);
+                SspiImpl::FreeBlob(blob);
+            }
+
+            return securityStatus;
+        }
+
+    private:
+        SspiServerImpl m_sspiServerImpl;
+    };
+
+    class SspiServerAcceptor : public Acceptor
+    {
+    public:
+        explicit SspiServerAcceptor(const char* securityPackage)
+            : m_securityPackage(securityPackage)
+        {
+        }
+
+        virtual std::unique_ptr<AcceptorContext> CreateContext()
+        {
+            return std::unique_ptr<AcceptorContext>(new SspiServerAcceptorContext(m_securityPackage));
+        }
+
+    private:
+        std::string m_securityPackage;
+    };
+
+    EpollTestServer* s_server = nullptr;
+
+    void OnStopSignal(int)
+    {
+        s_server->Stop();
+    }
+}
+
+EpollTestServer::EpollTestServer(Acceptor* acceptor, int acceptorThreads) :
+    m_acceptor(acceptor),
+    m_acceptorThreads(acceptorThreads > 0 ? acceptorThreads : 1),
+    m_port(0),
+    m_listenFd(-1),
+    m_epollFd(-1),
+    m_eventFd(-1),
+    m_isStopping(false),
+    m_connections(),
+    m_completionsMutex(),
+    m_completions(),
+    m_connectionCount(0),
+    m_activeConnections(0),
+    m_peakActiveConnections(0),
+    m_handshakes(0),
+    m_failures(0),
+    m_messagesIn(0),
+    m_messagesOut(0)
+{
+}
+
+EpollTestServer::~EpollTestServer()
+{
+    if (m_listenFd != -1)
+    {
+        close(m_listenFd);
+    }
+
+    if (m_eventFd != -1)
+    {
+        close(m_eventFd);
+    }
+
+    if (m_epollFd != -1)
+    {
+        close(m_epollFd);
+    }
+}
+
+bool EpollTestServer::Listen(int port, std::string* errorString)
+{
+    m_listenFd = socket(AF_INET, SOCK_STREAM | SOCK_NONBLOCK | SOCK_CLOEXEC, 0);
+    m_epollFd = epoll_create1(EPOLL_CLOEXEC);
+    m_eventFd = eventfd(0, EFD_NONBLOCK | EFD_CLOEXEC);
+    if (m_listenFd == -1 || m_epollFd == -1 || m_eventFd == -1)
+    {
+        *errorString = std::string("Failed to create sockets: ") + strerror(errno);
+        return false;
+    }
+
+    int reuseAddress = 1;
+    setsockopt(m_listenFd, SOL_SOCKET, SO_REUSEADDR, &reuseAddress, sizeof(reuseAddress));
+
+    sockaddr_in address;
+    memset(&address, 0, sizeof(address));
+    address.sin_family = AF_INET;
+    address.sin_addr.s_addr = htonl(INADDR_ANY);
+    address.sin_port = htons(static_cast<uint16_t>(port));
+    if (bind(m_listenFd, reinterpret_cast<sockaddr*>(&address), sizeof(address)) == -1
+        || listen(m_listenFd, SOMAXCONN) == -1)
+    {
+        *errorString = std::string("Failed to listen: ") + strerror(errno);
+        return false;
+    }
+
+    socklen_t addressLength = sizeof(address);
+    getsockname(m_listenFd, reinterpret_cast<sockaddr*>(&address), &addressLength);
+    m_port = ntohs(address.sin_port);
+
+    epoll_event event;
+    memset(&event, 0, sizeof(event));
+    event.events = EPOLLIN;
+    event.data.fd = m_listenFd;
+    epoll_ctl(m_epollFd, EPOLL_CTL_ADD, m_listenFd, &event);
+    event.data.fd = m_eventFd;
+    epoll_ctl(m_epollFd, EPOLL_CTL_ADD, m_eventFd, &event);
+
+    WorkerPool::GetInstance()->Configure(m_acceptorThreads, m_acceptorThreads, -1);
+    return true;
+}
+
+void EpollTestServer::Run()
+{
+    epoll_event events[c_maxEvents];
+    while (!m_isStopping)
+    {
+        int eventCount = epoll_wait(m_epollFd, events, c_maxEvents, -1);
+        if (eventCount == -1)
+        {
+            if (errno == EINTR)
+            {
+                continue;
+            }
+
+            fprintf(stderr, "epoll_wait failed: %s\n", strerror(errno));
+            break;
+        }
+
+        for (int i = 0; i < eventCount; i++)
+        {
+            int fd = events[i].data.fd;
+            if (fd == m_listenFd)
+            {
+                AcceptConnections();
+                continue;
+            }
+
+            if (fd == m_eventFd)
+            {
+                uint64_t signalCount;
+                while (read(m_eventFd, &signalCount, sizeof(signalCount)) > 0)
+                {
+                }
+
+                OnCompletions();
+                continue;
+            }
+
+            // May have been closed handling an earlier event.
+            std::unordered_map<int, std::shared_ptr<Connection>>::iterator it = m_connections.find(fd);
+            if (it == m_connections.end())
+            {
+                continue;
+            }
+
+            std::shared_ptr<Connection> connection = it->second;
+            if (events[i].events & EPOLLOUT)
+            {
+                OnWritable(connection);
+            }
+
+            if (!connection->isClosed && (events[i].events & (EPOLLIN | EPOLLHUP | EPOLLERR)))
+            {
+                OnReadable(connection);
+            }
+        }
+    }
+
+    while (!m_connections.empty())
+    {
+        Close(m_connections.begin()->second);
+    }
+}
+
+void EpollTestServer::Stop()
+{
+    m_isStopping = true;
+
+    uint64_t signal = 1;
+    ssize_t written = write(m_eventFd, &signal, sizeof(signal));
+    (void)written;
+}
+
+void EpollTestServer::GetStats(EpollTestServerStats* stats) const
+{
+    stats->connections = m_connectionCount.load();
+    stats->activeConnections = m_activeConnections.load();
+    stats->peakActiveConnections = m_peakActiveConnections.load();
+    stats->handshakes = m_handshakes.load();
+    stats->failures = m_failures.load();
+    stats->messagesIn = m_messagesIn.load();
+    stats->messagesOut = m_messagesOut.load();
+}
+
+void EpollTestServer::AcceptConnections()
+{
+    while (true)
+    {
+        int fd = accept4(m_listenFd, nullptr, nullptr, SOCK_NONBLOCK | SOCK_CLOEXEC);
+        if (fd == -1)
+        {
+            if (errno != EAGAIN && errno != EWOULDBLOCK && errno != ECONNABORTED)
+            {
+                fprintf(stderr, "accept failed: %s\n", strerror(errno));
+            }
+
+            return;
+        }
+
+        int noDelay = 1;
+        setsockopt(fd, IPPROTO_TCP, TCP_NODELAY, &noDelay, sizeof(noDelay));
+
+        std::shared_ptr<Connection> connection(new Connection());
+        connection->fd = fd;
+        connection->outOffset = 0;
+        connection->events = EPOLLIN;
+        connection->context = m_acceptor->CreateContext();
+        connection->isAccepting = false;
+        connection->isDone = false;
+        connection->isPeerClosed = false;
+        connection->isClosed = false;
+
+        epoll_event event;
+        memset(&event, 0, sizeof(event));
+        event.events = EPOLLIN;
+        event.data.fd = fd;
+        epoll_ctl(m_epollFd, EPOLL_CTL_ADD, fd, &event);
+        m_connections[fd] = connection;
+
+        m_connectionCount++;
+        UpdatePeak(&m_peakActiveConnections, ++m_activeConnections);
+        DebugLog("%d: EpollTestServer: Connection %d accepted.\n", GetCurrentThreadId(), fd);
+    }
+}
+
+void EpollTestServer::OnReadable(const std::shared_ptr<Connection>& connection)
+{
+    char buffer[c_readChunkSize];
+    while (true)
+    {
+        ssize_t bytesRead = recv(connection->fd, buffer, sizeof(buffer), 0);
+        if (bytesRead > 0)
+        {
+            connection->inBuffer.insert(connection->inBuffer.end(), buffer, buffer + bytesRead);
+            continue;
+        }
+
+        if (bytesRead == -1 && (errno == EAGAIN || errno == EWOULDBLOCK))
+        {
+            break;
+        }
+
+        if (bytesRead == -1 && errno == EINTR)
+        {
+            continue;
+        }
+
+        if (bytesRead == 0)
+        {
+            connection->isPeerClosed = true;
+            UpdateEvents(connection);
+            break;
+        }
+
+        Close(connection);
+        return;
+    }
+
+    StartAccept(connection);
+    if (connection->isPeerClosed && !connection->isAccepting)
+    {
+        Close(connection);
+    }
+}
+
+void EpollTestServer::OnWritable(const std::shared_ptr<Connection>& connection)
+{
+    Flush(connection);
+}
+
+// Hands the next complete blob to an acceptor thread. Blobs are accepted in
+// order, one at a time per connection.
+void EpollTestServer::StartAccept(const std::shared_ptr<Connection>& connection)
+{
+    if (connection->isAccepting || connection->isDone || connection->inBuffer.size() < c_headerLength)
+    {
+        return;
+    }
+
+    uint32_t blobLength;
+    memcpy(&blobLength, connection->inBuffer.data(), c_headerLength);
+    if (blobLength > c_maxMessageLength)
+    {
+        fprintf(stderr, "Connection %d: blob of %u bytes is too large.\n", connection->fd, blobLength);
+        m_failures++;
+        Close(connection);
+        return;
+    }
+
+    if (connection->inBuffer.size() < c_headerLength + blobLength)
+    {
+        return;
+    }
+
+    std::shared_ptr<std::vector<char>> blob(new std::vector<char>(
+        connection->inBuffer.begin() + c_headerLength,
+        connection->inBuffer.begin() + c_headerLength + blobLength));
+    connection->inBuffer.erase(connection->inBuffer.begin(), connection->inBuffer.begin() + c_headerLength + blobLength);
+    connection->isAccepting = true;
+    m_messagesIn++;
+
+    std::shared_ptr<Connection> acceptingConnection = connection;
+    WorkerPool::GetInstance()->Submit([this, acceptingConnection, blob]()
+    {
+        Completion completion;
+        completion.connection = acceptingConnection;
+        completion.isDone = false;
+        completion.securityStatus = acceptingConnection->context->AcceptNextBlob(
+            blob->data(),
+            static_cast<int>(blob->size()),
+            &completion.outBlob,
+            &completion.isDone,
+            &completion.errorString);
+
+        {
+            std::lock_guard<std::mutex> lock(m_completionsMutex);
+            m_completions.push_back(std::move(completion));
+        }
+
+        uint64_t signal = 1;
+        ssize_t written = write(m_eventFd, &signal, sizeof(signal));
+        (void)written;
+    });
+}
+
+void EpollTestServer::OnCompletions()
+{
+    std::deque<Completion> completions;
+    {
+        std::lock_guard<std::mutex> lock(m_completionsMutex);
+        completions.swap(m_completions);
+    }
+
+    for (size_t i = 0; i < completions.size(); i++)
+    {
+        Completion& completion = completions[i];
+        std::shared_ptr<Connection> connection = completion.connection;
+        connection->isAccepting = false;
+
+        // The client went away while the acceptor ran.
+        if (connection->isClosed)
+        {
+            continue;
+        }
+
+        if (completion.securityStatus < 0)
+        {
+            fprintf(stderr, "Connection %d: AcceptNextBlob failed: 0x%08x: %s\n",
+                connection->fd,
+                static_cast<unsigned int>(completion.securityStatus),
+                completion.errorString.c_str());
+            m_failures++;
+            Close(connection);
+            continue;
+        }
+
+        if (!completion.outBlob.empty())
+        {
+            uint32_t blobLength = static_cast<uint32_t>(completion.outBlob.size());
+            const char* header = reinterpret_cast<const char*>(&blobLength);
+            connection->outBuffer.insert(connection->outBuffer.end(), header, header + c_headerLength);
+            connection->outBuffer.insert(connection->outBuffer.end(), completion.outBlob.begin(), completion.outBlob.end());
+            m_messagesOut++;
+        }
+
+        if (completion.isDone)
+        {
+            connection->isDone = true;
+            m_handshakes++;
+            DebugLog("%d: EpollTestServer: Connection %d authenticated.\n", GetCurrentThreadId(), connection->fd);
+        }
+
+        Flush(connection);
+        if (connection->isClosed)
+        {
+            continue;
+        }
+
+        StartAccept(connection);
+        if (connection->isPeerClosed && !connection->isAccepting)
+        {
+            Close(connection);
+        }
+    }
+}
+
+// Sends what it can without blocking, the rest when the socket is writable.
+// Closes the connection once the handshake is done and everything is sent.
+void EpollTestServer::Flush(const std::shared_ptr<Connection>& connection)
+{
+    while (connection->outOffset < connection->outBuffer.size())
+    {
+        ssize_t bytesSent = send(
+            connection->fd,
+            connection->outBuffer.data() + connection->outOffset,
+            connection->outBuffer.size() - connection->outOffset,
+            MSG_NOSIGNAL);
+        if (bytesSent > 0)
+        {
+            connection->outOffset += bytesSent;
+            continue;
+        }
+
+        if (bytesSent == -1 && errno == EINTR)
+        {
+            continue;
+        }
+
+        if (bytesSent == -1 && (errno == EAGAIN || errno == EWOULDBLOCK))
+        {
+            break;
+        }
+
+        Close(connection);
+        return;
+    }
+
+    if (connection->outOffset == connection->outBuffer.size())
+    {
+        connection->outBuffer.clear();
+        connection->outOffset = 0;
+        if (connection->isDone)
+        {
+            Close(connection);
+            return;
+        }
+    }
+
+    UpdateEvents(connection);
+}
+
+// Level triggered, so no EPOLLIN after the client shuts down its side and
+// no EPOLLOUT unless there's something left to send.
+void EpollTestServer::UpdateEvents(const std::shared_ptr<Connection>& connection)
+{
+    uint32_t events = 0;
+    if (!connection->isPeerClosed)
+    {
+        events |= EPOLLIN;
+    }
+
+    if (connection->outOffset < connection->outBuffer.size())
+    {
+        events |= EPOLLOUT;
+    }
+
+    if (events != connection->events)
+    {
+        epoll_event event;
+        memset(&event, 0, sizeof(event));
+        event.events = events;
+        event.data.fd = connection->fd;
+        epoll_ctl(m_epollFd, EPOLL_CTL_MOD, connection->fd, &event);
+        connection->events = events;
+    }
+}
+
+// An acceptor thread may still hold the connection, its context goes away
+// with the last reference.
+void EpollTestServer::Close(const std::shared_ptr<Connection>& connection)
+{
+    if (connection->isClosed)
+    {
+        return;
+    }
+
+    DebugLog("%d: EpollTestServer: Connection %d closed.\n", GetCurrentThreadId(), connection->fd);
+
+    epoll_ctl(m_epollFd, EPOLL_CTL_DEL, connection->fd, nullptr);
+    close(connection->fd);
+    connection->isClosed = true;
+    m_activeConnections--;
+
+    // connection may be the map's own reference, erase it last.
+    std::shared_ptr<Connection> keepAlive = connection;
+    m_connections.erase(keepAlive->fd);
+}
+
+static void PrintStats(const EpollTestServer& server)
+{
+    EpollTestServerStats stats;
+    server.GetStats(&stats);
+    printf("{\"connections\":%llu,\"activeConnections\":%llu,\"peakActiveConnections\":%llu,"
+        "\"handshakes\":%llu,\"failures\":%llu,\"messagesIn\":%llu,\"messagesOut\":%llu}\n",
+        static_cast<unsigned long long>(stats.connections),
+        static_cast<unsigned long long>(stats.activeConnections),
+        static_cast<unsigned long long>(stats.peakActiveConnections),
+        static_cast<unsigned long long>(stats.handshakes),
+        static_cast<unsigned long long>(stats.failures),
+        static_cast<unsigned long long>(stats.messagesIn),
+        static_cast<unsigned long long>(stats.messagesOut));
+    fflush(stdout);
+}
+
+int main(int argc, char* argv[])
+{
+    int port = argc > 1 ? atoi(argv[1]) : c_defaultPort;
+    int acceptorThreads = argc > 2 ? atoi(argv[2]) : WorkerPool::c_defaultSize;
+    const char* securityPackage = argc > 3 ? argv[3] : "negotiate";
+
+    if (argc > 4 && !SspiProvider::SetDefault(argv[4]))
+    {
+        fprintf(stderr, "Unknown SSPI provider '%s'.\n", argv[4]);
+        return 1;
+    }
+
+    std::vector<std::string> availablePackages;
+    int defaultPackageIndex;
+    std::string errorString;
+    SECURITY_STATUS securityStatus = SspiImpl::Initialize(&availablePackages, &defaultPackageIndex, &errorString);
+    if (securityStatus < 0)
+    {
+        fprintf(stderr, "Initialization failed: 0x%08x: %s\n", static_cast<unsigned int>(securityStatus), errorString.c_str());
+        return 1;
+    }
+
+    SspiServerAcceptor acceptor(securityPackage);
+    EpollTestServer server(&acceptor, acceptorThreads);
+    if (!server.Listen(port, &errorString))
+    {
+        fprintf(stderr, "%s\n", errorString.c_str());
+        return 1;
+    }
+
+    s_server = &server;
+    signal(SIGINT, OnStopSignal);
+    signal(SIGTERM, OnStopSignal);
+
+    printf("Listening on port %d with %d acceptor threads, %s over the %s provider.\n",
+        server.GetPort(),
+        acceptorThreads,
+        securityPackage,
+        SspiProvider::GetDefault()->GetName());
+    fflush(stdout);
+
+    std::atomic<bool> isRunning(true);
+    std::thread statsThread([&server, &isRunning]()
+    {
+        uint64_t lastMessages = 0;
+        while (isRunning)
+        {
+            std::this_thread::sleep_for(std::chrono::milliseconds(c_statsIntervalMs));
+
+            EpollTestServerStats stats;
+            server.GetStats(&stats);
+            if (stats.messagesIn != lastMessages)
+            {
+                lastMessages = stats.messagesIn;
+                PrintStats(server);
+            }
+        }
+    });
+
+    server.Run();
+    isRunning = false;
+    statsThread.join();
+    PrintStats(server);
+    return 0;
+}
+
+#else   // IS_SUPPORTED_NODE_VERSION
+
+int main()
+{
+    printf("Not supported on this version of Node.js.\n");
+    return 0;
+}
+
+#endif  // IS_SUPPORTED_NODE_VERSION
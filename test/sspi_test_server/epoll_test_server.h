@@ -0,0 +1,156 @@
+#pragma once
+
+#include "sspi_platform.h"
+
+#include <stdint.h>
+
+#include <atomic>
+#include <deque>
+#include <memory>
+#include <mutex>
+#include <string>
+#include <unordered_map>
+#include <vector>
+
+// Server side authentication of one client connection. Created per
+// connection by an Acceptor and called on acceptor threads, one call at a
+// time.
+class AcceptorContext
+{
+public:
+    virtual ~AcceptorContext() {}
+
+    // Same contract as SspiServerImpl::AcceptNextBlob, outBlob is left empty
+    // when there's nothing to send back.
+    virtual SECURITY_STATUS AcceptNextBlob(
+        const char* inBlob,
+        int inBlobLength,
+        std::vector<char>* outBlob,
+        bool* isDone,
+        std::string* errorString) = 0;
+};
+
+// Pluggable authentication for EpollTestServer. Must be safe to call from
+// multiple acceptor threads at once.
+class Acceptor
+{
+public:
+    virtual ~Acceptor() {}
+
+    virtual std::unique_ptr<AcceptorContext> CreateContext() = 0;
+};
+
+struct EpollTestServerStats
+{
+    uint64_t connections;
+    uint64_t activeConnections;
+    uint64_t peakActiveConnections;
+    uint64_t handshakes;
+    uint64_t failures;
+    uint64_t messagesIn;
+    uint64_t messagesOut;
+};
+
+// Linux test server for concurrency testing, the counterpart of
+// sspi_test_server.cpp. One thread does all socket I/O through epoll on
+// non-blocking sockets. AcceptNextBlob calls run on the WorkerPool, sized
+// to acceptorThreads, and their results are handed back through an eventfd.
+//
+// Speaks the SendMsg/ReceiveMsg framing of sspi_test_server.cpp: a 4 byte
+// length in host byte order followed by the blob, nothing at all for an
+// empty blob. A connection is closed once its handshake is done.
+class EpollTestServer
+{
+public:
+    EpollTestServer(Acceptor* acceptor, int acceptorThreads);
+    ~EpollTestServer();
+
+    // port 0 picks a free port, see GetPort.
+    bool Listen(int port, std::string* errorString);
+
+    int GetPort() const
+    {
+        return m_port;
+    }
+
+    // Serves connections on the calling thread until Stop is called.
+    void Run();
+
+    // Thread-safe and async-signal-safe.
+    void Stop();
+
+    // Thread-safe.
+    void GetStats(EpollTestServerStats* stats) const;
+
+    // Blobs larger than this close the connection, as do failed accepts.
+    static const uint32_t c_maxMessageLength = 64 * 1024;
+
+private:
+    // Not implemented.
+    EpollTestServer(const EpollTestServer&);
+    EpollTestServer& operator=(const EpollTestServer&);
+
+    struct Connection
+    {
+        int fd;
+        std::vector<char> inBuffer;
+        std::vector<char> outBuffer;
+        size_t outOffset;
+
+        // Registered with epoll.
+        uint32_t events;
+
+        // Only used by one acceptor thread at a time, while isAccepting.
+        std::unique_ptr<AcceptorContext> context;
+        bool isAccepting;
+        bool isDone;
+
+        // The client shut down its side, blobs already received are still
+        // accepted.
+        bool isPeerClosed;
+        bool isClosed;
+    };
+
+    struct Completion
+    {
+        std::shared_ptr<Connection> connection;
+        SECURITY_STATUS securityStatus;
+        std::vector<char> outBlob;
+        bool isDone;
+        std::string errorString;
+    };
+
+    void AcceptConnections();
+    void OnReadable(const std::shared_ptr<Connection>& connection);
+    void OnWritable(const std::shared_ptr<Connection>& connection);
+    void StartAccept(const std::shared_ptr<Connection>& connection);
+    void OnCompletions();
+    void Flush(const std::shared_ptr<Connection>& connection);
+    void UpdateEvents(const std::shared_ptr<Connection>& connection);
+    void Close(const std::shared_ptr<Connection>& connection);
+
+    Acceptor* m_acceptor;
+    int m_acceptorThreads;
+    int m_port;
+
+    int m_listenFd;
+    int m_epollFd;
+
+    // Signals completions and Stop.
+    int m_eventFd;
+    std::atomic<bool> m_isStopping;
+
+    // Owned by the I/O thread.
+    std::unordered_map<int, std::shared_ptr<Connection>> m_connections;
+
+    std::mutex m_completionsMutex;
+    std::deque<Completion> m_completions;
+
+    std::atomic<uint64_t> m_connectionCount;
+    std::atomic<uint64_t> m_activeConnections;
+    std::atomic<uint64_t> m_peakActiveConnections;
+    std::atomic<uint64_t> m_handshakes;
+    std::atomic<uint64_t> m_failures;
+    std::atomic<uint64_t> m_messagesIn;
+    std::atomic<uint64_t> m_messagesOut;
+};
@@ -0,0 +1,164 @@
+'use strict';
+
+const SpnResolver = require('../../src_js/index.js').SpnResolver;
+
+// db1 has three addresses, only the last has a PTR record.
+const c_hosts = [
+  '10.0.0.1 - db1',
+  '10.0.0.2 - db1',
+  '10.0.0.3 db1.corp.example.com db1',
+  '10.0.0.4 db2.corp.example.com db2'
+].join('\n');
+
+const c_lookupDelayMs = 50;
+
+function useStubResolver(delayMs) {
+  SpnResolver.utSetStubResolver(c_hosts, delayMs);
+  SpnResolver.configureSpnResolver({ ttlMs: 60000, negativeTtlMs: 60000 });
+  SpnResolver.utResetSpnResolverStats();
+}
+
+function restoreSystemResolver() {
+  SpnResolver.utSetStubResolver('');
+  SpnResolver.configureSpnResolver({});
+}
+
+exports.resolveSpnInvalidArgs = function (test) {
+  if (SpnResolver === undefined) {
+    test.done();
+    return;
+  }
+
+  const cb = () => {};
+  test.throws(() => SpnResolver.resolveSpn('MSSQLSvc', 'db1', 1433), /Invalid number of arguments/);
+  test.throws(() => SpnResolver.resolveSpn(1, 'db1', 1433, cb), /serviceClassname/);
+  test.throws(() => SpnResolver.resolveSpn('MSSQLSvc', '', 1433, cb), /Empty string argument for 'host'/);
+  test.throws(() => SpnResolver.resolveSpn('MSSQLSvc', 'db1', {}, cb), /instanceNameOrPort/);
+  test.throws(() => SpnResolver.resolveSpn('MSSQLSvc', 'db1', 1433, 'cb'), /Invalid argument type for 'cb'/);
+  test.throws(() => SpnResolver.resolveSpn('MSSQLSvc', 'db1', 1433, { deadlineMs: -1 }, cb), /options.deadlineMs/);
+  test.throws(() => SpnResolver.resolveSpn('MSSQLSvc', 'db1', 1433, { tenant: 1 }, cb), /options.tenant/);
+  test.throws(() => SpnResolver.configureSpnResolver({ ttlMs: -1 }), /options.ttlMs/);
+  test.done();
+}
+
+exports.resolvedHostsAreCached = function (test) {
+  if (SpnResolver === undefined) {
+    test.done();
+    return;
+  }
+
+  useStubResolver(0);
+  SpnResolver.resolveSpn('MSSQLSvc', 'db2', 1433, (err, spn) => {
+    test.strictEqual(err, null);
+    test.strictEqual(spn, 'MSSQLSvc/db2.corp.example.com:1433');
+
+    SpnResolver.resolveSpn('MSSQLSvc', 'DB2', 'instance', (err, spn) => {
+      test.strictEqual(err, null);
+      test.strictEqual(spn, 'MSSQLSvc/db2.corp.example.com:instance');
+
+      const stats = SpnResolver.getSpnResolverStats();
+      test.strictEqual(stats.misses, 1);
+      test.strictEqual(stats.lookups, 1);
+      test.strictEqual(stats.hits, 1);
+      test.strictEqual(stats.size, 1);
+
+      SpnResolver.clearSpnResolverCache();
+      test.strictEqual(SpnResolver.getSpnResolverStats().size, 0);
+      restoreSystemResolver();
+      test.done();
+    });
+  });
+}
+
+exports.failuresAreCached = function (test) {
+  if (SpnResolver === undefined) {
+    test.done();
+    return;
+  }
+
+  useStubResolver(0);
+  SpnResolver.resolveSpn('MSSQLSvc', 'missing', 1433, (err, spn) => {
+    test.strictEqual(err.code, 'ENOTFOUND');
+    test.strictEqual(err.hostname, 'missing');
+    test.strictEqual(spn, undefined);
+
+    SpnResolver.resolveSpn('MSSQLSvc', 'missing', 1433, (err) => {
+      test.strictEqual(err.code, 'ENOTFOUND');
+
+      const stats = SpnResolver.getSpnResolverStats();
+      test.strictEqual(stats.lookups, 1);
+      test.strictEqual(stats.failures, 1);
+      test.strictEqual(stats.negativeHits, 1);
+      restoreSystemResolver();
+      test.done();
+    });
+  });
+}
+
+exports.concurrentResolutionsShareOneLookup = function (test) {
+  if (SpnResolver === undefined) {
+    test.done();
+    return;
+  }
+
+  const c_concurrentCalls = 8;
+  let completed = 0;
+
+  useStubResolver(c_lookupDelayMs);
+  for (let i = 0; i < c_concurrentCalls; i++) {
+    SpnResolver.resolveSpn('MSSQLSvc', 'db2', 1433, (err, spn) => {
+      test.strictEqual(err, null);
+      test.strictEqual(spn, 'MSSQLSvc/db2.corp.example.com:1433');
+
+      if (++completed === c_concurrentCalls) {
+        const stats = SpnResolver.getSpnResolverStats();
+        test.strictEqual(stats.lookups, 1);
+        test.strictEqual(stats.misses, 1);
+        test.strictEqual(stats.waits + stats.hits, c_concurrentCalls - 1);
+        restoreSystemResolver();
+        test.done();
+      }
+    });
+  }
+}
+
+// Looking up db1 and reverse resolving its three addresses one at a time
+// would take four delays, at once it takes two.
+exports.reverseLookupsRunAtOnce = function (test) {
+  if (SpnResolver === undefined) {
+    test.done();
+    return;
+  }
+
+  useStubResolver(c_lookupDelayMs);
+  const begin = process.hrtime();
+  SpnResolver.resolveSpn('MSSQLSvc', 'db1', 1433, (err, spn) => {
+    const elapsed = process.hrtime(begin);
+    const elapsedMs = elapsed[0] * 1000 + elapsed[1] / 1000000;
+
+    test.strictEqual(err, null);
+    test.strictEqual(spn, 'MSSQLSvc/db1.corp.example.com:1433');
+    test.ok(elapsedMs < c_lookupDelayMs * 3.5, 'elapsedMs: ' + elapsedMs);
+
+    const stats = SpnResolver.getSpnResolverStats();
+    test.ok(stats.maxLookupUs >= c_lookupDelayMs * 2 * 1000 * 0.9);
+    restoreSystemResolver();
+    test.done();
+  });
+}
+
+exports.fqdnIsNotResolved = function (test) {
+  if (SpnResolver === undefined) {
+    test.done();
+    return;
+  }
+
+  useStubResolver(0);
+  SpnResolver.resolveSpn('MSSQLSvc', 'abc.example.com', 1433, (err, spn) => {
+    test.strictEqual(err, null);
+    test.strictEqual(spn, 'MSSQLSvc/abc.example.com:1433');
+    test.strictEqual(SpnResolver.getSpnResolverStats().misses, 0);
+    restoreSystemResolver();
+    test.done();
+  });
+}
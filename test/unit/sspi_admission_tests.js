@@ -0,0 +1,197 @@
+'use strict';
+
+// Admission control, cancellation and timeouts of queued getNextBlob calls.
+// Calls are held up with the latency of the 'mock' provider on a single
+// worker thread, set SSPI_CLIENT_PROVIDER=mock to run them; they are skipped
+// otherwise.
+
+const SspiClientApi = require('../../src_js/index.js').SspiClientApi;
+const Loopback = require('../utils/loopback.js');
+
+const spn = 'MSSQLSvc/admission.example.com:1433';
+const c_latencyMs = 100;
+
+// Calls cb once predicate holds, polling every few milliseconds.
+function waitFor(predicate, cb) {
+  if (predicate()) {
+    cb();
+    return;
+  }
+
+  setTimeout(() => waitFor(predicate, cb), 5);
+}
+
+// One worker thread, busy with a slow first leg once cb is called.
+function occupyWorker(test, cb) {
+  SspiClientApi.configureWorkerPool({ size: 1 });
+  SspiClientApi.utResetHandshakeAdmissionStats();
+  SspiClientApi.ensureInitialization((errorCode, errorString) => {
+    test.strictEqual(errorCode, 0, errorString);
+    SspiClientApi.utSetMockLatency(c_latencyMs);
+
+    const running = new SspiClientApi.SspiClient(spn, 'kerberos');
+    running.getNextBlob(null, 0, 0, (clientResponse, isDone, errorCode, errorString) => {
+      test.strictEqual(errorCode, 0, errorString);
+    });
+
+    waitFor(() => {
+      const stats = SspiClientApi.getHandshakeAdmissionStats();
+      return stats.admitted === 1 && stats.queueDepth === 0;
+    }, cb);
+  });
+}
+
+function restore() {
+  SspiClientApi.utSetMockLatency(0);
+  SspiClientApi.configureHandshakeAdmission({ maxQueueDepth: 0 });
+  SspiClientApi.configureWorkerPool({ size: 4 });
+}
+
+exports.invalidArgs = function (test) {
+  if (SspiClientApi === undefined) {
+    test.done();
+    return;
+  }
+
+  test.throws(() => SspiClientApi.configureHandshakeAdmission(), /Invalid number of arguments/);
+  test.throws(() => SspiClientApi.configureHandshakeAdmission(null), /Invalid argument type for 'options'/);
+  test.throws(() => SspiClientApi.configureHandshakeAdmission({ maxQueueDepth: -1 }), /maxQueueDepth/);
+  test.throws(() => SspiClientApi.configureHandshakeAdmission({ maxQueueDepth: 1, timeoutMs: 1.5 }), /timeoutMs/);
+
+  const sspiClient = new SspiClientApi.SspiClient(spn, 'kerberos');
+  test.throws(() => sspiClient.getNextBlob(null, 0, 0, null, () => {}), /Invalid argument type for 'options'/);
+  test.throws(() => sspiClient.getNextBlob(null, 0, 0, { timeoutMs: -1 }, () => {}), /timeoutMs/);
+
+  // Nothing in flight.
+  sspiClient.cancel();
+  test.done();
+}
+
+exports.queueFullFailsFast = function (test) {
+  if (!Loopback.isMockProvider()) {
+    test.done();
+    return;
+  }
+
+  occupyWorker(test, () => {
+    SspiClientApi.configureHandshakeAdmission({ maxQueueDepth: 1 });
+
+    let queuedDone = false;
+    const queued = new SspiClientApi.SspiClient(spn, 'kerberos');
+    queued.getNextBlob(null, 0, 0, (clientResponse, isDone, errorCode, errorString) => {
+      test.strictEqual(errorCode, 0, errorString);
+      queuedDone = true;
+    });
+
+    const begin = Date.now();
+    const rejected = new SspiClientApi.SspiClient(spn, 'kerberos');
+    rejected.getNextBlob(null, 0, 0, (clientResponse, isDone, errorCode) => {
+      test.strictEqual(errorCode, SspiClientApi.errorCodes.queueFull);
+      test.ok(!queuedDone);
+      test.ok(Date.now() - begin < c_latencyMs);
+
+      const stats = SspiClientApi.getHandshakeAdmissionStats();
+      test.strictEqual(stats.maxQueueDepth, 1);
+      test.strictEqual(stats.queueDepth, 1);
+      test.strictEqual(stats.rejected, 1);
+
+      waitFor(() => queuedDone, () => {
+        test.strictEqual(SspiClientApi.getHandshakeAdmissionStats().admitted, 2);
+        restore();
+        test.done();
+      });
+    });
+  });
+}
+
+exports.cancelledCallIsSkipped = function (test) {
+  if (!Loopback.isMockProvider()) {
+    test.done();
+    return;
+  }
+
+  occupyWorker(test, () => {
+    const queued = new SspiClientApi.SspiClient(spn, 'kerberos');
+    queued.getNextBlob(null, 0, 0, (clientResponse, isDone, errorCode, errorString) => {
+      test.strictEqual(errorCode, SspiClientApi.errorCodes.cancelled);
+      test.strictEqual(errorString, 'Call cancelled.');
+      test.strictEqual(SspiClientApi.getHandshakeAdmissionStats().cancelled, 1);
+
+      // Out of the queue and free for another call at once.
+      test.strictEqual(SspiClientApi.getHandshakeAdmissionStats().queueDepth, 0);
+      test.ok(!queued.getNextBlobInProgress);
+
+      // Dropped once the worker gets to it, without calling the provider.
+      waitFor(() => SspiClientApi.getHandshakeAdmissionStats().skipped === 1, () => {
+        restore();
+        test.done();
+      });
+    });
+
+    queued.cancel();
+  });
+}
+
+exports.queuedCallTimesOut = function (test) {
+  if (!Loopback.isMockProvider()) {
+    test.done();
+    return;
+  }
+
+  occupyWorker(test, () => {
+    const begin = Date.now();
+    const queued = new SspiClientApi.SspiClient(spn, 'kerberos');
+    queued.getNextBlob(null, 0, 0, { timeoutMs: 10 }, (clientResponse, isDone, errorCode) => {
+      test.strictEqual(errorCode, SspiClientApi.errorCodes.timedOut);
+      test.ok(Date.now() - begin < c_latencyMs);
+      test.strictEqual(SspiClientApi.getHandshakeAdmissionStats().timedOut, 1);
+      test.strictEqual(SspiClientApi.getHandshakeAdmissionStats().queueDepth, 0);
+      test.ok(!queued.getNextBlobInProgress);
+
+      waitFor(() => SspiClientApi.getHandshakeAdmissionStats().skipped === 1, () => {
+        restore();
+        test.done();
+      });
+    });
+  });
+}
+
+exports.batchRequestsAreAdmittedOneByOne = function (test) {
+  if (!Loopback.isMockProvider()) {
+    test.done();
+    return;
+  }
+
+  occupyWorker(test, () => {
+    SspiClientApi.configureHandshakeAdmission({ maxQueueDepth: 2 });
+
+    const begin = Date.now();
+    const clients = [ 0, 1, 2 ].map(() => new SspiClientApi.SspiClient(spn, 'kerberos'));
+    SspiClientApi.getNextBlobBatch([
+      { client: clients[0], timeoutMs: 10 },
+      { client: clients[1] },
+      { client: clients[2] }
+    ], (results) => {
+      test.deepEqual(results.map((result) => result.errorCode), [
+        SspiClientApi.errorCodes.timedOut,
+        SspiClientApi.errorCodes.cancelled,
+        SspiClientApi.errorCodes.queueFull
+      ]);
+      test.ok(Date.now() - begin < c_latencyMs);
+
+      const stats = SspiClientApi.getHandshakeAdmissionStats();
+      test.strictEqual(stats.rejected, 1);
+      test.strictEqual(stats.cancelled, 1);
+      test.strictEqual(stats.timedOut, 1);
+      test.strictEqual(stats.queueDepth, 0);
+      test.ok(clients.every((sspiClient) => !sspiClient.getNextBlobInProgress));
+
+      waitFor(() => SspiClientApi.getHandshakeAdmissionStats().skipped === 2, () => {
+        restore();
+        test.done();
+      });
+    });
+
+    clients[1].cancel();
+  });
+}
@@ -71,6 +71,19 @@ exports.ensureInitializationWithCallback = function (test) {
   }
 }
 
+exports.ensureInitializationPromise = function (test) {
+  const promise = SspiClientApi.ensureInitialization();
+  test.strictEqual(SspiClientApi.ensureInitialization(), promise);
+
+  promise.then(() => {
+    test.strictEqual(SspiClientApi.getDefaultSspiPackageName(), 'Negotiate');
+    test.done();
+  }, (err) => {
+    test.ifError(err);
+    test.done();
+  });
+}
+
 exports.ensureInitializationTooManyArgs = function (test) {
   const expectedErrorMessage = 'Invalid number of arguments.';
 
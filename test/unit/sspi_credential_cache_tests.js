@@ -0,0 +1,107 @@
+'use strict';
+
+// Exercises the process-wide credential handle cache. These need the 'mock'
+// provider, set SSPI_CLIENT_PROVIDER=mock to run them; they are skipped
+// otherwise.
+
+const SspiClientApi = require('../../src_js/index.js').SspiClientApi;
+const Loopback = require('../utils/loopback.js');
+
+const spn = 'MSSQLSvc/host.example.com:1433';
+
+function getFirstBlobs(count, securityPackage, cb) {
+  let pending = count;
+  let failed = false;
+  for (let i = 0; i < count; i++) {
+    const sspiClient = new SspiClientApi.SspiClient(spn, securityPackage);
+    sspiClient.getNextBlob(null, 0, 0, (clientResponse, isDone, errorCode, errorString) => {
+      if (failed) {
+        return;
+      }
+
+      if (errorCode !== 0) {
+        failed = true;
+        cb(new Error(errorString));
+        return;
+      }
+
+      if (--pending === 0) {
+        cb(null);
+      }
+    });
+  }
+}
+
+exports.concurrentClientsShareCredential = function (test) {
+  if (!Loopback.isMockProvider()) {
+    test.done();
+    return;
+  }
+
+  SspiClientApi.clearCredentialCache();
+  const before = SspiClientApi.getCredentialCacheStats();
+
+  getFirstBlobs(16, 'kerberos', (err) => {
+    test.ifError(err);
+
+    const after = SspiClientApi.getCredentialCacheStats();
+    test.strictEqual(after.acquisitions - before.acquisitions, 1);
+    test.strictEqual(after.misses - before.misses, 1);
+    test.strictEqual(
+      (after.hits - before.hits) + (after.waits - before.waits), 15);
+    test.strictEqual(after.size, 1);
+    test.done();
+  });
+}
+
+exports.clientAndServerCredentialsAreSeparate = function (test) {
+  if (!Loopback.isMockProvider()) {
+    test.done();
+    return;
+  }
+
+  SspiClientApi.clearCredentialCache();
+  const before = SspiClientApi.getCredentialCacheStats();
+
+  Loopback.runHandshake(spn, 'ntlm', (err) => {
+    test.ifError(err);
+
+    Loopback.runHandshake(spn, 'NTLM', (err) => {
+      test.ifError(err);
+
+      // One outbound and one inbound credential, reused by the second
+      // handshake.
+      const after = SspiClientApi.getCredentialCacheStats();
+      test.strictEqual(after.acquisitions - before.acquisitions, 2);
+      test.strictEqual(after.hits - before.hits, 2);
+      test.strictEqual(after.size, 2);
+      test.done();
+    });
+  });
+}
+
+exports.expiredCredentialEvicted = function (test) {
+  if (!Loopback.isMockProvider()) {
+    test.done();
+    return;
+  }
+
+  SspiClientApi.clearCredentialCache();
+  SspiClientApi.utSetMockCredentialLifetime(0);
+  const before = SspiClientApi.getCredentialCacheStats();
+
+  getFirstBlobs(1, 'negotiate', (err) => {
+    test.ifError(err);
+
+    getFirstBlobs(1, 'negotiate', (err) => {
+      SspiClientApi.utSetMockCredentialLifetime(-1);
+      test.ifError(err);
+
+      const after = SspiClientApi.getCredentialCacheStats();
+      test.strictEqual(after.acquisitions - before.acquisitions, 2);
+      test.strictEqual(after.evictions - before.evictions, 1);
+      test.strictEqual(after.hits - before.hits, 0);
+      test.done();
+    });
+  });
+}
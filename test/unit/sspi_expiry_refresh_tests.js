@@ -0,0 +1,170 @@
+'use strict';
+
+// Background renewal of credentials and service tickets. Renewals need the
+// 'mock' provider, set SSPI_CLIENT_PROVIDER=mock to run them; they are
+// skipped otherwise. Expiry is reached by moving the native clock rather than
+// waiting.
+
+const SspiClientApi = require('../../src_js/index.js').SspiClientApi;
+const Loopback = require('../utils/loopback.js');
+
+const spn = 'MSSQLSvc/refresh.example.com:1433';
+const c_ticketLatencyMs = 100;
+
+// Calls cb once predicate holds, polling every few milliseconds.
+function waitFor(predicate, cb) {
+  if (predicate()) {
+    cb();
+    return;
+  }
+
+  setTimeout(() => waitFor(predicate, cb), 5);
+}
+
+function timedHandshake(securityPackage, cb) {
+  const begin = process.hrtime();
+  Loopback.runHandshake(spn, securityPackage, (err, result) => {
+    const elapsed = process.hrtime(begin);
+    cb(err, result, elapsed[0] * 1e3 + elapsed[1] / 1e6);
+  });
+}
+
+exports.invalidArgs = function (test) {
+  if (SspiClientApi === undefined) {
+    test.done();
+    return;
+  }
+
+  test.throws(() => SspiClientApi.configureExpiryRefresh(), /Invalid number of arguments/);
+  test.throws(() => SspiClientApi.configureExpiryRefresh(null), /Invalid argument type for 'options'/);
+  test.throws(() => SspiClientApi.configureExpiryRefresh({}), /options.enabled/);
+  test.throws(() => SspiClientApi.configureExpiryRefresh({ enabled: true, refreshAheadMs: -1 }), /refreshAheadMs/);
+  test.throws(() => SspiClientApi.configureExpiryRefresh({ enabled: true, jitterMs: 1.5 }), /jitterMs/);
+  test.throws(() => SspiClientApi.configureExpiryRefresh({ enabled: true, checkIntervalMs: 0 }), /checkIntervalMs/);
+  test.done();
+}
+
+exports.getExpiry = function (test) {
+  if (!Loopback.isMockProvider()) {
+    test.done();
+    return;
+  }
+
+  const sspiClient = new SspiClientApi.SspiClient(spn, 'kerberos');
+  let expiry = sspiClient.getExpiry();
+  test.strictEqual(expiry.contextExpiryMs, 0);
+  test.strictEqual(expiry.credentialExpiryMs, 0);
+
+  Loopback.runClientHandshake(sspiClient, 'kerberos', (err) => {
+    test.ifError(err);
+
+    expiry = sspiClient.getExpiry();
+    test.ok(expiry.contextExpiryMs > Date.now());
+    test.ok(expiry.credentialExpiryMs > Date.now());
+
+    sspiClient.reset();
+    test.strictEqual(sspiClient.getExpiry().contextExpiryMs, 0);
+    test.done();
+  });
+}
+
+exports.ticketRenewedAheadOfExpiry = function (test) {
+  if (!Loopback.isMockProvider()) {
+    test.done();
+    return;
+  }
+
+  const done = (err) => {
+    SspiClientApi.utSetClockOffset(0);
+    SspiClientApi.utSetMockTicketLatency(0);
+    SspiClientApi.configureExpiryRefresh({ enabled: false });
+    test.ifError(err);
+    test.done();
+  };
+
+  // The check interval is long enough for the test to trigger every pass.
+  SspiClientApi.configureExpiryRefresh({ enabled: true, checkIntervalMs: 60 * 60 * 1000 });
+  SspiClientApi.utResetExpiryRefreshStats();
+  SspiClientApi.utSetMockTicketLatency(c_ticketLatencyMs);
+
+  timedHandshake('kerberos', (err, result, elapsedMs) => {
+    if (err) {
+      done(err);
+      return;
+    }
+
+    test.ok(elapsedMs >= c_ticketLatencyMs * 0.9);
+    const expiryMs = result.sspiClient.getExpiry().contextExpiryMs;
+
+    // Not due yet.
+    SspiClientApi.refreshExpiring();
+    test.strictEqual(SspiClientApi.getExpiryRefreshStats().ticketRefreshes, 0);
+
+    // Within the renewal window of the mock's tickets and past the refresh
+    // time whatever the jitter.
+    SspiClientApi.utSetClockOffset(expiryMs - Date.now() - 90 * 1000);
+    SspiClientApi.refreshExpiring();
+    waitFor(() => {
+      const stats = SspiClientApi.getExpiryRefreshStats();
+      return stats.ticketRefreshes + stats.ticketRefreshFailures > 0;
+    }, () => {
+      const stats = SspiClientApi.getExpiryRefreshStats();
+      test.strictEqual(stats.ticketRefreshes, 1);
+      test.strictEqual(stats.ticketRefreshFailures, 0);
+      test.strictEqual(stats.tickets, 1);
+
+      // The login right before the old ticket expires doesn't wait for a new
+      // one.
+      timedHandshake('kerberos', (err, result, elapsedMs) => {
+        if (err) {
+          done(err);
+          return;
+        }
+
+        test.ok(elapsedMs < c_ticketLatencyMs);
+        test.ok(result.sspiClient.getExpiry().contextExpiryMs > expiryMs);
+        done(null);
+      });
+    });
+  });
+}
+
+exports.unusedTicketDropped = function (test) {
+  if (!Loopback.isMockProvider()) {
+    test.done();
+    return;
+  }
+
+  const done = (err) => {
+    SspiClientApi.utSetClockOffset(0);
+    SspiClientApi.configureExpiryRefresh({ enabled: false });
+    test.ifError(err);
+    test.done();
+  };
+
+  SspiClientApi.configureExpiryRefresh({ enabled: true, checkIntervalMs: 60 * 60 * 1000 });
+  SspiClientApi.utResetExpiryRefreshStats();
+
+  Loopback.runHandshake(spn, 'kerberos', (err, result) => {
+    if (err) {
+      done(err);
+      return;
+    }
+
+    const expiryMs = result.sspiClient.getExpiry().contextExpiryMs;
+    SspiClientApi.utSetClockOffset(expiryMs - Date.now() - 90 * 1000);
+    SspiClientApi.refreshExpiring();
+    waitFor(() => SspiClientApi.getExpiryRefreshStats().ticketRefreshes > 0, () => {
+      // Nothing authenticated to the SPN since, the renewed ticket isn't
+      // renewed again once it's due.
+      SspiClientApi.utSetClockOffset(expiryMs - Date.now() + 24 * 60 * 60 * 1000);
+      SspiClientApi.refreshExpiring();
+
+      const stats = SspiClientApi.getExpiryRefreshStats();
+      test.strictEqual(stats.ticketRefreshes, 1);
+      test.strictEqual(stats.ticketsDropped, 1);
+      test.strictEqual(stats.tickets, 0);
+      done(null);
+    });
+  });
+}
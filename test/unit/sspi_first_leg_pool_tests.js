@@ -0,0 +1,125 @@
+'use strict';
+
+// Exercises the first leg pool against the mock provider.
+
+const index = require('../../src_js/index.js');
+const SspiClientApi = index.SspiClientApi;
+const SspiServerApi = index.SspiServerApi;
+const Loopback = require('../utils/loopback.js');
+
+// Polls getFirstLegPoolStats until isReady(stats) or about a second passed.
+function waitForStats(isReady, cb) {
+  let attempts = 0;
+  const poll = () => {
+    const stats = SspiClientApi.getFirstLegPoolStats();
+    if (isReady(stats) || ++attempts === 100) {
+      cb(stats);
+      return;
+    }
+
+    setTimeout(poll, 10);
+  };
+
+  poll();
+}
+
+exports.configureFirstLegPoolInvalidArgs = function (test) {
+  if (SspiClientApi === undefined) {
+    test.done();
+    return;
+  }
+
+  test.throws(() => SspiClientApi.configureFirstLegPool('spn'), /Invalid number of arguments/);
+  test.throws(() => SspiClientApi.configureFirstLegPool(1, { size: 1 }), /Invalid argument type for 'spn'/);
+  test.throws(() => SspiClientApi.configureFirstLegPool('', { size: 1 }), /Empty string/);
+  test.throws(() => SspiClientApi.configureFirstLegPool('spn', null), /Invalid argument type for 'options'/);
+  test.throws(() => SspiClientApi.configureFirstLegPool('spn', { size: -1 }), /non-negative integer/);
+  test.throws(() => SspiClientApi.configureFirstLegPool('spn', { size: 1, securityPackage: 1 }), /securityPackage/);
+  test.throws(() => SspiClientApi.configureFirstLegPool('spn', { size: 1, maxAgeMs: 'x' }), /maxAgeMs/);
+  test.done();
+}
+
+exports.pooledFirstLegCompletesHandshake = function (test) {
+  if (!Loopback.isMockProvider()) {
+    test.done();
+    return;
+  }
+
+  const spn = 'MSSQLSvc/pooled.example.com:1433';
+  SspiClientApi.utResetFirstLegPoolStats();
+  SspiClientApi.configureFirstLegPool(spn, { size: 2, securityPackage: 'kerberos' });
+
+  waitForStats((stats) => stats.ready === 2, (stats) => {
+    test.strictEqual(stats.ready, 2);
+
+    const sspiClient = new SspiClientApi.SspiClient(spn, 'Kerberos');
+    const sspiServer = new SspiServerApi.SspiServer('kerberos');
+    sspiClient.getNextBlob(null, 0, 0, (clientResponse, isDone, errorCode) => {
+      test.strictEqual(errorCode, 0);
+      test.strictEqual(isDone, false);
+      test.strictEqual(clientResponse.length, 1480);
+      test.strictEqual(SspiClientApi.getFirstLegPoolStats().hits, 1);
+
+      sspiServer.acceptNextBlob(clientResponse, 0, clientResponse.length, (serverResponse, isDone, errorCode) => {
+        test.strictEqual(errorCode, 0);
+        sspiClient.getNextBlob(serverResponse, 0, serverResponse.length, (clientResponse, isDone, errorCode) => {
+          test.strictEqual(errorCode, 0);
+          test.strictEqual(isDone, true);
+
+          SspiClientApi.configureFirstLegPool(spn, { size: 0, securityPackage: 'kerberos' });
+          test.done();
+        });
+      });
+    });
+
+    test.strictEqual(sspiClient.getNextBlobInProgress, true);
+  });
+}
+
+exports.otherSpnsNotCounted = function (test) {
+  if (!Loopback.isMockProvider()) {
+    test.done();
+    return;
+  }
+
+  SspiClientApi.utResetFirstLegPoolStats();
+  const sspiClient = new SspiClientApi.SspiClient('MSSQLSvc/unpooled.example.com:1433', 'kerberos');
+  sspiClient.getNextBlob(null, 0, 0, (clientResponse, isDone, errorCode) => {
+    test.strictEqual(errorCode, 0);
+
+    const stats = SspiClientApi.getFirstLegPoolStats();
+    test.strictEqual(stats.hits, 0);
+    test.strictEqual(stats.misses, 0);
+    test.done();
+  });
+}
+
+exports.staleFirstLegsDiscarded = function (test) {
+  if (!Loopback.isMockProvider()) {
+    test.done();
+    return;
+  }
+
+  const spn = 'MSSQLSvc/stale.example.com:1433';
+  SspiClientApi.utResetFirstLegPoolStats();
+  SspiClientApi.configureFirstLegPool(spn, { size: 2, securityPackage: 'ntlm', maxAgeMs: 1 });
+
+  waitForStats((stats) => stats.generated >= 2, () => {
+    setTimeout(() => {
+      const sspiClient = new SspiClientApi.SspiClient(spn, 'ntlm');
+      sspiClient.getNextBlob(null, 0, 0, (clientResponse, isDone, errorCode) => {
+        // Generated by the worker thread instead.
+        test.strictEqual(errorCode, 0);
+        test.strictEqual(clientResponse.length, 40);
+
+        const stats = SspiClientApi.getFirstLegPoolStats();
+        test.strictEqual(stats.hits, 0);
+        test.strictEqual(stats.misses, 1);
+        test.ok(stats.stale >= 2);
+
+        SspiClientApi.configureFirstLegPool(spn, { size: 0, securityPackage: 'ntlm' });
+        test.done();
+      });
+    }, 10);
+  });
+}
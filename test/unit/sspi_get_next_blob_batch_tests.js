@@ -0,0 +1,114 @@
+'use strict';
+
+const SspiClientApi = require('../../src_js/index.js').SspiClientApi;
+const Loopback = require('../utils/loopback.js');
+
+const spn = 'MSSQLSvc/host.example.com:1433';
+
+function makeCannedClients(count) {
+  const clients = [];
+  for (let i = 0; i < count; i++) {
+    const sspiClient = new SspiClientApi.SspiClient(spn);
+    sspiClient.utEnableCannedResponse();
+    clients.push(sspiClient);
+  }
+
+  return clients;
+}
+
+exports.invalidArgs = function (test) {
+  if (SspiClientApi === undefined) {
+    test.done();
+    return;
+  }
+
+  const clients = makeCannedClients(1);
+  const cb = () => {};
+
+  test.throws(() => SspiClientApi.getNextBlobBatch([]), /Invalid number of arguments/);
+  test.throws(() => SspiClientApi.getNextBlobBatch({}, cb), /Invalid argument type for 'requests'/);
+  test.throws(() => SspiClientApi.getNextBlobBatch([], 'cb'), /Invalid argument type for 'cb'/);
+  test.throws(() => SspiClientApi.getNextBlobBatch([{ client: {} }], cb), /requests\[0\]\.client/);
+  test.throws(() => SspiClientApi.getNextBlobBatch([null], cb), /requests\[0\]\.client/);
+  test.throws(() => SspiClientApi.getNextBlobBatch([{ client: clients[0], deadlineMs: -1 }], cb), /requests\[0\]\.deadlineMs/);
+  test.throws(() => SspiClientApi.getNextBlobBatch([{ client: clients[0], tenant: 1 }], cb), /requests\[0\]\.tenant/);
+  test.throws(
+    () => SspiClientApi.getNextBlobBatch(
+      [{ client: clients[0], serverResponse: Buffer.alloc(4), serverResponseBeginOffset: 2, serverResponseLength: 4 }],
+      cb),
+    /buffer too small/);
+  test.throws(
+    () => SspiClientApi.getNextBlobBatch([{ client: clients[0] }, { client: clients[0] }], cb),
+    /Single invocation of getNextBlob/);
+
+  // Nothing was started by the calls that threw.
+  test.strictEqual(clients[0].getNextBlobInProgress, false);
+  test.done();
+}
+
+exports.emptyBatch = function (test) {
+  if (SspiClientApi === undefined) {
+    test.done();
+    return;
+  }
+
+  SspiClientApi.getNextBlobBatch([], (results) => {
+    test.deepEqual(results, []);
+    test.done();
+  });
+}
+
+exports.cannedResponsesInOrder = function (test) {
+  if (SspiClientApi === undefined) {
+    test.done();
+    return;
+  }
+
+  const count = 64;
+  const clients = makeCannedClients(count);
+  const requests = clients.map((client, i) => {
+    const serverResponse = Buffer.alloc(8 + i, i);
+    return {
+      client: client,
+      serverResponse: serverResponse,
+      serverResponseBeginOffset: 0,
+      serverResponseLength: serverResponse.length
+    };
+  });
+
+  SspiClientApi.getNextBlobBatch(requests, (results) => {
+    test.strictEqual(results.length, count);
+    results.forEach((result, i) => {
+      test.ok(result.clientResponse.equals(requests[i].serverResponse));
+      test.strictEqual(clients[i].getNextBlobInProgress, false);
+    });
+
+    // Clients may go on with getNextBlob.
+    clients[0].getNextBlob(null, 0, 0, () => test.done());
+  });
+
+  clients.forEach((client) => test.strictEqual(client.getNextBlobInProgress, true));
+  test.throws(() => clients[0].getNextBlob(null, 0, 0, () => {}), /Single invocation of getNextBlob/);
+}
+
+exports.firstLegs = function (test) {
+  if (!Loopback.isMockProvider()) {
+    test.done();
+    return;
+  }
+
+  const requests = [];
+  for (let i = 0; i < 16; i++) {
+    requests.push({ client: new SspiClientApi.SspiClient(spn, 'kerberos') });
+  }
+
+  SspiClientApi.getNextBlobBatch(requests, (results) => {
+    results.forEach((result) => {
+      test.strictEqual(result.errorCode, 0);
+      test.strictEqual(result.clientResponse.length, 1480);
+      test.strictEqual(result.isDone, false);
+    });
+
+    test.done();
+  });
+}
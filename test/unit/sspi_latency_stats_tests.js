@@ -0,0 +1,83 @@
+'use strict';
+
+const SspiClientApi = require('../../src_js/index.js').SspiClientApi;
+const Loopback = require('../utils/loopback.js');
+
+const spn = 'MSSQLSvc/host.example.com:1433';
+const c_latencyMs = 20;
+
+exports.phasesAreRecorded = function (test) {
+  if (!Loopback.isMockProvider()) {
+    test.done();
+    return;
+  }
+
+  SspiClientApi.resetStats();
+  SspiClientApi.utSetMockLatency(c_latencyMs);
+
+  Loopback.runHandshake(spn, 'kerberos', (err) => {
+    SspiClientApi.utSetMockLatency(0);
+    test.ifError(err);
+
+    const stats = SspiClientApi.getStats();
+
+    // Client side only, the first leg and the one consuming the server token.
+    const initializeContext = stats.initializeContext.Kerberos.success;
+    test.strictEqual(initializeContext.count, 2);
+    test.ok(initializeContext.minUs >= c_latencyMs * 1000 * 0.9);
+    test.ok(initializeContext.minUs <= initializeContext.p50Us);
+    test.ok(initializeContext.p50Us <= initializeContext.p99Us);
+    test.ok(initializeContext.p99Us <= initializeContext.maxUs);
+    test.strictEqual(stats.initializeContext.Kerberos.failure, undefined);
+
+    test.strictEqual(stats.acquireCredentials.Kerberos.success.count, 1);
+    test.strictEqual(stats.queueWait.Kerberos.success.count, 2);
+    test.strictEqual(stats.callbackDelay.Kerberos.success.count, 2);
+    test.strictEqual(stats.total.Kerberos.success.count, 2);
+    test.ok(stats.total.Kerberos.success.maxUs >= initializeContext.maxUs);
+    test.strictEqual(stats.completeToken, undefined);
+    test.done();
+  });
+}
+
+exports.failuresAreRecordedSeparately = function (test) {
+  if (!Loopback.isMockProvider()) {
+    test.done();
+    return;
+  }
+
+  SspiClientApi.resetStats();
+
+  const sspiClient = new SspiClientApi.SspiClient(spn, 'ntlm');
+  sspiClient.getNextBlob(null, 0, 0, (clientResponse, isDone, errorCode) => {
+    test.strictEqual(errorCode, 0);
+
+    const serverResponse = Buffer.from('not a challenge');
+    sspiClient.getNextBlob(serverResponse, 0, serverResponse.length, (clientResponse, isDone, errorCode) => {
+      test.notStrictEqual(errorCode, 0);
+
+      const stats = SspiClientApi.getStats();
+      test.strictEqual(stats.initializeContext.NTLM.success.count, 1);
+      test.strictEqual(stats.initializeContext.NTLM.failure.count, 1);
+      test.strictEqual(stats.total.NTLM.success.count, 1);
+      test.strictEqual(stats.total.NTLM.failure.count, 1);
+      test.done();
+    });
+  });
+}
+
+exports.resetStatsClearsHistograms = function (test) {
+  if (!Loopback.isMockProvider()) {
+    test.done();
+    return;
+  }
+
+  Loopback.runHandshake(spn, 'negotiate', (err) => {
+    test.ifError(err);
+    test.ok(SspiClientApi.getStats().total.Negotiate.success.count > 0);
+
+    SspiClientApi.resetStats();
+    test.deepEqual(SspiClientApi.getStats(), {});
+    test.done();
+  });
+}
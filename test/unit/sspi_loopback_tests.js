@@ -0,0 +1,101 @@
+'use strict';
+
+// Runs complete client/server handshakes in process. These need the 'mock'
+// provider, set SSPI_CLIENT_PROVIDER=mock to run them; they are skipped
+// otherwise.
+
+const SspiClientApi = require('../../src_js/index.js').SspiClientApi;
+const SspiServerApi = require('../../src_js/index.js').SspiServerApi;
+const Loopback = require('../utils/loopback.js');
+
+function handshakeImpl(test, securityPackage, expectedLegs) {
+  if (!Loopback.isMockProvider()) {
+    test.done();
+    return;
+  }
+
+  Loopback.runHandshake('MSSQLSvc/host.example.com:1433', securityPackage, (err, result) => {
+    test.ifError(err);
+    test.strictEqual(result.legs.length, expectedLegs.length);
+    for (let i = 0; i < expectedLegs.length; i++) {
+      test.strictEqual(result.legs[i].from, expectedLegs[i][0]);
+      test.strictEqual(result.legs[i].isDone, expectedLegs[i][1]);
+    }
+
+    test.done();
+  });
+}
+
+exports.handshakeDefault = function (test) {
+  handshakeImpl(test, undefined, [['client', false], ['server', true], ['client', true]]);
+}
+
+exports.handshakeKerberos = function (test) {
+  handshakeImpl(test, 'kerberos', [['client', false], ['server', true], ['client', true]]);
+}
+
+exports.handshakeNtlm = function (test) {
+  handshakeImpl(test, 'ntlm', [['client', false], ['server', false], ['client', true], ['server', true]]);
+}
+
+exports.handshakeDeterministic = function (test) {
+  if (!Loopback.isMockProvider()) {
+    test.done();
+    return;
+  }
+
+  const spn = 'MSSQLSvc/host.example.com:1433';
+  Loopback.runHandshake(spn, 'ntlm', (err, first) => {
+    test.ifError(err);
+    Loopback.runHandshake(spn, 'ntlm', (err, second) => {
+      test.ifError(err);
+      for (let i = 0; i < first.clientBlobs.length; i++) {
+        test.ok(first.clientBlobs[i].equals(second.clientBlobs[i]));
+      }
+
+      test.done();
+    });
+  });
+}
+
+exports.serverRejectsCorruptBlob = function (test) {
+  if (!Loopback.isMockProvider()) {
+    test.done();
+    return;
+  }
+
+  const sspiClient = new SspiClientApi.SspiClient('MSSQLSvc/host.example.com:1433', 'ntlm');
+  sspiClient.getNextBlob(null, 0, 0, (clientResponse, isDone, errorCode, errorString) => {
+    test.strictEqual(errorCode, 0);
+
+    clientResponse[clientResponse.length - 1] ^= 0xFF;
+
+    const sspiServer = new SspiServerApi.SspiServer('ntlm');
+    sspiServer.acceptNextBlob(clientResponse, 0, clientResponse.length, (serverResponse, isDone, errorCode, errorString) => {
+      test.strictEqual(errorCode, 0x80090308);    // SEC_E_INVALID_TOKEN
+      test.strictEqual(isDone, false);
+      test.done();
+    });
+  });
+}
+
+exports.blobStatsCountTraffic = function (test) {
+  if (!Loopback.isMockProvider()) {
+    test.done();
+    return;
+  }
+
+  const before = SspiClientApi.getBlobStats();
+  Loopback.runHandshake('MSSQLSvc/host.example.com:1433', 'ntlm', (err, result) => {
+    test.ifError(err);
+
+    const after = SspiClientApi.getBlobStats();
+    const tokenBytes = result.legs.reduce((total, leg) => total + leg.length, 0);
+
+    // Every token is produced once and consumed once, in place.
+    test.strictEqual(after.outBytes - before.outBytes, tokenBytes);
+    test.strictEqual(after.inBytes - before.inBytes, tokenBytes);
+    test.ok(after.bytesCopied - before.bytesCopied <= tokenBytes);
+    test.done();
+  });
+}
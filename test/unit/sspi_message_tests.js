@@ -0,0 +1,170 @@
+'use strict';
+
+// Message protection over contexts established in process. These need the
+// 'mock' provider, set SSPI_CLIENT_PROVIDER=mock to run them; they are skipped
+// otherwise.
+
+const SspiClientApi = require('../../src_js/index.js').SspiClientApi;
+const Loopback = require('../utils/loopback.js');
+
+const spn = 'MSSQLSvc/host.example.com:1433';
+
+// Two messages, the second split over three segments of one buffer.
+function makeMessages(tokenLength) {
+  const whole = Buffer.from('segmented message data');
+  return [
+    { token: Buffer.alloc(tokenLength), data: Buffer.from('single segment') },
+    { token: Buffer.alloc(tokenLength), data: [ whole.slice(0, 3), whole.slice(3, 12), whole.slice(12) ] }
+  ];
+}
+
+function withEstablishedPair(test, securityPackage, cb) {
+  if (!Loopback.isMockProvider()) {
+    test.done();
+    return;
+  }
+
+  Loopback.runHandshake(spn, securityPackage, (err, result) => {
+    test.ifError(err);
+    cb(result.sspiClient, result.sspiServer);
+  });
+}
+
+function trimTokens(messages, tokenLengths) {
+  messages.forEach((message, i) => {
+    message.token = message.token.slice(0, tokenLengths[i]);
+  });
+}
+
+function encryptDecryptImpl(test, securityPackage) {
+  withEstablishedPair(test, securityPackage, (sspiClient, sspiServer) => {
+    const sizes = sspiClient.getMessageSizes();
+    test.ok(sizes.securityTrailer > 0);
+
+    const messages = makeMessages(sizes.securityTrailer);
+    const original = makeMessages(sizes.securityTrailer);
+    sspiClient.encrypt(messages, (tokenLengths, errorCode, errorString) => {
+      test.strictEqual(errorCode, 0, errorString);
+      test.strictEqual(tokenLengths.length, 2);
+      test.ok(!messages[0].data.equals(original[0].data));
+
+      trimTokens(messages, tokenLengths);
+      sspiServer.decrypt(messages, (tokenLengths, errorCode, errorString) => {
+        test.strictEqual(errorCode, 0, errorString);
+        test.ok(messages[0].data.equals(original[0].data));
+        test.ok(Buffer.concat(messages[1].data).equals(Buffer.concat(original[1].data)));
+        test.done();
+      });
+    });
+  });
+}
+
+exports.encryptDecryptKerberos = function (test) {
+  encryptDecryptImpl(test, 'kerberos');
+}
+
+exports.encryptDecryptNtlm = function (test) {
+  encryptDecryptImpl(test, 'ntlm');
+}
+
+exports.signVerify = function (test) {
+  withEstablishedPair(test, 'kerberos', (sspiClient, sspiServer) => {
+    const sizes = sspiServer.getMessageSizes();
+    const messages = makeMessages(sizes.maxSignature);
+    const original = makeMessages(sizes.maxSignature);
+    sspiServer.sign(messages, (tokenLengths, errorCode, errorString) => {
+      test.strictEqual(errorCode, 0, errorString);
+      test.ok(messages[0].data.equals(original[0].data));
+
+      trimTokens(messages, tokenLengths);
+      sspiClient.verify(messages, (tokenLengths, errorCode, errorString) => {
+        test.strictEqual(errorCode, 0, errorString);
+        test.done();
+      });
+    });
+  });
+}
+
+exports.verifyDetectsTampering = function (test) {
+  withEstablishedPair(test, 'kerberos', (sspiClient, sspiServer) => {
+    const messages = makeMessages(sspiClient.getMessageSizes().maxSignature);
+    sspiClient.sign(messages, (tokenLengths, errorCode) => {
+      test.strictEqual(errorCode, 0);
+
+      messages[1].data[1][0] ^= 1;
+      sspiServer.verify(messages, (tokenLengths, errorCode, errorString) => {
+        // SEC_E_MESSAGE_ALTERED
+        test.strictEqual(errorCode, 0x8009030F);
+        test.ok(errorString.indexOf('VerifySignature') >= 0);
+        test.done();
+      });
+    });
+  });
+}
+
+exports.decryptRejectsReplay = function (test) {
+  withEstablishedPair(test, 'kerberos', (sspiClient, sspiServer) => {
+    const messages = makeMessages(sspiClient.getMessageSizes().securityTrailer);
+    sspiClient.encrypt(messages.slice(0, 1), (tokenLengths, errorCode) => {
+      test.strictEqual(errorCode, 0);
+
+      const replayed = [ { token: Buffer.from(messages[0].token), data: Buffer.from(messages[0].data) } ];
+      sspiServer.decrypt(messages.slice(0, 1), (tokenLengths, errorCode) => {
+        test.strictEqual(errorCode, 0);
+        sspiServer.decrypt(replayed, (tokenLengths, errorCode) => {
+          // SEC_E_OUT_OF_SEQUENCE
+          test.strictEqual(errorCode, 0x80090310);
+          test.done();
+        });
+      });
+    });
+  });
+}
+
+exports.notEstablished = function (test) {
+  if (!Loopback.isMockProvider()) {
+    test.done();
+    return;
+  }
+
+  const sspiClient = new SspiClientApi.SspiClient(spn, 'kerberos');
+  test.throws(() => sspiClient.getMessageSizes(), /not established/);
+  sspiClient.encrypt(makeMessages(16), (tokenLengths, errorCode, errorString) => {
+    // SEC_E_INVALID_HANDLE
+    test.strictEqual(errorCode, 0x80090301);
+    test.strictEqual(tokenLengths.length, 0);
+    test.ok(errorString.indexOf('not established') >= 0);
+    test.done();
+  });
+}
+
+exports.invalidArgs = function (test) {
+  if (!Loopback.isMockProvider()) {
+    test.done();
+    return;
+  }
+
+  const sspiClient = new SspiClientApi.SspiClient(spn, 'kerberos');
+  const cb = () => {};
+  test.throws(() => sspiClient.sign([]), /Invalid number of arguments/);
+  test.throws(() => sspiClient.sign({}, cb), /Invalid argument type for 'messages'/);
+  test.throws(() => sspiClient.sign([], 'cb'), /Invalid argument type for 'cb'/);
+  test.throws(() => sspiClient.sign([ { data: Buffer.alloc(1) } ], cb), /messages\[0\]\.token/);
+  test.throws(() => sspiClient.sign([ { token: Buffer.alloc(1), data: [ 'x' ] } ], cb), /messages\[0\]\.data/);
+  test.throws(() => sspiClient.sign([], null, cb), /Invalid argument type for 'options'/);
+  test.throws(() => sspiClient.sign([], { tenant: 1 }, cb), /options.tenant/);
+  test.done();
+}
+
+exports.singleInvocationInFlight = function (test) {
+  withEstablishedPair(test, 'kerberos', (sspiClient, sspiServer) => {
+    const messages = makeMessages(sspiClient.getMessageSizes().securityTrailer);
+    sspiClient.encrypt(messages, (tokenLengths, errorCode) => {
+      test.strictEqual(errorCode, 0);
+      test.done();
+    });
+
+    test.throws(() => sspiClient.encrypt(messages, () => {}), /Single invocation of message protection/);
+    test.throws(() => sspiClient.getNextBlob(null, 0, 0, () => {}), /Single invocation of message protection/);
+  });
+}
@@ -0,0 +1,66 @@
+'use strict';
+
+const SspiClientApi = require('../../src_js/index.js').SspiClientApi;
+const Loopback = require('../utils/loopback.js');
+
+const c_ticketLatencyMs = 100;
+
+exports.prefetchTicketsInvalidArgs = function (test) {
+  if (SspiClientApi === undefined) {
+    test.done();
+    return;
+  }
+
+  const cb = () => {};
+  test.throws(() => SspiClientApi.prefetchTickets([]), /Invalid number of arguments/);
+  test.throws(() => SspiClientApi.prefetchTickets('spn', cb), /Invalid argument type for 'spns'/);
+  test.throws(() => SspiClientApi.prefetchTickets(['spn', 1], cb), /spns\[1\]/);
+  test.throws(() => SspiClientApi.prefetchTickets([''], cb), /Empty string argument for 'spns\[0\]'/);
+  test.throws(() => SspiClientApi.prefetchTickets(['spn'], 'digest', cb), /securityPackage/);
+  test.throws(() => SspiClientApi.prefetchTickets(['spn'], 'kerberos', 'cb'), /Invalid argument type for 'cb'/);
+  test.done();
+}
+
+exports.prefetchTicketsEmpty = function (test) {
+  if (SspiClientApi === undefined) {
+    test.done();
+    return;
+  }
+
+  SspiClientApi.prefetchTickets([], (results) => {
+    test.deepEqual(results, []);
+    test.done();
+  });
+}
+
+exports.prefetchedTicketsAreCached = function (test) {
+  if (!Loopback.isMockProvider()) {
+    test.done();
+    return;
+  }
+
+  const spns = ['MSSQLSvc/prefetch1.example.com:1433', 'MSSQLSvc/prefetch2.example.com:1433'];
+  SspiClientApi.utSetMockTicketLatency(c_ticketLatencyMs);
+
+  SspiClientApi.prefetchTickets(spns, 'kerberos', (results) => {
+    test.strictEqual(results.length, spns.length);
+    results.forEach((result, i) => {
+      test.strictEqual(result.spn, spns[i]);
+      test.strictEqual(result.errorCode, 0);
+      test.strictEqual(result.errorString, '');
+      test.ok(result.elapsedMs >= c_ticketLatencyMs * 0.9);
+    });
+
+    // The ticket for the SPN is cached now, the first leg doesn't wait on it.
+    const begin = process.hrtime();
+    const sspiClient = new SspiClientApi.SspiClient(spns[0], 'kerberos');
+    sspiClient.getNextBlob(null, 0, 0, (clientResponse, isDone, errorCode) => {
+      const elapsed = process.hrtime(begin);
+      SspiClientApi.utSetMockTicketLatency(0);
+
+      test.strictEqual(errorCode, 0);
+      test.ok(elapsed[0] * 1e3 + elapsed[1] / 1e6 < c_ticketLatencyMs);
+      test.done();
+    });
+  });
+}
@@ -0,0 +1,103 @@
+'use strict';
+
+// SspiClient.reset and the client pool. Handshakes need the 'mock' provider,
+// set SSPI_CLIENT_PROVIDER=mock to run them; they are skipped otherwise.
+
+const SspiClientApi = require('../../src_js/index.js').SspiClientApi;
+const Loopback = require('../utils/loopback.js');
+
+const spn = 'MSSQLSvc/host.example.com:1433';
+
+exports.invalidArgs = function (test) {
+  if (SspiClientApi === undefined) {
+    test.done();
+    return;
+  }
+
+  test.throws(() => SspiClientApi.configureClientPool(), /Invalid number of arguments/);
+  test.throws(() => SspiClientApi.configureClientPool(null), /Invalid argument type for 'options'/);
+  test.throws(() => SspiClientApi.configureClientPool({ maxPerSpn: -1 }), /maxPerSpn/);
+  test.throws(() => SspiClientApi.releaseClient({}), /Invalid argument type for 'sspiClient'/);
+  test.done();
+}
+
+exports.resetWhileInFlight = function (test) {
+  if (SspiClientApi === undefined) {
+    test.done();
+    return;
+  }
+
+  const sspiClient = new SspiClientApi.SspiClient(spn);
+  sspiClient.utEnableCannedResponse();
+  sspiClient.getNextBlob(null, 0, 0, () => {
+    sspiClient.reset();
+    test.done();
+  });
+
+  test.throws(() => sspiClient.reset(), /Single invocation of getNextBlob/);
+}
+
+function reauthenticateImpl(test, securityPackage) {
+  if (!Loopback.isMockProvider()) {
+    test.done();
+    return;
+  }
+
+  Loopback.runHandshake(spn, securityPackage, (err, first) => {
+    test.ifError(err);
+
+    const sspiClient = first.sspiClient;
+    sspiClient.reset();
+    test.throws(() => sspiClient.getMessageSizes(), /not established/);
+
+    SspiClientApi.resetStats();
+    Loopback.runClientHandshake(sspiClient, securityPackage, (err, second) => {
+      test.ifError(err);
+      test.strictEqual(second.legs.length, first.legs.length);
+      test.ok(second.sspiClient.getMessageSizes().securityTrailer > 0);
+
+      // The credential was kept, nothing was acquired for the second one.
+      test.strictEqual(SspiClientApi.getStats().acquireCredentials, undefined);
+      test.done();
+    });
+  });
+}
+
+exports.reauthenticateKerberos = function (test) {
+  reauthenticateImpl(test, 'kerberos');
+}
+
+exports.reauthenticateNtlm = function (test) {
+  reauthenticateImpl(test, 'ntlm');
+}
+
+exports.clientPool = function (test) {
+  if (!Loopback.isMockProvider()) {
+    test.done();
+    return;
+  }
+
+  SspiClientApi.configureClientPool({ maxPerSpn: 1 });
+  const before = SspiClientApi.getClientPoolStats();
+
+  const first = SspiClientApi.acquireClient(spn, 'kerberos');
+  const second = SspiClientApi.acquireClient(spn, 'kerberos');
+  Loopback.runClientHandshake(first, 'kerberos', (err) => {
+    test.ifError(err);
+
+    SspiClientApi.releaseClient(first);
+    SspiClientApi.releaseClient(second);
+    test.strictEqual(SspiClientApi.acquireClient(spn, 'kerberos'), first);
+    test.notStrictEqual(SspiClientApi.acquireClient(spn, 'ntlm'), second);
+
+    const stats = SspiClientApi.getClientPoolStats();
+    test.strictEqual(stats.hits - before.hits, 1);
+    test.strictEqual(stats.misses - before.misses, 3);
+    test.strictEqual(stats.released - before.released, 1);
+    test.strictEqual(stats.discarded - before.discarded, 1);
+    test.strictEqual(stats.idle, 0);
+
+    SspiClientApi.configureClientPool({ maxPerSpn: 0 });
+    test.done();
+  });
+}
@@ -0,0 +1,174 @@
+'use strict';
+
+// Order in which getNextBlob calls waiting for a worker thread run. Calls are
+// held up with the latency of the 'mock' provider on a single worker thread,
+// set SSPI_CLIENT_PROVIDER=mock to run them; they are skipped otherwise.
+
+const SspiClientApi = require('../../src_js/index.js').SspiClientApi;
+const Loopback = require('../utils/loopback.js');
+
+const c_latencyMs = 50;
+
+// Calls cb once predicate holds, polling every few milliseconds.
+function waitFor(predicate, cb) {
+  if (predicate()) {
+    cb();
+    return;
+  }
+
+  setTimeout(() => waitFor(predicate, cb), 5);
+}
+
+// One worker thread, busy with a slow first leg once cb is called.
+function occupyWorker(test, cb) {
+  SspiClientApi.configureWorkerPool({ size: 1 });
+  SspiClientApi.ensureInitialization((errorCode, errorString) => {
+    test.strictEqual(errorCode, 0, errorString);
+    SspiClientApi.utSetMockLatency(c_latencyMs);
+    SspiClientApi.utResetWorkerPoolStats();
+
+    const running = new SspiClientApi.SspiClient('MSSQLSvc/busy.example.com:1433', 'kerberos');
+    running.getNextBlob(null, 0, 0, (clientResponse, isDone, errorCode, errorString) => {
+      test.strictEqual(errorCode, 0, errorString);
+    });
+
+    waitFor(() => {
+      const stats = SspiClientApi.getWorkerPoolStats();
+      return stats.submitted === 1 && stats.queueDepth === 0;
+    }, cb);
+  });
+}
+
+function restore() {
+  SspiClientApi.utSetMockLatency(0);
+  SspiClientApi.configureScheduler({});
+  SspiClientApi.configureWorkerPool({ size: 4 });
+}
+
+// Queues a first leg for each of calls, { name, spn, options }, and calls
+// back with the names in the order the calls completed.
+function runQueued(test, calls, cb) {
+  const completed = [];
+  calls.forEach((call) => {
+    const sspiClient = new SspiClientApi.SspiClient(call.spn, 'kerberos');
+    sspiClient.getNextBlob(null, 0, 0, call.options || {}, (clientResponse, isDone, errorCode, errorString) => {
+      test.strictEqual(errorCode, 0, errorString);
+      completed.push(call.name);
+      if (completed.length === calls.length) {
+        cb(completed);
+      }
+    });
+  });
+}
+
+exports.invalidArgs = function (test) {
+  if (SspiClientApi === undefined) {
+    test.done();
+    return;
+  }
+
+  test.throws(() => SspiClientApi.configureScheduler(), /Invalid number of arguments/);
+  test.throws(() => SspiClientApi.configureScheduler(null), /Invalid argument type for 'options'/);
+  test.throws(() => SspiClientApi.configureScheduler({ policy: 'lifo' }), /options.policy/);
+  test.throws(() => SspiClientApi.configureScheduler({ deadlineMs: -1 }), /options.deadlineMs/);
+  test.throws(() => SspiClientApi.configureScheduler({ backgroundDeadlineMs: 'x' }), /options.backgroundDeadlineMs/);
+  test.throws(() => SspiClientApi.configureScheduler({ tenantWeights: { a: 0 } }), /Weight of tenant 'a'/);
+
+  const sspiClient = new SspiClientApi.SspiClient('MSSQLSvc/host.example.com:1433', 'kerberos');
+  test.throws(() => sspiClient.getNextBlob(null, 0, 0, { deadlineMs: 1.5 }, () => {}), /options.deadlineMs/);
+  test.throws(() => sspiClient.getNextBlob(null, 0, 0, { tenant: 1 }, () => {}), /options.tenant/);
+  test.done();
+}
+
+exports.tenantsShareThreads = function (test) {
+  if (!Loopback.isMockProvider()) {
+    test.done();
+    return;
+  }
+
+  SspiClientApi.configureScheduler({ policy: 'fair' });
+  occupyWorker(test, () => {
+    // The burst from one SPN doesn't hold up the other.
+    runQueued(test, [
+      { name: 'a1', spn: 'MSSQLSvc/a.example.com:1433' },
+      { name: 'a2', spn: 'MSSQLSvc/a.example.com:1433' },
+      { name: 'a3', spn: 'MSSQLSvc/a.example.com:1433' },
+      { name: 'b1', spn: 'MSSQLSvc/b.example.com:1433' }
+    ], (completed) => {
+      test.deepEqual(completed, [ 'a1', 'b1', 'a2', 'a3' ]);
+      restore();
+      test.done();
+    });
+  });
+}
+
+exports.fifoPolicy = function (test) {
+  if (!Loopback.isMockProvider()) {
+    test.done();
+    return;
+  }
+
+  SspiClientApi.configureScheduler({ policy: 'fifo' });
+  occupyWorker(test, () => {
+    runQueued(test, [
+      { name: 'a1', spn: 'MSSQLSvc/a.example.com:1433' },
+      { name: 'a2', spn: 'MSSQLSvc/a.example.com:1433' },
+      { name: 'b1', spn: 'MSSQLSvc/b.example.com:1433' }
+    ], (completed) => {
+      test.deepEqual(completed, [ 'a1', 'a2', 'b1' ]);
+      restore();
+      test.done();
+    });
+  });
+}
+
+exports.earliestDeadlineFirst = function (test) {
+  if (!Loopback.isMockProvider()) {
+    test.done();
+    return;
+  }
+
+  SspiClientApi.configureScheduler({ policy: 'fair' });
+  occupyWorker(test, () => {
+    runQueued(test, [
+      { name: 'late', spn: 'MSSQLSvc/a.example.com:1433', options: { deadlineMs: 60000 } },
+      { name: 'urgent', spn: 'MSSQLSvc/a.example.com:1433', options: { deadlineMs: 10 } }
+    ], (completed) => {
+      test.deepEqual(completed, [ 'urgent', 'late' ]);
+
+      // Started after the busy call, past its deadline.
+      test.strictEqual(SspiClientApi.getWorkerPoolStats().deadlineMisses, 1);
+      restore();
+      test.done();
+    });
+  });
+}
+
+exports.batchRequestsAreScheduledByTenant = function (test) {
+  if (!Loopback.isMockProvider()) {
+    test.done();
+    return;
+  }
+
+  SspiClientApi.configureScheduler({ policy: 'fair' });
+  occupyWorker(test, () => {
+    // Each request of the batch counts against its SPN, the call from the
+    // other SPN doesn't wait for the whole batch.
+    const completed = [];
+    const clients = [ 0, 1, 2 ].map(() => new SspiClientApi.SspiClient('MSSQLSvc/a.example.com:1433', 'kerberos'));
+    SspiClientApi.getNextBlobBatch(clients.map((sspiClient) => ({ client: sspiClient })), (results) => {
+      results.forEach((result) => test.strictEqual(result.errorCode, 0, result.errorString));
+      completed.push('batch');
+    });
+
+    runQueued(test, [ { name: 'b1', spn: 'MSSQLSvc/b.example.com:1433' } ], (runQueuedCompleted) => {
+      completed.push(runQueuedCompleted[0]);
+    });
+
+    waitFor(() => completed.length === 2, () => {
+      test.deepEqual(completed, [ 'b1', 'batch' ]);
+      restore();
+      test.done();
+    });
+  });
+}
@@ -0,0 +1,50 @@
+'use strict';
+
+// Requiring the package must not load the native addon; it's loaded on first
+// use. Runs in child processes, this process has loaded it already.
+
+const childProcess = require('child_process');
+const path = require('path');
+
+const indexPath = path.join(__dirname, '..', '..', 'src_js', 'index.js');
+
+// Runs script in a fresh Node.js process and returns what it printed, parsed.
+function runChild(script) {
+  const output = childProcess.execFileSync(process.execPath, [ '-e', script ], {
+    env: process.env,
+    encoding: 'utf8'
+  });
+
+  return JSON.parse(output);
+}
+
+function loadedModules() {
+  return 'Object.keys(require.cache).filter((name) => '
+    + '/[\\\\/]bindings[\\\\/]|[\\\\/]sspi_client\\.js$|\\.node$/.test(name))';
+}
+
+exports.requireDoesNotLoadAddon = function (test) {
+  const result = runChild(
+    'const index = require(' + JSON.stringify(indexPath) + ');'
+    + 'console.log(JSON.stringify({ supported: index.ModuleSupported === true, loaded: ' + loadedModules() + ' }));');
+
+  test.deepEqual(result.loaded, []);
+  test.done();
+}
+
+exports.addonLoadedOnFirstUse = function (test) {
+  const result = runChild(
+    'const index = require(' + JSON.stringify(indexPath) + ');'
+    + 'const supported = index.ModuleSupported === true;'
+    + 'const providerName = supported ? index.SspiClientApi.getProviderName() : null;'
+    + 'console.log(JSON.stringify({ supported: supported, providerName: providerName, loaded: ' + loadedModules() + ' }));');
+
+  if (!result.supported) {
+    test.done();
+    return;
+  }
+
+  test.strictEqual(typeof (result.providerName), 'string');
+  test.ok(result.loaded.some((name) => /\.node$/.test(name)));
+  test.done();
+}
@@ -0,0 +1,115 @@
+'use strict';
+
+const fs = require('fs');
+const os = require('os');
+const path = require('path');
+
+const SspiClientApi = require('../../src_js/index.js').SspiClientApi;
+const Loopback = require('../utils/loopback.js');
+
+const spn = 'MSSQLSvc/host.example.com:1433';
+
+exports.configureTracingInvalidArgs = function (test) {
+  if (SspiClientApi === undefined) {
+    test.done();
+    return;
+  }
+
+  test.throws(() => SspiClientApi.configureTracing(), /Invalid number of arguments/);
+  test.throws(() => SspiClientApi.configureTracing('debug'), /Invalid argument type/);
+  test.throws(() => SspiClientApi.configureTracing({ level: 'verbose' }), /options.level/);
+  test.throws(() => SspiClientApi.configureTracing({ level: 'events', file: '' }), /options.file/);
+  test.throws(() => SspiClientApi.configureTracing({ level: 'events', flushIntervalMs: -1 }), /options.flushIntervalMs/);
+  test.done();
+}
+
+exports.nothingRecordedWhenOff = function (test) {
+  if (!Loopback.isMockProvider()) {
+    test.done();
+    return;
+  }
+
+  SspiClientApi.configureTracing({ level: 'off' });
+  SspiClientApi.drainTrace();
+  const recorded = SspiClientApi.getTraceStats().recorded;
+
+  Loopback.runHandshake(spn, 'kerberos', (err) => {
+    test.ifError(err);
+    test.strictEqual(SspiClientApi.getTraceStats().recorded, recorded);
+    test.deepEqual(SspiClientApi.drainTrace(), []);
+    test.done();
+  });
+}
+
+exports.sspiCallsAreRecorded = function (test) {
+  if (!Loopback.isMockProvider()) {
+    test.done();
+    return;
+  }
+
+  SspiClientApi.configureTracing({ level: 'events' });
+  SspiClientApi.drainTrace();
+
+  Loopback.runHandshake(spn, 'ntlm', (err) => {
+    SspiClientApi.configureTracing({ level: 'off' });
+    test.ifError(err);
+
+    const records = SspiClientApi.drainTrace();
+    const calls = records.map((record) => record.call);
+    test.strictEqual(calls.filter((call) => call === 'InitializeContext').length, 2);
+    test.strictEqual(calls.filter((call) => call === 'AcceptContext').length, 2);
+
+    records.forEach((record, i) => {
+      test.strictEqual(record.message, undefined);
+      test.strictEqual(record.status & 0x80000000, 0);
+      test.ok(record.durationUs >= 0);
+      test.ok(i === 0 || record.timestampUs >= records[i - 1].timestampUs);
+    });
+
+    test.strictEqual(SspiClientApi.getTraceStats().dropped, 0);
+    test.done();
+  });
+}
+
+exports.debugMessagesAreRecorded = function (test) {
+  if (!Loopback.isMockProvider()) {
+    test.done();
+    return;
+  }
+
+  SspiClientApi.configureTracing({ level: 'debug' });
+  SspiClientApi.drainTrace();
+
+  Loopback.runHandshake(spn, 'kerberos', (err) => {
+    SspiClientApi.configureTracing({ level: 'off' });
+    test.ifError(err);
+
+    const messages = SspiClientApi.drainTrace().filter((record) => record.message !== undefined);
+    test.ok(messages.some((record) => /GetNextBlob/.test(record.message)));
+    test.ok(messages.every((record) => !/\n$/.test(record.message)));
+    test.done();
+  });
+}
+
+exports.tracesAreDrainedToFile = function (test) {
+  if (!Loopback.isMockProvider()) {
+    test.done();
+    return;
+  }
+
+  const file = path.join(os.tmpdir(), 'sspi_trace_tests_' + process.pid + '.log');
+  SspiClientApi.configureTracing({ level: 'events', file: file, flushIntervalMs: 10 });
+
+  Loopback.runHandshake(spn, 'kerberos', (err) => {
+    test.ifError(err);
+
+    // Stopping the file sink writes what's left.
+    SspiClientApi.configureTracing({ level: 'off' });
+    const lines = fs.readFileSync(file, 'utf8').split('\n');
+    fs.unlinkSync(file);
+
+    test.ok(lines.some((line) => / InitializeContext status=0x00090312 /.test(line)));
+    test.ok(lines.some((line) => / AcceptContext status=0x00000000 /.test(line)));
+    test.done();
+  });
+}
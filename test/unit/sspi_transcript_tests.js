@@ -0,0 +1,190 @@
+'use strict';
+
+// Handshakes recorded with the 'mock' provider, then replayed by the 'replay'
+// provider in child processes, as it has to be selected before the addon
+// runs anything. Set SSPI_CLIENT_PROVIDER=mock to run them; they are skipped
+// otherwise.
+
+const childProcess = require('child_process');
+const fs = require('fs');
+const os = require('os');
+const path = require('path');
+
+const index = require('../../src_js/index.js');
+const SspiClientApi = index.SspiClientApi;
+const Transcript = index.Transcript;
+const Loopback = require('../utils/loopback.js');
+
+const indexPath = path.join(__dirname, '..', '..', 'src_js', 'index.js');
+const spn = 'MSSQLSvc/transcript.example.com:1433';
+
+function transcriptPath(name) {
+  return path.join(os.tmpdir(), 'sspi_transcript_tests_' + name + '_' + process.pid + '.trn');
+}
+
+// Records a handshake for each of securityPackages to file.
+//
+// Signature of cb is:
+//  cb(err)
+function recordHandshakes(file, securityPackages, cb) {
+  SspiClientApi.startTranscriptRecording(file);
+  const next = (i) => {
+    if (i === securityPackages.length) {
+      SspiClientApi.stopTranscriptRecording();
+      cb(null);
+      return;
+    }
+
+    Loopback.runHandshake(spn, securityPackages[i], (err) => {
+      if (err) {
+        SspiClientApi.stopTranscriptRecording();
+        cb(err);
+        return;
+      }
+
+      next(i + 1);
+    });
+  };
+
+  next(0);
+}
+
+// Runs the client side of the first handshake in file with the replay
+// provider in a fresh Node.js process, sending it serverTokens, base64, and
+// returns what the client sent and the error code it stopped on.
+function replayInChild(file, securityPackage, serverTokens) {
+  const script = 'const SspiClientApi = require(' + JSON.stringify(indexPath) + ').SspiClientApi;'
+    + 'const serverTokens = ' + JSON.stringify(serverTokens) + '.map((token) => Buffer.from(token, "base64"));'
+    + 'const sspiClient = new SspiClientApi.SspiClient(' + JSON.stringify(spn) + ', ' + JSON.stringify(securityPackage) + ');'
+    + 'const clientTokens = [];'
+    + 'const step = (leg, serverResponse) => {'
+    + '  const length = serverResponse ? serverResponse.length : 0;'
+    + '  sspiClient.getNextBlob(serverResponse, 0, length, (clientResponse, isDone, errorCode) => {'
+    + '    if (errorCode === 0) { clientTokens.push(clientResponse.toString("base64")); }'
+    + '    if (errorCode !== 0 || isDone || leg === serverTokens.length) {'
+    + '      console.log(JSON.stringify({ clientTokens: clientTokens, isDone: isDone, errorCode: errorCode,'
+    + '        stats: SspiClientApi.getTranscriptStats() }));'
+    + '      return;'
+    + '    }'
+    + '    step(leg + 1, serverTokens[leg]);'
+    + '  });'
+    + '};'
+    + 'step(0, null);';
+
+  const env = Object.assign({}, process.env, {
+    SSPI_CLIENT_PROVIDER: 'replay',
+    SSPI_CLIENT_REPLAY_FILE: file
+  });
+
+  const output = childProcess.execFileSync(process.execPath, [ '-e', script ], {
+    env: env,
+    encoding: 'utf8'
+  });
+
+  return JSON.parse(output);
+}
+
+exports.invalidArgs = function (test) {
+  if (SspiClientApi === undefined) {
+    test.done();
+    return;
+  }
+
+  test.throws(() => SspiClientApi.startTranscriptRecording(), /Invalid number of arguments/);
+  test.throws(() => SspiClientApi.startTranscriptRecording(''), /'path' must be a non-empty string/);
+  test.throws(() => SspiClientApi.loadReplayTranscripts(1), /'path' must be a non-empty string/);
+  test.throws(() => SspiClientApi.loadReplayTranscripts('x.trn', null), /Invalid argument type for 'options'/);
+  test.throws(() => SspiClientApi.loadReplayTranscripts('x.trn', { realTime: 1 }), /options.realTime/);
+  test.done();
+}
+
+exports.notATranscriptFile = function (test) {
+  if (SspiClientApi === undefined) {
+    test.done();
+    return;
+  }
+
+  const file = transcriptPath('invalid');
+  fs.writeFileSync(file, 'Not a transcript file.');
+  test.throws(() => SspiClientApi.startTranscriptRecording(file), /is not a transcript file/);
+  test.throws(() => SspiClientApi.loadReplayTranscripts(file), /is not a transcript file/);
+  test.throws(() => Transcript.readHandshakes(file), /Not a transcript file/);
+  fs.unlinkSync(file);
+  test.done();
+}
+
+exports.handshakesAreRecorded = function (test) {
+  if (!Loopback.isMockProvider()) {
+    test.done();
+    return;
+  }
+
+  const file = transcriptPath('recorded');
+  const recordedBefore = SspiClientApi.getTranscriptStats().recorded;
+  recordHandshakes(file, [ 'kerberos', 'ntlm' ], (err) => {
+    test.ifError(err);
+
+    const handshakes = Transcript.readHandshakes(file);
+    fs.unlinkSync(file);
+
+    test.deepEqual(handshakes.map((handshake) => handshake.securityPackage), [ 'Kerberos', 'NTLM' ]);
+    test.deepEqual(handshakes.map((handshake) => handshake.legs.length), [ 2, 2 ]);
+    test.notStrictEqual(handshakes[0].contextId, handshakes[1].contextId);
+    handshakes.forEach((handshake) => {
+      test.strictEqual(handshake.spn, spn);
+      test.strictEqual(handshake.legs[0].inToken.length, 0);
+      test.ok(handshake.legs[0].outToken.length > 0);
+      test.ok(handshake.legs[1].inToken.length > 0);
+      test.deepEqual(handshake.legs.map((leg) => leg.isDone), [ false, true ]);
+      test.deepEqual(handshake.legs.map((leg) => leg.status), [ 0, 0 ]);
+    });
+
+    test.strictEqual(SspiClientApi.getTranscriptStats().recorded, recordedBefore + 4);
+    test.done();
+  });
+}
+
+exports.handshakesAreReplayed = function (test) {
+  if (!Loopback.isMockProvider()) {
+    test.done();
+    return;
+  }
+
+  const file = transcriptPath('replayed');
+  recordHandshakes(file, [ 'ntlm' ], (err) => {
+    test.ifError(err);
+
+    const legs = Transcript.readHandshakes(file)[0].legs;
+    const result = replayInChild(file, 'ntlm', [ legs[1].inToken.toString('base64') ]);
+    fs.unlinkSync(file);
+
+    // Same tokens as recorded, served by the replay provider.
+    test.strictEqual(result.errorCode, 0);
+    test.strictEqual(result.isDone, true);
+    test.deepEqual(result.clientTokens, legs.map((leg) => leg.outToken.toString('base64')));
+    test.strictEqual(result.stats.handshakes, 1);
+    test.strictEqual(result.stats.served, 2);
+    test.strictEqual(result.stats.mismatches, 0);
+    test.done();
+  });
+}
+
+exports.unrecordedServerTokenFails = function (test) {
+  if (!Loopback.isMockProvider()) {
+    test.done();
+    return;
+  }
+
+  const file = transcriptPath('mismatch');
+  recordHandshakes(file, [ 'kerberos' ], (err) => {
+    test.ifError(err);
+
+    const result = replayInChild(file, 'kerberos', [ Buffer.from('not recorded').toString('base64') ]);
+    fs.unlinkSync(file);
+
+    test.strictEqual(result.errorCode, 0x80090308);   // SEC_E_INVALID_TOKEN
+    test.strictEqual(result.clientTokens.length, 1);
+    test.strictEqual(result.stats.mismatches, 1);
+    test.done();
+  });
+}
@@ -0,0 +1,64 @@
+'use strict';
+
+// Exercises the native worker pool through the canned response path, which
+// needs no provider calls.
+
+const SspiClientApi = require('../../src_js/index.js').SspiClientApi;
+const Canned = require('../utils/canned.js');
+
+const spn = 'MSSQLSvc/host.example.com:1433';
+
+exports.configureWorkerPoolInvalidArgs = function (test) {
+  if (SspiClientApi === undefined) {
+    test.done();
+    return;
+  }
+
+  test.throws(() => SspiClientApi.configureWorkerPool(), /Invalid number of arguments/);
+  test.throws(() => SspiClientApi.configureWorkerPool(4), /Invalid argument type/);
+  test.throws(() => SspiClientApi.configureWorkerPool({ size: -1 }), /non-negative integer/);
+  test.throws(() => SspiClientApi.configureWorkerPool({ size: 1.5 }), /non-negative integer/);
+  test.throws(() => SspiClientApi.configureWorkerPool({ size: 4, maxSize: 2 }), /not less than/);
+  test.throws(() => SspiClientApi.configureWorkerPool({ size: 4, idleTimeoutMs: 'x' }), /non-negative integer/);
+  test.done();
+}
+
+exports.callsRunOnWorkerPool = function (test) {
+  if (SspiClientApi === undefined) {
+    test.done();
+    return;
+  }
+
+  SspiClientApi.configureWorkerPool({ size: 2, maxSize: 4 });
+  SspiClientApi.utResetWorkerPoolStats();
+
+  Canned.getCannedBlobs(spn, 16, null, () => {
+    const stats = SspiClientApi.getWorkerPoolStats();
+    test.strictEqual(stats.enabled, true);
+    test.strictEqual(stats.size, 2);
+    test.strictEqual(stats.maxSize, 4);
+    test.strictEqual(stats.submitted, 16);
+    test.strictEqual(stats.completed, 16);
+    test.ok(stats.peakThreads >= 1 && stats.peakThreads <= 4);
+    test.done();
+  });
+}
+
+exports.callsRunOnLibuvPool = function (test) {
+  if (SspiClientApi === undefined) {
+    test.done();
+    return;
+  }
+
+  SspiClientApi.configureWorkerPool({ size: 0 });
+  SspiClientApi.utResetWorkerPoolStats();
+
+  Canned.getCannedBlobs(spn, 4, null, () => {
+    const stats = SspiClientApi.getWorkerPoolStats();
+    test.strictEqual(stats.enabled, false);
+    test.strictEqual(stats.submitted, 0);
+
+    SspiClientApi.configureWorkerPool({ size: 4 });
+    test.done();
+  });
+}
@@ -0,0 +1,25 @@
+'use strict';
+
+const SspiClientApi = require('../../src_js/index.js').SspiClientApi;
+
+// Gets the next blob of count new clients for spn through the canned response
+// path, all at once. serverResponse may be null.
+//
+// Signature of cb is:
+//  cb(clientResponses) - in order of completion.
+function getCannedBlobs(spn, count, serverResponse, cb) {
+  const clientResponses = [];
+  const length = serverResponse ? serverResponse.length : 0;
+  for (let i = 0; i < count; i++) {
+    const sspiClient = new SspiClientApi.SspiClient(spn);
+    sspiClient.utEnableCannedResponse();
+    sspiClient.getNextBlob(serverResponse, 0, length, (clientResponse) => {
+      clientResponses.push(clientResponse);
+      if (clientResponses.length === count) {
+        cb(clientResponses);
+      }
+    });
+  }
+}
+
+module.exports.getCannedBlobs = getCannedBlobs;
@@ -0,0 +1,80 @@
+'use strict';
+
+const index = require('../../src_js/index.js');
+const SspiClientApi = index.SspiClientApi;
+const SspiServerApi = index.SspiServerApi;
+
+// True when the tests run on the mock provider, see npm run-script test-mock.
+function isMockProvider() {
+  return SspiClientApi !== undefined && SspiClientApi.getProviderName() === 'mock';
+}
+
+// Runs a complete handshake between an SspiClient and an SspiServer in
+// process, passing blobs back and forth until both sides are done.
+//
+// Signature of cb is:
+//  cb(err, result)
+//      result - { legs: [ { from, length, isDone } ], clientBlobs, serverBlobs,
+//                 sspiClient, sspiServer }
+function runHandshake(spn, securityPackage, cb) {
+  const sspiClient = securityPackage
+    ? new SspiClientApi.SspiClient(spn, securityPackage)
+    : new SspiClientApi.SspiClient(spn);
+  runClientHandshake(sspiClient, securityPackage, cb);
+}
+
+// Same as runHandshake with an existing client, e.g. a reset one.
+function runClientHandshake(sspiClient, securityPackage, cb) {
+  const sspiServer = new SspiServerApi.SspiServer(securityPackage || 'negotiate');
+
+  const result = {
+    legs: [],
+    clientBlobs: [],
+    serverBlobs: [],
+    sspiClient: sspiClient,
+    sspiServer: sspiServer
+  };
+
+  const clientLeg = (serverResponse) => {
+    const length = serverResponse ? serverResponse.length : 0;
+    sspiClient.getNextBlob(serverResponse, 0, length, (clientResponse, isDone, errorCode, errorString) => {
+      if (errorCode !== 0) {
+        cb(new Error('Client failed: ' + errorString));
+        return;
+      }
+
+      result.legs.push({ from: 'client', length: clientResponse.length, isDone: isDone });
+      result.clientBlobs.push(clientResponse);
+
+      if (clientResponse.length === 0) {
+        cb(null, result);
+      } else {
+        serverLeg(clientResponse);
+      }
+    });
+  };
+
+  const serverLeg = (clientResponse) => {
+    sspiServer.acceptNextBlob(clientResponse, 0, clientResponse.length, (serverResponse, isDone, errorCode, errorString) => {
+      if (errorCode !== 0) {
+        cb(new Error('Server failed: ' + errorString));
+        return;
+      }
+
+      result.legs.push({ from: 'server', length: serverResponse.length, isDone: isDone });
+      result.serverBlobs.push(serverResponse);
+
+      if (serverResponse.length === 0) {
+        cb(null, result);
+      } else {
+        clientLeg(serverResponse);
+      }
+    });
+  };
+
+  clientLeg(null);
+}
+
+module.exports.isMockProvider = isMockProvider;
+module.exports.runHandshake = runHandshake;
+module.exports.runClientHandshake = runClientHandshake;
@@ -0,0 +1,21 @@
+'use strict';
+
+// Runs the unit tests with the mock provider, for npm run-script test-mock.
+// Sets SSPI_CLIENT_PROVIDER here rather than in package.json so the script
+// works with the Windows shell too.
+
+const childProcess = require('child_process');
+const path = require('path');
+
+const nodeunit = require.resolve('nodeunit/bin/nodeunit');
+const unitTests = path.join(__dirname, '..', 'unit');
+
+const env = Object.assign({}, process.env, { SSPI_CLIENT_PROVIDER: 'mock' });
+const child = childProcess.spawn(process.execPath, [nodeunit, '--reporter', 'minimal', unitTests], {
+  env: env,
+  stdio: 'inherit'
+});
+
+child.on('exit', (code, signal) => {
+  process.exit(signal ? 1 : code);
+});